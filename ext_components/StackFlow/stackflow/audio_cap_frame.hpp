@@ -0,0 +1,60 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace StackFlows {
+
+/*
+ * Header in front of every capture period published by the audio unit on its frame channel
+ * (the url returned by the "cap_frame" rpc), followed by samples * int16 PCM.
+ * seq is the capture ring period index and increases by one per period, so a consumer sees every lost
+ * period as a gap whether it was overwritten in the ring or lost on the way. ring_overruns / ring_dropped
+ * are the counters of the publisher's own ring cursor at the time of this period.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t head_size;
+    uint16_t channels;
+    uint32_t rate;
+    uint32_t samples;
+    uint64_t seq;
+    uint64_t timestamp_us;  // steady clock (CLOCK_MONOTONIC) time the period was captured
+    uint64_t ring_overruns;
+    uint64_t ring_dropped;
+} audio_cap_frame_head_t;
+
+static const uint32_t audio_cap_frame_magic = 0x464d4350;  // "PCMF"
+
+/* Per-consumer view of the frame channel: validates each message and counts the periods this consumer lost. */
+class audio_cap_frame_reader {
+public:
+    uint64_t periods_  = 0;
+    uint64_t overruns_ = 0;  // gaps seen
+    uint64_t dropped_  = 0;  // periods missing in those gaps
+    uint64_t next_seq_ = 0;
+
+    // Returns the PCM of one message and fills head, or NULL when the message is not a capture frame.
+    const int16_t *parse(const void *data, size_t size, audio_cap_frame_head_t *head)
+    {
+        if (size < sizeof(audio_cap_frame_head_t)) return NULL;
+        memcpy(head, data, sizeof(audio_cap_frame_head_t));
+        if ((head->magic != audio_cap_frame_magic) || (head->head_size < sizeof(audio_cap_frame_head_t)) ||
+            (size < head->head_size) || ((size - head->head_size) / sizeof(int16_t) < head->samples))
+            return NULL;
+        if (periods_ && (head->seq > next_seq_)) {
+            overruns_++;
+            dropped_ += head->seq - next_seq_;
+        }
+        next_seq_ = head->seq + 1;
+        periods_++;
+        return (const int16_t *)((const char *)data + head->head_size);
+    }
+};
+
+};  // namespace StackFlows
@@ -0,0 +1,175 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace StackFlows {
+
+/* dst[i] = src[i] * scale, vectorized for NEON / SSE2. */
+static inline void audio_s16_to_float(const int16_t *src, float *dst, size_t count, float scale)
+{
+    size_t i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    float32x4_t vscale = vdupq_n_f32(scale);
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t s = vld1q_s16(src + i);
+        vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))), vscale));
+        vst1q_f32(dst + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))), vscale));
+    }
+#elif defined(__SSE2__)
+    __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        __m128i s  = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+    }
+#endif
+    for (; i < count; i++) dst[i] = src[i] * scale;
+}
+
+/*
+ * Float sample buffer in front of vad / kws / asr models.
+ * PCM s16le messages are converted on push, and consumers read contiguous windows.
+ * Storage only grows until it fits the largest backlog; consumed samples are compacted in place.
+ */
+class audio_frontend {
+private:
+    std::vector<float> buf_;
+    size_t head_;
+    size_t tail_;
+    float scale_;
+    int delay_frames_;
+    int pending_frames_;
+    char odd_byte_;
+    bool has_odd_byte_;
+
+    float *reserve_tail(size_t count)
+    {
+        if (tail_ + count > buf_.size()) {
+            if (head_ > 0) {
+                memmove(buf_.data(), buf_.data() + head_, (tail_ - head_) * sizeof(float));
+                tail_ -= head_;
+                head_ = 0;
+            }
+            if (tail_ + count > buf_.size()) buf_.resize(std::max(buf_.size() * 2, tail_ + count));
+        }
+        return buf_.data() + tail_;
+    }
+
+public:
+    /* scale: 1.0f / 32768 (or INT16_MAX) for normalized models, 1.0f for raw-scale models. */
+    audio_frontend(float scale = 1.0f / 32768.0f, size_t reserve = 16000)
+        : head_(0), tail_(0), scale_(scale), delay_frames_(0), pending_frames_(0), odd_byte_(0), has_odd_byte_(false)
+    {
+        buf_.resize(reserve);
+    }
+
+    void set_scale(float scale)
+    {
+        scale_ = scale;
+    }
+
+    /* Number of extra messages push() collects before reporting a batch (delay_audio_frame). */
+    void set_delay_frames(int frames)
+    {
+        delay_frames_ = frames;
+    }
+
+    /* Append one PCM s16le message. Returns true when delay_frames + 1 messages have been collected. */
+    bool push(const char *data, size_t size)
+    {
+        if (has_odd_byte_ && size) {
+            char pair[2] = {odd_byte_, data[0]};
+            int16_t sample;
+            memcpy(&sample, pair, sizeof(sample));
+            *reserve_tail(1) = sample * scale_;
+            tail_++;
+            data++;
+            size--;
+            has_odd_byte_ = false;
+        }
+        size_t count = size / sizeof(int16_t);
+        float *dst   = reserve_tail(count);
+        if (((uintptr_t)data & 1) == 0) {
+            audio_s16_to_float((const int16_t *)data, dst, count, scale_);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                int16_t sample;
+                memcpy(&sample, data + i * sizeof(int16_t), sizeof(sample));
+                dst[i] = sample * scale_;
+            }
+        }
+        tail_ += count;
+        if (size & 1) {
+            odd_byte_     = data[size - 1];
+            has_odd_byte_ = true;
+        }
+        if (pending_frames_++ < delay_frames_) return false;
+        pending_frames_ = 0;
+        return true;
+    }
+
+    bool push(const std::string &raw)
+    {
+        return push(raw.data(), raw.size());
+    }
+
+    const float *data() const
+    {
+        return buf_.data() + head_;
+    }
+
+    size_t size() const
+    {
+        return tail_ - head_;
+    }
+
+    bool empty() const
+    {
+        return tail_ == head_;
+    }
+
+    /* Drop count samples from the front. */
+    void consume(size_t count)
+    {
+        head_ += std::min(count, size());
+        if (head_ == tail_) head_ = tail_ = 0;
+    }
+
+    void clear()
+    {
+        head_           = 0;
+        tail_           = 0;
+        pending_frames_ = 0;
+        has_odd_byte_   = false;
+    }
+
+    /* Call fn for every full window, advancing by hop. The partial tail is kept for the next push. */
+    size_t for_each_window(size_t window, size_t hop, const std::function<void(const float *, size_t)> &fn)
+    {
+        size_t windows = 0;
+        while (size() >= window) {
+            fn(data(), window);
+            consume(hop);
+            windows++;
+        }
+        return windows;
+    }
+};
+
+};  // namespace StackFlows
@@ -0,0 +1,111 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <map>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include "pzmq.hpp"
+#include "StackFlowUtil.h"
+
+namespace StackFlows {
+
+/*
+ * Subscribes to the playback lifecycle events published by the audio unit
+ * ({"play_id":N,"event":"started|progress|drained|interrupted|error",...})
+ * and lets a unit block until a given play request has left the speaker.
+ * play_id is the value returned by the audio unit's "play_raw" / "queue_play" rpc.
+ */
+class audio_play_monitor {
+public:
+    typedef std::function<void(uint64_t play_id, const std::string &event, int frames, int total)> event_callback_fun;
+
+private:
+    const size_t max_finished_ = 64;
+    std::unique_ptr<pzmq> sub_ctx_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::map<uint64_t, std::string> finished_;
+    event_callback_fun event_callback_;
+
+    // a decimal field of the event, false if it is missing, malformed or out of range
+    static bool parse_field(const std::string &msg, const char *key, unsigned long long max, unsigned long long &val)
+    {
+        std::string str = sample_json_str_get(msg, key);
+        if (str.empty() || (str[0] < '0') || (str[0] > '9')) return false;
+        char *end = nullptr;
+        errno     = 0;
+        val       = strtoull(str.c_str(), &end, 10);
+        return (errno == 0) && (*end == '\0') && (val <= max);
+    }
+
+    // runs on the ZMQ callback thread: anything that is not a well formed event is skipped, never thrown out of here
+    void on_event(pzmq *, const std::shared_ptr<pzmq_data> &raw)
+    {
+        std::string msg = raw->string();
+        std::string ev  = sample_json_str_get(msg, "event");
+        unsigned long long play_id;
+        if (ev.empty() || !parse_field(msg, "play_id", UINT64_MAX, play_id)) return;
+        if (event_callback_) {
+            unsigned long long frames = 0, total = 0;
+            if (!parse_field(msg, "frames", INT_MAX, frames)) frames = 0;
+            if (!parse_field(msg, "total", INT_MAX, total)) total = 0;
+            event_callback_(play_id, ev, (int)frames, (int)total);
+        }
+        if ((ev == "drained") || (ev == "interrupted") || (ev == "error")) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            finished_[play_id] = ev;
+            while (finished_.size() > max_finished_) finished_.erase(finished_.begin());
+            cv_.notify_all();
+        }
+    }
+
+public:
+    audio_play_monitor(const std::string &unit_name = "audio")
+    {
+        std::string url = unit_call(unit_name, "play_event", "None");
+        if (url.empty() || (url.find("://") == std::string::npos)) return;
+        sub_ctx_ = std::make_unique<pzmq>(
+            url, ZMQ_SUB, std::bind(&audio_play_monitor::on_event, this, std::placeholders::_1, std::placeholders::_2));
+    }
+
+    bool is_ready()
+    {
+        return sub_ctx_ != nullptr;
+    }
+
+    void set_event_callback(const event_callback_fun &callback)
+    {
+        event_callback_ = callback;
+    }
+
+    // Returns the final event ("drained", "interrupted", "error") or an empty string on timeout.
+    std::string wait(uint64_t play_id, int timeout_ms)
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        std::string ev;
+        cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] {
+            auto it = finished_.find(play_id);
+            if (it == finished_.end()) return false;
+            ev = it->second;
+            return true;
+        });
+        return ev;
+    }
+
+    ~audio_play_monitor()
+    {
+        sub_ctx_.reset();
+    }
+};
+};  // namespace StackFlows
@@ -0,0 +1,250 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace StackFlows {
+
+typedef enum {
+    IMAGE_FORMAT_YUYV = 0,
+    IMAGE_FORMAT_NV12,
+    IMAGE_FORMAT_BGR,
+    IMAGE_FORMAT_RGB,
+} image_format_t;
+
+/* Placement of the resized source inside the letterboxed destination. */
+typedef struct {
+    float scale;
+    int resize_w;
+    int resize_h;
+    int pad_left;
+    int pad_top;
+} letterbox_info_t;
+
+/* Same arithmetic as common::get_input_data_letterbox, so boxes map back the same way. */
+static inline letterbox_info_t letterbox_info(int src_w, int src_h, int dst_w, int dst_h)
+{
+    letterbox_info_t info;
+    if ((dst_h * 1.0 / src_h) < (dst_w * 1.0 / src_w))
+        info.scale = (float)dst_h / (float)src_h;
+    else
+        info.scale = (float)dst_w / (float)src_w;
+    info.resize_w = std::min((int)(info.scale * src_w), dst_w);
+    info.resize_h = std::min((int)(info.scale * src_h), dst_h);
+    info.pad_left = (dst_w - info.resize_w) / 2;
+    info.pad_top  = (dst_h - info.resize_h) / 2;
+    return info;
+}
+
+static inline uint8_t image_clamp_u8(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+/* BT.601 video range to RGB in 6-bit fixed point, the NEON path uses the same coefficients. */
+static inline void image_yuv_pixel(int y, int u, int v, uint8_t *out, int r_idx, int b_idx)
+{
+    int c      = (std::max(y - 16, 0) * 74) + 32;
+    out[r_idx] = image_clamp_u8((c + 102 * v) >> 6);
+    out[1]     = image_clamp_u8((c - 25 * u - 52 * v) >> 6);
+    out[b_idx] = image_clamp_u8((c + 129 * u) >> 6);
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+/* 8 pixels from 8 luma values and 8 (already duplicated) chroma pairs. */
+static inline uint8x8x3_t image_yuv8_neon(uint8x8_t y8, uint8x8_t u8, uint8x8_t v8, bool bgr)
+{
+    int16x8_t y = vreinterpretq_s16_u16(vmull_u8(vqsub_u8(y8, vdup_n_u8(16)), vdup_n_u8(74)));
+    y           = vaddq_s16(y, vdupq_n_s16(32));
+    int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), vdupq_n_s16(128));
+    int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), vdupq_n_s16(128));
+    int16x8_t r = vmlaq_n_s16(y, v, 102);
+    int16x8_t g = vmlsq_n_s16(vmlsq_n_s16(y, u, 25), v, 52);
+    // 129 * u can push past int16, saturate (the result clamps to 255 anyway)
+    int16x8_t b = vqaddq_s16(vqaddq_s16(y, vshlq_n_s16(u, 7)), u);
+    uint8x8x3_t px;
+    px.val[bgr ? 2 : 0] = vqshrun_n_s16(r, 6);
+    px.val[1]           = vqshrun_n_s16(g, 6);
+    px.val[bgr ? 0 : 2] = vqshrun_n_s16(b, 6);
+    return px;
+}
+#endif
+
+/* One source row as packed 3-channel pixels, RGB or BGR. */
+static inline void image_convert_row(const uint8_t *src, int src_w, int src_h, int src_stride, image_format_t format,
+                                     int row, uint8_t *out, bool bgr)
+{
+    int r_idx = bgr ? 2 : 0;
+    int b_idx = bgr ? 0 : 2;
+    int x     = 0;
+    if (format == IMAGE_FORMAT_YUYV) {
+        const uint8_t *p = src + (size_t)row * src_stride;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        for (; x + 16 <= src_w; x += 16) {
+            uint8x8x4_t yuyv = vld4_u8(p + x * 2);
+            uint8x8x2_t y    = vzip_u8(yuyv.val[0], yuyv.val[2]);
+            uint8x8x2_t u    = vzip_u8(yuyv.val[1], yuyv.val[1]);
+            uint8x8x2_t v    = vzip_u8(yuyv.val[3], yuyv.val[3]);
+            vst3_u8(out + x * 3, image_yuv8_neon(y.val[0], u.val[0], v.val[0], bgr));
+            vst3_u8(out + x * 3 + 24, image_yuv8_neon(y.val[1], u.val[1], v.val[1], bgr));
+        }
+#endif
+        for (; x + 1 < src_w; x += 2) {
+            const uint8_t *q = p + x * 2;
+            int u            = q[1] - 128;
+            int v            = q[3] - 128;
+            image_yuv_pixel(q[0], u, v, out + x * 3, r_idx, b_idx);
+            image_yuv_pixel(q[2], u, v, out + x * 3 + 3, r_idx, b_idx);
+        }
+        // odd width: the last macropixel carries a single pixel
+        if (x < src_w) {
+            const uint8_t *q = p + x * 2;
+            image_yuv_pixel(q[0], q[1] - 128, q[3] - 128, out + x * 3, r_idx, b_idx);
+        }
+    } else if (format == IMAGE_FORMAT_NV12) {
+        const uint8_t *py  = src + (size_t)row * src_stride;
+        const uint8_t *puv = src + (size_t)src_h * src_stride + (size_t)(row / 2) * src_stride;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        for (; x + 16 <= src_w; x += 16) {
+            uint8x16_t y8    = vld1q_u8(py + x);
+            uint8x8x2_t uv   = vld2_u8(puv + x);
+            uint8x8x2_t u    = vzip_u8(uv.val[0], uv.val[0]);
+            uint8x8x2_t v    = vzip_u8(uv.val[1], uv.val[1]);
+            vst3_u8(out + x * 3, image_yuv8_neon(vget_low_u8(y8), u.val[0], v.val[0], bgr));
+            vst3_u8(out + x * 3 + 24, image_yuv8_neon(vget_high_u8(y8), u.val[1], v.val[1], bgr));
+        }
+#endif
+        for (; x < src_w; x++) {
+            const uint8_t *uv = puv + (x & ~1);
+            image_yuv_pixel(py[x], uv[0] - 128, uv[1] - 128, out + x * 3, r_idx, b_idx);
+        }
+    } else {
+        const uint8_t *p = src + (size_t)row * src_stride;
+        bool swap        = (format == IMAGE_FORMAT_BGR) != bgr;
+        if (!swap) {
+            memcpy(out, p, (size_t)src_w * 3);
+            return;
+        }
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        for (; x + 16 <= src_w; x += 16) {
+            uint8x16x3_t px = vld3q_u8(p + x * 3);
+            uint8x16_t t    = px.val[0];
+            px.val[0]       = px.val[2];
+            px.val[2]       = t;
+            vst3q_u8(out + x * 3, px);
+        }
+#endif
+        for (; x < src_w; x++) {
+            out[x * 3]     = p[x * 3 + 2];
+            out[x * 3 + 1] = p[x * 3 + 1];
+            out[x * 3 + 2] = p[x * 3];
+        }
+    }
+}
+
+/*
+ * Converts, resizes (bilinear, pixel centres aligned like cv::resize) and pads src into dst in one pass.
+ * dst holds dst_w * dst_h * 3 bytes and may be a reused buffer or a model input tensor. Source rows are
+ * converted when first needed and rows the resize skips are never touched. src_stride is the byte
+ * length of a source row (of the luma plane for NV12), 0 for packed rows. Chroma is stored in whole pairs:
+ * a YUYV row of an odd width ends with a full macropixel, and the NV12 chroma rows are rounded up likewise.
+ */
+static inline letterbox_info_t image_letterbox(const uint8_t *src, int src_w, int src_h, int src_stride,
+                                               image_format_t format, uint8_t *dst, int dst_w, int dst_h,
+                                               bool bgr = false, uint8_t pad = 0)
+{
+    if (src_stride <= 0) {
+        int even_w = (src_w + 1) & ~1;
+        src_stride = (format == IMAGE_FORMAT_YUYV) ? even_w * 2 : ((format == IMAGE_FORMAT_NV12) ? even_w : src_w * 3);
+    }
+    letterbox_info_t info = letterbox_info(src_w, src_h, dst_w, dst_h);
+    size_t dst_row        = (size_t)dst_w * 3;
+
+    // borders
+    memset(dst, pad, info.pad_top * dst_row);
+    memset(dst + (size_t)(info.pad_top + info.resize_h) * dst_row, pad,
+           (size_t)(dst_h - info.pad_top - info.resize_h) * dst_row);
+    for (int y = info.pad_top; y < info.pad_top + info.resize_h; y++) {
+        uint8_t *line = dst + (size_t)y * dst_row;
+        memset(line, pad, (size_t)info.pad_left * 3);
+        memset(line + (size_t)(info.pad_left + info.resize_w) * 3, pad,
+               (size_t)(dst_w - info.pad_left - info.resize_w) * 3);
+    }
+
+    if ((info.resize_w == src_w) && (info.resize_h == src_h)) {
+        for (int y = 0; y < src_h; y++) {
+            image_convert_row(src, src_w, src_h, src_stride, format, y,
+                              dst + (size_t)(info.pad_top + y) * dst_row + (size_t)info.pad_left * 3, bgr);
+        }
+        return info;
+    }
+
+    // horizontal taps in 8-bit fixed point
+    std::vector<int> xofs(info.resize_w);
+    std::vector<uint16_t> xw(info.resize_w);
+    float sx = (float)src_w / info.resize_w;
+    for (int x = 0; x < info.resize_w; x++) {
+        float fx = std::max((x + 0.5f) * sx - 0.5f, 0.f);
+        int x0   = std::min((int)fx, src_w - 1);
+        xofs[x]  = x0;
+        xw[x]    = (x0 + 1 < src_w) ? (uint16_t)((fx - x0) * 256.f + 0.5f) : 0;
+    }
+
+    // two horizontally resampled rows, each kept until the vertical taps move past it
+    std::vector<uint8_t> line(src_w * 3);
+    std::vector<uint16_t> rows[2] = {std::vector<uint16_t>(info.resize_w * 3), std::vector<uint16_t>(info.resize_w * 3)};
+    int row_src[2]                = {-1, -1};
+    auto fetch                    = [&](int sy) -> const uint16_t * {
+        for (int i = 0; i < 2; i++)
+            if (row_src[i] == sy) return rows[i].data();
+        int slot = (row_src[0] == -1 || (row_src[1] != -1 && row_src[0] < row_src[1])) ? 0 : 1;
+        image_convert_row(src, src_w, src_h, src_stride, format, sy, line.data(), bgr);
+        uint16_t *h = rows[slot].data();
+        for (int x = 0; x < info.resize_w; x++) {
+            const uint8_t *a = &line[xofs[x] * 3];
+            const uint8_t *b = a + (xw[x] ? 3 : 0);
+            int w1           = xw[x];
+            int w0           = 256 - w1;
+            h[x * 3]         = (uint16_t)(a[0] * w0 + b[0] * w1);
+            h[x * 3 + 1]     = (uint16_t)(a[1] * w0 + b[1] * w1);
+            h[x * 3 + 2]     = (uint16_t)(a[2] * w0 + b[2] * w1);
+        }
+        row_src[slot] = sy;
+        return h;
+    };
+
+    float sy = (float)src_h / info.resize_h;
+    for (int y = 0; y < info.resize_h; y++) {
+        float fy         = std::max((y + 0.5f) * sy - 0.5f, 0.f);
+        int y0           = std::min((int)fy, src_h - 1);
+        int y1           = std::min(y0 + 1, src_h - 1);
+        uint32_t w1      = (y1 != y0) ? (uint32_t)((fy - y0) * 256.f + 0.5f) : 0;
+        uint32_t w0      = 256 - w1;
+        const uint16_t *a = fetch(y0);
+        const uint16_t *b = w1 ? fetch(y1) : a;
+        uint8_t *out      = dst + (size_t)(info.pad_top + y) * dst_row + (size_t)info.pad_left * 3;
+        int n             = info.resize_w * 3;
+        for (int i = 0; i < n; i++) out[i] = (uint8_t)((a[i] * w0 + b[i] * w1 + 32768) >> 16);
+    }
+    return info;
+}
+
+/* Resizes dst to fit before converting, so a std::vector kept across frames is reused without reallocation. */
+static inline letterbox_info_t image_letterbox(const uint8_t *src, int src_w, int src_h, int src_stride,
+                                               image_format_t format, std::vector<uint8_t> &dst, int dst_w, int dst_h,
+                                               bool bgr = false, uint8_t pad = 0)
+{
+    dst.resize((size_t)dst_w * dst_h * 3);
+    return image_letterbox(src, src_w, src_h, src_stride, format, dst.data(), dst_w, dst_h, bgr, pad);
+}
+
+}  // namespace StackFlows
@@ -12,8 +12,12 @@
 #include <atomic>
 #include <unordered_map>
 #include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <mutex>
 #include <vector>
+#include "pzmq_shm.hpp"
 #define ZMQ_RPC_FUN  (ZMQ_REP | 0x80)
 #define ZMQ_RPC_CALL (ZMQ_REQ | 0x80)
 
@@ -28,6 +32,11 @@ public:
     {
         zmq_msg_init(&msg);
     }
+    // Owns a buffer of size bytes.
+    explicit pzmq_data(size_t size)
+    {
+        zmq_msg_init_size(&msg, size);
+    }
     std::shared_ptr<std::string> get_string()
     {
         auto len = zmq_msg_size(&msg);
@@ -101,6 +110,10 @@ private:
     std::string rpc_server_;
     std::string zmq_url_;
     int timeout_;
+    std::unique_ptr<pzmq_shm_ring> shm_ring_;
+    std::string shm_name_;
+    uint64_t shm_dropped_ = 0;
+    int creat_ret_        = 0;
 
     bool is_bind()
     {
@@ -127,7 +140,7 @@ public:
         if ((url[0] != 'i') && (url[1] != 'p')) {
             rpc_url_head_.clear();
         }
-        creat(url, raw_call);
+        creat_ret_ = creat(url, raw_call);
     }
     void set_timeout(int ms)
     {
@@ -137,6 +150,12 @@ public:
     {
         return timeout_;
     }
+    // Result of creat() in the url constructor: 0, or nonzero when the socket or shm ring could not be set up and
+    // send_data() will fail.
+    int get_creat_ret()
+    {
+        return creat_ret_;
+    }
     std::string get_zmq_url()
     {
         if ((!flage_.load()) && is_bind() && (zmq_url_.find("tcp://") != std::string::npos) &&
@@ -225,6 +244,9 @@ public:
     int creat(const std::string &url, const msg_callback_fun &raw_call = nullptr)
     {
         zmq_url_ = url;
+        if (url.compare(0, 6, "shm://") == 0) {
+            return creat_shm(url, raw_call);
+        }
         do {
             zmq_ctx_ = zmq_ctx_new();
         } while (zmq_ctx_ == NULL);
@@ -295,12 +317,85 @@ public:
     }
     int send_data(const std::string &raw)
     {
+        if (shm_ring_) return shm_ring_->write(raw.c_str(), raw.length());
+        if (!zmq_socket_) return -1;
         return zmq_send(zmq_socket_, raw.c_str(), raw.length(), 0);
     }
     int send_data(const char *raw, int size)
     {
+        if (shm_ring_) return shm_ring_->write(raw, size);
+        if (!zmq_socket_) return -1;
         return zmq_send(zmq_socket_, raw, size, 0);
     }
+    // Messages a shm subscriber lost because it fell a whole ring behind.
+    uint64_t shm_dropped()
+    {
+        return shm_dropped_;
+    }
+    // shm://name[?size=bytes&count=slots], returns -1 on a malformed or out of range parameter.
+    static int parse_shm_url(const std::string &url, std::string &name, uint32_t &size, uint32_t &count)
+    {
+        if (url.compare(0, 6, "shm://") != 0) return -1;
+        name          = url.substr(6);
+        size          = 64 * 1024;
+        count         = 16;
+        size_t query  = name.find('?');
+        if (query != std::string::npos) {
+            std::string params = name.substr(query + 1);
+            name               = name.substr(0, query);
+            size_t start       = 0;
+            while (start < params.length()) {
+                size_t end = params.find('&', start);
+                if (end == std::string::npos) end = params.length();
+                std::string param = params.substr(start, end - start);
+                start             = end + 1;
+                size_t eq         = param.find('=');
+                if (eq == std::string::npos) return -1;
+                const char *value = param.c_str() + eq + 1;
+                char *value_end   = NULL;
+                errno             = 0;
+                unsigned long val = strtoul(value, &value_end, 10);
+                if ((value_end == value) || (*value_end != '\0') || (errno == ERANGE) || (val == 0) ||
+                    (val > (1ul << 30)) || (*value == '-'))
+                    return -1;
+                std::string key = param.substr(0, eq);
+                if (key == "size")
+                    size = val;
+                else if (key == "count")
+                    count = val;
+                else
+                    return -1;
+            }
+        }
+        if (name.empty()) return -1;
+        return 0;
+    }
+    /*
+     * shm://name[?size=bytes&count=slots]: local publish / subscribe through a shared memory ring.
+     * The subscriber copies each message out of the ring once and checks it was not overwritten meanwhile, the
+     * callback only ever sees complete messages.
+     */
+    int creat_shm(const std::string &url, const msg_callback_fun &raw_call)
+    {
+        std::string name;
+        uint32_t size, count;
+        if (parse_shm_url(url, name, size, count)) return -1;
+        shm_name_ = name;
+        if (mode_ == ZMQ_PUB) {
+            // only a ring that was created is kept, send_data() never writes to a half set up one
+            auto ring = std::make_unique<pzmq_shm_ring>();
+            if (ring->create(name, size, count)) return -1;
+            shm_ring_ = std::move(ring);
+            return 0;
+        }
+        if (mode_ == ZMQ_SUB) {
+            shm_ring_   = std::make_unique<pzmq_shm_ring>();
+            flage_      = false;
+            zmq_thread_ = std::make_unique<std::thread>(std::bind(&pzmq::shm_event_loop, this, raw_call));
+            return 0;
+        }
+        return -1;
+    }
     inline int creat_pub(const std::string &url)
     {
         return zmq_bind(zmq_socket_, url.c_str());
@@ -391,6 +486,42 @@ public:
             msg_ptr.reset();
         }
     }
+    void shm_event_loop(const msg_callback_fun &raw_call)
+    {
+        uint64_t next = 0;
+        while (!flage_.load()) {
+            if (!shm_ring_->is_open()) {
+                if (shm_ring_->open(shm_name_)) {
+                    usleep(100 * 1000);
+                    continue;
+                }
+                next = shm_ring_->head();
+            }
+            if (shm_ring_->closed()) {
+                // publisher stopped or restarted, map the new ring
+                shm_ring_->release();
+                continue;
+            }
+            if (!shm_ring_->wait(next, 100)) {
+                // a publisher that died without closing its ring is replaced under the same name
+                if (shm_ring_->replaced()) shm_ring_->release();
+                continue;
+            }
+            size_t size;
+            uint64_t seq;
+            const char *data = shm_ring_->peek(next, &size, &seq, NULL, &shm_dropped_);
+            if (!data) continue;
+            std::shared_ptr<pzmq_data> msg_ptr = std::make_shared<pzmq_data>(size);
+            memcpy(msg_ptr->data(), data, size);
+            next = seq;
+            if (!shm_ring_->valid(seq)) {
+                // overwritten while copying
+                shm_dropped_++;
+                continue;
+            }
+            raw_call(this, msg_ptr);
+        }
+    }
     void close_zmq()
     {
         int linger = 1000;
@@ -410,6 +541,14 @@ public:
     }
     ~pzmq()
     {
+        if (shm_ring_) {
+            flage_ = true;
+            if (zmq_thread_) {
+                zmq_thread_->join();
+            }
+            shm_ring_.reset();
+            return;
+        }
         if (!zmq_socket_) {
             return;
         }
@@ -0,0 +1,297 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace StackFlows {
+
+/*
+ * Single writer / multi reader message ring in POSIX shared memory, used by pzmq for "shm://name" urls.
+ * Readers never take a lock and get a view of the payload inside the mapping; the writer never waits for
+ * readers. A slot carries the sequence number of the message it holds, checked by the reader before and
+ * after use, so a reader that falls a whole ring behind sees an overrun instead of a torn message.
+ * New messages are signalled with a process-shared futex on the header, woken only when a reader sleeps.
+ * A publisher that is restarted marks the ring it replaces closed; readers also notice a ring that was unlinked
+ * or recreated under their name while they wait, and reopen it.
+ */
+class pzmq_shm_ring {
+public:
+    static const uint32_t magic = 0x4d485350;  // "PSHM"
+
+    typedef struct {
+        uint32_t magic;
+        uint32_t slot_size;
+        uint32_t slot_count;
+        std::atomic<uint32_t> closed;
+        std::atomic<uint32_t> futex_word;
+        std::atomic<uint32_t> waiters;
+        alignas(64) std::atomic<uint64_t> head;
+    } shm_head_t;
+
+    typedef struct {
+        std::atomic<uint64_t> seq;  // message index + 1, 0 while being written
+        uint64_t timestamp;
+        uint32_t size;
+        uint32_t reserved;
+    } shm_slot_t;
+
+private:
+    std::string name_;
+    bool owner_;
+    size_t map_size_;
+    shm_head_t *head_;
+    char *base_;
+    ino_t ino_;
+
+    static std::string shm_path(const std::string &name)
+    {
+        std::string path = "/llm.";
+        for (char c : name) path += (c == '/') ? '.' : c;
+        return path;
+    }
+
+    size_t slot_stride() const
+    {
+        return (sizeof(shm_slot_t) + head_->slot_size + 63) & ~(size_t)63;
+    }
+
+    shm_slot_t *slot(uint64_t index) const
+    {
+        return (shm_slot_t *)(base_ + (index % head_->slot_count) * slot_stride());
+    }
+
+    static long futex(std::atomic<uint32_t> *addr, int op, uint32_t val, const struct timespec *timeout)
+    {
+        return syscall(SYS_futex, (uint32_t *)addr, op, val, timeout, NULL, 0);
+    }
+
+    bool replaced_name() const
+    {
+        int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+        if (fd < 0) return true;
+        struct stat st;
+        bool ret = (fstat(fd, &st) != 0) || (st.st_ino != ino_);
+        close(fd);
+        return ret;
+    }
+
+    // Mark the ring currently under path closed, so readers of a publisher that died without release() move on.
+    static void close_stale(const std::string &path)
+    {
+        int fd = shm_open(path.c_str(), O_RDWR, 0);
+        if (fd < 0) return;
+        struct stat st;
+        if ((fstat(fd, &st) == 0) && ((size_t)st.st_size >= sizeof(shm_head_t))) {
+            void *addr = mmap(NULL, sizeof(shm_head_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr != MAP_FAILED) {
+                shm_head_t *head = (shm_head_t *)addr;
+                if (head->magic == magic) {
+                    head->closed = 1;
+                    head->futex_word++;
+                    futex(&head->futex_word, FUTEX_WAKE, INT_MAX, NULL);
+                }
+                munmap(addr, sizeof(shm_head_t));
+            }
+        }
+        close(fd);
+    }
+
+public:
+    pzmq_shm_ring() : owner_(false), map_size_(0), head_(NULL), base_(NULL), ino_(0)
+    {
+    }
+
+    // Writer side. Replaces a stale ring of the same name.
+    int create(const std::string &name, uint32_t slot_size, uint32_t slot_count)
+    {
+        name_       = shm_path(name);
+        owner_      = true;
+        slot_size   = (slot_size + 7) & ~7u;
+        size_t head = (sizeof(shm_head_t) + 63) & ~(size_t)63;
+        map_size_   = head + (size_t)slot_count * ((sizeof(shm_slot_t) + slot_size + 63) & ~(size_t)63);
+        close_stale(name_);
+        shm_unlink(name_.c_str());
+        int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (fd < 0) return -1;
+        fchmod(fd, 0666);
+        struct stat st;
+        if ((ftruncate(fd, map_size_) != 0) || (fstat(fd, &st) != 0)) {
+            close(fd);
+            shm_unlink(name_.c_str());
+            return -1;
+        }
+        ino_ = st.st_ino;
+        void *addr = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            shm_unlink(name_.c_str());
+            return -1;
+        }
+        memset(addr, 0, map_size_);
+        head_             = (shm_head_t *)addr;
+        base_             = (char *)addr + head;
+        head_->slot_size  = slot_size;
+        head_->slot_count = slot_count;
+        std::atomic_thread_fence(std::memory_order_release);
+        head_->magic = magic;
+        return 0;
+    }
+
+    // Reader side. Returns -1 while the writer has not created the ring yet.
+    int open(const std::string &name)
+    {
+        name_  = shm_path(name);
+        owner_ = false;
+        int fd = shm_open(name_.c_str(), O_RDWR, 0);
+        if (fd < 0) return -1;
+        struct stat st;
+        if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(shm_head_t))) {
+            close(fd);
+            return -1;
+        }
+        void *addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) return -1;
+        ino_      = st.st_ino;
+        map_size_ = st.st_size;
+        head_     = (shm_head_t *)addr;
+        base_     = (char *)addr + ((sizeof(shm_head_t) + 63) & ~(size_t)63);
+        if ((head_->magic != magic) || head_->closed) {
+            release();
+            return -1;
+        }
+        return 0;
+    }
+
+    void release()
+    {
+        if (!head_) return;
+        if (owner_) {
+            head_->closed = 1;
+            head_->futex_word++;
+            futex(&head_->futex_word, FUTEX_WAKE, INT_MAX, NULL);
+            // leave the name alone if a newer publisher has taken it over
+            if (!replaced_name()) shm_unlink(name_.c_str());
+        }
+        munmap(head_, map_size_);
+        head_ = NULL;
+        base_ = NULL;
+    }
+
+    bool is_open() const
+    {
+        return head_ != NULL;
+    }
+
+    bool closed() const
+    {
+        return head_->closed.load() != 0;
+    }
+
+    // Reader: true when the name no longer refers to the mapped ring (unlinked or created again).
+    bool replaced() const
+    {
+        if (owner_ || !head_) return false;
+        return replaced_name();
+    }
+
+    uint64_t head() const
+    {
+        return head_->head.load(std::memory_order_acquire);
+    }
+
+    uint32_t slot_size() const
+    {
+        return head_->slot_size;
+    }
+
+    uint32_t slot_count() const
+    {
+        return head_->slot_count;
+    }
+
+    // Writer: returns the payload size, or -1 when the message does not fit in a slot.
+    int write(const void *data, size_t size, uint64_t timestamp = 0)
+    {
+        if (size > head_->slot_size) return -1;
+        uint64_t index = head_->head.load(std::memory_order_relaxed);
+        shm_slot_t *s  = slot(index);
+        s->seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy((char *)(s + 1), data, size);
+        s->size      = size;
+        s->timestamp = timestamp;
+        s->seq.store(index + 1, std::memory_order_release);
+        head_->head.store(index + 1, std::memory_order_seq_cst);
+        head_->futex_word.fetch_add(1, std::memory_order_seq_cst);
+        if (head_->waiters.load(std::memory_order_seq_cst)) futex(&head_->futex_word, FUTEX_WAKE, INT_MAX, NULL);
+        return size;
+    }
+
+    // Reader: block until a message after next exists, the ring is closed or timeout_ms elapses.
+    bool wait(uint64_t next, int timeout_ms)
+    {
+        uint32_t word = head_->futex_word.load(std::memory_order_seq_cst);
+        if ((head() > next) || closed()) return true;
+        struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+        head_->waiters++;
+        if (head() <= next) futex(&head_->futex_word, FUTEX_WAIT, word, &timeout);
+        head_->waiters--;
+        return (head() > next) || closed();
+    }
+
+    /*
+     * Reader: view of message next (no copy). Skips ahead when the writer has lapped the reader.
+     * Returns NULL if nothing is available. The view stays valid until valid(seq) turns false.
+     */
+    const char *peek(uint64_t &next, size_t *size, uint64_t *seq, uint64_t *timestamp, uint64_t *dropped)
+    {
+        for (;;) {
+            uint64_t h = head();
+            if (next >= h) return NULL;
+            if (h - next > head_->slot_count) {
+                if (dropped) *dropped += h - head_->slot_count - next;
+                next = h - head_->slot_count;
+            }
+            shm_slot_t *s = slot(next);
+            uint64_t sq   = s->seq.load(std::memory_order_acquire);
+            if (sq != next + 1) {
+                if (dropped) (*dropped)++;
+                next++;
+                continue;
+            }
+            *size = s->size < head_->slot_size ? s->size : head_->slot_size;
+            if (timestamp) *timestamp = s->timestamp;
+            *seq = sq;
+            return (const char *)(s + 1);
+        }
+    }
+
+    // Reader: true while the message returned by peek() has not been overwritten.
+    bool valid(uint64_t seq) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot(seq - 1)->seq.load(std::memory_order_relaxed) == seq;
+    }
+
+    ~pzmq_shm_ring()
+    {
+        release();
+    }
+};
+
+};  // namespace StackFlows
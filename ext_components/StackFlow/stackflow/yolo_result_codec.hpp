@@ -0,0 +1,226 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+ * Packed per-frame detection result, the "yolo.boxbin" response format. Header-only and dependency free so
+ * clients can decode it on the host. All fields are little endian.
+ *
+ *   header, 24 bytes
+ *     u32 magic 'YOLB'   u16 version   u16 flags (YOLO_RESULT_*)
+ *     u32 frame_index    u16 img_w     u16 img_h
+ *     u16 object_num     u8 point_num  u8 mask_dim   u32 reserved
+ *   object_num objects
+ *     u16 label   u16 score (prob * 65535)   f32 x, y, w, h (source image pixels)
+ *     YOLO_RESULT_ANGLE   f32 angle
+ *     YOLO_RESULT_KPS     point_num * (u16 x * 4, u16 y * 4, u8 visibility * 255)
+ *     YOLO_RESULT_MASK    f32 scale, mask_dim * i8 coefficient / scale
+ */
+namespace yolo_result {
+
+static const uint32_t MAGIC   = 0x424C4F59;  // "YOLB"
+static const uint16_t VERSION = 1;
+
+enum {
+    YOLO_RESULT_MASK  = 1 << 0,
+    YOLO_RESULT_KPS   = 1 << 1,
+    YOLO_RESULT_ANGLE = 1 << 2,
+};
+
+struct Object {
+    int label;
+    float prob;
+    float x;
+    float y;
+    float w;
+    float h;
+    float angle;
+    // x, y, visibility triplets
+    std::vector<float> kps;
+    std::vector<float> mask;
+};
+
+struct Frame {
+    uint16_t flags       = 0;
+    uint32_t frame_index = 0;
+    int img_w            = 0;
+    int img_h            = 0;
+    int point_num        = 0;
+    int mask_dim         = 0;
+    std::vector<Object> objects;
+};
+
+namespace detail {
+
+template <typename T>
+inline void put(std::string& out, T value)
+{
+    uint8_t bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    for (size_t i = 0; i < sizeof(T) / 2; i++) std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+#endif
+    out.append((const char*)bytes, sizeof(T));
+}
+
+template <typename T>
+inline bool get(const uint8_t*& p, const uint8_t* end, T& value)
+{
+    if ((size_t)(end - p) < sizeof(T)) return false;
+    uint8_t bytes[sizeof(T)];
+    memcpy(bytes, p, sizeof(T));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    for (size_t i = 0; i < sizeof(T) / 2; i++) std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+#endif
+    memcpy(&value, bytes, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+inline uint16_t to_u16(float v, float scale)
+{
+    float q = roundf(v * scale);
+    return (uint16_t)(q < 0.f ? 0.f : (q > 65535.f ? 65535.f : q));
+}
+
+}  // namespace detail
+
+inline size_t object_size(const Frame& frame)
+{
+    size_t size = 2 + 2 + 16;
+    if (frame.flags & YOLO_RESULT_ANGLE) size += 4;
+    if (frame.flags & YOLO_RESULT_KPS) size += frame.point_num * 5;
+    if (frame.flags & YOLO_RESULT_MASK) size += 4 + frame.mask_dim;
+    return size;
+}
+
+// appends the packed frame to out
+inline void encode(const Frame& frame, std::string& out)
+{
+    using detail::put;
+    out.reserve(out.size() + 24 + frame.objects.size() * object_size(frame));
+    put<uint32_t>(out, MAGIC);
+    put<uint16_t>(out, VERSION);
+    put<uint16_t>(out, frame.flags);
+    put<uint32_t>(out, frame.frame_index);
+    put<uint16_t>(out, (uint16_t)frame.img_w);
+    put<uint16_t>(out, (uint16_t)frame.img_h);
+    put<uint16_t>(out, (uint16_t)frame.objects.size());
+    put<uint8_t>(out, (uint8_t)frame.point_num);
+    put<uint8_t>(out, (uint8_t)frame.mask_dim);
+    put<uint32_t>(out, 0);
+
+    for (const auto& obj : frame.objects) {
+        put<uint16_t>(out, (uint16_t)obj.label);
+        put<uint16_t>(out, detail::to_u16(obj.prob, 65535.f));
+        put<float>(out, obj.x);
+        put<float>(out, obj.y);
+        put<float>(out, obj.w);
+        put<float>(out, obj.h);
+        if (frame.flags & YOLO_RESULT_ANGLE) {
+            put<float>(out, obj.angle);
+        }
+        if (frame.flags & YOLO_RESULT_KPS) {
+            for (int k = 0; k < frame.point_num; k++) {
+                bool has = (size_t)(k * 3 + 2) < obj.kps.size();
+                put<uint16_t>(out, has ? detail::to_u16(obj.kps[k * 3], 4.f) : 0);
+                put<uint16_t>(out, has ? detail::to_u16(obj.kps[k * 3 + 1], 4.f) : 0);
+                float vis = has ? roundf(obj.kps[k * 3 + 2] * 255.f) : 0.f;
+                put<uint8_t>(out, (uint8_t)(vis < 0.f ? 0.f : (vis > 255.f ? 255.f : vis)));
+            }
+        }
+        if (frame.flags & YOLO_RESULT_MASK) {
+            float max_abs = 0.f;
+            for (int c = 0; c < frame.mask_dim && c < (int)obj.mask.size(); c++) {
+                max_abs = std::fabs(obj.mask[c]) > max_abs ? std::fabs(obj.mask[c]) : max_abs;
+            }
+            float scale = max_abs > 0.f ? max_abs / 127.f : 1.f;
+            put<float>(out, scale);
+            for (int c = 0; c < frame.mask_dim; c++) {
+                float q = c < (int)obj.mask.size() ? roundf(obj.mask[c] / scale) : 0.f;
+                put<int8_t>(out, (int8_t)(q < -127.f ? -127.f : (q > 127.f ? 127.f : q)));
+            }
+        }
+    }
+}
+
+// false on a foreign, newer or truncated buffer
+inline bool decode(const uint8_t* data, size_t size, Frame& frame)
+{
+    using detail::get;
+    const uint8_t* p   = data;
+    const uint8_t* end = data + size;
+    uint32_t magic, reserved;
+    uint16_t version, img_w, img_h, object_num;
+    uint8_t point_num, mask_dim;
+    if (!(get(p, end, magic) && get(p, end, version) && get(p, end, frame.flags) && get(p, end, frame.frame_index) &&
+          get(p, end, img_w) && get(p, end, img_h) && get(p, end, object_num) && get(p, end, point_num) &&
+          get(p, end, mask_dim) && get(p, end, reserved))) {
+        return false;
+    }
+    if ((magic != MAGIC) || (version != VERSION)) {
+        return false;
+    }
+    frame.img_w     = img_w;
+    frame.img_h     = img_h;
+    frame.point_num = point_num;
+    frame.mask_dim  = mask_dim;
+    if ((size_t)(end - p) < object_num * object_size(frame)) {
+        return false;
+    }
+
+    frame.objects.resize(object_num);
+    for (auto& obj : frame.objects) {
+        uint16_t label = 0, score = 0;
+        get(p, end, label);
+        get(p, end, score);
+        obj.label = label;
+        obj.prob  = score / 65535.f;
+        get(p, end, obj.x);
+        get(p, end, obj.y);
+        get(p, end, obj.w);
+        get(p, end, obj.h);
+        obj.angle = 0.f;
+        if (frame.flags & YOLO_RESULT_ANGLE) {
+            get(p, end, obj.angle);
+        }
+        obj.kps.clear();
+        if (frame.flags & YOLO_RESULT_KPS) {
+            obj.kps.resize(point_num * 3);
+            for (int k = 0; k < point_num; k++) {
+                uint16_t x = 0, y = 0;
+                uint8_t vis = 0;
+                get(p, end, x);
+                get(p, end, y);
+                get(p, end, vis);
+                obj.kps[k * 3]     = x / 4.f;
+                obj.kps[k * 3 + 1] = y / 4.f;
+                obj.kps[k * 3 + 2] = vis / 255.f;
+            }
+        }
+        obj.mask.clear();
+        if (frame.flags & YOLO_RESULT_MASK) {
+            float scale = 0.f;
+            get(p, end, scale);
+            obj.mask.resize(mask_dim);
+            for (int c = 0; c < mask_dim; c++) {
+                int8_t q = 0;
+                get(p, end, q);
+                obj.mask[c] = q * scale;
+            }
+        }
+    }
+    return true;
+}
+
+}  // namespace yolo_result
@@ -0,0 +1,152 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "audio_frontend.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace StackFlows;
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+static std::vector<int16_t> make_pcm(size_t count, unsigned seed)
+{
+    std::vector<int16_t> pcm(count);
+    srand(seed);
+    for (auto &s : pcm) s = (int16_t)(rand() & 0xffff);
+    // the extremes go through the same conversion
+    if (count > 2) {
+        pcm[0] = INT16_MIN;
+        pcm[1] = INT16_MAX;
+    }
+    return pcm;
+}
+
+static std::string as_bytes(const std::vector<int16_t> &pcm)
+{
+    return std::string((const char *)pcm.data(), pcm.size() * sizeof(int16_t));
+}
+
+// The vectorized conversion matches the plain loop exactly, for every length around the vector width.
+static void test_convert()
+{
+    const float scales[] = {1.0f, 1.0f / 32768.0f, 1.0f / INT16_MAX};
+    std::vector<int16_t> pcm = make_pcm(70, 1);
+    for (float scale : scales) {
+        for (size_t count = 0; count <= 40; count++) {
+            for (size_t offset = 0; offset < 3; offset++) {
+                std::vector<float> out(count + 1, -7.0f);
+                audio_s16_to_float(pcm.data() + offset, out.data(), count, scale);
+                bool same = true;
+                for (size_t i = 0; i < count; i++) same &= (out[i] == pcm[offset + i] * scale);
+                CHECK(same);
+                // nothing past count is written
+                CHECK(out[count] == -7.0f);
+            }
+        }
+    }
+}
+
+// Messages at odd addresses and with odd sizes convert to the same samples as one aligned message.
+static void test_push_unaligned()
+{
+    std::vector<int16_t> pcm = make_pcm(1000, 2);
+    std::string bytes        = as_bytes(pcm);
+    std::string shifted      = " " + bytes;
+    audio_frontend frontend(1.0f / 32768.0f, 16);
+    const size_t sizes[]     = {1, 2, 3, 17, 64, 255, 1};
+    size_t pos               = 0;
+    for (size_t i = 0; pos < bytes.size(); i++) {
+        size_t size = std::min(sizes[i % 7], bytes.size() - pos);
+        frontend.push(shifted.data() + 1 + pos, size);
+        pos += size;
+    }
+    CHECK(frontend.size() == pcm.size());
+    bool same = true;
+    for (size_t i = 0; i < pcm.size() && i < frontend.size(); i++) same &= (frontend.data()[i] == pcm[i] / 32768.0f);
+    CHECK(same);
+}
+
+// push() reports a batch every delay_frames + 1 messages and keeps every sample of the batch.
+static void test_delay_frames()
+{
+    std::vector<int16_t> pcm = make_pcm(160, 3);
+    audio_frontend frontend(1.0f);
+    frontend.set_delay_frames(2);
+    std::vector<bool> ready;
+    for (int i = 0; i < 6; i++) ready.push_back(frontend.push(as_bytes(pcm)));
+    CHECK((ready == std::vector<bool>{false, false, true, false, false, true}));
+    CHECK(frontend.size() == 6 * pcm.size());
+    frontend.consume(frontend.size());
+    CHECK(frontend.empty());
+
+    // clear() drops the samples and the partial batch
+    CHECK(!frontend.push(as_bytes(pcm)));
+    frontend.clear();
+    CHECK(frontend.empty());
+    CHECK(!frontend.push(as_bytes(pcm)));
+    CHECK(!frontend.push(as_bytes(pcm)));
+    CHECK(frontend.push(as_bytes(pcm)));
+    CHECK(frontend.size() == 3 * pcm.size());
+
+    // no delay: every message is a batch
+    frontend.clear();
+    frontend.set_delay_frames(0);
+    CHECK(frontend.push(as_bytes(pcm)));
+    CHECK(frontend.push(as_bytes(pcm)));
+}
+
+// Windows of a stream pushed in uneven messages are the windows of the whole signal, the partial tail carries over.
+static void test_windows_across_pushes()
+{
+    const size_t window = 400, hop = 160;
+    std::vector<int16_t> pcm = make_pcm(16000, 4);
+    audio_frontend frontend(1.0f, 64);
+    size_t pos = 0, next = 0, bad = 0;
+    const size_t sizes[] = {160, 1, 333, 960, 7, 2048, 512};
+    for (size_t i = 0; pos < pcm.size(); i++) {
+        size_t count = std::min(sizes[i % 7], pcm.size() - pos);
+        frontend.push((const char *)(pcm.data() + pos), count * sizeof(int16_t));
+        pos += count;
+        frontend.for_each_window(window, hop, [&](const float *data, size_t size) {
+            if (size != window) bad++;
+            for (size_t k = 0; k < size; k++) {
+                if (data[k] != pcm[next * hop + k]) {
+                    bad++;
+                    break;
+                }
+            }
+            next++;
+        });
+        // what is left is always less than a window and starts at the next hop
+        CHECK(frontend.size() < window);
+        CHECK(frontend.size() == pos - next * hop);
+    }
+    CHECK(bad == 0);
+    CHECK(next == (pcm.size() - window) / hop + 1);
+}
+
+int main()
+{
+    test_convert();
+    test_push_unaligned();
+    test_delay_frames();
+    test_windows_across_pushes();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_audio_frontend: ok\n");
+    return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * image_letterbox against a float reference: BT.601 video range conversion and cv::resize style bilinear
+ * sampling, for every source format, odd sizes and padded strides, with the pad regions checked exactly.
+ * letterbox_info is checked against the arithmetic of common::get_input_data_letterbox it replaced. Source
+ * buffers are sized exactly, so ASan reports any read past a row or plane.
+ */
+#include "image_preprocess.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace StackFlows;
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+// most a fixed-point output may differ from the float reference, in 8-bit levels
+static const int tolerance = 3;
+
+static const char *format_names[] = {"yuyv", "nv12", "bgr", "rgb"};
+
+struct source_image {
+    image_format_t format;
+    int w, h, stride;
+    // packed rows are handed to image_letterbox as stride 0
+    bool packed;
+    std::vector<uint8_t> data;
+};
+
+static int packed_stride(image_format_t format, int w)
+{
+    int even_w = (w + 1) & ~1;
+    return (format == IMAGE_FORMAT_YUYV) ? even_w * 2 : ((format == IMAGE_FORMAT_NV12) ? even_w : w * 3);
+}
+
+// random pixels, luma and chroma inside the video range; stride 0 packs the rows
+static source_image make_source(image_format_t format, int w, int h, int stride, unsigned seed)
+{
+    source_image img = {format, w, h, stride ? stride : packed_stride(format, w), stride == 0, {}};
+    size_t size      = (size_t)img.stride * h;
+    if (format == IMAGE_FORMAT_NV12) size += (size_t)img.stride * ((h + 1) / 2);
+    img.data.resize(size);
+    srand(seed);
+    for (auto &b : img.data) b = (uint8_t)(16 + rand() % 220);
+    return img;
+}
+
+// reference RGB of one source pixel, floats in 0..255
+static void ref_pixel(const source_image &img, int x, int y, float rgb[3])
+{
+    const uint8_t *p = img.data.data();
+    if ((img.format == IMAGE_FORMAT_BGR) || (img.format == IMAGE_FORMAT_RGB)) {
+        const uint8_t *px = p + (size_t)y * img.stride + x * 3;
+        bool bgr          = img.format == IMAGE_FORMAT_BGR;
+        rgb[0]            = px[bgr ? 2 : 0];
+        rgb[1]            = px[1];
+        rgb[2]            = px[bgr ? 0 : 2];
+        return;
+    }
+    int Y, U, V;
+    if (img.format == IMAGE_FORMAT_YUYV) {
+        const uint8_t *q = p + (size_t)y * img.stride + (x & ~1) * 2;
+        Y                = q[(x & 1) ? 2 : 0];
+        U                = q[1];
+        V                = q[3];
+    } else {
+        Y                 = p[(size_t)y * img.stride + x];
+        const uint8_t *uv = p + (size_t)img.h * img.stride + (size_t)(y / 2) * img.stride + (x & ~1);
+        U                 = uv[0];
+        V                 = uv[1];
+    }
+    float c = 1.164f * (Y - 16);
+    rgb[0]  = std::min(std::max(c + 1.596f * (V - 128), 0.f), 255.f);
+    rgb[1]  = std::min(std::max(c - 0.391f * (U - 128) - 0.813f * (V - 128), 0.f), 255.f);
+    rgb[2]  = std::min(std::max(c + 2.018f * (U - 128), 0.f), 255.f);
+}
+
+// source coordinate and weight of the next pixel for output x of a resize from src to dst pixels
+static void ref_tap(int x, int src, int dst, int &x0, int &x1, float &w)
+{
+    float f = std::max((x + 0.5f) * src / dst - 0.5f, 0.f);
+    x0      = std::min((int)f, src - 1);
+    x1      = std::min(x0 + 1, src - 1);
+    w       = (x1 != x0) ? f - x0 : 0.f;
+}
+
+/*
+ * Letterboxes img into dst_w x dst_h with image_letterbox and compares every byte with the reference: pad bytes
+ * exactly, resized pixels within tolerance. Returns the largest difference seen.
+ */
+static int check_letterbox(const source_image &img, int dst_w, int dst_h, bool bgr, uint8_t pad)
+{
+    // a guard byte past the destination catches writes beyond it
+    std::vector<uint8_t> dst((size_t)dst_w * dst_h * 3 + 1, 0xA5);
+    letterbox_info_t info = image_letterbox(img.data.data(), img.w, img.h, img.packed ? 0 : img.stride, img.format,
+                                            dst.data(), dst_w, dst_h, bgr, pad);
+    CHECK(dst.back() == 0xA5);
+
+    int worst = 0, bad_pad = 0;
+    for (int y = 0; y < dst_h; y++) {
+        for (int x = 0; x < dst_w; x++) {
+            const uint8_t *out = &dst[((size_t)y * dst_w + x) * 3];
+            int rx = x - info.pad_left, ry = y - info.pad_top;
+            if ((rx < 0) || (ry < 0) || (rx >= info.resize_w) || (ry >= info.resize_h)) {
+                if ((out[0] != pad) || (out[1] != pad) || (out[2] != pad)) bad_pad++;
+                continue;
+            }
+            int x0, x1, y0, y1;
+            float wx, wy, a[3], b[3], c[3], d[3];
+            ref_tap(rx, img.w, info.resize_w, x0, x1, wx);
+            ref_tap(ry, img.h, info.resize_h, y0, y1, wy);
+            ref_pixel(img, x0, y0, a);
+            ref_pixel(img, x1, y0, b);
+            ref_pixel(img, x0, y1, c);
+            ref_pixel(img, x1, y1, d);
+            for (int ch = 0; ch < 3; ch++) {
+                float top = a[ch] + (b[ch] - a[ch]) * wx;
+                float bot = c[ch] + (d[ch] - c[ch]) * wx;
+                int ref   = (int)std::lround(top + (bot - top) * wy);
+                int diff  = std::abs(out[bgr ? 2 - ch : ch] - ref);
+                worst     = std::max(worst, diff);
+            }
+        }
+    }
+    if ((bad_pad > 0) || (worst > tolerance)) {
+        fprintf(stderr, "%s %dx%d stride %d -> %dx%d%s: %d bad pad pixels, max diff %d\n", format_names[img.format],
+                img.w, img.h, img.stride, dst_w, dst_h, bgr ? " bgr" : "", bad_pad, worst);
+    }
+    CHECK(bad_pad == 0);
+    CHECK(worst <= tolerance);
+    return worst;
+}
+
+// every format through the resize path, the same-size path, odd sizes and padded strides
+static void test_formats()
+{
+    struct size_case {
+        int src_w, src_h, extra_stride, dst_w, dst_h;
+    };
+    const size_case cases[] = {
+        {64, 48, 0, 32, 32},    // downscale, pad top and bottom
+        {33, 17, 0, 20, 20},    // odd width and height
+        {31, 24, 0, 31, 40},    // same size: rows converted straight into place, odd last pixel
+        {15, 9, 0, 64, 40},     // upscale, pad left and right
+        {37, 21, 7, 24, 24},    // padded odd stride
+        {48, 33, 16, 48, 33},   // same size with padded stride, no padding at all
+        {100, 3, 5, 16, 16},    // very wide
+        {1, 5, 0, 4, 8},        // single column
+    };
+    unsigned seed = 1;
+    for (int f = IMAGE_FORMAT_YUYV; f <= IMAGE_FORMAT_RGB; f++) {
+        image_format_t format = (image_format_t)f;
+        for (const auto &c : cases) {
+            int stride         = c.extra_stride ? packed_stride(format, c.src_w) + c.extra_stride : 0;
+            source_image img   = make_source(format, c.src_w, c.src_h, stride, seed++);
+            for (bool bgr : {false, true}) check_letterbox(img, c.dst_w, c.dst_h, bgr, bgr ? 114 : 0);
+        }
+    }
+}
+
+// the last pixel of an odd-width YUYV row is converted, in the same-size and the resize path
+static void test_yuyv_odd_width()
+{
+    source_image img = make_source(IMAGE_FORMAT_YUYV, 5, 2, 0, 99);
+    // last macropixel: Y0 = 200, U = V = 128 is a plain grey of 1.164 * 184
+    for (int y = 0; y < 2; y++) {
+        uint8_t *q = &img.data[(size_t)y * img.stride + 4 * 2];
+        q[0]       = 200;
+        q[1]       = 128;
+        q[3]       = 128;
+    }
+    std::vector<uint8_t> dst(5 * 2 * 3, 0);
+    image_letterbox(img.data.data(), 5, 2, 0, IMAGE_FORMAT_YUYV, dst.data(), 5, 2);
+    for (int ch = 0; ch < 3; ch++) CHECK(std::abs(dst[(1 * 5 + 4) * 3 + ch] - 214) <= 1);
+    check_letterbox(img, 9, 9, false, 0);
+}
+
+/*
+ * The placement arithmetic of common::get_input_data_letterbox: scale by the tighter axis (compared in
+ * double), truncate the resized size, pad left and top with the floor of half the difference.
+ */
+static void test_letterbox_info()
+{
+    int bad = 0;
+    for (int src_w = 1; src_w <= 130; src_w += 3) {
+        for (int src_h = 1; src_h <= 130; src_h += 5) {
+            for (int dst : {64, 320, 640}) {
+                for (int dst_h : {dst, dst * 3 / 4}) {
+                    int dst_w = dst;
+                    float scale;
+                    if ((dst_h * 1.0 / src_h) < (dst_w * 1.0 / src_w))
+                        scale = (float)dst_h * 1.0f / (float)src_h;
+                    else
+                        scale = (float)dst_w * 1.0f / (float)src_w;
+                    int resize_w = int(scale * (float)src_w);
+                    int resize_h = int(scale * (float)src_h);
+                    int top      = (dst_h - resize_h) / 2;
+                    int left     = (dst_w - resize_w) / 2;
+
+                    letterbox_info_t info = letterbox_info(src_w, src_h, dst_w, dst_h);
+                    if ((info.scale != scale) || (info.resize_w != resize_w) || (info.resize_h != resize_h) ||
+                        (info.pad_top != top) || (info.pad_left != left)) {
+                        if (bad++ < 5)
+                            fprintf(stderr, "letterbox_info %dx%d -> %dx%d differs\n", src_w, src_h, dst_w, dst_h);
+                    }
+                }
+            }
+        }
+    }
+    CHECK(bad == 0);
+    // the common camera and model sizes
+    letterbox_info_t info = letterbox_info(1280, 720, 640, 640);
+    CHECK((info.resize_w == 640) && (info.resize_h == 360) && (info.pad_left == 0) && (info.pad_top == 140));
+    info = letterbox_info(320, 240, 640, 640);
+    CHECK((info.resize_w == 640) && (info.resize_h == 480) && (info.pad_top == 80) && (info.scale == 2.0f));
+}
+
+int main()
+{
+    test_formats();
+    test_yuyv_odd_width();
+    test_letterbox_info();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_image_preprocess: ok\n");
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "pzmq.hpp"
+#include <sys/wait.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace StackFlows;
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+// message i: 8 byte index followed by bytes all equal to i & 0xff
+static std::vector<char> make_message(uint64_t index, size_t size)
+{
+    std::vector<char> msg(size, (char)(index & 0xff));
+    memcpy(msg.data(), &index, sizeof(index));
+    return msg;
+}
+
+static bool check_message(const char *data, size_t size, uint64_t *index)
+{
+    if (size < sizeof(uint64_t)) return false;
+    memcpy(index, data, sizeof(*index));
+    for (size_t i = sizeof(uint64_t); i < size; i++) {
+        if (data[i] != (char)(*index & 0xff)) return false;
+    }
+    return true;
+}
+
+template <typename F>
+static bool wait_until(F cond, int timeout_ms)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() > end) return false;
+        usleep(1000);
+    }
+    return true;
+}
+
+static void test_parse_url()
+{
+    std::string name;
+    uint32_t size, count;
+    CHECK(pzmq::parse_shm_url("shm://pcm.cap", name, size, count) == 0);
+    CHECK(name == "pcm.cap" && size == 64 * 1024 && count == 16);
+    CHECK(pzmq::parse_shm_url("shm://pcm.cap?size=4096&count=64", name, size, count) == 0);
+    CHECK(name == "pcm.cap" && size == 4096 && count == 64);
+    CHECK(pzmq::parse_shm_url("shm://img?count=4", name, size, count) == 0);
+    CHECK(name == "img" && size == 64 * 1024 && count == 4);
+    CHECK(pzmq::parse_shm_url("shm://pcm.cap?size=abc", name, size, count) == -1);
+    CHECK(pzmq::parse_shm_url("shm://pcm.cap?size=", name, size, count) == -1);
+    CHECK(pzmq::parse_shm_url("shm://pcm.cap?size=12k", name, size, count) == -1);
+    CHECK(pzmq::parse_shm_url("shm://pcm.cap?count=-1", name, size, count) == -1);
+    CHECK(pzmq::parse_shm_url("shm://pcm.cap?count=0", name, size, count) == -1);
+    CHECK(pzmq::parse_shm_url("shm://pcm.cap?size=99999999999999999999999", name, size, count) == -1);
+    CHECK(pzmq::parse_shm_url("shm://pcm.cap?slots=4", name, size, count) == -1);
+    CHECK(pzmq::parse_shm_url("shm://?size=4", name, size, count) == -1);
+    CHECK(pzmq::parse_shm_url("ipc:///tmp/x", name, size, count) == -1);
+}
+
+// A subscriber slower than the publisher gets only whole messages and counts what it missed.
+static void test_slow_subscriber(const std::string &name)
+{
+    std::string url = "shm://" + name + "?size=256&count=8";
+    pzmq pub(url, ZMQ_PUB);
+    std::atomic<uint64_t> received(0), torn(0), last(0);
+    std::atomic<bool> ordered(true);
+    pzmq sub("shm://" + name, ZMQ_SUB, [&](pzmq *, const std::shared_ptr<pzmq_data> &raw) {
+        // give the publisher time to lap the ring while this message is held
+        usleep(200);
+        uint64_t index;
+        if (!check_message((const char *)raw->data(), raw->size(), &index)) torn++;
+        if (received && (index <= last)) ordered = false;
+        last = index;
+        received++;
+    });
+    usleep(200 * 1000);
+    const uint64_t total = 5000;
+    for (uint64_t i = 1; i <= total; i++) {
+        auto msg = make_message(i, 200);
+        CHECK(pub.send_data(msg.data(), msg.size()) == 200);
+    }
+    CHECK(wait_until([&] { return last == total; }, 3000));
+    CHECK(torn == 0);
+    CHECK(ordered);
+    CHECK(received > 0);
+    CHECK(received + sub.shm_dropped() >= total);
+    CHECK(sub.shm_dropped() > 0);
+    // a message larger than a slot is refused
+    CHECK(pub.send_data(std::string(300, 'x')) == -1);
+}
+
+// Publisher killed without closing its ring, a new one takes the name: the subscriber follows.
+static void test_publisher_restart(const std::string &name)
+{
+    std::string url = "shm://" + name + "?size=64&count=4";
+    std::atomic<uint64_t> last(0);
+    pzmq sub("shm://" + name, ZMQ_SUB, [&](pzmq *, const std::shared_ptr<pzmq_data> &raw) {
+        uint64_t index;
+        if (check_message((const char *)raw->data(), raw->size(), &index)) last = index;
+    });
+    pid_t pid = fork();
+    if (pid == 0) {
+        pzmq_shm_ring *ring = new pzmq_shm_ring();
+        if (ring->create(name, 64, 4)) _exit(1);
+        usleep(300 * 1000);
+        auto msg = make_message(1, 32);
+        ring->write(msg.data(), msg.size());
+        usleep(200 * 1000);
+        _exit(0);  // no release(): the ring stays open and linked
+    }
+    CHECK(wait_until([&] { return last == 1; }, 3000));
+    int status = 0;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    pzmq pub(url, ZMQ_PUB);
+    auto msg = make_message(2, 32);
+    CHECK(wait_until(
+        [&] {
+            pub.send_data(msg.data(), msg.size());
+            usleep(10 * 1000);
+            return last == 2;
+        },
+        3000));
+}
+
+// Reader side of the ring: a recreated ring is detected either way, and the old owner leaves the new ring alone.
+static void test_ring_replaced(const std::string &name)
+{
+    pzmq_shm_ring writer;
+    CHECK(writer.create(name, 64, 4) == 0);
+    pzmq_shm_ring reader;
+    CHECK(reader.open(name) == 0);
+    CHECK(!reader.closed() && !reader.replaced());
+    pzmq_shm_ring writer2;
+    CHECK(writer2.create(name, 64, 4) == 0);
+    CHECK(reader.closed());
+    CHECK(reader.replaced());
+    writer.release();
+    pzmq_shm_ring reader2;
+    CHECK(reader2.open(name) == 0);
+    CHECK(!reader2.replaced());
+    reader2.release();
+    writer2.release();
+    CHECK(reader2.open(name) == -1);
+}
+
+// A publisher whose ring cannot be set up reports it and fails its sends instead of writing to nothing.
+static void test_create_failure(const std::string &name)
+{
+    pzmq pub("shm://" + name + "?size=1073741824&count=1073741824", ZMQ_PUB);
+    CHECK(pub.get_creat_ret() != 0);
+    CHECK(pub.send_data(std::string("lost")) == -1);
+    CHECK(pub.send_data("lost", 4) == -1);
+    CHECK(access(("/dev/shm/llm." + name).c_str(), F_OK) != 0);
+
+    pzmq bad("shm://" + name + "?size=12k", ZMQ_PUB);
+    CHECK(bad.get_creat_ret() != 0);
+    CHECK(bad.send_data(std::string("lost")) == -1);
+
+    pzmq good("shm://" + name + "?size=64&count=4", ZMQ_PUB);
+    CHECK(good.get_creat_ret() == 0);
+    CHECK(good.send_data(std::string("kept")) == 4);
+}
+
+int main()
+{
+    std::string base = "stackflow_test_" + std::to_string(getpid());
+    test_parse_url();
+    test_slow_subscriber(base + ".slow");
+    test_publisher_restart(base + ".restart");
+    test_ring_replaced(base + ".replaced");
+    test_create_failure(base + ".fail");
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_pzmq_shm: ok\n");
+    return 0;
+}
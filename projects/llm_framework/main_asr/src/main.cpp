@@ -19,10 +19,9 @@
 #include <stdexcept>
 #include "../../../../SDK/components/utilities/include/sample_log.h"
 
-#define BUFFER_IMPLEMENTATION
 #include <stdbool.h>
 #include <stdint.h>
-#include "libs/buffer.h"
+#include "audio_frontend.hpp"
 
 using namespace StackFlows;
 
@@ -117,7 +116,7 @@ public:
     float silence_ms_accum_ = 0.0f;
     float silence_timeout   = 1000.0f;
 
-    buffer_t *pcmdata;
+    audio_frontend pcm_frontend_{1.0f / INT16_MAX};
     std::function<void(void)> pause;
 
     bool is_using_itn() const
@@ -500,23 +499,9 @@ public:
 
     void sys_pcm_on_data_ncnn(const std::string &raw)
     {
-        static int count = 0;
-        if (count < delay_audio_frame_) {
-            buffer_write_char(pcmdata, raw.data(), raw.length());
-            count++;
-            return;
-        }
-        buffer_write_char(pcmdata, raw.data(), raw.length());
-        buffer_position_set(pcmdata, 0);
-
-        std::vector<float> floatSamples;
-        int16_t audio_val;
-        while (buffer_read_i16(pcmdata, &audio_val, 1)) {
-            float normalizedSample = static_cast<float>(audio_val) / INT16_MAX;
-            floatSamples.push_back(normalizedSample);
-        }
-        buffer_resize(pcmdata, 0);
-        count = 0;
+        pcm_frontend_.set_scale(1.0f / INT16_MAX);
+        pcm_frontend_.set_delay_frames(delay_audio_frame_);
+        if (!pcm_frontend_.push(raw)) return;
 
         if (awake_flage_ && ncnn_stream_) {
             ncnn_stream_.reset();
@@ -526,7 +511,9 @@ public:
             ncnn_stream_ = ncnn_recognizer_->CreateStream();
         }
 
-        ncnn_stream_->AcceptWaveform(ncnn_config_.feat_config.sampling_rate, floatSamples.data(), floatSamples.size());
+        ncnn_stream_->AcceptWaveform(ncnn_config_.feat_config.sampling_rate, pcm_frontend_.data(),
+                                     pcm_frontend_.size());
+        pcm_frontend_.consume(pcm_frontend_.size());
 
         while (ncnn_recognizer_->IsReady(ncnn_stream_.get())) {
             ncnn_recognizer_->DecodeStream(ncnn_stream_.get());
@@ -555,28 +542,15 @@ public:
     void sys_pcm_on_data_onnx(const std::string &raw)
     {
         if (delay_audio_frame_ == 0) {
-            buffer_write_char(pcmdata, raw.data(), raw.length());
-            buffer_position_set(pcmdata, 0);
-
-            std::vector<float> floatSamples;
-            int16_t audio_val;
-            while (buffer_read_i16(pcmdata, &audio_val, 1)) {
-                float normalizedSample = static_cast<float>(audio_val) / INT16_MAX;
-                floatSamples.push_back(normalizedSample);
-            }
-
-            buffer_resize(pcmdata, 0);
+            pcm_frontend_.set_scale(1.0f / INT16_MAX);
+            pcm_frontend_.set_delay_frames(0);
+            pcm_frontend_.push(raw);
             int32_t window_size = vad_config_.silero_vad.window_size;
-            int32_t i           = 0;
             std::string final_text;
 
-            while (i < floatSamples.size()) {
-                if (i + window_size <= floatSamples.size()) {
-                    vad_->AcceptWaveform(floatSamples.data() + i, window_size);
-                } else {
-                    vad_->Flush();
-                }
-                i += window_size;
+            // full silero windows only, the remainder waits for the next message
+            pcm_frontend_.for_each_window(window_size, window_size, [&](const float *window, size_t count) {
+                vad_->AcceptWaveform(window, count);
 
                 while (!vad_->Empty()) {
                     const auto &segment = vad_->Front();
@@ -602,7 +576,7 @@ public:
                     vad_->Pop();
                     offline_stream_.reset();
                 }
-            }
+            });
 
             if (out_callback_) {
                 out_callback_(final_text, true);
@@ -614,28 +588,11 @@ public:
                 PushPreRollPcm(pcm16, n16);
             }
 
-            static int count = 0;
-            if (count < delay_audio_frame_) {
-                buffer_write_char(pcmdata, raw.data(), raw.length());
-                count++;
-                return;
-            }
-
-            buffer_write_char(pcmdata, raw.data(), raw.length());
-            buffer_position_set(pcmdata, 0);
-
-            std::vector<float> floatSamples;
-            floatSamples.reserve((delay_audio_frame_ + 1) * kFrameSamples);
-
-            int16_t audio_val;
-            while (buffer_read_i16(pcmdata, &audio_val, 1)) {
-                floatSamples.push_back(static_cast<float>(audio_val) / 32768.0f);
-            }
-
-            buffer_resize(pcmdata, 0);
-            count = 0;
-
-            vad_->AcceptWaveform(floatSamples.data(), floatSamples.size());
+            pcm_frontend_.set_scale(1.0f / 32768.0f);
+            pcm_frontend_.set_delay_frames(delay_audio_frame_);
+            if (!pcm_frontend_.push(raw)) return;
+            vad_->AcceptWaveform(pcm_frontend_.data(), pcm_frontend_.size());
+            pcm_frontend_.consume(pcm_frontend_.size());
 
             bool detected      = vad_->IsSpeechDetected();
             bool speech_start  = (!prev_vad_detected_ && detected);
@@ -649,15 +606,11 @@ public:
                 }
 
                 if (speech_start && !pre_roll_pcm_.empty()) {
-                    std::vector<float> pre;
-                    pre.reserve(pre_roll_pcm_.size());
+                    std::vector<float> merged;
+                    merged.reserve(pre_roll_pcm_.size() + segment.samples.size());
                     for (int16_t s : pre_roll_pcm_) {
-                        pre.push_back(static_cast<float>(s) / 32768.0f);
+                        merged.push_back(static_cast<float>(s) / 32768.0f);
                     }
-
-                    std::vector<float> merged;
-                    merged.reserve(pre.size() + segment.samples.size());
-                    merged.insert(merged.end(), pre.begin(), pre.end());
                     merged.insert(merged.end(), segment.samples.begin(), segment.samples.end());
 
                     offline_stream_->AcceptWaveform(kSampleRate, merged.data(), merged.size());
@@ -700,27 +653,14 @@ public:
 
     void sys_pcm_on_data_online(const std::string &raw)
     {
-        static int count = 0;
-        if (count < delay_audio_frame_) {
-            buffer_write_char(pcmdata, raw.data(), raw.length());
-            count++;
-            return;
-        }
-        buffer_write_char(pcmdata, raw.data(), raw.length());
-        buffer_position_set(pcmdata, 0);
-
-        std::vector<float> floatSamples;
-        int16_t audio_val;
-        while (buffer_read_i16(pcmdata, &audio_val, 1)) {
-            float normalizedSample = static_cast<float>(audio_val) / INT16_MAX;
-            floatSamples.push_back(normalizedSample);
-        }
-        buffer_resize(pcmdata, 0);
-        count = 0;
+        pcm_frontend_.set_scale(1.0f / INT16_MAX);
+        pcm_frontend_.set_delay_frames(delay_audio_frame_);
+        if (!pcm_frontend_.push(raw)) return;
 
         if (!online_stream) online_stream = onnx_online_recognizer_->CreateStream();
-        online_stream->AcceptWaveform(onnx_online_config.feat_config.sampling_rate, floatSamples.data(),
-                                      floatSamples.size());
+        online_stream->AcceptWaveform(onnx_online_config.feat_config.sampling_rate, pcm_frontend_.data(),
+                                      pcm_frontend_.size());
+        pcm_frontend_.consume(pcm_frontend_.size());
 
         while (onnx_online_recognizer_->IsReady(online_stream.get())) {
             onnx_online_recognizer_->DecodeStream(online_stream.get());
@@ -773,7 +713,6 @@ public:
     {
         ensleep_     = false;
         awake_flage_ = false;
-        pcmdata      = buffer_create();
     }
 
     void start()
@@ -786,7 +725,6 @@ public:
     ~llm_task()
     {
         stop();
-        buffer_destroy(pcmdata);
     }
 };
 
@@ -5,9 +5,10 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <unistd.h>
 
 static struct pcm *g_play_pcm = NULL;
-static int gplayLoopExit      = 1;
 static int gcapLoopExit       = 1;
 AlsaConfig cap_config;
 AlsaConfig play_config;
@@ -67,12 +68,22 @@ void alsa_cap_start(unsigned int card, unsigned int device, float Volume, int ch
 
     int src_channels = 1;
 
+    /* mono output of one read, reused for every period */
+    short *out_short = malloc((in_frames > out_frames ? in_frames : out_frames) * sizeof(short));
+    if (!out_short) {
+        fprintf(stderr, "Unable to allocate output buffer\n");
+        free(buffer);
+        pcm_close(pcm);
+        return;
+    }
+
     if (rate != 48000) {
         src_state = src_new(SRC_SINC_FASTEST, src_channels, NULL);
         in_float  = malloc(in_frames * src_channels * sizeof(float));
         out_float = malloc(out_frames * src_channels * sizeof(float));
         if (!src_state || !in_float || !out_float) {
             fprintf(stderr, "Unable to allocate resample buffers\n");
+            free(out_short);
             free(buffer);
             if (in_float) free(in_float);
             if (out_float) free(out_float);
@@ -96,18 +107,11 @@ void alsa_cap_start(unsigned int card, unsigned int device, float Volume, int ch
             int in_channels = channel;  // 比如 4
             int16_t *in     = (int16_t *)buffer;
 
-            int16_t *ch0 = malloc(frames_read * sizeof(int16_t));
-            if (!ch0) {
-                fprintf(stderr, "Unable to allocate ch0 buffer\n");
-                break;
-            }
-
             for (unsigned int i = 0; i < frames_read; ++i) {
-                ch0[i] = in[i * in_channels + 0];
+                out_short[i] = in[i * in_channels + 0];
             }
 
-            callback((const char *)ch0, frames_read * sizeof(int16_t));
-            free(ch0);
+            callback((const char *)out_short, frames_read * sizeof(int16_t));
 
         } else {
             int in_channels = channel;  // 比如 4
@@ -131,12 +135,7 @@ void alsa_cap_start(unsigned int card, unsigned int device, float Volume, int ch
                 fprintf(stderr, "SRC error: %s\n", src_strerror(error));
                 break;
             }
-            int out_samples  = src_data.output_frames_gen;
-            short *out_short = malloc(out_samples * sizeof(short));
-            if (!out_short) {
-                fprintf(stderr, "Unable to allocate out_short buffer\n");
-                break;
-            }
+            int out_samples = src_data.output_frames_gen;
             for (int i = 0; i < out_samples; ++i) {
                 float sample = out_float[i];
                 if (sample > 1.0f) sample = 1.0f;
@@ -144,7 +143,6 @@ void alsa_cap_start(unsigned int card, unsigned int device, float Volume, int ch
                 out_short[i] = (short)(sample * 32767.0f);
             }
             callback((const char *)out_short, out_samples * sizeof(short));
-            free(out_short);
         }
     }
 
@@ -153,6 +151,7 @@ void alsa_cap_start(unsigned int card, unsigned int device, float Volume, int ch
         free(out_float);
         src_delete(src_state);
     }
+    free(out_short);
     free(buffer);
     pcm_close(pcm);
 }
@@ -167,16 +166,13 @@ int alsa_cap_status()
     return gcapLoopExit;
 }
 
-void alsa_play(unsigned int card, unsigned int device, float Volume, int channel, int rate, int bit, const void *data,
-               int size)
+int alsa_play_open(unsigned int card, unsigned int device, int channel, int rate, int bit, int period_size)
 {
-    gplayLoopExit = 0;
-
     struct pcm_config config;
     memset(&config, 0, sizeof(config));
     config.channels          = channel;
     config.rate              = rate;
-    config.period_size       = 1024;
+    config.period_size       = period_size;
     config.period_count      = 2;
     config.format            = PCM_FORMAT_S16_LE;
     config.silence_threshold = config.period_size * config.period_count;
@@ -191,26 +187,26 @@ void alsa_play(unsigned int card, unsigned int device, float Volume, int channel
         if (pcm) {
             pcm_close(pcm);
         }
-        gplayLoopExit = 2;
-        return;
-    }
-
-    int frames         = pcm_bytes_to_frames(pcm, size);
-    int written_frames = pcm_writei(pcm, data, frames);
-    if (written_frames < 0) {
-        fprintf(stderr, "PCM playback error %s\n", pcm_get_error(pcm));
+        return -1;
     }
-    printf("Played %d frames\n", written_frames);
-    pcm_close(pcm);
-    gplayLoopExit = 2;
+    g_play_pcm = pcm;
+    return 0;
 }
 
-void alsa_close_play()
+int alsa_play_write(const void *data, int frames)
 {
-    gplayLoopExit = 1;
+    if (!g_play_pcm) return -1;
+    int n = pcm_writei(g_play_pcm, data, frames);
+    if (n < 0) {
+        fprintf(stderr, "PCM playback error %s\n", pcm_get_error(g_play_pcm));
+    }
+    return n;
 }
 
-int alsa_play_status()
+void alsa_play_close()
 {
-    return gplayLoopExit;
-}
\ No newline at end of file
+    if (g_play_pcm) {
+        pcm_close(g_play_pcm);
+        g_play_pcm = NULL;
+    }
+}
@@ -8,6 +8,7 @@ typedef struct AlsaConfig
     int channel;
     int rate;
     int bit;
+    int null_sink;
 } AlsaConfig;
 
 extern AlsaConfig cap_config;
@@ -23,12 +24,12 @@ void alsa_cap_start(unsigned int card, unsigned int device, float Volume, int ch
                     AUDIOCallback callback);
 void alsa_close_cap();
 
-void alsa_play(unsigned int card, unsigned int device, float Volume, int channel, int rate, int bit, const void *data,
-             int size);
+/* persistent playback stream, used by the mixer thread */
+int alsa_play_open(unsigned int card, unsigned int device, int channel, int rate, int bit, int period_size);
+int alsa_play_write(const void *data, int frames);
+void alsa_play_close();
 
-void alsa_close_play();
 int alsa_cap_status();
-int alsa_play_status();
 
 #ifdef __cplusplus
 }
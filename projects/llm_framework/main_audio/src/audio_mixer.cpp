@@ -0,0 +1,309 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "audio_mixer.h"
+#include <unistd.h>
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+#include <climits>
+
+int null_audio_sink::write(const int16_t *, int frames)
+{
+    usleep((useconds_t)((int64_t)frames * 1000000 / rate_));
+    return frames;
+}
+
+int file_audio_sink::open()
+{
+    if (fp_) return 0;
+    fp_ = fopen(path_.c_str(), "ab");
+    return fp_ ? 0 : -1;
+}
+
+int file_audio_sink::write(const int16_t *data, int frames)
+{
+    if (!fp_) return -1;
+    return fwrite(data, sizeof(int16_t) * channels_, frames, fp_);
+}
+
+void file_audio_sink::close()
+{
+    if (fp_) {
+        fclose(fp_);
+        fp_ = NULL;
+    }
+}
+
+std::string audio_play_event_json(uint64_t play_id, const char *event, int frames, int total, int rate)
+{
+    std::ostringstream body;
+    body << "{\"play_id\":" << play_id << ",\"event\":\"" << event << "\",\"frames\":" << frames
+         << ",\"total\":" << total << ",\"rate\":" << rate << "}";
+    return body.str();
+}
+
+audio_mixer::audio_mixer(std::unique_ptr<audio_sink> sink, int rate, int period_frames)
+    : sink_(std::move(sink)),
+      rate_(rate),
+      period_frames_(period_frames),
+      stream_count_(0),
+      period_index_(0),
+      sink_open_(false),
+      xruns_(0),
+      exit_flage_(true)
+{
+    int periods_per_second   = std::max(1, rate_ / period_frames_);
+    progress_periods_        = std::max(1, periods_per_second / 10);
+    idle_close_periods_      = std::max(1, periods_per_second / 2);
+    underrun_window_periods_ = std::max(1, periods_per_second / 2);
+    mix_buf_.resize(period_frames_);
+    out_buf_.resize(period_frames_ * sink_->channels());
+    pending_events_.reserve(max_streams * 64);
+}
+
+audio_mixer::~audio_mixer()
+{
+    stop();
+    for (int i = 0; i < stream_count_; i++) {
+        audio_play_item *item;
+        if (streams_[i]->current_) delete streams_[i]->current_;
+        while (streams_[i]->queue_.pop(item)) delete item;
+    }
+}
+
+void audio_mixer::start()
+{
+    if (mixer_thread_) return;
+    exit_flage_   = false;
+    mixer_thread_ = std::make_unique<std::thread>(std::bind(&audio_mixer::mixer_loop, this));
+}
+
+void audio_mixer::stop()
+{
+    if (!mixer_thread_) return;
+    exit_flage_ = true;
+    {
+        std::lock_guard<std::mutex> lock(wait_mtx_);
+    }
+    wait_cv_.notify_one();
+    mixer_thread_->join();
+    mixer_thread_.reset();
+    if (sink_open_) {
+        sink_->close();
+        sink_open_ = false;
+    }
+}
+
+std::shared_ptr<audio_stream> audio_mixer::create_stream(const std::string &name, int priority, float gain,
+                                                         float duck_gain, size_t depth)
+{
+    auto stream = get_stream(name);
+    if (stream) {
+        stream->priority_  = priority;
+        stream->gain_      = gain;
+        stream->duck_gain_ = duck_gain;
+        return stream;
+    }
+    int index = stream_count_.load();
+    if (index >= max_streams) return nullptr;
+    streams_[index] = std::make_shared<audio_stream>(name, priority, gain, duck_gain, depth);
+    stream_count_.store(index + 1, std::memory_order_release);
+    return streams_[index];
+}
+
+std::shared_ptr<audio_stream> audio_mixer::get_stream(const std::string &name)
+{
+    int count = stream_count_.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        if (streams_[i]->name_ == name) return streams_[i];
+    }
+    return nullptr;
+}
+
+int audio_mixer::submit(const std::shared_ptr<audio_stream> &stream, uint64_t play_id,
+                        const std::shared_ptr<void> &owner, const int16_t *samples, size_t count)
+{
+    audio_play_item *item = new audio_play_item{play_id, owner, samples, count, 0, 0};
+    if (!stream->queue_.push(item)) {
+        delete item;
+        return -1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wait_mtx_);
+    }
+    wait_cv_.notify_one();
+    return 0;
+}
+
+void audio_mixer::cancel(const std::shared_ptr<audio_stream> &stream, uint64_t upto_play_id, bool keep_current)
+{
+    if (keep_current)
+        stream->flush_upto_ = upto_play_id;
+    else
+        stream->cancel_upto_ = upto_play_id;
+    {
+        std::lock_guard<std::mutex> lock(wait_mtx_);
+    }
+    wait_cv_.notify_one();
+}
+
+bool audio_mixer::busy()
+{
+    int count = stream_count_.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        if (streams_[i]->active_ || !streams_[i]->queue_.empty()) return true;
+    }
+    return false;
+}
+
+bool audio_mixer::has_pending()
+{
+    return exit_flage_ || busy();
+}
+
+void audio_mixer::push_event(uint64_t play_id, const char *event, int frames, int total)
+{
+    pending_events_.push_back(pending_event_t{play_id, event, frames, total});
+}
+
+void audio_mixer::flush_events()
+{
+    if (event_callback_) {
+        for (auto &ev : pending_events_) event_callback_(ev.play_id, ev.event, ev.frames, ev.total);
+    }
+    pending_events_.clear();
+}
+
+int audio_mixer::mix_stream(audio_stream *stream, int top_priority, int frames)
+{
+    float target = stream->gain_.load();
+    if (stream->priority_.load() < top_priority) target *= stream->duck_gain_.load();
+    float gain  = stream->mix_gain_;
+    float step  = (target - gain) / frames;
+    int written = 0;
+    while (written < frames) {
+        audio_play_item *item = stream->current_;
+        if (!item) {
+            if (!stream->queue_.pop(item)) break;
+            if (item->play_id <= std::max(stream->cancel_upto_.load(), stream->flush_upto_.load())) {
+                push_event(item->play_id, "interrupted", 0, item->count);
+                delete item;
+                continue;
+            }
+            if (stream->dry_ && (period_index_ - stream->dry_period_ <= (uint64_t)underrun_window_periods_)) {
+                stream->underruns_++;
+            }
+            stream->dry_     = false;
+            stream->current_ = item;
+            push_event(item->play_id, "started", 0, item->count);
+        }
+        int n = std::min<size_t>(frames - written, item->count - item->pos);
+        const int16_t *src = item->samples + item->pos;
+        float *dst         = mix_buf_.data() + written;
+        for (int i = 0; i < n; i++) {
+            dst[i] += src[i] * gain;
+            gain += step;
+        }
+        written += n;
+        item->pos += n;
+        if (item->pos >= item->count) {
+            push_event(item->play_id, "drained", item->count, item->count);
+            delete item;
+            stream->current_ = nullptr;
+        } else if (++item->progress_period >= progress_periods_) {
+            item->progress_period = 0;
+            push_event(item->play_id, "progress", item->pos, item->count);
+        }
+    }
+    // a ramp cut short by a dry queue resumes from where it stopped next period
+    stream->mix_gain_ = (written == frames) ? target : gain;
+    stream->played_frames_ += written;
+    if ((written < frames) && !stream->current_ && !stream->dry_) {
+        stream->dry_        = true;
+        stream->dry_period_ = period_index_;
+    }
+    return written;
+}
+
+int audio_mixer::render(int16_t *out, int frames)
+{
+    int count        = stream_count_.load(std::memory_order_acquire);
+    int top_priority = INT_MIN;
+    int audible      = 0;
+    frames           = std::min(frames, period_frames_);
+    for (int i = 0; i < count; i++) {
+        audio_stream *stream = streams_[i].get();
+        uint64_t cancel_upto = stream->cancel_upto_.load();
+        if (stream->current_ && (stream->current_->play_id <= cancel_upto)) {
+            push_event(stream->current_->play_id, "interrupted", stream->current_->pos, stream->current_->count);
+            delete stream->current_;
+            stream->current_ = nullptr;
+        }
+        stream->active_ = stream->current_ || !stream->queue_.empty();
+        if (stream->active_) top_priority = std::max(top_priority, stream->priority_.load());
+    }
+    std::fill(mix_buf_.begin(), mix_buf_.begin() + frames, 0.0f);
+    for (int i = 0; i < count; i++) {
+        audio_stream *stream = streams_[i].get();
+        if (!stream->active_) continue;
+        if (mix_stream(stream, top_priority, frames) > 0) audible++;
+        stream->active_ = stream->current_ || !stream->queue_.empty();
+    }
+    int channels = sink_->channels();
+    for (int i = 0; i < frames; i++) {
+        float v        = std::min(32767.0f, std::max(-32768.0f, mix_buf_[i]));
+        int16_t sample = (int16_t)v;
+        for (int c = 0; c < channels; c++) out[i * channels + c] = sample;
+    }
+    period_index_++;
+    return audible;
+}
+
+void audio_mixer::mixer_loop()
+{
+    int idle = 0;
+    while (!exit_flage_) {
+        int audible = render(out_buf_.data(), period_frames_);
+        if (audible) {
+            idle = 0;
+            if (!sink_open_) {
+                if (sink_->open()) {
+                    xruns_++;
+                    flush_events();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    continue;
+                }
+                sink_open_ = true;
+            }
+        } else if (sink_open_ && (++idle > idle_close_periods_)) {
+            sink_->close();
+            sink_open_ = false;
+        }
+        if (sink_open_ && (sink_->write(out_buf_.data(), period_frames_) < 0)) xruns_++;
+        flush_events();
+        if (!sink_open_) {
+            std::unique_lock<std::mutex> lock(wait_mtx_);
+            wait_cv_.wait_for(lock, std::chrono::milliseconds(100), [this] { return has_pending(); });
+        }
+    }
+}
+
+std::string audio_mixer::status()
+{
+    std::ostringstream body;
+    int count = stream_count_.load(std::memory_order_acquire);
+    body << "{\"rate\":" << rate_ << ",\"period\":" << period_frames_ << ",\"xruns\":" << xruns_ << ",\"streams\":[";
+    for (int i = 0; i < count; i++) {
+        audio_stream *stream = streams_[i].get();
+        if (i) body << ",";
+        body << "{\"stream\":\"" << stream->name_ << "\",\"priority\":" << stream->priority_
+             << ",\"gain\":" << stream->gain_ << ",\"duck\":" << stream->duck_gain_
+             << ",\"active\":" << (stream->active_ ? "true" : "false") << ",\"queued\":" << stream->queue_.size()
+             << ",\"underruns\":" << stream->underruns_ << ",\"played\":" << stream->played_frames_ << "}";
+    }
+    body << "]}";
+    return body.str();
+}
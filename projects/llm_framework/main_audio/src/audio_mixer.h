@@ -0,0 +1,239 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+
+/* Lock-free single producer / single consumer ring. Capacity is rounded up to a power of two. */
+template <typename T>
+class spsc_ring {
+private:
+    std::vector<T> buf_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+
+public:
+    explicit spsc_ring(size_t capacity) : head_(0), tail_(0)
+    {
+        size_t n = 1;
+        while (n < capacity) n <<= 1;
+        buf_.resize(n);
+        mask_ = n - 1;
+    }
+    bool push(const T &val)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) > mask_) return false;
+        buf_[head & mask_] = val;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop(T &val)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) return false;
+        val = buf_[tail & mask_];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    size_t size() const
+    {
+        // tail first: head only grows, so a tail read before it can never be ahead of it
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_acquire);
+        return std::min(head - tail, mask_ + 1);
+    }
+    bool empty() const
+    {
+        return size() == 0;
+    }
+};
+
+/* Output device of the mixer. write() is expected to block for about one period on real hardware. */
+class audio_sink {
+public:
+    virtual int open()                                   = 0;
+    virtual int write(const int16_t *data, int frames)   = 0;
+    virtual void close()                                 = 0;
+    virtual int channels() const                         = 0;
+    virtual ~audio_sink()
+    {
+    }
+};
+
+/* Discards samples but keeps real-time pacing, for hosts without audio hardware. */
+class null_audio_sink : public audio_sink {
+private:
+    int rate_;
+    int channels_;
+
+public:
+    null_audio_sink(int rate, int channels) : rate_(rate), channels_(channels)
+    {
+    }
+    int open() override
+    {
+        return 0;
+    }
+    int write(const int16_t *data, int frames) override;
+    void close() override
+    {
+    }
+    int channels() const override
+    {
+        return channels_;
+    }
+};
+
+/* Appends interleaved s16le samples to a file as fast as the mixer renders them. */
+class file_audio_sink : public audio_sink {
+private:
+    std::string path_;
+    int channels_;
+    FILE *fp_;
+
+public:
+    file_audio_sink(const std::string &path, int channels) : path_(path), channels_(channels), fp_(NULL)
+    {
+    }
+    int open() override;
+    int write(const int16_t *data, int frames) override;
+    void close() override;
+    int channels() const override
+    {
+        return channels_;
+    }
+    ~file_audio_sink()
+    {
+        close();
+    }
+};
+
+/* One queued play request. samples point into owner, mono s16 at the mixer rate. */
+typedef struct {
+    uint64_t play_id;
+    std::shared_ptr<void> owner;
+    const int16_t *samples;
+    size_t count;
+    size_t pos;
+    int progress_period;
+} audio_play_item;
+
+/* Logical playback stream. Producer side (submit / cancel) must be a single thread. */
+class audio_stream {
+public:
+    std::string name_;
+    std::atomic<int> priority_;
+    std::atomic<float> gain_;
+    std::atomic<float> duck_gain_;
+    spsc_ring<audio_play_item *> queue_;
+    std::atomic<uint64_t> cancel_upto_;
+    std::atomic<uint64_t> flush_upto_;
+    std::atomic<uint64_t> underruns_;
+    std::atomic<uint64_t> played_frames_;
+    std::atomic<bool> active_;
+
+    /* mixer thread state */
+    audio_play_item *current_;
+    float mix_gain_;
+    bool dry_;
+    uint64_t dry_period_;
+
+    audio_stream(const std::string &name, int priority, float gain, float duck_gain, size_t depth)
+        : name_(name),
+          priority_(priority),
+          gain_(gain),
+          duck_gain_(duck_gain),
+          queue_(depth),
+          cancel_upto_(0),
+          flush_upto_(0),
+          underruns_(0),
+          played_frames_(0),
+          active_(false),
+          current_(nullptr),
+          mix_gain_(gain),
+          dry_(false),
+          dry_period_(0)
+    {
+    }
+};
+
+/* Body of one playback lifecycle event as published on the audio.play.event channel. */
+std::string audio_play_event_json(uint64_t play_id, const char *event, int frames, int total, int rate);
+
+class audio_mixer {
+public:
+    typedef std::function<void(uint64_t play_id, const char *event, int frames, int total)> event_callback_fun;
+    static const int max_streams = 8;
+
+private:
+    std::unique_ptr<audio_sink> sink_;
+    int rate_;
+    int period_frames_;
+    int progress_periods_;
+    int idle_close_periods_;
+    int underrun_window_periods_;
+    std::shared_ptr<audio_stream> streams_[max_streams];
+    std::atomic<int> stream_count_;
+    std::vector<float> mix_buf_;
+    std::vector<int16_t> out_buf_;
+    uint64_t period_index_;
+    bool sink_open_;
+    std::atomic<uint64_t> xruns_;
+    std::atomic<bool> exit_flage_;
+    std::unique_ptr<std::thread> mixer_thread_;
+    std::mutex wait_mtx_;
+    std::condition_variable wait_cv_;
+    event_callback_fun event_callback_;
+
+    typedef struct {
+        uint64_t play_id;
+        const char *event;
+        int frames;
+        int total;
+    } pending_event_t;
+    std::vector<pending_event_t> pending_events_;
+
+    void push_event(uint64_t play_id, const char *event, int frames, int total);
+    bool has_pending();
+    int mix_stream(audio_stream *stream, int top_priority, int frames);
+    void mixer_loop();
+
+public:
+    audio_mixer(std::unique_ptr<audio_sink> sink, int rate, int period_frames);
+    ~audio_mixer();
+    void start();
+    void stop();
+    void set_event_callback(const event_callback_fun &callback)
+    {
+        event_callback_ = callback;
+    }
+    std::shared_ptr<audio_stream> create_stream(const std::string &name, int priority, float gain, float duck_gain,
+                                                size_t depth = 64);
+    std::shared_ptr<audio_stream> get_stream(const std::string &name);
+    int submit(const std::shared_ptr<audio_stream> &stream, uint64_t play_id, const std::shared_ptr<void> &owner,
+               const int16_t *samples, size_t count);
+    void cancel(const std::shared_ptr<audio_stream> &stream, uint64_t upto_play_id, bool keep_current = false);
+    bool busy();
+    /* Mix one period into out (sink channels interleaved). Returns the number of audible streams. */
+    int render(int16_t *out, int frames);
+    void flush_events();
+    std::string status();
+    int rate() const
+    {
+        return rate_;
+    }
+};
@@ -0,0 +1,138 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "capture_ring.h"
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+
+capture_ring::capture_ring(size_t slots, int max_samples) : max_samples_(max_samples), head_(0), waiters_(0)
+{
+    size_t n = 1;
+    while (n < slots) n <<= 1;
+    mask_  = n - 1;
+    slots_ = std::unique_ptr<capture_slot_t[]>(new capture_slot_t[n]);
+    for (size_t i = 0; i < n; i++) {
+        slots_[i].seq          = 0;
+        slots_[i].timestamp_us = 0;
+        slots_[i].count        = 0;
+    }
+    samples_.resize(n * max_samples_);
+}
+
+void capture_ring::write_period(const int16_t *data, int count, uint64_t timestamp_us)
+{
+    uint64_t index       = head_.load(std::memory_order_relaxed);
+    capture_slot_t &slot = slots_[index & mask_];
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(samples_.data() + (index & mask_) * max_samples_, data, count * sizeof(int16_t));
+    slot.timestamp_us = timestamp_us;
+    slot.count        = count;
+    slot.seq.store(index + 1, std::memory_order_release);
+    head_.store(index + 1, std::memory_order_seq_cst);
+}
+
+void capture_ring::write(const int16_t *data, int count, uint64_t timestamp_us)
+{
+    while (count > 0) {
+        int n = std::min(count, max_samples_);
+        write_period(data, n, timestamp_us);
+        data += n;
+        count -= n;
+    }
+    if (waiters_.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(wait_mtx_);
+        wait_cv_.notify_all();
+    }
+}
+
+std::shared_ptr<capture_cursor> capture_ring::attach(const std::string &name)
+{
+    auto cursor = std::make_shared<capture_cursor>(name, head_.load());
+    std::lock_guard<std::mutex> lock(cursor_mtx_);
+    cursors_.push_back(cursor);
+    return cursor;
+}
+
+void capture_ring::detach(const std::shared_ptr<capture_cursor> &cursor)
+{
+    std::lock_guard<std::mutex> lock(cursor_mtx_);
+    cursors_.remove(cursor);
+}
+
+int capture_ring::read(capture_cursor &cursor, int16_t *out, uint64_t *timestamp_us, int timeout_ms, uint64_t *seq)
+{
+    uint64_t capacity = mask_ + 1;
+    for (;;) {
+        uint64_t head = head_.load(std::memory_order_seq_cst);
+        if (cursor.next_ >= head) {
+            if (timeout_ms <= 0) return 0;
+            waiters_++;
+            {
+                std::unique_lock<std::mutex> lock(wait_mtx_);
+                wait_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                  [&] { return head_.load(std::memory_order_seq_cst) > cursor.next_; });
+            }
+            waiters_--;
+            timeout_ms = 0;
+            continue;
+        }
+        if (head - cursor.next_ > capacity) {
+            cursor.overruns_++;
+            cursor.dropped_ += head - capacity - cursor.next_;
+            cursor.next_ = head - capacity;
+        }
+        size_t pos           = cursor.next_ & mask_;
+        capture_slot_t &slot = slots_[pos];
+        uint64_t slot_seq    = slot.seq.load(std::memory_order_acquire);
+        if (slot_seq != cursor.next_ + 1) {
+            // overwritten (or being overwritten) by the producer
+            cursor.overruns_++;
+            cursor.dropped_++;
+            cursor.next_++;
+            continue;
+        }
+        int count   = std::min(slot.count, max_samples_);
+        uint64_t ts = slot.timestamp_us;
+        memcpy(out, samples_.data() + pos * max_samples_, count * sizeof(int16_t));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != slot_seq) {
+            cursor.overruns_++;
+            cursor.dropped_++;
+            cursor.next_++;
+            continue;
+        }
+        if (seq) *seq = cursor.next_;
+        cursor.next_++;
+        cursor.periods_++;
+        if (timestamp_us) *timestamp_us = ts;
+        return count;
+    }
+}
+
+void capture_ring::wake()
+{
+    std::lock_guard<std::mutex> lock(wait_mtx_);
+    wait_cv_.notify_all();
+}
+
+std::string capture_ring::status()
+{
+    std::ostringstream body;
+    body << "{\"slots\":" << mask_ + 1 << ",\"period\":" << max_samples_ << ",\"written\":" << head_.load()
+         << ",\"consumers\":[";
+    std::lock_guard<std::mutex> lock(cursor_mtx_);
+    bool first = true;
+    for (auto &cursor : cursors_) {
+        if (!first) body << ",";
+        first = false;
+        body << "{\"name\":\"" << cursor->name_ << "\",\"periods\":" << cursor->periods_
+             << ",\"overruns\":" << cursor->overruns_ << ",\"dropped\":" << cursor->dropped_ << "}";
+    }
+    body << "]}";
+    return body.str();
+}
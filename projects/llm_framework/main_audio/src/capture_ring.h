@@ -0,0 +1,76 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+/* Read position of one consumer. Counters are updated by the consumer and may be read from any thread. */
+class capture_cursor {
+public:
+    std::string name_;
+    uint64_t next_;
+    std::atomic<uint64_t> periods_;
+    std::atomic<uint64_t> overruns_;
+    std::atomic<uint64_t> dropped_;
+
+    capture_cursor(const std::string &name, uint64_t next)
+        : name_(name), next_(next), periods_(0), overruns_(0), dropped_(0)
+    {
+    }
+};
+
+/*
+ * Preallocated single producer / multi consumer ring of timestamped capture periods.
+ * The producer never blocks and never allocates: when a consumer falls more than one ring behind,
+ * the oldest periods are overwritten and the consumer skips ahead, counting an overrun.
+ * Each slot carries a sequence number that the reader checks before and after copying (seqlock),
+ * so a period torn by a concurrent overwrite is dropped instead of returned.
+ */
+class capture_ring {
+private:
+    typedef struct {
+        std::atomic<uint64_t> seq;  // period index + 1, 0 while being written
+        uint64_t timestamp_us;
+        int count;
+    } capture_slot_t;
+
+    size_t mask_;
+    int max_samples_;
+    std::unique_ptr<capture_slot_t[]> slots_;
+    std::vector<int16_t> samples_;
+    alignas(64) std::atomic<uint64_t> head_;
+    std::atomic<int> waiters_;
+    std::mutex wait_mtx_;
+    std::condition_variable wait_cv_;
+    std::mutex cursor_mtx_;
+    std::list<std::shared_ptr<capture_cursor>> cursors_;
+
+    void write_period(const int16_t *data, int count, uint64_t timestamp_us);
+
+public:
+    capture_ring(size_t slots, int max_samples);
+    /* Producer: store one period, split into several slots when larger than max_samples. */
+    void write(const int16_t *data, int count, uint64_t timestamp_us);
+    /* Consumer: attach at the live position. */
+    std::shared_ptr<capture_cursor> attach(const std::string &name);
+    void detach(const std::shared_ptr<capture_cursor> &cursor);
+    /* Copy the next period into out (at least max_samples long). Returns samples, 0 on timeout.
+       seq gets the period index, consecutive unless periods were lost. */
+    int read(capture_cursor &cursor, int16_t *out, uint64_t *timestamp_us, int timeout_ms, uint64_t *seq = NULL);
+    /* Wake blocked readers, used on shutdown. */
+    void wake();
+    std::string status();
+    int max_samples() const
+    {
+        return max_samples_;
+    }
+};
@@ -27,6 +27,10 @@ static void __sigint(int iSigNo)
 #else
 #include "alsa_audio.h"
 #endif
+#include "audio_mixer.h"
+#include "capture_ring.h"
+#include "audio_cap_frame.hpp"
+#include <cmath>
 
 #define CONFIG_AUTO_SET(obj, key)             \
     if (config_body.contains(#key))           \
@@ -36,82 +40,215 @@ static void __sigint(int iSigNo)
 
 using namespace StackFlows;
 
+class hw_audio_sink : public audio_sink {
+private:
+    int period_;
+
+public:
+    hw_audio_sink(int period) : period_(period)
+    {
+    }
+#if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
+    int open() override
+    {
+        return ax_play_open(play_config.card, play_config.device, play_config.volume, play_config.bit);
+    }
+    int write(const int16_t *data, int frames) override
+    {
+        return ax_play_write(data, frames * sizeof(int16_t));
+    }
+    void close() override
+    {
+        ax_play_close();
+    }
+    int channels() const override
+    {
+        return 1;
+    }
+#else
+    int open() override
+    {
+        return alsa_play_open(play_config.card, play_config.device, play_config.channel, play_config.rate,
+                              play_config.bit, period_);
+    }
+    int write(const int16_t *data, int frames) override
+    {
+        return alsa_play_write(data, frames);
+    }
+    void close() override
+    {
+        alsa_play_close();
+    }
+    int channels() const override
+    {
+        return play_config.channel;
+    }
+#endif
+};
+
 class llm_audio : public StackFlow {
 private:
-    enum { EVENT_LOAD_CONFIG = EVENT_EXPORT + 1, EVENT_QUEUE_PLAY };
-    std::atomic_bool audio_clear_flage_;
-    std::string sys_pcm_cap_channel = "ipc:///tmp/llm/pcm.cap.socket";
+    enum { EVENT_LOAD_CONFIG = EVENT_EXPORT + 1 };
+    std::string sys_pcm_cap_channel    = "ipc:///tmp/llm/pcm.cap.socket";
+    std::string sys_pcm_frame_channel  = "ipc:///tmp/llm/pcm.cap.frame.socket";
+    std::string sys_play_event_channel = "ipc:///tmp/llm/audio.play.event.socket";
+    std::string play_file_sink_;
+    int mixer_period_   = 0;
+    int cap_synthetic_  = 0;
+    int cap_ring_slots_ = 128;
     static llm_audio *self;
     std::unique_ptr<pzmq> pub_ctx_;
+    std::unique_ptr<pzmq> frame_pub_ctx_;
+    std::unique_ptr<pzmq> play_event_ctx_;
+    std::string play_event_ctx_url_;
+    std::mutex play_event_mtx_;
+    std::atomic<uint64_t> play_id_count_;
+    std::atomic_int play_rate_;
     std::atomic_int cap_status_;
-    std::unique_ptr<std::thread> audio_play_thread_;
     std::unique_ptr<std::thread> audio_cap_thread_;
-    std::mutex ax_play_mtx;
+    std::unique_ptr<std::thread> cap_pub_thread_;
+    std::unique_ptr<capture_ring> cap_ring_;
+    std::mutex cap_mtx_;
+    std::atomic_bool cap_exit_;
+    std::unique_ptr<audio_mixer> mixer_;
+    std::mutex mixer_mtx_;
+
+    static uint64_t cap_timestamp_us()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
 
+    // Runs on the capture thread: only copies the period into the preallocated ring.
     static void on_cap_sample(const char *data, int size)
     {
-        self->pub_ctx_->send_data((const char *)data, size);
+        self->cap_ring_->write((const int16_t *)data, size / sizeof(int16_t), cap_timestamp_us());
     }
 
-    static std::string mono_to_stereo_s16le(const std::string &mono_data)
+    // Consumer of the capture ring that forwards periods to the pcm.cap PUB socket as raw PCM and to the
+    // frame channel behind an audio_cap_frame_head_t, read once into the same buffer.
+    void cap_pub_loop()
     {
-        if (mono_data.empty()) return mono_data;
-
-        size_t sample_count = mono_data.size() / 2;
-        std::string stereo_data;
-        stereo_data.reserve(mono_data.size() * 2);
-
-        const char *src = mono_data.data();
-        for (size_t i = 0; i < sample_count; ++i) {
-            stereo_data.append(src + i * 2, 2);
-            stereo_data.append(src + i * 2, 2);
+        auto cursor = cap_ring_->attach("pub");
+        std::vector<char> frame(sizeof(audio_cap_frame_head_t) + cap_ring_->max_samples() * sizeof(int16_t));
+        audio_cap_frame_head_t head;
+        memset(&head, 0, sizeof(head));
+        head.magic     = audio_cap_frame_magic;
+        head.head_size = sizeof(audio_cap_frame_head_t);
+        head.channels  = 1;
+        head.rate      = cap_config.rate;
+        int16_t *pcm   = (int16_t *)(frame.data() + sizeof(audio_cap_frame_head_t));
+        while (!cap_exit_) {
+            int count = cap_ring_->read(*cursor, pcm, &head.timestamp_us, 100, &head.seq);
+            if (count <= 0) continue;
+            pub_ctx_->send_data((const char *)pcm, count * sizeof(int16_t));
+            head.samples       = count;
+            head.ring_overruns = cursor->overruns_;
+            head.ring_dropped  = cursor->dropped_;
+            memcpy(frame.data(), &head, sizeof(head));
+            frame_pub_ctx_->send_data(frame.data(), sizeof(head) + count * sizeof(int16_t));
         }
-        return stereo_data;
+        cap_ring_->detach(cursor);
     }
 
-    void hw_queue_play(const std::shared_ptr<void> &arg)
+    // Test source: a sine tone of cap_synthetic_ Hz at the capture rate, paced in 10 ms periods.
+    void synthetic_cap()
     {
-        if (audio_clear_flage_) {
-            return;
+        int rate = cap_config.rate > 0 ? cap_config.rate : 16000;
+        std::vector<int16_t> period(rate / 100);
+        double phase = 0, step = 2.0 * M_PI * cap_synthetic_ / rate;
+        auto next    = std::chrono::steady_clock::now();
+        while (!cap_exit_) {
+            for (auto &sample : period) {
+                sample = (int16_t)(8192.0 * sin(phase));
+                phase += step;
+                if (phase > 2.0 * M_PI) phase -= 2.0 * M_PI;
+            }
+            on_cap_sample((const char *)period.data(), period.size() * sizeof(int16_t));
+            next += std::chrono::milliseconds(10);
+            std::this_thread::sleep_until(next);
         }
+    }
 
-        std::shared_ptr<pzmq_data> originalPtr = std::static_pointer_cast<pzmq_data>(arg);
-        std::string audio_data(static_cast<const char *>(originalPtr->data()), originalPtr->size());
+    // Playback lifecycle: started -> progress* -> drained | interrupted.
+    void play_event(uint64_t play_id, const char *event, int played_frames, int total_frames)
+    {
+        std::string event_body = audio_play_event_json(play_id, event, played_frames, total_frames, play_rate_);
+        std::lock_guard<std::mutex> guard(play_event_mtx_);
+        if (!play_event_ctx_) return;
+        play_event_ctx_->send_data(event_body);
+    }
 
-        std::string final_data = audio_data;
-        if (play_config.channel == 2) {
-            final_data = mono_to_stereo_s16le(audio_data);
-        }
+    // Binds the event publisher to sys_play_event_channel, again whenever a setup moves the channel.
+    void _play_event_bind()
+    {
+        std::lock_guard<std::mutex> guard(play_event_mtx_);
+        if (play_event_ctx_ && (play_event_ctx_url_ == sys_play_event_channel)) return;
+        play_event_ctx_.reset();
+        play_event_ctx_     = std::make_unique<pzmq>(sys_play_event_channel, ZMQ_PUB);
+        play_event_ctx_url_ = sys_play_event_channel;
+        if (play_event_ctx_->get_creat_ret())
+            SLOGE("play event channel %s open failed", sys_play_event_channel.c_str());
+    }
 
-        std::lock_guard<std::mutex> guard(ax_play_mtx);
-#if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
-        ax_play(play_config.card, play_config.device, play_config.volume, play_config.channel, play_config.rate,
-                play_config.bit, audio_data.c_str(), audio_data.length());
-#else
-        alsa_play(play_config.card, play_config.device, play_config.volume, play_config.channel, play_config.rate,
-                  play_config.bit, final_data.c_str(), final_data.length());
+    void _mixer_start()
+    {
+        int period = mixer_period_ > 0 ? mixer_period_ : play_config.rate / 50;
+        std::unique_ptr<audio_sink> sink;
+        if (!play_file_sink_.empty()) {
+            sink = std::make_unique<file_audio_sink>(play_file_sink_, 1);
+        }
+#if !defined(CONFIG_AX_620E_MSP_ENABLED) && !defined(CONFIG_AX_620Q_MSP_ENABLED)
+        else if (play_config.null_sink) {
+            sink = std::make_unique<null_audio_sink>(play_config.rate, play_config.channel);
+        }
 #endif
+        else {
+            sink = std::make_unique<hw_audio_sink>(period);
+        }
+        play_rate_ = play_config.rate;
+        mixer_     = std::make_unique<audio_mixer>(std::move(sink), play_config.rate, period);
+        mixer_->create_stream("default", 1, 1.0f, 0.3f);
+        mixer_->create_stream("queue", 1, 1.0f, 0.3f);
+        mixer_->create_stream("notify", 2, 1.0f, 1.0f);
+        mixer_->set_event_callback(std::bind(&llm_audio::play_event, this, std::placeholders::_1,
+                                             std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
+        mixer_->start();
     }
 
-    void hw_play(const std::string &audio_data)
+    // Input is mono s16le at play rate. The message stays alive until the mixer has played it.
+    uint64_t _submit(const std::string &stream_name, const std::shared_ptr<void> &owner, const char *data, size_t size)
     {
-        std::string final_data = audio_data;
-
-        if (play_config.channel == 2) {
-            final_data = mono_to_stereo_s16le(audio_data);
+        std::lock_guard<std::mutex> guard(mixer_mtx_);
+        if (!mixer_) return 0;
+        auto stream = mixer_->get_stream(stream_name);
+        if (!stream) return 0;
+        uint64_t play_id = ++play_id_count_;
+        if (((uintptr_t)data) & 1) {
+            auto aligned = std::make_shared<std::vector<int16_t>>(size / sizeof(int16_t));
+            memcpy(aligned->data(), data, aligned->size() * sizeof(int16_t));
+            if (mixer_->submit(stream, play_id, aligned, aligned->data(), aligned->size())) return 0;
+        } else {
+            if (mixer_->submit(stream, play_id, owner, (const int16_t *)data, size / sizeof(int16_t))) return 0;
         }
-        std::lock_guard<std::mutex> guard(ax_play_mtx);
-#if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
-        ax_play(play_config.card, play_config.device, play_config.volume, play_config.channel, play_config.rate,
-                play_config.bit, audio_data.c_str(), audio_data.length());
-#else
-        alsa_play(play_config.card, play_config.device, play_config.volume, play_config.channel, play_config.rate,
-                  play_config.bit, final_data.c_str(), final_data.length());
-#endif
+        return play_id;
+    }
+
+    void _cancel(const std::string &stream_name, bool keep_current)
+    {
+        std::lock_guard<std::mutex> guard(mixer_mtx_);
+        if (!mixer_) return;
+        auto stream = mixer_->get_stream(stream_name);
+        if (stream) mixer_->cancel(stream, play_id_count_, keep_current);
     }
 
     void hw_cap()
     {
+        if (cap_synthetic_ > 0) {
+            synthetic_cap();
+            return;
+        }
 #if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
         ax_cap_start(cap_config.card, cap_config.device, cap_config.volume, cap_config.channel, cap_config.rate,
                      cap_config.bit, llm_audio::on_cap_sample);
@@ -121,37 +258,39 @@ private:
 #endif
     }
 
-    void _play(const std::string &audio_data)
+    uint64_t _play(const std::shared_ptr<std::string> &audio_data)
     {
-        if (audio_play_thread_) {
-            _play_stop();
-        }
-        audio_play_thread_ = std::make_unique<std::thread>(std::bind(&llm_audio::hw_play, this, audio_data));
+        _cancel("default", false);
+        return _submit("default", audio_data, audio_data->data(), audio_data->size());
     }
 
     void _play_stop()
     {
-#if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
-        ax_close_play();
-#else
-        alsa_close_play();
-#endif
-        if (audio_play_thread_) {
-            audio_play_thread_->join();
-            audio_play_thread_.reset();
-        }
+        _cancel("default", false);
+        _cancel("queue", false);
     }
 
     void _cap()
     {
         if (!audio_cap_thread_) {
-            pub_ctx_          = std::make_unique<pzmq>(sys_pcm_cap_channel, ZMQ_PUB);
+            pub_ctx_       = std::make_unique<pzmq>(sys_pcm_cap_channel, ZMQ_PUB);
+            frame_pub_ctx_ = std::make_unique<pzmq>(sys_pcm_frame_channel, ZMQ_PUB);
+            if (pub_ctx_->get_creat_ret()) SLOGE("cap channel %s open failed", sys_pcm_cap_channel.c_str());
+            if (frame_pub_ctx_->get_creat_ret())
+                SLOGE("cap frame channel %s open failed", sys_pcm_frame_channel.c_str());
+            {
+                std::lock_guard<std::mutex> guard(cap_mtx_);
+                cap_ring_ = std::make_unique<capture_ring>(cap_ring_slots_, 960);
+            }
+            cap_exit_         = false;
+            cap_pub_thread_   = std::make_unique<std::thread>(std::bind(&llm_audio::cap_pub_loop, this));
             audio_cap_thread_ = std::make_unique<std::thread>(std::bind(&llm_audio::hw_cap, this));
         }
     }
 
     void _cap_stop()
     {
+        cap_exit_ = true;
 #if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
         ax_close_cap();
 
@@ -161,19 +300,29 @@ private:
         if (audio_cap_thread_) {
             audio_cap_thread_->join();
             audio_cap_thread_.reset();
+            cap_ring_->wake();
+            cap_pub_thread_->join();
+            cap_pub_thread_.reset();
+            {
+                std::lock_guard<std::mutex> guard(cap_mtx_);
+                cap_ring_.reset();
+            }
             pub_ctx_.reset();
+            frame_pub_ctx_.reset();
         }
     }
 
 public:
     llm_audio() : StackFlow("audio")
     {
-        event_queue_.appendListener(EVENT_QUEUE_PLAY,
-                                    std::bind(&llm_audio::hw_queue_play, this, std::placeholders::_1));
         setup("", "audio.play", "{\"None\":\"None\"}");
         setup("", "audio.cap", "{\"None\":\"None\"}");
-        self        = this;
-        cap_status_ = 0;
+        self            = this;
+        cap_status_     = 0;
+        cap_exit_       = true;
+        play_id_count_  = 0;
+        _play_event_bind();
+        _mixer_start();
         rpc_ctx_->register_rpc_action("play",
                                       std::bind(&llm_audio::play, this, std::placeholders::_1, std::placeholders::_2));
         rpc_ctx_->register_rpc_action(
@@ -186,10 +335,24 @@ public:
                                                                    std::placeholders::_1, std::placeholders::_2));
         rpc_ctx_->register_rpc_action(
             "audio_status", std::bind(&llm_audio::audio_status, this, std::placeholders::_1, std::placeholders::_2));
+        rpc_ctx_->register_rpc_action(
+            "play_event", std::bind(&llm_audio::play_event_url, this, std::placeholders::_1, std::placeholders::_2));
+        rpc_ctx_->register_rpc_action(
+            "stream_setup", std::bind(&llm_audio::stream_setup, this, std::placeholders::_1, std::placeholders::_2));
+        rpc_ctx_->register_rpc_action(
+            "stream_play", std::bind(&llm_audio::stream_play, this, std::placeholders::_1, std::placeholders::_2));
+        rpc_ctx_->register_rpc_action(
+            "stream_stop", std::bind(&llm_audio::stream_stop, this, std::placeholders::_1, std::placeholders::_2));
+        rpc_ctx_->register_rpc_action(
+            "mixer_status", std::bind(&llm_audio::mixer_status, this, std::placeholders::_1, std::placeholders::_2));
         rpc_ctx_->register_rpc_action("cap",
                                       std::bind(&llm_audio::cap, this, std::placeholders::_1, std::placeholders::_2));
+        rpc_ctx_->register_rpc_action(
+            "cap_frame", std::bind(&llm_audio::cap_frame, this, std::placeholders::_1, std::placeholders::_2));
         rpc_ctx_->register_rpc_action(
             "cap_stop", std::bind(&llm_audio::cap_stop, this, std::placeholders::_1, std::placeholders::_2));
+        rpc_ctx_->register_rpc_action("cap_ring_status", std::bind(&llm_audio::cap_ring_status, this,
+                                                                   std::placeholders::_1, std::placeholders::_2));
         rpc_ctx_->register_rpc_action(
             "cap_stop_all", std::bind(&llm_audio::cap_stop_all, this, std::placeholders::_1, std::placeholders::_2));
     }
@@ -239,6 +402,46 @@ public:
         }
 
         try {
+            if (object == "audio.play") {
+                if (config_body.contains("sys_play_event_channel")) {
+                    sys_play_event_channel = config_body["sys_play_event_channel"];
+                } else if (file_body["play_param"].contains("sys_play_event_channel")) {
+                    sys_play_event_channel = file_body["play_param"]["sys_play_event_channel"];
+                }
+                _play_event_bind();
+                if (config_body.contains("mixer_period")) {
+                    mixer_period_ = config_body["mixer_period"];
+                } else if (file_body["play_param"].contains("mixer_period")) {
+                    mixer_period_ = file_body["play_param"]["mixer_period"];
+                }
+                if (config_body.contains("file_sink")) {
+                    play_file_sink_ = config_body["file_sink"];
+                } else if (file_body["play_param"].contains("file_sink")) {
+                    play_file_sink_ = file_body["play_param"]["file_sink"];
+                }
+            }
+            if (object == "audio.cap") {
+                if (config_body.contains("sys_pcm_cap_channel")) {
+                    sys_pcm_cap_channel = config_body["sys_pcm_cap_channel"];
+                } else if (file_body["cap_param"].contains("sys_pcm_cap_channel")) {
+                    sys_pcm_cap_channel = file_body["cap_param"]["sys_pcm_cap_channel"];
+                }
+                if (config_body.contains("sys_pcm_frame_channel")) {
+                    sys_pcm_frame_channel = config_body["sys_pcm_frame_channel"];
+                } else if (file_body["cap_param"].contains("sys_pcm_frame_channel")) {
+                    sys_pcm_frame_channel = file_body["cap_param"]["sys_pcm_frame_channel"];
+                }
+                if (config_body.contains("synthetic_source")) {
+                    cap_synthetic_ = config_body["synthetic_source"];
+                } else if (file_body["cap_param"].contains("synthetic_source")) {
+                    cap_synthetic_ = file_body["cap_param"]["synthetic_source"];
+                }
+                if (config_body.contains("ring_slots")) {
+                    cap_ring_slots_ = config_body["ring_slots"];
+                } else if (file_body["cap_param"].contains("ring_slots")) {
+                    cap_ring_slots_ = file_body["cap_param"]["ring_slots"];
+                }
+            }
 #if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
             AX_AUDIO_SAMPLE_CONFIG_t mode_config_;
             memset(&mode_config_, 0, sizeof(AX_AUDIO_SAMPLE_CONFIG_t));
@@ -343,11 +546,6 @@ public:
                         mode_config_.stPoolConfig.PartitionName[i] = PartitionName[i];
                     }
                 }
-                if (config_body.contains("sys_pcm_cap_channel")) {
-                    sys_pcm_cap_channel = config_body["sys_pcm_cap_channel"];
-                } else if (file_body["cap_param"].contains("sys_pcm_cap_channel")) {
-                    sys_pcm_cap_channel = file_body["cap_param"]["sys_pcm_cap_channel"];
-                }
                 memcpy(&cap_config, &mode_config_, sizeof(AX_AUDIO_SAMPLE_CONFIG_t));
             }
 
@@ -362,6 +560,7 @@ public:
                 CONFIG_AUTO_SET(file_body["play_param"], channel);
                 CONFIG_AUTO_SET(file_body["play_param"], rate);
                 CONFIG_AUTO_SET(file_body["play_param"], bit);
+                CONFIG_AUTO_SET(file_body["play_param"], null_sink);
                 memcpy(&play_config, &mode_config_, sizeof(AlsaConfig));
             }
 
@@ -381,6 +580,11 @@ public:
             send("None", "None", error_body, "audio");
             return -3;
         }
+        if ((object == "audio.play") && mixer_) {
+            std::lock_guard<std::mutex> guard(mixer_mtx_);
+            mixer_.reset();
+            _mixer_start();
+        }
         send(std::string("None"), std::string("None"), std::string(""), "audio");
         return -1;
     }
@@ -418,7 +622,7 @@ public:
                 }
             }
         if (post > 0) {
-            _play(std::string((char *)(rawdata.c_str() + post), rawdata.length() - post));
+            _play(std::make_shared<std::string>((char *)(rawdata.c_str() + post), rawdata.length() - post));
         } else {
             return std::string("wav_error");
         }
@@ -469,29 +673,91 @@ public:
 
     std::string play_raw(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
     {
-        auto _rawdata = rawdata->string();
-        if (_rawdata.empty()) return std::string("rawdata empty");
-        _play(_rawdata);
-        return LLM_NONE;
+        if (rawdata->size() == 0) return std::string("rawdata empty");
+        _cancel("default", false);
+        uint64_t play_id = _submit("default", rawdata, (const char *)rawdata->data(), rawdata->size());
+        return play_id ? std::to_string(play_id) : std::string("queue full");
     }
 
     std::string enqueue_play(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
     {
-        audio_clear_flage_ = false;
-        event_queue_.enqueue(EVENT_QUEUE_PLAY, rawdata);
+        uint64_t play_id = _submit("queue", rawdata, (const char *)rawdata->data(), rawdata->size());
+        return play_id ? std::to_string(play_id) : std::string("queue full");
+    }
+
+    // data: {"stream":"notify","priority":2,"gain":1.0,"duck":0.3}
+    std::string stream_setup(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
+    {
+        try {
+            nlohmann::json config_body = nlohmann::json::parse(rawdata->string());
+            std::string name           = config_body.at("stream");
+            std::lock_guard<std::mutex> guard(mixer_mtx_);
+            if (!mixer_) return std::string("mixer error");
+            auto stream    = mixer_->get_stream(name);
+            int priority   = stream ? stream->priority_.load() : 1;
+            float gain     = stream ? stream->gain_.load() : 1.0f;
+            float duck     = stream ? stream->duck_gain_.load() : 1.0f;
+            if (config_body.contains("priority")) priority = config_body["priority"];
+            if (config_body.contains("gain")) gain = config_body["gain"];
+            if (config_body.contains("duck")) duck = config_body["duck"];
+            if (!mixer_->create_stream(name, priority, gain, duck)) return std::string("stream full");
+        } catch (...) {
+            return std::string("stream format error");
+        }
+        return LLM_NONE;
+    }
+
+    // data: pzmq_data::set_param(stream_name, pcm)
+    std::string stream_play(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
+    {
+        if (rawdata->size() < 2) return std::string("rawdata empty");
+        const char *data   = (const char *)rawdata->data();
+        size_t name_length = (unsigned char)data[0];
+        if (rawdata->size() <= name_length + 1) return std::string("rawdata empty");
+        std::string stream_name(data + 1, name_length);
+        uint64_t play_id = _submit(stream_name, rawdata, data + name_length + 1, rawdata->size() - name_length - 1);
+        return play_id ? std::to_string(play_id) : std::string("stream error");
+    }
+
+    std::string stream_stop(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
+    {
+        _cancel(rawdata->string(), false);
         return LLM_NONE;
     }
 
+    std::string cap_ring_status(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
+    {
+        std::lock_guard<std::mutex> guard(cap_mtx_);
+        if (!cap_ring_) return LLM_NONE;
+        return cap_ring_->status();
+    }
+
+    std::string mixer_status(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
+    {
+        std::lock_guard<std::mutex> guard(mixer_mtx_);
+        if (!mixer_) return LLM_NONE;
+        return mixer_->status();
+    }
+
+    std::string play_event_url(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
+    {
+        std::lock_guard<std::mutex> guard(play_event_mtx_);
+        return play_event_ctx_url_;
+    }
+
     std::string audio_status(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
     {
         std::string _rawdata = rawdata->string();
 
+        bool play_state;
+        {
+            std::lock_guard<std::mutex> guard(mixer_mtx_);
+            play_state = !(mixer_ && mixer_->busy());
+        }
 #if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
-        auto play_state = ax_play_status();
-        auto cap_state  = ax_cap_status();
+        auto cap_state = ax_cap_status();
 #else
-        auto play_state = alsa_play_status();
-        auto cap_state  = alsa_cap_status();
+        auto cap_state = alsa_cap_status();
 #endif
 
         if (_rawdata == "play") {
@@ -514,7 +780,7 @@ public:
 
     std::string queue_play_stop(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
     {
-        audio_clear_flage_ = true;
+        _cancel("queue", true);
         return LLM_NONE;
     }
 
@@ -527,6 +793,13 @@ public:
         return sys_pcm_cap_channel;
     }
 
+    // Same as cap, returns the channel carrying audio_cap_frame_head_t + PCM per period.
+    std::string cap_frame(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
+    {
+        cap(_pzmq, rawdata);
+        return sys_pcm_frame_channel;
+    }
+
     std::string cap_stop(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &rawdata)
     {
         if (cap_status_ > 0) {
@@ -547,8 +820,10 @@ public:
 
     ~llm_audio()
     {
-        _play_stop();
+        mixer_.reset();
         _cap_stop();
+        std::lock_guard<std::mutex> guard(play_event_mtx_);
+        play_event_ctx_.reset();
     }
 };
 
@@ -38,8 +38,7 @@
         }                                                                                                        \
     }
 
-static AX_S32 gplayLoopExit = 0;
-static AX_S32 gcapLoopExit  = 0;
+static AX_S32 gcapLoopExit = 0;
 
 int BitsToFormat(unsigned int bits, AX_AUDIO_BIT_WIDTH_E *format)
 {
@@ -75,24 +74,23 @@ int IsDnVqeEnabled(const AX_AP_DNVQE_ATTR_T *pstVqeAttr)
 }
 
 AX_AUDIO_SAMPLE_CONFIG_t play_config;
-void ax_play(unsigned int card, unsigned int device, float Volume, int channel, int rate, int bit, const void *data,
-             int size)
+
+static AX_POOL gPlayPoolId              = AX_INVALID_POOLID;
+static unsigned int gPlayCard           = 0;
+static unsigned int gPlayDevice         = 0;
+static AX_AUDIO_BIT_WIDTH_E gPlayFormat = AX_AUDIO_BIT_WIDTH_16;
+
+int ax_play_open(unsigned int card, unsigned int device, float Volume, int bit)
 {
-    gplayLoopExit               = 0;
     int ret                     = 0;
     AX_AUDIO_BIT_WIDTH_E format = AX_AUDIO_BIT_WIDTH_16;
-    int num_read;
     if (BitsToFormat(bit, &format)) {
-        goto FCLOSE_MIX_FILE;
+        return -1;
     }
-    uint16_t num_channels           = channel;
-    uint32_t sample_rate            = rate;
-    long wave_data_pos              = 0;
-    AX_AUDIO_BIT_WIDTH_E mix_format = AX_AUDIO_BIT_WIDTH_16;
-    ret                             = AX_SYS_Init();
+    ret = AX_SYS_Init();
     if (AX_SUCCESS != ret) {
         printf("AX_SYS_Init failed! Error Code:0x%X\n", ret);
-        goto FCLOSE_MIX_FILE;
+        return -1;
     }
     AX_POOL PoolId = AX_POOL_CreatePool(&play_config.stPoolConfig);
     if (PoolId == AX_INVALID_POOLID) {
@@ -160,7 +158,7 @@ void ax_play(unsigned int card, unsigned int device, float Volume, int channel,
 #if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
         goto DIS_EQ;
 #endif
-        goto DIS_AO_DEVICE;
+        goto AO_DEINIT;
     }
     if (play_config.gResample) {
         ret = AX_AO_EnableResample(card, device, play_config.enInSampleRate);
@@ -174,36 +172,71 @@ void ax_play(unsigned int card, unsigned int device, float Volume, int channel,
         printf("AX_AO_SetVqeVolume failed! ret = %x \n", ret);
         goto DIS_AO_DEVICE;
     }
-    {
-        buffer_t *pcmdata = buffer_map((void *)data, size);
-        AX_AUDIO_FRAME_T stFrmInfo;
-        memset(&stFrmInfo, 0, sizeof(stFrmInfo));
-        stFrmInfo.enBitwidth  = format;
-        stFrmInfo.enSoundmode = play_config.stAttr.enSoundmode;
-        AX_U64 BlkSize        = 960;
-        while (!gplayLoopExit) {
-            stFrmInfo.u32BlkId   = AX_POOL_GetBlock(PoolId, BlkSize, NULL);
-            stFrmInfo.u64VirAddr = AX_POOL_GetBlockVirAddr(stFrmInfo.u32BlkId);
-            stFrmInfo.u32Len     = buffer_read_char(pcmdata, stFrmInfo.u64VirAddr, BlkSize);
-            if (stFrmInfo.u32Len == 0) {
-                AX_POOL_ReleaseBlock(stFrmInfo.u32BlkId);
-                break;
-            }
+    gPlayPoolId = PoolId;
+    gPlayCard   = card;
+    gPlayDevice = device;
+    gPlayFormat = format;
+    return 0;
+
+DIS_AO_DEVICE:
+    AX_AO_DisableDev(card, device);
+#if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
+DIS_EQ:
+    if (play_config.stEqAttr.bEnable) AX_ACODEC_TxEqDisable(card);
+DIS_LPF:
+    if (play_config.stLpfAttr.bEnable) AX_ACODEC_TxLpfDisable(card);
+DIS_HPF:
+    if (play_config.stHpfAttr.bEnable) AX_ACODEC_TxHpfDisable(card);
+#endif
+AO_DEINIT:
+    AX_AO_DeInit();
+DESTROY_POOL:
+    AX_POOL_DestroyPool(PoolId);
+FREE_SYS:
+    AX_SYS_Deinit();
+    return -1;
+}
+
+int ax_play_write(const void *data, int size)
+{
+    int ret;
+    if (gPlayPoolId == AX_INVALID_POOLID) return -1;
+    AX_AUDIO_FRAME_T stFrmInfo;
+    memset(&stFrmInfo, 0, sizeof(stFrmInfo));
+    stFrmInfo.enBitwidth  = gPlayFormat;
+    stFrmInfo.enSoundmode = play_config.stAttr.enSoundmode;
+    stFrmInfo.u32BlkId    = AX_POOL_GetBlock(gPlayPoolId, size, NULL);
+    if (stFrmInfo.u32BlkId == AX_INVALID_BLOCKID) {
+        printf("AX_POOL_GetBlock failed! size: %d\n", size);
+        return -1;
+    }
+    stFrmInfo.u64VirAddr = AX_POOL_GetBlockVirAddr(stFrmInfo.u32BlkId);
+    if (!stFrmInfo.u64VirAddr) {
+        printf("AX_POOL_GetBlockVirAddr failed!\n");
+        AX_POOL_ReleaseBlock(stFrmInfo.u32BlkId);
+        return -1;
+    }
+    memcpy(stFrmInfo.u64VirAddr, data, size);
+    stFrmInfo.u32Len = size;
 #if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
-            ret = AX_AO_SendFrame(card, device, &stFrmInfo, NULL, 0.f, -1);
+    ret = AX_AO_SendFrame(gPlayCard, gPlayDevice, &stFrmInfo, NULL, 0.f, -1);
 #else
-            ret = AX_AO_SendFrame(card, device, &stFrmInfo, -1);
+    ret = AX_AO_SendFrame(gPlayCard, gPlayDevice, &stFrmInfo, -1);
 #endif
-            if (ret != AX_SUCCESS) {
-                AX_POOL_ReleaseBlock(stFrmInfo.u32BlkId);
-                printf("AX_AO_SendFrame error, ret: %x\n", ret);
-                break;
-            }
-            AX_POOL_ReleaseBlock(stFrmInfo.u32BlkId);
-        }
-        buffer_destroy(pcmdata);
+    AX_POOL_ReleaseBlock(stFrmInfo.u32BlkId);
+    if (ret != AX_SUCCESS) {
+        printf("AX_AO_SendFrame error, ret: %x\n", ret);
+        return -1;
     }
+    return size;
+}
 
+void ax_play_close()
+{
+    int ret;
+    unsigned int card   = gPlayCard;
+    unsigned int device = gPlayDevice;
+    if (gPlayPoolId == AX_INVALID_POOLID) return;
     if (play_config.gInstant) {
         ret = AX_AO_ClearDevBuf(card, device);
         if (ret) {
@@ -231,21 +264,18 @@ void ax_play(unsigned int card, unsigned int device, float Volume, int channel,
     }
     printf("ao success.\n");
 #if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
-DIS_EQ:
     if (play_config.stEqAttr.bEnable) {
         ret = AX_ACODEC_TxEqDisable(card);
         if (ret) {
             printf("AX_ACODEC_TxEqDisable failed! ret= %x\n", ret);
         }
     }
-DIS_LPF:
     if (play_config.stLpfAttr.bEnable) {
         ret = AX_ACODEC_TxLpfDisable(card);
         if (ret) {
             printf("AX_ACODEC_TxLpfDisable failed! ret= %x\n", ret);
         }
     }
-DIS_HPF:
     if (play_config.stHpfAttr.bEnable) {
         ret = AX_ACODEC_TxHpfDisable(card);
         if (ret) {
@@ -253,43 +283,23 @@ DIS_HPF:
         }
     }
 #endif
-DIS_AO_DEVICE:
     ret = AX_AO_DisableDev(card, device);
     if (ret) {
         printf("AX_AO_DisableDev failed! ret= %x\n", ret);
-        goto FREE_SYS;
     }
-AO_DEINIT:
     ret = AX_AO_DeInit();
     if (AX_SUCCESS != ret) {
         printf("AX_AO_DeInit failed! Error Code:0x%X\n", ret);
     }
-
-DESTROY_POOL:
-    ret = AX_POOL_DestroyPool(PoolId);
+    ret = AX_POOL_DestroyPool(gPlayPoolId);
     if (AX_SUCCESS != ret) {
         printf("AX_POOL_DestroyPool failed! Error Code:0x%X\n", ret);
     }
-
-FREE_SYS:
     ret = AX_SYS_Deinit();
     if (AX_SUCCESS != ret) {
         printf("AX_SYS_Deinit failed! Error Code:0x%X\n", ret);
-        ret = -1;
     }
-    gplayLoopExit = 2;
-FCLOSE_MIX_FILE:
-    return;
-}
-
-void ax_close_play()
-{
-    gplayLoopExit = 1;
-}
-
-int ax_play_status()
-{
-    return gplayLoopExit;
+    gPlayPoolId = AX_INVALID_POOLID;
 }
 
 AX_AUDIO_SAMPLE_CONFIG_t cap_config;
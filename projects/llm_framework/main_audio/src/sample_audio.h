@@ -51,15 +51,13 @@ extern AX_AUDIO_SAMPLE_CONFIG_t play_config;
 extern "C" {
 #endif
 typedef void (*AUDIOCallback)(const char *data, int size);
-void ax_play(unsigned int card, unsigned int device, float Volume, int channel, int rate, int bit, const void *data,
-             int size);
-void ax_set_play(unsigned int card, unsigned int device, float Volume, int channel, int rate, int bit);
-void ax_play_continue(const void *data, int size);
-void ax_close_play();
+/* persistent playback stream, used by the mixer thread */
+int ax_play_open(unsigned int card, unsigned int device, float Volume, int bit);
+int ax_play_write(const void *data, int size);
+void ax_play_close();
 void ax_cap_start(unsigned int card, unsigned int device, float Volume, int channel, int rate, int bit,
                   AUDIOCallback callback);
 void ax_close_cap();
-int ax_play_status();
 int ax_cap_status();
 
 #ifdef __cplusplus
@@ -0,0 +1,224 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "audio_mixer.h"
+#include <cmath>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+typedef struct {
+    uint64_t play_id;
+    std::string event;
+    int frames;
+    int total;
+} event_t;
+
+static std::shared_ptr<std::vector<int16_t>> make_pcm(size_t count, int16_t value)
+{
+    return std::make_shared<std::vector<int16_t>>(count, value);
+}
+
+static int submit(audio_mixer &mixer, const std::shared_ptr<audio_stream> &stream, uint64_t play_id,
+                  const std::shared_ptr<std::vector<int16_t>> &pcm)
+{
+    return mixer.submit(stream, play_id, pcm, pcm->data(), pcm->size());
+}
+
+static void test_spsc_ring()
+{
+    spsc_ring<int> ring(5);
+    int val;
+    for (int i = 0; i < 8; i++) CHECK(ring.push(i));
+    CHECK(!ring.push(8));
+    CHECK(ring.size() == 8);
+    for (int i = 0; i < 8; i++) CHECK(ring.pop(val) && (val == i));
+    CHECK(!ring.pop(val));
+    CHECK(ring.empty());
+
+    // size() is read from a third thread while the ring is in use, it must stay within capacity
+    spsc_ring<int> shared(64);
+    std::atomic<bool> done(false);
+    std::atomic<size_t> max_size(0);
+    std::thread producer([&] {
+        for (int i = 0; i < 200000;) {
+            if (shared.push(i)) i++;
+        }
+    });
+    std::thread consumer([&] {
+        int v, expect = 0;
+        while (expect < 200000) {
+            if (shared.pop(v)) {
+                if (v != expect) failures++;
+                expect++;
+            }
+        }
+        done = true;
+    });
+    while (!done) {
+        size_t n = shared.size();
+        if (n > max_size) max_size = n;
+    }
+    producer.join();
+    consumer.join();
+    CHECK(max_size <= 64);
+}
+
+static void test_render_events()
+{
+    audio_mixer mixer(std::make_unique<null_audio_sink>(16000, 2), 16000, 160);
+    std::vector<event_t> events;
+    mixer.set_event_callback([&](uint64_t play_id, const char *event, int frames, int total) {
+        events.push_back(event_t{play_id, event, frames, total});
+    });
+    auto stream = mixer.create_stream("default", 1, 1.0f, 0.3f);
+    CHECK(mixer.get_stream("default") == stream);
+    auto pcm = make_pcm(3200, 1000);
+    CHECK(submit(mixer, stream, 1, pcm) == 0);
+    CHECK(mixer.busy());
+
+    std::vector<int16_t> out(160 * 2);
+    int periods = 0;
+    size_t rendered = 0;
+    while (mixer.busy() && (periods < 100)) {
+        CHECK(mixer.render(out.data(), 160) == 1 || !mixer.busy());
+        for (size_t i = 0; (i < out.size()) && (rendered < 3200 * 2); i++, rendered++) CHECK(out[i] == 1000);
+        mixer.flush_events();
+        periods++;
+    }
+    CHECK(periods == 20);
+    CHECK(!mixer.busy());
+    CHECK(stream->played_frames_ == 3200);
+    CHECK(events.size() >= 3);
+    CHECK(events.front().event == "started");
+    CHECK(events.back().event == "drained");
+    CHECK(events.back().frames == 3200 && events.back().total == 3200);
+    for (size_t i = 1; i + 1 < events.size(); i++) CHECK(events[i].event == "progress");
+
+    // the samples are no longer referenced once drained
+    CHECK(pcm.use_count() == 1);
+}
+
+static void test_ducking()
+{
+    audio_mixer mixer(std::make_unique<null_audio_sink>(16000, 1), 16000, 160);
+    auto music  = mixer.create_stream("default", 1, 1.0f, 0.25f);
+    auto notify = mixer.create_stream("notify", 2, 1.0f, 1.0f);
+    CHECK(submit(mixer, music, 1, make_pcm(1600, 1000)) == 0);
+    CHECK(submit(mixer, notify, 2, make_pcm(1600, 2000)) == 0);
+    std::vector<int16_t> out(160);
+    // first period ramps the ducked stream down, after it the mix is steady
+    CHECK(mixer.render(out.data(), 160) == 2);
+    CHECK(out[0] > 2900 && out[159] < 2300);
+    CHECK(mixer.render(out.data(), 160) == 2);
+    for (auto v : out) CHECK(v == 2250);
+    CHECK(std::fabs(music->mix_gain_ - 0.25f) < 1e-6f);
+    CHECK(std::fabs(notify->mix_gain_ - 1.0f) < 1e-6f);
+}
+
+static void test_ramp_cut_short()
+{
+    audio_mixer mixer(std::make_unique<null_audio_sink>(16000, 1), 16000, 160);
+    auto stream = mixer.create_stream("default", 1, 1.0f, 1.0f);
+    std::vector<int16_t> out(160);
+    stream->gain_ = 0.0f;
+    // only half a period is queued: the ramp to 0 stops half way
+    CHECK(submit(mixer, stream, 1, make_pcm(80, 1000)) == 0);
+    mixer.render(out.data(), 160);
+    CHECK(std::fabs(stream->mix_gain_ - 0.5f) < 0.01f);
+    CHECK(out[79] > 490 && out[79] < 510);
+    CHECK(out[80] == 0);
+    // and resumes from there instead of jumping
+    CHECK(submit(mixer, stream, 2, make_pcm(160, 1000)) == 0);
+    mixer.render(out.data(), 160);
+    CHECK(out[0] > 490 && out[0] < 510);
+    CHECK(out[159] < 10);
+    CHECK(std::fabs(stream->mix_gain_) < 1e-6f);
+}
+
+static void test_cancel()
+{
+    audio_mixer mixer(std::make_unique<null_audio_sink>(16000, 1), 16000, 160);
+    std::vector<event_t> events;
+    mixer.set_event_callback([&](uint64_t play_id, const char *event, int frames, int total) {
+        events.push_back(event_t{play_id, event, frames, total});
+    });
+    auto stream = mixer.create_stream("queue", 1, 1.0f, 1.0f);
+    std::vector<int16_t> out(160);
+    CHECK(submit(mixer, stream, 1, make_pcm(1600, 1000)) == 0);
+    CHECK(submit(mixer, stream, 2, make_pcm(1600, 1000)) == 0);
+    CHECK(submit(mixer, stream, 3, make_pcm(160, 1000)) == 0);
+    mixer.render(out.data(), 160);
+    // keep_current: 1 plays to the end, 2 is dropped
+    mixer.cancel(stream, 2, true);
+    while (mixer.busy()) mixer.render(out.data(), 160);
+    mixer.flush_events();
+    std::vector<std::string> expect = {"1:started", "1:drained", "2:interrupted", "3:started", "3:drained"};
+    std::vector<std::string> got;
+    for (auto &ev : events) {
+        if (ev.event != "progress") got.push_back(std::to_string(ev.play_id) + ":" + ev.event);
+    }
+    CHECK(got == expect);
+
+    // without keep_current the playing item stops at the next period
+    events.clear();
+    CHECK(submit(mixer, stream, 4, make_pcm(1600, 1000)) == 0);
+    mixer.render(out.data(), 160);
+    mixer.cancel(stream, 4);
+    mixer.render(out.data(), 160);
+    mixer.flush_events();
+    CHECK(!mixer.busy());
+    CHECK(events.back().event == "interrupted" && events.back().frames == 160);
+}
+
+static void test_mixer_thread()
+{
+    audio_mixer mixer(std::make_unique<null_audio_sink>(16000, 1), 16000, 160);
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::string last;
+    mixer.set_event_callback([&](uint64_t play_id, const char *event, int, int) {
+        std::lock_guard<std::mutex> lock(mtx);
+        last = std::to_string(play_id) + ":" + event;
+        cv.notify_all();
+    });
+    auto stream = mixer.create_stream("default", 1, 1.0f, 1.0f);
+    mixer.start();
+    auto begin = std::chrono::steady_clock::now();
+    CHECK(submit(mixer, stream, 7, make_pcm(1600, 1000)) == 0);
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        CHECK(cv.wait_for(lock, std::chrono::seconds(2), [&] { return last == "7:drained"; }));
+    }
+    // the null sink keeps real time: 100 ms of audio
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    CHECK(ms >= 90);
+    mixer.stop();
+    CHECK(mixer.status().find("\"played\":1600") != std::string::npos);
+}
+
+int main()
+{
+    test_spsc_ring();
+    test_render_events();
+    test_ducking();
+    test_ramp_cut_short();
+    test_cancel();
+    test_mixer_thread();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_audio_mixer: ok\n");
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "capture_ring.h"
+#include "audio_cap_frame.hpp"
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace StackFlows;
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+static std::vector<int16_t> make_period(int count, int index)
+{
+    std::vector<int16_t> period(count);
+    for (int i = 0; i < count; i++) period[i] = (int16_t)(index * 100 + i);
+    return period;
+}
+
+static void test_read_write()
+{
+    capture_ring ring(8, 160);
+    auto cursor = ring.attach("asr");
+    std::vector<int16_t> out(160);
+    uint64_t ts = 0, seq = 0;
+    CHECK(ring.read(*cursor, out.data(), &ts, 0, &seq) == 0);
+    for (int i = 0; i < 4; i++) {
+        auto period = make_period(160, i);
+        ring.write(period.data(), period.size(), 1000 + i);
+    }
+    for (int i = 0; i < 4; i++) {
+        CHECK(ring.read(*cursor, out.data(), &ts, 0, &seq) == 160);
+        CHECK(ts == (uint64_t)(1000 + i));
+        CHECK(seq == (uint64_t)i);
+        CHECK(out == make_period(160, i));
+    }
+    // a period larger than a slot is split and keeps its timestamp
+    auto big = make_period(400, 9);
+    ring.write(big.data(), big.size(), 2000);
+    int total = 0;
+    for (int n; (n = ring.read(*cursor, out.data(), &ts, 0, &seq)) > 0; total += n) {
+        CHECK(ts == 2000);
+        CHECK(memcmp(out.data(), big.data() + total, n * sizeof(int16_t)) == 0);
+    }
+    CHECK(total == 400);
+    CHECK(seq == 6);
+    CHECK(cursor->periods_ == 7 && cursor->overruns_ == 0 && cursor->dropped_ == 0);
+}
+
+static void test_slow_consumer()
+{
+    capture_ring ring(8, 160);
+    auto fast = ring.attach("kws");
+    auto slow = ring.attach("vad");
+    std::vector<int16_t> out(160);
+    uint64_t seq = 0;
+    for (int i = 0; i < 20; i++) {
+        auto period = make_period(160, i);
+        ring.write(period.data(), period.size(), i);
+        CHECK(ring.read(*fast, out.data(), NULL, 0, &seq) == 160 && seq == (uint64_t)i);
+    }
+    // 20 written into 8 slots: the slow reader resumes at the oldest one still there
+    CHECK(ring.read(*slow, out.data(), NULL, 0, &seq) == 160);
+    CHECK(seq == 12);
+    CHECK(out == make_period(160, 12));
+    CHECK(slow->overruns_ == 1 && slow->dropped_ == 12);
+    CHECK(fast->overruns_ == 0 && fast->dropped_ == 0);
+    std::string status = ring.status();
+    CHECK(status.find("\"name\":\"vad\",\"periods\":1,\"overruns\":1,\"dropped\":12") != std::string::npos);
+    CHECK(status.find("\"name\":\"kws\",\"periods\":20,\"overruns\":0") != std::string::npos);
+    ring.detach(slow);
+    CHECK(ring.status().find("vad") == std::string::npos);
+}
+
+static void test_blocking_read()
+{
+    capture_ring ring(16, 160);
+    auto cursor = ring.attach("pub");
+    std::thread producer([&] {
+        for (int i = 0; i < 50; i++) {
+            auto period = make_period(160, i);
+            ring.write(period.data(), period.size(), i);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    std::vector<int16_t> out(160);
+    uint64_t seq = 0, ts = 0;
+    int periods  = 0;
+    while (periods < 50) {
+        if (ring.read(*cursor, out.data(), &ts, 1000, &seq) <= 0) break;
+        CHECK(seq == ts);
+        CHECK(out == make_period(160, (int)seq));
+        periods++;
+    }
+    producer.join();
+    CHECK(periods + cursor->dropped_ == 50);
+}
+
+// what the audio unit publishes on the frame channel, and what a consumer in another process reads back
+static std::vector<char> make_frame(capture_ring &ring, capture_cursor &cursor)
+{
+    std::vector<char> frame(sizeof(audio_cap_frame_head_t) + ring.max_samples() * sizeof(int16_t));
+    audio_cap_frame_head_t head;
+    memset(&head, 0, sizeof(head));
+    head.magic     = audio_cap_frame_magic;
+    head.head_size = sizeof(head);
+    head.channels  = 1;
+    head.rate      = 16000;
+    int count      = ring.read(cursor, (int16_t *)(frame.data() + sizeof(head)), &head.timestamp_us, 0, &head.seq);
+    if (count <= 0) return std::vector<char>();
+    head.samples       = count;
+    head.ring_overruns = cursor.overruns_;
+    head.ring_dropped  = cursor.dropped_;
+    memcpy(frame.data(), &head, sizeof(head));
+    frame.resize(sizeof(head) + count * sizeof(int16_t));
+    return frame;
+}
+
+static void test_frame_channel()
+{
+    capture_ring ring(4, 160);
+    auto cursor = ring.attach("pub");
+    audio_cap_frame_reader reader;
+    audio_cap_frame_head_t head;
+    std::vector<std::vector<char>> sent;
+    for (int i = 0; i < 10; i++) {
+        auto period = make_period(160, i);
+        ring.write(period.data(), period.size(), 5000 + i);
+        // the publisher falls behind after period 3 and loses 4 and 5 in the ring
+        if ((i < 4) || (i >= 9)) {
+            auto frame = make_frame(ring, *cursor);
+            while (!frame.empty()) {
+                sent.push_back(frame);
+                frame = make_frame(ring, *cursor);
+            }
+        }
+    }
+    // the transport loses period 9
+    sent.pop_back();
+    for (auto &frame : sent) {
+        const int16_t *pcm = reader.parse(frame.data(), frame.size(), &head);
+        CHECK(pcm != NULL);
+        if (!pcm) continue;
+        CHECK(head.samples == 160);
+        CHECK(head.timestamp_us == 5000 + head.seq);
+        CHECK(memcmp(pcm, make_period(160, (int)head.seq).data(), 160 * sizeof(int16_t)) == 0);
+    }
+    CHECK(head.seq == 8);
+    CHECK(head.ring_overruns == 1 && head.ring_dropped == 2);
+    CHECK(reader.periods_ == 7);
+    CHECK(reader.overruns_ == 1 && reader.dropped_ == 2);
+
+    // sent.back() is period 8, 9 never arrived
+    ring.write(make_period(160, 10).data(), 160, 5010);
+    auto frame = make_frame(ring, *cursor);
+    CHECK(reader.parse(frame.data(), frame.size(), &head) != NULL);
+    CHECK(reader.overruns_ == 2 && reader.dropped_ == 3);
+
+    // truncated or foreign messages are rejected and do not touch the counters
+    CHECK(reader.parse(frame.data(), frame.size() - 2, &head) == NULL);
+    CHECK(reader.parse(frame.data(), 10, &head) == NULL);
+    frame[0] = 'x';
+    CHECK(reader.parse(frame.data(), frame.size(), &head) == NULL);
+    CHECK(reader.periods_ == 8);
+}
+
+int main()
+{
+    test_read_write();
+    test_slow_consumer();
+    test_blocking_read();
+    test_frame_channel();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_capture_ring: ok\n");
+    return 0;
+}
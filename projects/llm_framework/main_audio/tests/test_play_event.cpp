@@ -0,0 +1,104 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * Plays through the mixer on a null sink, publishes the lifecycle events the way llm_audio does and waits for
+ * completion with audio_play_monitor, resolving the channel through a "play_event" rpc like a real unit.
+ */
+#include "audio_mixer.h"
+#include "audio_play_monitor.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace StackFlows;
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+int main()
+{
+    const std::string unit_name = "test_audio_" + std::to_string(getpid());
+    const std::string event_url = "ipc:///tmp/" + unit_name + ".play.event.socket";
+    const int rate              = 16000;
+
+    pzmq rpc(unit_name);
+    rpc.register_rpc_action("play_event", [&](pzmq *, const std::shared_ptr<pzmq_data> &) { return event_url; });
+    pzmq pub(event_url, ZMQ_PUB);
+
+    audio_mixer mixer(std::make_unique<null_audio_sink>(rate, 1), rate, rate / 50);
+    std::mutex pub_mtx;
+    mixer.set_event_callback([&](uint64_t play_id, const char *event, int frames, int total) {
+        std::lock_guard<std::mutex> guard(pub_mtx);
+        pub.send_data(audio_play_event_json(play_id, event, frames, total, rate));
+    });
+    auto stream = mixer.create_stream("default", 1, 1.0f, 0.3f);
+    mixer.start();
+
+    audio_play_monitor monitor(unit_name);
+    CHECK(monitor.is_ready());
+    std::vector<std::string> events;
+    std::mutex events_mtx;
+    monitor.set_event_callback([&](uint64_t play_id, const std::string &event, int, int) {
+        std::lock_guard<std::mutex> guard(events_mtx);
+        events.push_back(std::to_string(play_id) + ":" + event);
+    });
+    // let the subscription reach the publisher before anything is played
+    usleep(200 * 1000);
+
+    // 300 ms of audio: wait() returns only once it has been played out
+    auto pcm   = std::make_shared<std::vector<int16_t>>(rate * 3 / 10, 1000);
+    auto begin = std::chrono::steady_clock::now();
+    CHECK(mixer.submit(stream, 1, pcm, pcm->data(), pcm->size()) == 0);
+    CHECK(monitor.wait(1, 2000) == "drained");
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    CHECK(ms >= 280);
+    CHECK(!mixer.busy());
+
+    // a stopped request completes as interrupted
+    auto longer = std::make_shared<std::vector<int16_t>>(rate * 2, 1000);
+    CHECK(mixer.submit(stream, 2, longer, longer->data(), longer->size()) == 0);
+    usleep(100 * 1000);
+    mixer.cancel(stream, 2);
+    CHECK(monitor.wait(2, 1000) == "interrupted");
+
+    // malformed or foreign events on the channel are skipped without taking the subscriber down
+    {
+        std::lock_guard<std::mutex> guard(pub_mtx);
+        pub.send_data("not json at all");
+        pub.send_data("{\"play_id\":\"abc\",\"event\":\"drained\"}");
+        pub.send_data("{\"play_id\":-5,\"event\":\"drained\"}");
+        pub.send_data("{\"play_id\":99999999999999999999999,\"event\":\"drained\"}");
+        pub.send_data("{\"play_id\":4,\"event\":\"drained\",\"frames\":\"lots\",\"total\":1e99}");
+    }
+    CHECK(monitor.wait(4, 1000) == "drained");
+
+    // unknown ids time out with an empty result
+    CHECK(monitor.wait(3, 100).empty());
+    mixer.stop();
+
+    {
+        std::lock_guard<std::mutex> guard(events_mtx);
+        CHECK(!events.empty() && (events.front() == "1:started"));
+        CHECK(std::find(events.begin(), events.end(), "1:progress") != events.end());
+        CHECK(std::find(events.begin(), events.end(), "1:drained") != events.end());
+        CHECK(std::find(events.begin(), events.end(), "2:interrupted") != events.end());
+        CHECK(events.back() == "4:drained");
+    }
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_play_event: ok\n");
+    return 0;
+}
@@ -9,19 +9,52 @@
 #include <stdint.h>
 #include <pthread.h>
 #define CONFIG_CAPTURE_BUF_CNT 10
+#define CONFIG_CAPTURE_BUF_MAX 32
 #define CONFIG_DEVNAME_LEN     32
 
 #if __cplusplus
 extern "C" {
 #endif
+struct camera_t;
+struct camera_frame_t;
 typedef void (*vcamera_frame_get)(void* pdata, uint32_t width, uint32_t height, uint32_t length, void* ctx);
+/**
+ * Frame handle callback: the frame holds one reference for the duration of the call, take another with
+ * camera_frame_ref() to keep the buffer past it. The buffer goes back to the driver on the last unref.
+ */
+typedef void (*vcamera_frame_ref_get)(struct camera_frame_t* frame, void* ctx);
 typedef enum { CAMERA_STATE_CLOSE, CAMERA_SATTE_OPEN, CAMERA_SATTE_CAP, CAMERA_STATE_ERR } CAMERA_STATE_t;
 
 typedef struct {
     void* pstart;
     int length;
+    int dmabuf_fd; /* exported DMABUF, -1 if not exported */
 } CAMERA_Buffer_t;
 
+typedef struct camera_frame_t {
+    struct camera_t* camera_;
+    void* data_;
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t length_; /* bytes used */
+    int index_;
+    int dmabuf_fd_;
+    uint32_t sequence_;
+    uint64_t timestamp_us_; /* driver timestamp, CLOCK_MONOTONIC on most drivers */
+    int refcount_;
+} camera_frame_t;
+
+typedef struct {
+    uint64_t captured_;
+    uint64_t dropped_; /* sequence gaps, frames the driver dropped, usually because no buffer was free */
+    int buffers_in_use_;
+} CAMERA_Stats_t;
+
+typedef struct {
+    int buffer_cnt;
+    int export_dmabuf;
+} v4l2_config_t;
+
 typedef struct camera_t {
     char dev_name_[CONFIG_DEVNAME_LEN];
     int dev_fd_;
@@ -31,9 +64,14 @@ typedef struct camera_t {
     uint32_t width_;
     uint32_t height_;
     CAMERA_Buffer_t* pcamera_buffer_;
+    camera_frame_t* pcamera_frame_;
     vcamera_frame_get pcallback_;
+    vcamera_frame_ref_get pframe_callback_;
+    int export_dmabuf_;
+    CAMERA_Stats_t stats_;
     int state_; /* 0 Not open, 1 Turn on the camera, 2 Start capturing,
                             3 Error */
+    int refs_;  /* one for the owner plus one per frame buffer handed out, see camera_close() */
     pthread_t capture_thread_id_;
     void* ctx_;
     void* custom_config_;
@@ -42,6 +80,16 @@ typedef struct camera_t {
      * Return value: 0 for success, -1 for failure
      */
     int (*camera_capture_callback_set)(struct camera_t*, vcamera_frame_get);
+    /**
+     * Set frame handle callback, used instead of the capture callback when set
+     * Return value: 0 for success, -1 for failure. NULL when the camera does not support frame handles
+     */
+    int (*camera_frame_callback_set)(struct camera_t*, vcamera_frame_ref_get);
+    /**
+     * Give a frame buffer back to the driver, called by camera_frame_unref()
+     */
+    void (*camera_frame_release)(struct camera_t*, camera_frame_t*);
+    void (*camera_get_stats)(struct camera_t*, CAMERA_Stats_t*);
     /**
      * Start capturing
      * Return value: 0 for success, -1 for failure
@@ -55,9 +103,22 @@ typedef struct camera_t {
     void (*camera_set_ctx)(struct camera_t*, void*);
 } camera_t;
 
+static inline void camera_frame_ref(camera_frame_t* frame)
+{
+    __atomic_add_fetch(&frame->refcount_, 1, __ATOMIC_RELAXED);
+}
+
+static inline void camera_frame_unref(camera_frame_t* frame)
+{
+    if (__atomic_sub_fetch(&frame->refcount_, 1, __ATOMIC_ACQ_REL) == 0) {
+        frame->camera_->camera_frame_release(frame->camera_, frame);
+    }
+}
+
 /**
  * Open the camera
  * @pdev_name Device node
+ * @config v4l2_config_t or NULL for the defaults
  * Return value: NULL for failure
  */
 camera_t* camera_open(const char* pdev_name, int width, int height, int fps, void* config);
@@ -70,7 +131,8 @@ camera_t* camera_open(const char* pdev_name, int width, int height, int fps, voi
 int camera_open_from(camera_t* camera);
 
 /**
- * Close the camera
+ * Close the camera: streaming stops at once, frame handles still held stay valid and the buffers are
+ * unmapped, and a camera from camera_open() freed, with the last camera_frame_unref()
  * Return value: 0 for success, -1 for failure
  */
 int camera_close(camera_t* camera);
@@ -0,0 +1,314 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace camera_fanout {
+
+typedef std::shared_ptr<const std::vector<uint8_t>> buffer_ptr;
+
+/**
+ * One captured YUYV frame and the representations derived from it.
+ * The pixels are either a pooled copy or, for zero-copy capture, the driver buffer itself kept alive by owner.
+ * Every representation is computed on first use by whichever consumer asks for it and then shared by
+ * reference with all the others, so a frame is converted and encoded at most once per format.
+ */
+class frame {
+public:
+    frame(int width, int height) : width_(width), height_(height), seq_(0), timestamp_us_(0), data_(NULL), size_(0)
+    {
+    }
+
+    int width() const
+    {
+        return width_;
+    }
+
+    int height() const
+    {
+        return height_;
+    }
+
+    uint64_t seq() const
+    {
+        return seq_;
+    }
+
+    // capture time in microseconds, 0 when unknown
+    uint64_t timestamp_us() const
+    {
+        return timestamp_us_;
+    }
+
+    const uint8_t *data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    // YUYV to BGR, computed once
+    const cv::Mat &bgr()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        return bgr_locked();
+    }
+
+    // JPEG of the full frame at the given quality
+    buffer_ptr jpeg(int quality)
+    {
+        return preview(width_, height_, quality);
+    }
+
+    // JPEG of the frame scaled to width x height, the full size when they match the frame
+    buffer_ptr preview(int width, int height, int quality)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        uint64_t key = ((uint64_t)width << 40) | ((uint64_t)height << 16) | (uint64_t)quality;
+        auto iter    = jpeg_cache_.find(key);
+        if (iter != jpeg_cache_.end()) return iter->second;
+
+        const cv::Mat &src = bgr_locked();
+        cv::Mat scaled;
+        if ((width == width_) && (height == height_)) {
+            scaled = src;
+        } else {
+            cv::resize(src, scaled, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+        }
+        auto out = std::make_shared<std::vector<uint8_t>>();
+        cv::imencode(".jpg", scaled, *out, {cv::IMWRITE_JPEG_QUALITY, quality});
+        jpeg_cache_[key] = out;
+        return out;
+    }
+
+    // arbitrary derived data (e.g. a base64 envelope), built once under the given key
+    std::shared_ptr<const std::string> cached(const std::string &key, const std::function<std::string()> &build)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        auto iter = text_cache_.find(key);
+        if (iter != text_cache_.end()) return iter->second;
+        auto out         = std::make_shared<const std::string>(build());
+        text_cache_[key] = out;
+        return out;
+    }
+
+private:
+    friend class frame_fanout;
+
+    void assign(const void *data, int size, uint64_t seq, uint64_t timestamp_us)
+    {
+        raw_.resize(size);
+        memcpy(raw_.data(), data, size);
+        reset((const uint8_t *)raw_.data(), size, seq, timestamp_us);
+    }
+
+    void wrap(const void *data, int size, uint64_t seq, uint64_t timestamp_us, const std::shared_ptr<void> &owner)
+    {
+        owner_ = owner;
+        reset((const uint8_t *)data, size, seq, timestamp_us);
+    }
+
+    void reset(const uint8_t *data, int size, uint64_t seq, uint64_t timestamp_us)
+    {
+        data_         = data;
+        size_         = size;
+        seq_          = seq;
+        timestamp_us_ = timestamp_us;
+        bgr_valid_    = false;
+        jpeg_cache_.clear();
+        text_cache_.clear();
+    }
+
+    const cv::Mat &bgr_locked()
+    {
+        if (!bgr_valid_) {
+            cv::Mat yuv(height_, width_, CV_8UC2, (void *)data_);
+            cv::cvtColor(yuv, bgr_, cv::COLOR_YUV2BGR_YUYV);
+            bgr_valid_ = true;
+        }
+        return bgr_;
+    }
+
+    int width_;
+    int height_;
+    uint64_t seq_;
+    uint64_t timestamp_us_;
+    const uint8_t *data_;
+    size_t size_;
+    std::vector<uint8_t> raw_;
+    std::shared_ptr<void> owner_;
+    std::mutex mtx_;
+    bool bgr_valid_ = false;
+    cv::Mat bgr_;
+    std::map<uint64_t, buffer_ptr> jpeg_cache_;
+    std::map<std::string, std::shared_ptr<const std::string>> text_cache_;
+};
+
+typedef std::shared_ptr<frame> frame_ptr;
+typedef std::function<void(const frame_ptr &)> consumer_callback_t;
+
+/**
+ * Hands every captured frame to a set of consumers, each running on its own thread.
+ * A consumer only ever holds the newest frame: when it is still busy with an older one the pending frame is
+ * replaced and counted as dropped, so a slow consumer never blocks capture or the other consumers.
+ */
+class frame_fanout {
+public:
+    frame_fanout(int width, int height) : width_(width), height_(height), seq_(0)
+    {
+    }
+
+    ~frame_fanout()
+    {
+        stop();
+    }
+
+    void add_consumer(const consumer_callback_t &callback)
+    {
+        auto con      = std::make_shared<consumer>();
+        con->callback = callback;
+        con->thread   = std::thread(&frame_fanout::consumer_run, con);
+        std::lock_guard<std::mutex> guard(consumers_mtx_);
+        consumers_.push_back(con);
+    }
+
+    bool empty()
+    {
+        std::lock_guard<std::mutex> guard(consumers_mtx_);
+        return consumers_.empty();
+    }
+
+    // copies the frame once into a pooled buffer and queues it for every consumer, never blocks on them
+    void publish(const void *data, int size, uint64_t timestamp_us = 0)
+    {
+        if (!is_frame(size)) return;
+        std::lock_guard<std::mutex> guard(consumers_mtx_);
+        if (consumers_.empty()) return;
+        frame_ptr f = pool_get();
+        f->assign(data, size, seq_++, timestamp_us);
+        dispatch(f);
+    }
+
+    // zero-copy variant: the data stays valid while owner is alive, owner is dropped with the last reference
+    void publish(const void *data, int size, uint64_t timestamp_us, const std::shared_ptr<void> &owner)
+    {
+        if (!is_frame(size)) return;
+        std::lock_guard<std::mutex> guard(consumers_mtx_);
+        if (consumers_.empty()) return;
+        frame_ptr f = std::make_shared<frame>(width_, height_);
+        f->wrap(data, size, seq_++, timestamp_us, owner);
+        dispatch(f);
+    }
+
+    // frames each consumer skipped because it was still busy
+    std::vector<uint64_t> dropped()
+    {
+        std::vector<uint64_t> out;
+        std::lock_guard<std::mutex> guard(consumers_mtx_);
+        for (auto &con : consumers_) {
+            std::lock_guard<std::mutex> con_guard(con->mtx);
+            out.push_back(con->dropped);
+        }
+        return out;
+    }
+
+    void stop()
+    {
+        std::vector<std::shared_ptr<consumer>> consumers;
+        {
+            std::lock_guard<std::mutex> guard(consumers_mtx_);
+            consumers.swap(consumers_);
+            pool_.clear();
+        }
+        for (auto &con : consumers) {
+            {
+                std::lock_guard<std::mutex> con_guard(con->mtx);
+                con->exit = true;
+                con->pending.reset();
+                con->cond.notify_one();
+            }
+            if (con->thread.get_id() == std::this_thread::get_id()) {
+                con->thread.detach();
+            } else if (con->thread.joinable()) {
+                con->thread.join();
+            }
+        }
+    }
+
+private:
+    struct consumer {
+        consumer_callback_t callback;
+        std::thread thread;
+        std::mutex mtx;
+        std::condition_variable cond;
+        frame_ptr pending;
+        uint64_t dropped = 0;
+        bool exit        = false;
+    };
+
+    // every consumer reads width x height YUYV pixels, a shorter buffer is not a frame
+    bool is_frame(int size) const
+    {
+        return (size >= 0) && ((size_t)size >= (size_t)width_ * height_ * 2);
+    }
+
+    static void consumer_run(std::shared_ptr<consumer> con)
+    {
+        for (;;) {
+            frame_ptr f;
+            {
+                std::unique_lock<std::mutex> lock(con->mtx);
+                con->cond.wait(lock, [&] { return con->exit || con->pending; });
+                if (con->exit) break;
+                f.swap(con->pending);
+            }
+            con->callback(f);
+        }
+    }
+
+    void dispatch(const frame_ptr &f)
+    {
+        for (auto &con : consumers_) {
+            std::lock_guard<std::mutex> con_guard(con->mtx);
+            if (con->pending) con->dropped++;
+            con->pending = f;
+            con->cond.notify_one();
+        }
+    }
+
+    // a pooled frame is free once nobody but the pool references it
+    frame_ptr pool_get()
+    {
+        for (auto &f : pool_) {
+            if (f.use_count() == 1) return f;
+        }
+        pool_.push_back(std::make_shared<frame>(width_, height_));
+        return pool_.back();
+    }
+
+    int width_;
+    int height_;
+    uint64_t seq_;
+    std::mutex consumers_mtx_;
+    std::vector<std::shared_ptr<consumer>> consumers_;
+    std::vector<frame_ptr> pool_;
+};
+
+}  // namespace camera_fanout
@@ -13,13 +13,14 @@
 #include <iostream>
 #include "../../../../SDK/components/utilities/include/sample_log.h"
 #include "camera.h"
+#include "frame_fanout.hpp"
+#include "mjpeg_server.h"
 #include <global_config.h>
 #if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
 #include "axera_camera.h"
 #endif
 #include <glob.h>
 #include <opencv2/opencv.hpp>
-#include "hv/TcpServer.h"
 #include <sys/time.h>
 #include <time.h>
 
@@ -36,27 +37,6 @@
 using namespace StackFlows;
 int main_exit_flage = 0;
 
-const char *http_response =
-    "HTTP/1.0 200 OK\n"
-    "Server: BaseHTTP/0.6 Python/3.10.12\n"
-    "Date: %s\n"
-    "Cache-Control: no-store, no-cache, must-revalidate, pre-check=0, post-check=0, max-age=0\n"
-    "Connection: close\n"
-    "Content-Type: multipart/x-mixed-replace;boundary=--boundarydonotcross\n"
-    "Expires: Mon, 1 Jan 2130 00:00:00 GMT\n"
-    "Pragma: no-cache\n"
-    "Access-Control-Allow-Origin: *\n";
-const char *http_jpeg_response =
-    "\n"
-    "--boundarydonotcross\n"
-    "X-Timestamp: %lf\n"
-    "Content-Length: %d\n"
-    "Content-Type: image/jpeg\n"
-    "\n";
-
-char http_response_buff[1024];
-char http_response_buff1[1024];
-
 static void __sigint(int iSigNo)
 {
     main_exit_flage = 1;
@@ -101,6 +81,7 @@ public:
     bool enjpegout_;
     std::string rtsp_config_;
     bool enable_webstream_;
+    int jpeg_quality_;
     std::atomic_int cap_status_;
     std::unique_ptr<std::thread> camera_cap_thread_;
     std::atomic_bool camera_clear_flage_;
@@ -110,7 +91,8 @@ public:
     int frame_height_;
     cv::Mat yuv_dist_;
 
-    std::unique_ptr<hv::TcpServer> hv_tcpserver_;
+    std::unique_ptr<camera_fanout::frame_fanout> fanout_;
+    std::unique_ptr<mjpeg_server> webstream_;
 
     static void on_cap_fream(void *pData, uint32_t width, uint32_t height, uint32_t Length, void *ctx)
     {
@@ -125,6 +107,7 @@ public:
         int dst_H;
         if ((self->frame_height_ == height) && (self->frame_width_ == width)) {
             if (self->out_callback_) self->out_callback_(pData, Length);
+            if (self->fanout_) self->fanout_->publish(pData, Length);
         } else {
             if ((self->frame_height_ >= height) && (self->frame_width_ >= width)) {
                 src_offsetX = 0;
@@ -168,13 +151,62 @@ public:
                 .copyTo(self->yuv_dist_(cv::Rect(dst_offsetX, dst_offsetY, dst_W, dst_H)));
             if (self->out_callback_)
                 self->out_callback_(self->yuv_dist_.data, self->frame_height_ * self->frame_width_ * 2);
+            if (self->fanout_)
+                self->fanout_->publish(self->yuv_dist_.data, self->frame_height_ * self->frame_width_ * 2);
+        }
+    }
+
+    // zero-copy capture: the fan-out keeps a reference on the driver buffer instead of copying it
+    static void on_cap_frame_ref(camera_frame_t *frame, void *ctx)
+    {
+        llm_task *self = static_cast<llm_task *>(ctx);
+        if ((self->frame_height_ != frame->height_) || (self->frame_width_ != frame->width_)) {
+            on_cap_fream(frame->data_, frame->width_, frame->height_, frame->length_, ctx);
+            return;
+        }
+        if (self->out_callback_) self->out_callback_(frame->data_, frame->length_);
+        if (!self->fanout_) return;
+        CAMERA_Stats_t stats;
+        self->cam->camera_get_stats(self->cam, &stats);
+        // keep a couple of buffers with the driver, copy instead when the consumers hold the rest
+        if (self->cam->buffer_cnt_ - stats.buffers_in_use_ < 2) {
+            self->fanout_->publish(frame->data_, frame->length_, frame->timestamp_us_);
+        } else {
+            camera_frame_ref(frame);
+            self->fanout_->publish(frame->data_, frame->length_, frame->timestamp_us_,
+                                   std::shared_ptr<camera_frame_t>(frame, camera_frame_unref));
+        }
+    }
+
+    nlohmann::json frame_stats()
+    {
+        nlohmann::json stats_body;
+        if (cam && cam->camera_get_stats) {
+            CAMERA_Stats_t stats;
+            cam->camera_get_stats(cam, &stats);
+            stats_body["captured"]       = stats.captured_;
+            stats_body["dropped"]        = stats.dropped_;
+            stats_body["buffers_in_use"] = stats.buffers_in_use_;
+            stats_body["buffer_count"]   = cam->buffer_cnt_;
         }
+        return stats_body;
     }
 
     void set_output(task_callback_t out_callback)
     {
         out_callback_ = out_callback;
     }
+
+    static bool parse_v4l2_config(const nlohmann::json &config_body, const nlohmann::json &file_body,
+                                  void **custom_config)
+    {
+        static v4l2_config_t v4l2_config;
+        memset(&v4l2_config, 0, sizeof(v4l2_config_t));
+        v4l2_config.buffer_cnt    = config_body.value("buffer_count", CONFIG_CAPTURE_BUF_CNT);
+        v4l2_config.export_dmabuf = config_body.value("dmabuf", false) ? 1 : 0;
+        *custom_config            = (void *)&v4l2_config;
+        return false;
+    }
 #if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
     static bool parse_axera_config(const nlohmann::json &config_body, const nlohmann::json &file_body,
                                    void **custom_config)
@@ -496,6 +528,11 @@ public:
             } else {
                 enable_webstream_ = false;
             }
+            if (config_body.contains("jpeg_quality")) {
+                jpeg_quality_ = config_body.at("jpeg_quality");
+            } else {
+                jpeg_quality_ = 95;
+            }
 
         } catch (...) {
             return true;
@@ -503,10 +540,11 @@ public:
         enstream_  = (response_format_.find("stream") != std::string::npos);
         enjpegout_ = (response_format_.find("jpeg") != std::string::npos);
         yuv_dist_  = cv::Mat(frame_height_, frame_width_, CV_8UC2, cv::Scalar(0, 128));
+        fanout_    = std::make_unique<camera_fanout::frame_fanout>(frame_width_, frame_height_);
         if (devname_.find("/dev/video") != std::string::npos) {
             hal_camera_open  = camera_open;
             hal_camera_close = camera_close;
-            hal_parse_config = NULL;
+            hal_parse_config = llm_task::parse_v4l2_config;
         }
 #if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
         else if (devname_.find("axera_") != std::string::npos) {
@@ -563,8 +601,13 @@ public:
                 printf("Camera open failed \n");
                 return -1;
             }
+            if (enable_webstream_) start_webstream();
             cam->ctx_ = static_cast<void *>(this);
-            cam->camera_capture_callback_set(cam, on_cap_fream);
+            if (cam->camera_frame_callback_set) {
+                cam->camera_frame_callback_set(cam, on_cap_frame_ref);
+            } else {
+                cam->camera_capture_callback_set(cam, on_cap_fream);
+            }
             cam->camera_capture_start(cam);
         } catch (...) {
             SLOGE("config file read false");
@@ -573,6 +616,19 @@ public:
         return 0;
     }
 
+    // the webstream is one fan-out consumer, its clients are paced and dropped inside the server
+    void start_webstream()
+    {
+        mjpeg_server_config_t config = {8989, 4, 2, 0, jpeg_quality_, 0, 0, 2000};
+        webstream_                   = std::make_unique<mjpeg_server>(config);
+        if (webstream_->start() != 0) {
+            SLOGE("webstream listen on tcp:%d failed", config.port);
+            webstream_.reset();
+            return;
+        }
+        fanout_->add_consumer(std::bind(&mjpeg_server::push, webstream_.get(), std::placeholders::_1));
+    }
+
     void inference(const std::string &msg)
     {
         // std::cout << msg << std::endl;
@@ -593,13 +649,19 @@ public:
     {
         if (cam) {
             cam->camera_capture_stop(cam);
+        }
+        // consumers drop their frame references before the buffers are unmapped
+        if (fanout_) {
+            fanout_->stop();
+        }
+        if (webstream_) {
+            webstream_->stop();
+            webstream_.reset();
+        }
+        if (cam) {
             hal_camera_close(cam);
             cam = NULL;
         }
-        if (hv_tcpserver_) {
-            hv_tcpserver_->stop();
-            hv_tcpserver_.reset();
-        }
     }
 
     ~llm_task()
@@ -636,6 +698,10 @@ public:
         return LLM_NONE;
     }
 
+    /*
+     * Raw StackFlow output for other units, on the capture thread (and once per inference request).
+     * The fan-out is fed by the capture callbacks themselves, only with real frames.
+     */
     void task_output(const std::weak_ptr<llm_task> llm_task_obj_weak,
                      const std::weak_ptr<llm_channel_obj> llm_channel_weak, const void *data, int size)
     {
@@ -644,81 +710,47 @@ public:
         if (!(llm_task_obj && llm_channel)) {
             return;
         }
-        std::vector<uchar> jpeg_image;
         // StackFlow output
-        std::string out_data((char *)data, size);
-        llm_channel->send_raw_to_pub(out_data);
-        // user output
-        if (llm_task_obj->enoutput_) {
-            std::string base64_data;
-            if (llm_task_obj->enjpegout_) {
-                cv::Mat yuv_image(llm_task_obj->frame_height_, llm_task_obj->frame_width_, CV_8UC2, (void *)data);
-                cv::Mat bgr_image;
-                cv::cvtColor(yuv_image, bgr_image, cv::COLOR_YUV2BGR_YUYV);
-                cv::imencode(".jpg", bgr_image, jpeg_image);
-                std::string in_data((char *)jpeg_image.data(), jpeg_image.size());
-                StackFlows::encode_base64(in_data, base64_data);
-            } else {
-                StackFlows::encode_base64(out_data, base64_data);
-            }
-            std::string out_json_str;
-            out_json_str.reserve(llm_channel->request_id_.size() + llm_channel->work_id_.size() + base64_data.size() +
-                                 128);
-            out_json_str += R"({"request_id":")";
-            out_json_str += llm_channel->request_id_;
-            out_json_str += R"(","work_id":")";
-            out_json_str += llm_channel->work_id_;
-            out_json_str += R"(","object":")";
-            out_json_str += llm_task_obj->response_format_;
-            out_json_str += R"(","error":{"code":0, "message":""},"data":")";
-            out_json_str += base64_data;
-            out_json_str += "\"}\n";
-            llm_channel->send_raw_to_usr(out_json_str);
+        llm_channel->send_raw_to_pub((const char *)data, size);
+    }
+
+    void task_user_output(const std::weak_ptr<llm_task> llm_task_obj_weak,
+                          const std::weak_ptr<llm_channel_obj> llm_channel_weak, const camera_fanout::frame_ptr &frame)
+    {
+        auto llm_task_obj = llm_task_obj_weak.lock();
+        auto llm_channel  = llm_channel_weak.lock();
+        if (!(llm_task_obj && llm_channel)) {
+            return;
         }
-        // webstream output
-        if (llm_task_obj->enable_webstream_) {
-            if (!llm_task_obj->hv_tcpserver_) {
-                llm_task_obj->hv_tcpserver_ = std::make_unique<hv::TcpServer>();
-                int listenfd                = llm_task_obj->hv_tcpserver_->createsocket(8989);
-                if (listenfd < 0) {
-                    llm_task_obj->hv_tcpserver_.reset();
-                    return;
-                }
-                llm_task_obj->hv_tcpserver_->onConnection = [](const hv::SocketChannelPtr &channel) {
-                    std::string peeraddr = channel->peeraddr();
-                    if (channel->isConnected()) {
-                        memset(http_response_buff, 0, 1024);
-                        time_t current_time;
-                        struct tm *time_info;
-                        time(&current_time);
-                        time_info = gmtime(&current_time);
-                        char time_str[30];
-                        strftime(time_str, sizeof(time_str), "%a, %d %b %Y %H:%M:%S GMT", time_info);
-                        sprintf(http_response_buff, http_response, time_str);
-                        channel->write(http_response_buff);
-                    }
-                };
-                llm_task_obj->hv_tcpserver_->onMessage = [](const hv::SocketChannelPtr &channel, hv::Buffer *buf) {};
-                llm_task_obj->hv_tcpserver_->setThreadNum(1);
-                llm_task_obj->hv_tcpserver_->start();
-            }
-            llm_task_obj->hv_tcpserver_->foreachChannel([&](const hv::SocketChannelPtr &channel) {
-                if (jpeg_image.empty()) {
-                    cv::Mat yuv_image(llm_task_obj->frame_height_, llm_task_obj->frame_width_, CV_8UC2, (void *)data);
-                    cv::Mat bgr_image;
-                    cv::cvtColor(yuv_image, bgr_image, cv::COLOR_YUV2BGR_YUYV);
-                    cv::imencode(".jpg", bgr_image, jpeg_image);
-                }
-                char tmpsdas[256];
-                struct timeval tv;
-                gettimeofday(&tv, NULL);
-                double timestamp = (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
-                memset(http_response_buff1, 0, 1024);
-                sprintf(http_response_buff1, http_jpeg_response, timestamp, jpeg_image.size());
-                channel->write(http_response_buff1);
-                channel->write(jpeg_image.data(), jpeg_image.size());
+        std::shared_ptr<const std::string> base64_data;
+        if (llm_task_obj->enjpegout_) {
+            int quality = llm_task_obj->jpeg_quality_;
+            base64_data = frame->cached("base64.jpeg." + std::to_string(quality), [&] {
+                auto jpeg = frame->jpeg(quality);
+                std::string out;
+                StackFlows::encode_base64(std::string((const char *)jpeg->data(), jpeg->size()), out);
+                return out;
+            });
+        } else {
+            base64_data = frame->cached("base64.raw", [&] {
+                std::string out;
+                StackFlows::encode_base64(std::string((const char *)frame->data(), frame->size()), out);
+                return out;
             });
         }
+        std::string out_json_str;
+        out_json_str.reserve(llm_channel->request_id_.size() + llm_channel->work_id_.size() + base64_data->size() +
+                             128);
+        out_json_str += R"({"request_id":")";
+        out_json_str += llm_channel->request_id_;
+        out_json_str += R"(","work_id":")";
+        out_json_str += llm_channel->work_id_;
+        out_json_str += R"(","object":")";
+        out_json_str += llm_task_obj->response_format_;
+        out_json_str += R"(","error":{"code":0, "message":""},"data":")";
+        out_json_str += *base64_data;
+        out_json_str += "\"}\n";
+        llm_channel->send_raw_to_usr(out_json_str);
     }
 
     int setup(const std::string &work_id, const std::string &object, const std::string &data) override
@@ -746,6 +778,12 @@ public:
         if (ret == 0) {
             llm_channel->set_output(llm_task_obj->enoutput_);
             llm_channel->set_stream(llm_task_obj->enstream_);
+            if (llm_task_obj->enoutput_) {
+                llm_task_obj->fanout_->add_consumer(std::bind(&llm_camera::task_user_output, this,
+                                                              std::weak_ptr<llm_task>(llm_task_obj),
+                                                              std::weak_ptr<llm_channel_obj>(llm_channel),
+                                                              std::placeholders::_1));
+            }
             llm_task_obj->set_output(std::bind(&llm_camera::task_output, this, std::weak_ptr<llm_task>(llm_task_obj),
                                                std::weak_ptr<llm_channel_obj>(llm_channel), std::placeholders::_1,
                                                std::placeholders::_2));
@@ -783,6 +821,7 @@ public:
             req_body["input"]           = llm_task_obj->devname_;
             req_body["frame_width"]     = llm_task_obj->frame_width_;
             req_body["frame_height"]    = llm_task_obj->frame_height_;
+            req_body["frame_stats"]     = llm_task_obj->frame_stats();
             send("camera.taskinfo", req_body, LLM_NO_ERROR, work_id);
         }
     }
@@ -0,0 +1,468 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "mjpeg_server.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+
+#define MJPEG_BOUNDARY         "boundarydonotcross"
+#define MJPEG_REQUEST_MAX      8192
+#define MJPEG_IDLE_TIMEOUT_MS  10000
+#define MJPEG_FRAME_TIMEOUT_MS 3000
+
+static const char *mjpeg_stream_header =
+    "HTTP/1.1 200 OK\r\n"
+    "Server: StackFlow\r\n"
+    "Cache-Control: no-store, no-cache, must-revalidate, pre-check=0, post-check=0, max-age=0\r\n"
+    "Pragma: no-cache\r\n"
+    "Expires: Mon, 1 Jan 2130 00:00:00 GMT\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Connection: close\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=" MJPEG_BOUNDARY
+    "\r\n"
+    "\r\n";
+
+static const char *mjpeg_part_header =
+    "--" MJPEG_BOUNDARY
+    "\r\n"
+    "Content-Type: image/jpeg\r\n"
+    "Content-Length: %zu\r\n"
+    "X-Timestamp: %.6f\r\n"
+    "\r\n";
+
+static const char *mjpeg_snapshot_header =
+    "HTTP/1.1 200 OK\r\n"
+    "Server: StackFlow\r\n"
+    "Cache-Control: no-store, no-cache, must-revalidate, max-age=0\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Connection: %s\r\n"
+    "Content-Type: image/jpeg\r\n"
+    "Content-Length: %zu\r\n"
+    "\r\n";
+
+static double mjpeg_timestamp()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+
+// case-insensitive search for "name: value" among the request headers
+static bool mjpeg_header_has(const std::string &request, const char *name, const char *value)
+{
+    size_t pos = request.find("\r\n");
+    while (pos != std::string::npos) {
+        size_t start = pos + 2;
+        size_t end   = request.find("\r\n", start);
+        if (end == std::string::npos) end = request.size();
+        std::string line = request.substr(start, end - start);
+        size_t colon     = line.find(':');
+        if ((colon != std::string::npos) && (colon == strlen(name)) &&
+            (strncasecmp(line.c_str(), name, colon) == 0)) {
+            std::string field = line.substr(colon + 1);
+            std::transform(field.begin(), field.end(), field.begin(), ::tolower);
+            if (field.find(value) != std::string::npos) return true;
+        }
+        pos = (end < request.size()) ? end : std::string::npos;
+    }
+    return false;
+}
+
+mjpeg_server::mjpeg_server(const mjpeg_server_config_t &config)
+    : config_(config), listen_fd_(-1), dropped_(0), running_(false)
+{
+    wake_pipe_[0] = -1;
+    wake_pipe_[1] = -1;
+    if (config_.max_clients <= 0) config_.max_clients = 4;
+    if (config_.queue_depth <= 0) config_.queue_depth = 2;
+    if (config_.send_timeout_ms <= 0) config_.send_timeout_ms = 2000;
+}
+
+mjpeg_server::~mjpeg_server()
+{
+    stop();
+}
+
+int mjpeg_server::start()
+{
+    if (running_) return 0;
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) return -1;
+    int on = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(config_.port);
+    if ((bind(listen_fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(listen_fd_, 16) < 0) ||
+        (pipe2(wake_pipe_, O_CLOEXEC) < 0)) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return -1;
+    }
+    running_       = true;
+    accept_thread_ = std::thread(&mjpeg_server::accept_run, this);
+    return 0;
+}
+
+void mjpeg_server::stop()
+{
+    if (!running_) return;
+    running_ = false;
+    char c      = 0;
+    ssize_t ret = write(wake_pipe_[1], &c, 1);
+    (void)ret;
+    if (accept_thread_.joinable()) accept_thread_.join();
+    reap_clients(true);
+    close(listen_fd_);
+    close(wake_pipe_[0]);
+    close(wake_pipe_[1]);
+    listen_fd_    = -1;
+    wake_pipe_[0] = -1;
+    wake_pipe_[1] = -1;
+}
+
+void mjpeg_server::push(const camera_fanout::frame_ptr &frame)
+{
+    std::lock_guard<std::mutex> guard(clients_mtx_);
+    for (auto &con : clients_) {
+        if (con->done) continue;
+        std::lock_guard<std::mutex> con_guard(con->mtx);
+        if (!con->active) continue;
+        if ((int)con->queue.size() >= config_.queue_depth) {
+            con->queue.pop_front();
+            con->dropped++;
+        }
+        con->queue.push_back(frame);
+        con->cond.notify_one();
+    }
+}
+
+int mjpeg_server::client_num()
+{
+    std::lock_guard<std::mutex> guard(clients_mtx_);
+    int num = 0;
+    for (auto &con : clients_) {
+        if (!con->done) num++;
+    }
+    return num;
+}
+
+uint64_t mjpeg_server::dropped_frames()
+{
+    std::lock_guard<std::mutex> guard(clients_mtx_);
+    uint64_t num = dropped_;
+    for (auto &con : clients_) {
+        std::lock_guard<std::mutex> con_guard(con->mtx);
+        num += con->dropped;
+    }
+    return num;
+}
+
+void mjpeg_server::accept_run()
+{
+    while (running_) {
+        struct pollfd fds[2];
+        fds[0].fd     = listen_fd_;
+        fds[0].events = POLLIN;
+        fds[1].fd     = wake_pipe_[0];
+        fds[1].events = POLLIN;
+        int ret       = poll(fds, 2, 1000);
+        reap_clients(false);
+        if ((ret <= 0) || (fds[1].revents & POLLIN)) continue;
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int fd = accept4(listen_fd_, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        struct timeval tv;
+        tv.tv_sec  = config_.send_timeout_ms / 1000;
+        tv.tv_usec = (config_.send_timeout_ms % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        auto con = std::make_shared<client>();
+        con->fd  = fd;
+        if (client_num() >= config_.max_clients) {
+            send_error(*con, 503, "Too many clients");
+            close(fd);
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(clients_mtx_);
+        con->thread = std::thread(&mjpeg_server::client_run, this, con);
+        clients_.push_back(con);
+    }
+}
+
+// joins finished clients, or every client when all is set; the fd is only closed after the thread is gone
+void mjpeg_server::reap_clients(bool all)
+{
+    std::list<std::shared_ptr<client>> finished;
+    {
+        std::lock_guard<std::mutex> guard(clients_mtx_);
+        for (auto iter = clients_.begin(); iter != clients_.end();) {
+            if (all || (*iter)->done) {
+                finished.push_back(*iter);
+                iter = clients_.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+    for (auto &con : finished) {
+        {
+            std::lock_guard<std::mutex> con_guard(con->mtx);
+            con->exit = true;
+            con->cond.notify_one();
+        }
+        shutdown(con->fd, SHUT_RDWR);
+        if (con->thread.joinable()) con->thread.join();
+        close(con->fd);
+        std::lock_guard<std::mutex> guard(clients_mtx_);
+        dropped_ += con->dropped;
+    }
+}
+
+void mjpeg_server::client_run(std::shared_ptr<client> con)
+{
+    std::string buf;
+    std::string request;
+    while (running_ && read_request(*con, buf, request)) {
+        char method[16];
+        char target[1024];
+        char version[16];
+        if (sscanf(request.c_str(), "%15s %1023s %15s", method, target, version) != 3) {
+            send_error(*con, 400, "Bad Request");
+            break;
+        }
+        bool keep_alive = (strcmp(version, "HTTP/1.1") == 0) ? !mjpeg_header_has(request, "Connection", "close")
+                                                              : mjpeg_header_has(request, "Connection", "keep-alive");
+        if (strcmp(method, "GET") != 0) {
+            send_error(*con, 405, "Method Not Allowed");
+            break;
+        }
+        std::string path(target);
+        std::string query;
+        size_t qpos = path.find('?');
+        if (qpos != std::string::npos) {
+            query = path.substr(qpos + 1);
+            path  = path.substr(0, qpos);
+        }
+        if ((path == "/") || (path == "/stream")) {
+            serve_stream(*con, query);
+            break;
+        } else if (path == "/snapshot") {
+            if (!serve_snapshot(*con, query, keep_alive)) break;
+        } else {
+            if (!send_error(*con, 404, "Not Found")) break;
+        }
+        if (!keep_alive) break;
+    }
+    shutdown(con->fd, SHUT_RDWR);
+    {
+        std::lock_guard<std::mutex> con_guard(con->mtx);
+        con->active = false;
+        con->queue.clear();
+    }
+    con->done = true;
+}
+
+// reads one request header block, keeping any pipelined bytes in buf
+bool mjpeg_server::read_request(client &con, std::string &buf, std::string &request)
+{
+    int idle_ms = 0;
+    for (;;) {
+        size_t end = buf.find("\r\n\r\n");
+        if (end != std::string::npos) {
+            request = buf.substr(0, end + 2);
+            buf.erase(0, end + 4);
+            return true;
+        }
+        if (buf.size() > MJPEG_REQUEST_MAX) return false;
+        {
+            std::lock_guard<std::mutex> con_guard(con.mtx);
+            if (con.exit) return false;
+        }
+        struct pollfd pfd;
+        pfd.fd     = con.fd;
+        pfd.events = POLLIN;
+        int ret    = poll(&pfd, 1, 200);
+        if (ret < 0 && errno != EINTR) return false;
+        if (ret <= 0) {
+            idle_ms += 200;
+            if (idle_ms >= MJPEG_IDLE_TIMEOUT_MS) return false;
+            continue;
+        }
+        char tmp[1024];
+        ssize_t len = recv(con.fd, tmp, sizeof(tmp), 0);
+        if (len <= 0) return false;
+        buf.append(tmp, len);
+    }
+}
+
+camera_fanout::frame_ptr mjpeg_server::wait_frame(client &con, int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(con.mtx);
+    con.cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return con.exit || !con.queue.empty(); });
+    if (con.exit || con.queue.empty()) return nullptr;
+    camera_fanout::frame_ptr frame = con.queue.front();
+    con.queue.pop_front();
+    return frame;
+}
+
+mjpeg_server::stream_param mjpeg_server::parse_param(const std::string &query, int frame_w, int frame_h)
+{
+    stream_param param;
+    param.fps     = config_.fps;
+    param.quality = config_.quality;
+    param.width   = config_.width;
+    param.height  = config_.height;
+    size_t pos    = 0;
+    while (pos < query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos) end = query.size();
+        std::string item = query.substr(pos, end - pos);
+        size_t eq        = item.find('=');
+        if (eq != std::string::npos) {
+            std::string key = item.substr(0, eq);
+            int value       = atoi(item.c_str() + eq + 1);
+            if (key == "fps") param.fps = value;
+            if (key == "quality") param.quality = value;
+            if (key == "width") param.width = value;
+            if (key == "height") param.height = value;
+        }
+        pos = end + 1;
+    }
+    if ((param.width <= 0) && (param.height <= 0)) {
+        param.width  = frame_w;
+        param.height = frame_h;
+    } else if (param.height <= 0) {
+        param.height = param.width * frame_h / frame_w;
+    } else if (param.width <= 0) {
+        param.width = param.height * frame_w / frame_h;
+    }
+    param.width   = std::max(16, std::min(param.width, frame_w)) & ~1;
+    param.height  = std::max(16, std::min(param.height, frame_h)) & ~1;
+    param.quality = std::max(1, std::min(param.quality, 100));
+    param.fps     = std::max(0, std::min(param.fps, 60));
+    return param;
+}
+
+bool mjpeg_server::send_all(client &con, const void *data, size_t size)
+{
+    const char *ptr = (const char *)data;
+    while (size > 0) {
+        ssize_t len = send(con.fd, ptr, size, MSG_NOSIGNAL);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            // EAGAIN here means the send timeout expired: the client stopped reading
+            return false;
+        }
+        ptr += len;
+        size -= len;
+    }
+    return true;
+}
+
+bool mjpeg_server::send_error(client &con, int code, const char *reason)
+{
+    char head[256];
+    int len = snprintf(head, sizeof(head),
+                       "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n\r\n%s", code, reason,
+                       strlen(reason), reason);
+    return send_all(con, head, len);
+}
+
+bool mjpeg_server::peer_closed(client &con)
+{
+    struct pollfd pfd;
+    pfd.fd     = con.fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 0) <= 0) return false;
+    if (pfd.revents & (POLLERR | POLLHUP)) return true;
+    char tmp[256];
+    // a streaming client has nothing more to say, anything it sends is discarded
+    ssize_t len = recv(con.fd, tmp, sizeof(tmp), MSG_DONTWAIT);
+    return (len == 0) || ((len < 0) && (errno != EAGAIN) && (errno != EINTR));
+}
+
+bool mjpeg_server::serve_stream(client &con, const std::string &query)
+{
+    {
+        std::lock_guard<std::mutex> con_guard(con.mtx);
+        con.active = true;
+    }
+    if (!send_all(con, mjpeg_stream_header, strlen(mjpeg_stream_header))) return false;
+
+    bool have_param = false;
+    stream_param param;
+    std::chrono::steady_clock::duration period(0);
+    std::chrono::steady_clock::time_point next_due = std::chrono::steady_clock::now();
+    while (running_) {
+        camera_fanout::frame_ptr frame = wait_frame(con, 1000);
+        if (peer_closed(con)) return false;
+        if (!frame) {
+            std::lock_guard<std::mutex> con_guard(con.mtx);
+            if (con.exit) return false;
+            continue;
+        }
+        if (!have_param) {
+            param      = parse_param(query, frame->width(), frame->height());
+            have_param = true;
+            if (param.fps > 0) period = std::chrono::microseconds(1000000 / param.fps);
+        }
+        if (param.fps > 0) {
+            auto now = std::chrono::steady_clock::now();
+            if (now < next_due) continue;
+            // keep the cadence, but do not try to catch up after a stall
+            next_due = (now - next_due > period) ? now + period : next_due + period;
+        }
+
+        camera_fanout::buffer_ptr jpeg = frame->preview(param.width, param.height, param.quality);
+        frame.reset();
+        char head[160];
+        int len = snprintf(head, sizeof(head), mjpeg_part_header, jpeg->size(), mjpeg_timestamp());
+        if (!send_all(con, head, len) || !send_all(con, jpeg->data(), jpeg->size()) || !send_all(con, "\r\n", 2)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool mjpeg_server::serve_snapshot(client &con, const std::string &query, bool keep_alive)
+{
+    {
+        std::lock_guard<std::mutex> con_guard(con.mtx);
+        con.queue.clear();
+        con.active = true;
+    }
+    camera_fanout::frame_ptr frame = wait_frame(con, MJPEG_FRAME_TIMEOUT_MS);
+    {
+        std::lock_guard<std::mutex> con_guard(con.mtx);
+        con.active = false;
+        con.queue.clear();
+    }
+    if (!frame) return send_error(con, 503, "No Frame");
+
+    stream_param param             = parse_param(query, frame->width(), frame->height());
+    camera_fanout::buffer_ptr jpeg = frame->preview(param.width, param.height, param.quality);
+    frame.reset();
+    char head[320];
+    int len = snprintf(head, sizeof(head), mjpeg_snapshot_header, keep_alive ? "keep-alive" : "close", jpeg->size());
+    return send_all(con, head, len) && send_all(con, jpeg->data(), jpeg->size());
+}
@@ -0,0 +1,95 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "frame_fanout.hpp"
+
+typedef struct {
+    int port;
+    int max_clients;
+    int queue_depth;  // frames queued per client before the oldest is dropped
+    int fps;          // default per-client frame rate, 0 sends every frame
+    int quality;      // default JPEG quality
+    int width;        // default stream size, 0 uses the frame size
+    int height;
+    int send_timeout_ms;  // a client that cannot take a frame in this time is disconnected
+} mjpeg_server_config_t;
+
+/**
+ * HTTP MJPEG server fed from the camera fan-out.
+ *
+ *   GET /  or  /stream   multipart/x-mixed-replace stream
+ *   GET /snapshot        one image/jpeg, the connection is kept alive for further requests
+ *
+ * fps, quality, width and height can be set per client in the query string, e.g. /stream?fps=5&width=320.
+ * Every client has its own thread and a bounded frame queue, so a slow client only loses its own frames.
+ * Clients asking for the same size and quality share one encode per frame through the frame cache.
+ */
+class mjpeg_server {
+public:
+    mjpeg_server(const mjpeg_server_config_t &config);
+    ~mjpeg_server();
+
+    // returns 0 on success, -1 if the port cannot be bound
+    int start();
+    void stop();
+
+    // queues the frame for every client, never blocks
+    void push(const camera_fanout::frame_ptr &frame);
+
+    int client_num();
+    uint64_t dropped_frames();
+
+private:
+    struct client {
+        int fd;
+        std::thread thread;
+        std::mutex mtx;
+        std::condition_variable cond;
+        std::deque<camera_fanout::frame_ptr> queue;
+        uint64_t dropped = 0;
+        bool active      = false;  // only a client waiting for frames is queued any
+        bool exit        = false;
+        std::atomic_bool done{false};
+    };
+
+    struct stream_param {
+        int fps;
+        int quality;
+        int width;
+        int height;
+    };
+
+    void accept_run();
+    void client_run(std::shared_ptr<client> con);
+    void reap_clients(bool all);
+
+    bool read_request(client &con, std::string &buf, std::string &request);
+    camera_fanout::frame_ptr wait_frame(client &con, int timeout_ms);
+    stream_param parse_param(const std::string &query, int frame_w, int frame_h);
+    bool send_all(client &con, const void *data, size_t size);
+    bool send_error(client &con, int code, const char *reason);
+    bool serve_stream(client &con, const std::string &query);
+    bool serve_snapshot(client &con, const std::string &query, bool keep_alive);
+    bool peer_closed(client &con);
+
+    mjpeg_server_config_t config_;
+    int listen_fd_;
+    int wake_pipe_[2];
+    std::thread accept_thread_;
+    std::mutex clients_mtx_;
+    std::list<std::shared_ptr<client>> clients_;
+    uint64_t dropped_;
+    std::atomic_bool running_;
+};
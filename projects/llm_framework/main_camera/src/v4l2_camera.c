@@ -15,6 +15,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <poll.h>
 #include <unistd.h>
 
 static int camera_capture_callback_set(struct camera_t* camera, vcamera_frame_get pcallback)
@@ -27,40 +28,126 @@ static int camera_capture_callback_set(struct camera_t* camera, vcamera_frame_ge
     return 0;
 }
 
+static int camera_frame_callback_set(struct camera_t* camera, vcamera_frame_ref_get pcallback)
+{
+    if (camera->state_ == CAMERA_SATTE_CAP) {
+        SLOGW("Set frame callback failed");
+        return -1;
+    }
+    camera->pframe_callback_ = pcallback;
+    return 0;
+}
+
+/* Unmap the buffers and close their exported DMABUFs, for the mappings made so far */
+static void camera_release_buffers(camera_t* camera)
+{
+    if (camera->pcamera_buffer_) {
+        for (int i = 0; i < camera->buffer_cnt_; i++) {
+            CAMERA_Buffer_t* buffer = &camera->pcamera_buffer_[i];
+            if (buffer->pstart != NULL && buffer->pstart != MAP_FAILED) munmap(buffer->pstart, buffer->length);
+            if (buffer->dmabuf_fd >= 0) close(buffer->dmabuf_fd);
+        }
+    }
+    free(camera->pcamera_buffer_);
+    camera->pcamera_buffer_ = NULL;
+    free(camera->pcamera_frame_);
+    camera->pcamera_frame_ = NULL;
+    if (camera->dev_fd_ >= 0) close(camera->dev_fd_);
+    camera->dev_fd_ = -1;
+}
+
+/*
+ * The camera holds one reference for its owner and one per buffer handed out, whoever drops the last one
+ * unmaps the buffers and frees the camera. So a close with frames still held only stops streaming.
+ */
+static void camera_put(camera_t* camera)
+{
+    if (__atomic_sub_fetch(&camera->refs_, 1, __ATOMIC_ACQ_REL) != 0) return;
+    camera_release_buffers(camera);
+    SLOGI("camera closed");
+    if (camera->is_alloc_) free(camera);
+}
+
+/* Re-queue a buffer once the last frame handle on it is released, from whichever thread released it */
+static void camera_frame_release(struct camera_t* camera, camera_frame_t* frame)
+{
+    struct v4l2_buffer EnQueueBuf;
+    if (camera->state_ == CAMERA_SATTE_OPEN || camera->state_ == CAMERA_SATTE_CAP) {
+        memset(&EnQueueBuf, 0, sizeof(struct v4l2_buffer));
+        EnQueueBuf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        EnQueueBuf.memory = V4L2_MEMORY_MMAP;
+        EnQueueBuf.index  = frame->index_;
+        if (ioctl(camera->dev_fd_, VIDIOC_QBUF, &EnQueueBuf)) {
+            perror("Enqueue fail");
+        }
+    }
+    __atomic_sub_fetch(&camera->stats_.buffers_in_use_, 1, __ATOMIC_RELEASE);
+    camera_put(camera);
+}
+
+static void camera_get_stats(struct camera_t* camera, CAMERA_Stats_t* stats)
+{
+    stats->captured_       = __atomic_load_n(&camera->stats_.captured_, __ATOMIC_RELAXED);
+    stats->dropped_        = __atomic_load_n(&camera->stats_.dropped_, __ATOMIC_RELAXED);
+    stats->buffers_in_use_ = __atomic_load_n(&camera->stats_.buffers_in_use_, __ATOMIC_ACQUIRE);
+}
+
 static void* camera_capture_thread(void* param)
 {
     int Ret          = -1;
     camera_t* camera = (camera_t*)param;
-    struct v4l2_buffer EnQueueBuf;
     struct v4l2_buffer DeQueueBuf;
+    struct pollfd Pfd;
+    uint32_t LastSequence = 0;
 
     SLOGI("Start capture");
 
     while (camera->state_ == CAMERA_SATTE_CAP) {
+        /* Wait with a timeout: when consumers hold every buffer nothing is dequeued until one is released */
+        Pfd.fd      = camera->dev_fd_;
+        Pfd.events  = POLLIN;
+        Pfd.revents = 0;
+        Ret         = poll(&Pfd, 1, 200);
+        if (Ret == 0) continue;
+        if (Ret < 0) {
+            if (errno == EINTR) continue;
+            perror("Poll fail");
+            break;
+        }
+
         memset(&DeQueueBuf, 0, sizeof(struct v4l2_buffer));
         DeQueueBuf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         DeQueueBuf.memory = V4L2_MEMORY_MMAP;
 
-        memset(&EnQueueBuf, 0, sizeof(struct v4l2_buffer));
-        EnQueueBuf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        EnQueueBuf.memory = V4L2_MEMORY_MMAP;
-
         // Retrieve data from the queue
         Ret = ioctl(camera->dev_fd_, VIDIOC_DQBUF, &DeQueueBuf);
         if (Ret) {
+            if (errno == EAGAIN) continue;
             perror("Dequeue fail");
             break;
         }
-        camera->pcallback_(camera->pcamera_buffer_[DeQueueBuf.index].pstart, camera->width_, camera->height_,
-                           camera->pcamera_buffer_[DeQueueBuf.index].length, camera->ctx_);
 
-        // Re-queue the data
-        EnQueueBuf.index = DeQueueBuf.index;
-
-        if (ioctl(camera->dev_fd_, VIDIOC_QBUF, &EnQueueBuf)) {
-            perror("Enqueue fail");
-            break;
+        camera_frame_t* frame = &camera->pcamera_frame_[DeQueueBuf.index];
+        frame->length_        = DeQueueBuf.bytesused ? DeQueueBuf.bytesused : frame->length_;
+        frame->sequence_      = DeQueueBuf.sequence;
+        frame->timestamp_us_ =
+            (uint64_t)DeQueueBuf.timestamp.tv_sec * 1000000 + (uint64_t)DeQueueBuf.timestamp.tv_usec;
+        if ((camera->stats_.captured_ > 0) && (DeQueueBuf.sequence > LastSequence + 1)) {
+            __atomic_add_fetch(&camera->stats_.dropped_, DeQueueBuf.sequence - LastSequence - 1, __ATOMIC_RELAXED);
         }
+        LastSequence = DeQueueBuf.sequence;
+        __atomic_add_fetch(&camera->stats_.captured_, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&camera->stats_.buffers_in_use_, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&camera->refs_, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&frame->refcount_, 1, __ATOMIC_RELEASE);
+
+        if (camera->pframe_callback_) {
+            camera->pframe_callback_(frame, camera->ctx_);
+        } else {
+            camera->pcallback_(frame->data_, camera->width_, camera->height_, frame->length_, camera->ctx_);
+        }
+        // Re-queue the data once every consumer let go of it
+        camera_frame_unref(frame);
     }
 
     SLOGI("Stop capture");
@@ -71,7 +158,7 @@ static void* camera_capture_thread(void* param)
 static int camera_capture_start(struct camera_t* camera)
 {
     SLOGI("Start capture thread");
-    if (!camera->pcallback_) {
+    if (!camera->pcallback_ && !camera->pframe_callback_) {
         SLOGW("Capture callback not set, start faild");
         return -1;
     }
@@ -108,8 +195,10 @@ int camera_open_from(camera_t* camera)
     SLOGI("Open camera %s...", camera->dev_name_);
     if (camera->state_ != CAMERA_STATE_CLOSE) {
         SLOGE("Error: camera was open or meet error, now state is: %d", camera->state_);
-        goto ErrorHandle;
+        return -1;
     }
+    camera->pcamera_buffer_ = NULL;
+    camera->pcamera_frame_  = NULL;
 
     /* Open the camera device */
     if ((camera->dev_fd_ = open(camera->dev_name_, O_RDWR, 0)) == -1) {
@@ -262,10 +351,12 @@ int camera_open_from(camera_t* camera)
     SLOGI("Buffer count: %d", camera->buffer_cnt_);
 
     camera->pcamera_buffer_ = (CAMERA_Buffer_t*)calloc(camera->buffer_cnt_, sizeof(CAMERA_Buffer_t));
-    if (camera->pcamera_buffer_ == NULL) {
+    camera->pcamera_frame_  = (camera_frame_t*)calloc(camera->buffer_cnt_, sizeof(camera_frame_t));
+    if (camera->pcamera_buffer_ == NULL || camera->pcamera_frame_ == NULL) {
         SLOGE("Malloc buffer failed");
         goto ErrorHandle;
     }
+    for (int i = 0; i < camera->buffer_cnt_; i++) camera->pcamera_buffer_[i].dmabuf_fd = -1;
 
     /* Map kernel buffer to user space */
     struct v4l2_buffer Buf;
@@ -289,6 +380,28 @@ int camera_open_from(camera_t* camera)
             goto ErrorHandle;
         }
 
+        /* Export the buffer so consumers can hand it to other devices without a copy */
+        if (camera->export_dmabuf_) {
+            struct v4l2_exportbuffer ExpBuf;
+            memset(&ExpBuf, 0, sizeof(ExpBuf));
+            ExpBuf.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            ExpBuf.index = i;
+            ExpBuf.flags = O_RDONLY | O_CLOEXEC;
+            if (ioctl(camera->dev_fd_, VIDIOC_EXPBUF, &ExpBuf)) {
+                perror("Fail to ioctl : VIDIOC_EXPBUF");
+            } else {
+                camera->pcamera_buffer_[i].dmabuf_fd = ExpBuf.fd;
+            }
+        }
+
+        camera->pcamera_frame_[i].camera_    = camera;
+        camera->pcamera_frame_[i].data_      = camera->pcamera_buffer_[i].pstart;
+        camera->pcamera_frame_[i].width_     = camera->width_;
+        camera->pcamera_frame_[i].height_    = camera->height_;
+        camera->pcamera_frame_[i].length_    = Buf.length;
+        camera->pcamera_frame_[i].index_     = i;
+        camera->pcamera_frame_[i].dmabuf_fd_ = camera->pcamera_buffer_[i].dmabuf_fd;
+
         if (ioctl(camera->dev_fd_, VIDIOC_QBUF, &Buf)) {
             perror("Unable to queue buffer");
             goto ErrorHandle;
@@ -303,7 +416,11 @@ int camera_open_from(camera_t* camera)
         goto ErrorHandle;
     }
     camera->state_                      = CAMERA_SATTE_OPEN;
+    camera->refs_                       = 1;
     camera->camera_capture_callback_set = camera_capture_callback_set;
+    camera->camera_frame_callback_set   = camera_frame_callback_set;
+    camera->camera_frame_release        = camera_frame_release;
+    camera->camera_get_stats            = camera_get_stats;
     camera->camera_capture_start        = camera_capture_start;
     camera->camera_capture_stop         = camera_capture_stop;
     camera->camera_set_ctx              = camera_set_ctx;
@@ -312,8 +429,7 @@ int camera_open_from(camera_t* camera)
 
 ErrorHandle:
     SLOGE("Camera open meet error, now handle it");
-    close(camera->dev_fd_);
-    free(camera->pcamera_buffer_);
+    camera_release_buffers(camera);
     return -1;
 }
 
@@ -324,6 +440,13 @@ camera_t* camera_open(const char* pdev_name, int width, int height, int fps, voi
     if (camera == NULL) return NULL;
     memset(camera, 0, sizeof(camera_t));
     camera->buffer_cnt_ = CONFIG_CAPTURE_BUF_CNT;
+    if (config) {
+        v4l2_config_t* v4l2_config = (v4l2_config_t*)config;
+        if (v4l2_config->buffer_cnt > 0) camera->buffer_cnt_ = v4l2_config->buffer_cnt;
+        if (camera->buffer_cnt_ < 2) camera->buffer_cnt_ = 2;
+        if (camera->buffer_cnt_ > CONFIG_CAPTURE_BUF_MAX) camera->buffer_cnt_ = CONFIG_CAPTURE_BUF_MAX;
+        camera->export_dmabuf_ = v4l2_config->export_dmabuf;
+    }
 
     int CopyLen = strlen(pdev_name);
     if (CopyLen > CONFIG_DEVNAME_LEN - 1) {
@@ -359,26 +482,19 @@ int camera_close(camera_t* camera)
         SLOGW("Skip close camera progress");
         return 0;
     }
+    if (camera->state_ == CAMERA_SATTE_CAP) camera_capture_stop(camera);
 
-    for (int i = 0; i < CONFIG_CAPTURE_BUF_CNT; i++) {
-        munmap(camera->pcamera_buffer_[i].pstart, camera->pcamera_buffer_[i].length);
-        camera->pcamera_buffer_[i].length = 0;
-    }
-
-    free(camera->pcamera_buffer_);
-    camera->pcamera_buffer_ = NULL;
-
-    int Off = 1;
-
-    if (ioctl(camera->dev_fd_, VIDIOC_STREAMOFF, &Off)) {
+    enum v4l2_buf_type BufType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(camera->dev_fd_, VIDIOC_STREAMOFF, &BufType)) {
         perror("Stop camera fail");
-        return -1;
     }
+    camera->state_ = CAMERA_STATE_CLOSE;
 
-    close(camera->dev_fd_);
-    if (camera->is_alloc_) free(camera);
-
-    SLOGI("camera closed");
+    int Held = __atomic_load_n(&camera->stats_.buffers_in_use_, __ATOMIC_ACQUIRE);
+    if (Held > 0) {
+        SLOGI("%d frame buffers still held, unmapped on their release", Held);
+    }
+    camera_put(camera);
 
     return 0;
-}
\ No newline at end of file
+}
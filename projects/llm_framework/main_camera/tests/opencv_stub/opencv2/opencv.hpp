@@ -0,0 +1,67 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+/*
+ * Stand-in for the few OpenCV calls frame_fanout.hpp makes, so the camera's frame path can be tested on a host
+ * without OpenCV. No pixels are converted: a Mat only carries its size and the first byte of the frame it came
+ * from, and imencode() writes a text "JPEG" naming size, quality and that byte, so tests can tell which frame
+ * a client was sent and how it was encoded. Encodes are counted in cv::stub_encodes.
+ */
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#define CV_8UC2 (0)
+
+namespace cv {
+
+enum { COLOR_YUV2BGR_YUYV = 0, INTER_AREA = 0, IMWRITE_JPEG_QUALITY = 1 };
+
+inline std::atomic<int> stub_encodes(0);
+
+struct Size {
+    Size(int w, int h) : width(w), height(h)
+    {
+    }
+    int width;
+    int height;
+};
+
+struct Mat {
+    Mat() = default;
+    Mat(int r, int c, int, void *d) : rows(r), cols(c), tag(d ? *(const unsigned char *)d : 0)
+    {
+    }
+    int rows          = 0;
+    int cols          = 0;
+    unsigned char tag = 0;
+};
+
+inline void cvtColor(const Mat &src, Mat &dst, int)
+{
+    dst = src;
+}
+
+inline void resize(const Mat &src, Mat &dst, Size size, double, double, int)
+{
+    dst      = src;
+    dst.cols = size.width;
+    dst.rows = size.height;
+}
+
+inline bool imencode(const std::string &, const Mat &img, std::vector<unsigned char> &buf,
+                     const std::vector<int> &params = std::vector<int>())
+{
+    int quality = (params.size() >= 2) ? params[1] : 95;
+    char text[64];
+    int len = snprintf(text, sizeof(text), "JPEG %dx%d q%d f%d", img.cols, img.rows, quality, img.tag);
+    buf.assign(text, text + len);
+    stub_encodes++;
+    return true;
+}
+
+}  // namespace cv
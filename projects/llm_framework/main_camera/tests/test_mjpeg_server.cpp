@@ -0,0 +1,378 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * The webstream server over real loopback sockets, fed through the frame fan-out like the camera feeds it:
+ * several stream clients at once, per-client fps / quality / size, keep-alive snapshots, and the 404, 405 and
+ * 503 answers. Built against the OpenCV stand-in in opencv_stub/, whose "JPEG" names the size, quality and
+ * frame it was encoded from.
+ */
+#include "mjpeg_server.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+static const int frame_w = 640;
+static const int frame_h = 480;
+
+static mjpeg_server_config_t test_config(int port)
+{
+    mjpeg_server_config_t config = {port, 4, 2, 0, 80, 0, 0, 2000};
+    return config;
+}
+
+// a camera stand-in: publishes frames whose bytes are all the frame number, at about fps
+class frame_source {
+public:
+    frame_source(mjpeg_server &server, int fps) : fanout_(frame_w, frame_h), fps_(fps), running_(true)
+    {
+        fanout_.add_consumer(std::bind(&mjpeg_server::push, &server, std::placeholders::_1));
+        thread_ = std::thread([this] {
+            std::vector<uint8_t> yuyv(frame_w * frame_h * 2);
+            for (int n = 1; running_; n++) {
+                std::fill(yuyv.begin(), yuyv.end(), (uint8_t)n);
+                fanout_.publish(yuyv.data(), (int)yuyv.size());
+                std::this_thread::sleep_for(std::chrono::microseconds(1000000 / fps_));
+            }
+        });
+    }
+
+    ~frame_source()
+    {
+        running_ = false;
+        thread_.join();
+        fanout_.stop();
+    }
+
+private:
+    camera_fanout::frame_fanout fanout_;
+    int fps_;
+    std::atomic_bool running_;
+    std::thread thread_;
+};
+
+class http_client {
+public:
+    explicit http_client(int port)
+    {
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        connected_           = connect(fd_, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    }
+
+    ~http_client()
+    {
+        close(fd_);
+    }
+
+    bool connected() const
+    {
+        return connected_;
+    }
+
+    bool send_request(const std::string &request)
+    {
+        return send(fd_, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size();
+    }
+
+    bool get(const std::string &target, const std::string &headers = "")
+    {
+        return send_request("GET " + target + " HTTP/1.1\r\nHost: localhost\r\n" + headers + "\r\n");
+    }
+
+    // header block up to the blank line, empty on timeout or close
+    std::string read_head(int timeout_ms = 5000)
+    {
+        for (;;) {
+            size_t end = buf_.find("\r\n\r\n");
+            if (end != std::string::npos) {
+                std::string head = buf_.substr(0, end + 4);
+                buf_.erase(0, end + 4);
+                return head;
+            }
+            if (!fill(timeout_ms)) return "";
+        }
+    }
+
+    std::string read_body(size_t size, int timeout_ms = 5000)
+    {
+        while (buf_.size() < size) {
+            if (!fill(timeout_ms)) return "";
+        }
+        std::string body = buf_.substr(0, size);
+        buf_.erase(0, size);
+        return body;
+    }
+
+    // one response or multipart part: its header block and Content-Length body
+    bool read_message(std::string &head, std::string &body, int timeout_ms = 5000)
+    {
+        head = read_head(timeout_ms);
+        if (head.empty()) return false;
+        size_t pos = head.find("Content-Length: ");
+        if (pos == std::string::npos) return false;
+        body = read_body(atoi(head.c_str() + pos + 16), timeout_ms);
+        return true;
+    }
+
+    // true once the server closed the connection
+    bool closed_by_peer(int timeout_ms = 2000)
+    {
+        while (fill(timeout_ms)) {
+        }
+        return eof_;
+    }
+
+private:
+    bool fill(int timeout_ms)
+    {
+        struct pollfd pfd = {fd_, POLLIN, 0};
+        if (poll(&pfd, 1, timeout_ms) <= 0) return false;
+        char tmp[4096];
+        ssize_t len = recv(fd_, tmp, sizeof(tmp), 0);
+        if (len <= 0) {
+            eof_ = true;
+            return false;
+        }
+        buf_.append(tmp, len);
+        return true;
+    }
+
+    int fd_;
+    bool connected_ = false;
+    bool eof_       = false;
+    std::string buf_;
+};
+
+static int status_of(const std::string &head)
+{
+    int status = 0;
+    sscanf(head.c_str(), "HTTP/1.1 %d", &status);
+    return status;
+}
+
+static bool wait_clients(mjpeg_server &server, int num)
+{
+    for (int i = 0; i < 300; i++) {
+        if (server.client_num() == num) return true;
+        usleep(10000);
+    }
+    return false;
+}
+
+struct stream_result {
+    int parts = 0;
+    std::vector<std::string> jpegs;
+};
+
+// reads parts for the given time, returns the part bodies
+static stream_result read_stream(http_client &client, int ms)
+{
+    stream_result result;
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    std::string head, body;
+    while (std::chrono::steady_clock::now() < until) {
+        if (!client.read_message(head, body, 200)) continue;
+        if (head.find("--boundarydonotcross") == std::string::npos) continue;
+        result.parts++;
+        result.jpegs.push_back(body);
+    }
+    return result;
+}
+
+static bool all_start_with(const stream_result &result, const std::string &prefix)
+{
+    for (const auto &jpeg : result.jpegs) {
+        if (jpeg.compare(0, prefix.size(), prefix) != 0) return false;
+    }
+    return !result.jpegs.empty();
+}
+
+// three clients at once, each with its own rate, quality and size
+static void test_stream_clients(int port)
+{
+    mjpeg_server server(test_config(port));
+    CHECK(server.start() == 0);
+    frame_source source(server, 40);
+
+    http_client full(port), slow(port), small(port);
+    CHECK(full.connected() && slow.connected() && small.connected());
+    full.get("/stream");
+    slow.get("/stream?fps=5&quality=30");
+    small.get("/?width=320&quality=50");
+    std::string head = full.read_head();
+    CHECK((status_of(head) == 200) && (head.find("multipart/x-mixed-replace") != std::string::npos));
+    CHECK(status_of(slow.read_head()) == 200);
+    CHECK(status_of(small.read_head()) == 200);
+    CHECK(wait_clients(server, 3));
+
+    stream_result full_parts, slow_parts, small_parts;
+    std::thread t1([&] { full_parts = read_stream(full, 1500); });
+    std::thread t2([&] { slow_parts = read_stream(slow, 1500); });
+    std::thread t3([&] { small_parts = read_stream(small, 1500); });
+    t1.join();
+    t2.join();
+    t3.join();
+
+    // 40 fps source: every frame for the unthrottled clients (allowing for loaded hosts), 5 fps for the slow one
+    CHECK(full_parts.parts >= 20);
+    CHECK(small_parts.parts >= 20);
+    CHECK((slow_parts.parts >= 4) && (slow_parts.parts <= 10));
+    CHECK(all_start_with(full_parts, "JPEG 640x480 q80 "));
+    CHECK(all_start_with(slow_parts, "JPEG 640x480 q30 "));
+    // height follows the aspect ratio
+    CHECK(all_start_with(small_parts, "JPEG 320x240 q50 "));
+    // parts are consecutive frames, not the same one resent
+    CHECK((full_parts.jpegs.size() >= 2) && (full_parts.jpegs.front() != full_parts.jpegs.back()));
+    server.stop();
+}
+
+// clients asking for the same encoding share one encode per frame
+static void test_shared_encode(int port)
+{
+    mjpeg_server server(test_config(port));
+    CHECK(server.start() == 0);
+    http_client a(port), b(port);
+    a.get("/stream?quality=60");
+    b.get("/stream?quality=60");
+    a.read_head();
+    b.read_head();
+    CHECK(wait_clients(server, 2));
+
+    int before = cv::stub_encodes;
+    stream_result a_parts, b_parts;
+    {
+        frame_source source(server, 20);
+        std::thread t1([&] { a_parts = read_stream(a, 1000); });
+        std::thread t2([&] { b_parts = read_stream(b, 1000); });
+        t1.join();
+        t2.join();
+    }
+    int encodes = cv::stub_encodes - before;
+    CHECK((a_parts.parts >= 10) && (b_parts.parts >= 10));
+    CHECK(encodes <= std::max(a_parts.parts, b_parts.parts) + 2);
+    server.stop();
+}
+
+// several snapshots on one connection, then Connection: close ends it
+static void test_snapshot_keep_alive(int port)
+{
+    mjpeg_server server(test_config(port));
+    CHECK(server.start() == 0);
+    frame_source source(server, 30);
+
+    http_client client(port);
+    std::string head, body, first;
+    for (int i = 0; i < 3; i++) {
+        CHECK(client.get(i == 1 ? "/snapshot?width=160&quality=20" : "/snapshot"));
+        CHECK(client.read_message(head, body));
+        CHECK(status_of(head) == 200);
+        CHECK(head.find("Connection: keep-alive") != std::string::npos);
+        CHECK(head.find("Content-Type: image/jpeg") != std::string::npos);
+        CHECK(body.compare(0, 17, (i == 1) ? "JPEG 160x120 q20 " : "JPEG 640x480 q80 ") == 0);
+        if (i == 0) first = body;
+        usleep(100000);
+    }
+    // a later snapshot is a later frame
+    CHECK(body != first);
+    CHECK(wait_clients(server, 1));
+
+    CHECK(client.get("/snapshot", "Connection: close\r\n"));
+    CHECK(client.read_message(head, body));
+    CHECK(head.find("Connection: close") != std::string::npos);
+    CHECK(client.closed_by_peer());
+    server.stop();
+}
+
+static void test_errors(int port)
+{
+    mjpeg_server_config_t config = test_config(port);
+    config.max_clients           = 2;
+    mjpeg_server server(config);
+    CHECK(server.start() == 0);
+    std::string head, body;
+
+    // unknown paths answer 404 and keep the connection
+    {
+        http_client client(port);
+        client.get("/nothing");
+        CHECK(client.read_message(head, body) && (status_of(head) == 404));
+        client.get("/favicon.ico");
+        CHECK(client.read_message(head, body) && (status_of(head) == 404));
+    }
+    // anything but GET answers 405 and closes
+    {
+        http_client client(port);
+        client.send_request("POST /stream HTTP/1.1\r\nContent-Length: 0\r\n\r\n");
+        CHECK(client.read_message(head, body) && (status_of(head) == 405));
+        CHECK(client.closed_by_peer());
+    }
+    // a snapshot with no camera frame answers 503 after the frame timeout
+    {
+        http_client client(port);
+        client.get("/snapshot");
+        CHECK(client.read_message(head, body, 6000) && (status_of(head) == 503) && (body == "No Frame"));
+    }
+    // a client over max_clients answers 503 and is closed
+    CHECK(wait_clients(server, 0));
+    {
+        http_client a(port), b(port);
+        a.get("/stream");
+        b.get("/stream");
+        a.read_head(500);
+        b.read_head(500);
+        CHECK(wait_clients(server, 2));
+        http_client c(port);
+        CHECK(c.read_message(head, body) && (status_of(head) == 503) && (body == "Too many clients"));
+        CHECK(c.closed_by_peer());
+    }
+    // the slots free up once those clients leave
+    CHECK(wait_clients(server, 0));
+    {
+        http_client client(port);
+        client.get("/nothing");
+        CHECK(client.read_message(head, body) && (status_of(head) == 404));
+    }
+    server.stop();
+}
+
+int main()
+{
+    // a port per test, so a socket of the previous one in TIME_WAIT cannot get in the way
+    int port = 20000 + getpid() % 20000;
+    test_stream_clients(port);
+    test_shared_encode(port + 1);
+    test_snapshot_keep_alive(port + 2);
+    test_errors(port + 3);
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_mjpeg_server: ok\n");
+    return 0;
+}
@@ -0,0 +1,429 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * The V4L2 capture backend against a fake device: the system calls v4l2_camera.c makes on FAKE_DEVICE are
+ * answered here (the link wraps open, close, ioctl, mmap, munmap and poll), so buffer hand-out, frame
+ * references, close with frames still held and the open error path run without hardware, and every mapping
+ * and file descriptor can be accounted for.
+ *
+ * With V4L2_TEST_DEVICE=/dev/videoN (e.g. the vivid test driver) the capture and held-frame tests also run
+ * against that device, checking behaviour only.
+ */
+#include "camera.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+#define FAKE_DEVICE "/dev/fake-video0"
+
+// one simulated capture device, at most one open at a time
+struct fake_device {
+    std::mutex mtx;
+    int fd            = -1;
+    uint32_t width    = 0;
+    uint32_t height   = 0;
+    bool streaming    = false;
+    uint32_t sequence = 0;
+    std::vector<void *> maps;
+    std::deque<int> queued;
+    std::set<int> dmabuf_fds;
+    std::set<void *> mapped;
+    int qbuf_while_stopped = 0;
+    int double_qbuf        = 0;
+    // failure injection: the ioctl that fails, for VIDIOC_EXPBUF / VIDIOC_QBUF only on buffer fail_index
+    unsigned long fail_request = 0;
+    int fail_index             = -1;
+
+    // between tests, with no device open
+    void reset()
+    {
+        streaming          = false;
+        sequence           = 0;
+        qbuf_while_stopped = 0;
+        double_qbuf        = 0;
+        fail_request       = 0;
+        fail_index         = -1;
+        maps.clear();
+        queued.clear();
+    }
+};
+
+static fake_device fake;
+static std::atomic<int> fake_dev_open(0);
+
+extern "C" {
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+int __real_ioctl(int fd, unsigned long request, ...);
+void *__real_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+int __real_munmap(void *addr, size_t length);
+int __real_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+int __wrap_open(const char *path, int flags, ...)
+{
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = va_arg(args, mode_t);
+    va_end(args);
+    if (strcmp(path, FAKE_DEVICE) != 0) return __real_open(path, flags, mode);
+    std::lock_guard<std::mutex> guard(fake.mtx);
+    fake.fd = __real_open("/dev/null", O_RDWR);
+    fake_dev_open++;
+    return fake.fd;
+}
+
+int __wrap_close(int fd)
+{
+    {
+        std::lock_guard<std::mutex> guard(fake.mtx);
+        if ((fd >= 0) && (fd == fake.fd)) {
+            fake.fd = -1;
+            fake_dev_open--;
+        }
+        fake.dmabuf_fds.erase(fd);
+    }
+    return __real_close(fd);
+}
+
+static int fake_ioctl(unsigned long request, void *arg)
+{
+    std::lock_guard<std::mutex> guard(fake.mtx);
+    auto fail = [&](int index) {
+        return (request == fake.fail_request) && ((fake.fail_index < 0) || (index == fake.fail_index));
+    };
+    switch (request) {
+        case VIDIOC_QUERYCAP: {
+            struct v4l2_capability *cap = (struct v4l2_capability *)arg;
+            memset(cap, 0, sizeof(*cap));
+            strcpy((char *)cap->driver, "fake");
+            cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+            break;
+        }
+        case VIDIOC_ENUM_FMT: {
+            struct v4l2_fmtdesc *desc = (struct v4l2_fmtdesc *)arg;
+            if (desc->index > 0) {
+                errno = EINVAL;
+                return -1;
+            }
+            desc->pixelformat = V4L2_PIX_FMT_YUYV;
+            break;
+        }
+        case VIDIOC_S_FMT: {
+            struct v4l2_format *fmt = (struct v4l2_format *)arg;
+            fake.width              = fmt->fmt.pix.width;
+            fake.height             = fmt->fmt.pix.height;
+            break;
+        }
+        case VIDIOC_G_FMT: {
+            struct v4l2_format *fmt  = (struct v4l2_format *)arg;
+            fmt->fmt.pix.width       = fake.width;
+            fmt->fmt.pix.height      = fake.height;
+            fmt->fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+            break;
+        }
+        case VIDIOC_REQBUFS: {
+            struct v4l2_requestbuffers *req = (struct v4l2_requestbuffers *)arg;
+            fake.maps.assign(req->count, NULL);
+            break;
+        }
+        case VIDIOC_QUERYBUF: {
+            struct v4l2_buffer *buf = (struct v4l2_buffer *)arg;
+            buf->length             = fake.width * fake.height * 2;
+            buf->m.offset           = buf->index * 0x100000;
+            break;
+        }
+        case VIDIOC_EXPBUF: {
+            struct v4l2_exportbuffer *exp = (struct v4l2_exportbuffer *)arg;
+            if (fail(exp->index)) {
+                errno = EINVAL;
+                return -1;
+            }
+            exp->fd = __real_open("/dev/null", O_RDONLY);
+            fake.dmabuf_fds.insert(exp->fd);
+            break;
+        }
+        case VIDIOC_QBUF: {
+            struct v4l2_buffer *buf = (struct v4l2_buffer *)arg;
+            if (fail(buf->index)) {
+                errno = EINVAL;
+                return -1;
+            }
+            for (int index : fake.queued) {
+                if (index == (int)buf->index) fake.double_qbuf++;
+            }
+            if (!fake.streaming && (fake.sequence > 0)) fake.qbuf_while_stopped++;
+            fake.queued.push_back(buf->index);
+            break;
+        }
+        case VIDIOC_DQBUF: {
+            struct v4l2_buffer *buf = (struct v4l2_buffer *)arg;
+            if (!fake.streaming || fake.queued.empty()) {
+                errno = EAGAIN;
+                return -1;
+            }
+            buf->index = fake.queued.front();
+            fake.queued.pop_front();
+            buf->bytesused = fake.width * fake.height * 2;
+            buf->sequence  = fake.sequence;
+            // every byte of a frame is its sequence number
+            memset(fake.maps[buf->index], (int)(fake.sequence & 0xFF), buf->bytesused);
+            fake.sequence++;
+            break;
+        }
+        case VIDIOC_STREAMON:
+            if (fail(-1)) {
+                errno = EIO;
+                return -1;
+            }
+            fake.streaming = true;
+            break;
+        case VIDIOC_STREAMOFF:
+            fake.streaming = false;
+            fake.queued.clear();
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+    va_list args;
+    va_start(args, request);
+    void *arg = va_arg(args, void *);
+    va_end(args);
+    bool is_fake;
+    {
+        std::lock_guard<std::mutex> guard(fake.mtx);
+        is_fake = (fd >= 0) && (fd == fake.fd);
+    }
+    return is_fake ? fake_ioctl(request, arg) : __real_ioctl(fd, request, arg);
+}
+
+void *__wrap_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+    std::lock_guard<std::mutex> guard(fake.mtx);
+    if ((fd < 0) || (fd != fake.fd)) return __real_mmap(addr, length, prot, flags, fd, offset);
+    void *map = __real_mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    fake.maps[offset / 0x100000] = map;
+    fake.mapped.insert(map);
+    return map;
+}
+
+int __wrap_munmap(void *addr, size_t length)
+{
+    {
+        std::lock_guard<std::mutex> guard(fake.mtx);
+        fake.mapped.erase(addr);
+    }
+    return __real_munmap(addr, length);
+}
+
+int __wrap_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    bool is_fake, ready;
+    {
+        std::lock_guard<std::mutex> guard(fake.mtx);
+        is_fake = (nfds == 1) && (fds[0].fd >= 0) && (fds[0].fd == fake.fd);
+        ready   = fake.streaming && !fake.queued.empty();
+    }
+    if (!is_fake) return __real_poll(fds, nfds, timeout);
+    // about 500 fps when a buffer is queued, the full timeout in 10 ms steps otherwise
+    usleep(ready ? 2000 : 10000);
+    fds[0].revents = ready ? POLLIN : 0;
+    return ready ? 1 : 0;
+}
+}
+
+struct capture_state {
+    std::mutex mtx;
+    std::vector<camera_frame_t *> held;
+    int hold       = 0;
+    int frames     = 0;
+    int bad_frames = 0;
+    bool check_pattern = true;
+};
+
+static void on_frame(camera_frame_t *frame, void *ctx)
+{
+    capture_state *state = (capture_state *)ctx;
+    std::lock_guard<std::mutex> guard(state->mtx);
+    state->frames++;
+    const uint8_t *data = (const uint8_t *)frame->data_;
+    if (state->check_pattern) {
+        uint8_t expect = (uint8_t)(frame->sequence_ & 0xFF);
+        if ((frame->length_ != frame->width_ * frame->height_ * 2) || (data[0] != expect) ||
+            (data[frame->length_ - 1] != expect)) {
+            state->bad_frames++;
+        }
+    }
+    if ((int)state->held.size() < state->hold) {
+        camera_frame_ref(frame);
+        state->held.push_back(frame);
+    }
+}
+
+static bool wait_frames(capture_state &state, int frames)
+{
+    for (int i = 0; i < 500; i++) {
+        {
+            std::lock_guard<std::mutex> guard(state.mtx);
+            if (state.frames >= frames) return true;
+        }
+        usleep(10000);
+    }
+    return false;
+}
+
+static camera_t *open_camera(const char *dev, int export_dmabuf)
+{
+    v4l2_config_t config = {4, export_dmabuf};
+    return camera_open(dev, 64, 48, 30, &config);
+}
+
+static void test_capture(const char *dev, bool is_fake)
+{
+    camera_t *cam = open_camera(dev, is_fake ? 1 : 0);
+    CHECK(cam != NULL);
+    if (!cam) return;
+    if (is_fake) {
+        CHECK(cam->buffer_cnt_ == 4);
+        for (int i = 0; i < cam->buffer_cnt_; i++) CHECK(cam->pcamera_frame_[i].dmabuf_fd_ >= 0);
+    }
+
+    capture_state state;
+    state.check_pattern = is_fake;
+    cam->camera_set_ctx(cam, &state);
+    CHECK(cam->camera_frame_callback_set(cam, on_frame) == 0);
+    CHECK(cam->camera_capture_start(cam) == 0);
+    CHECK(wait_frames(state, 20));
+    cam->camera_capture_stop(cam);
+
+    CAMERA_Stats_t stats;
+    cam->camera_get_stats(cam, &stats);
+    CHECK(stats.captured_ >= 20);
+    CHECK(stats.buffers_in_use_ == 0);
+    CHECK(state.bad_frames == 0);
+    CHECK(camera_close(cam) == 0);
+
+    if (is_fake) {
+        CHECK(fake.mapped.empty());
+        CHECK(fake.dmabuf_fds.empty());
+        CHECK(fake_dev_open == 0);
+        CHECK(fake.double_qbuf == 0);
+    }
+}
+
+/*
+ * The consumer keeps three frames past close: they stay mapped and readable, are not queued back to the
+ * stopped device, and the last unref unmaps everything and frees the camera (LeakSanitizer checks the free).
+ */
+static void test_close_with_held_frames(const char *dev, bool is_fake)
+{
+    camera_t *cam = open_camera(dev, is_fake ? 1 : 0);
+    CHECK(cam != NULL);
+    if (!cam) return;
+
+    capture_state state;
+    state.check_pattern = is_fake;
+    state.hold          = 3;
+    cam->camera_set_ctx(cam, &state);
+    cam->camera_frame_callback_set(cam, on_frame);
+    cam->camera_capture_start(cam);
+    CHECK(wait_frames(state, 10));
+    // close without stopping capture first, close stops it
+    CHECK(camera_close(cam) == 0);
+
+    CHECK(state.held.size() == 3);
+    if (is_fake) {
+        CHECK(fake.mapped.size() == 4);
+        CHECK(fake.dmabuf_fds.size() == 4);
+        CHECK(fake_dev_open == 1);
+    }
+    for (size_t i = 0; i < state.held.size(); i++) {
+        camera_frame_t *frame = state.held[i];
+        const uint8_t *data   = (const uint8_t *)frame->data_;
+        if (is_fake) CHECK(data[frame->length_ / 2] == (uint8_t)(frame->sequence_ & 0xFF));
+        camera_frame_unref(frame);
+        if (is_fake && (i + 1 < state.held.size())) CHECK(fake.mapped.size() == 4);
+    }
+
+    if (is_fake) {
+        CHECK(fake.mapped.empty());
+        CHECK(fake.dmabuf_fds.empty());
+        CHECK(fake_dev_open == 0);
+        CHECK(fake.qbuf_while_stopped == 0);
+    }
+}
+
+// a failure after some buffers were mapped and exported releases all of them and the device
+static void test_open_error(unsigned long request, int index)
+{
+    fake.reset();
+    fake.fail_request = request;
+    fake.fail_index   = index;
+    CHECK(open_camera(FAKE_DEVICE, 1) == NULL);
+    CHECK(fake.mapped.empty());
+    CHECK(fake.dmabuf_fds.empty());
+    CHECK(fake_dev_open == 0);
+    fake.reset();
+}
+
+int main()
+{
+    fake.reset();
+    test_capture(FAKE_DEVICE, true);
+    fake.reset();
+    test_close_with_held_frames(FAKE_DEVICE, true);
+    test_open_error(VIDIOC_STREAMON, -1);
+    test_open_error(VIDIOC_QBUF, 2);
+    // a buffer that cannot be exported is only logged, the camera opens without its DMABUF
+    fake.reset();
+    fake.fail_request = VIDIOC_EXPBUF;
+    fake.fail_index   = 1;
+    camera_t *cam     = open_camera(FAKE_DEVICE, 1);
+    CHECK((cam != NULL) && (cam->pcamera_frame_[1].dmabuf_fd_ == -1) && (cam->pcamera_frame_[2].dmabuf_fd_ >= 0));
+    if (cam) camera_close(cam);
+    CHECK(fake.dmabuf_fds.empty() && fake.mapped.empty());
+
+    const char *dev = getenv("V4L2_TEST_DEVICE");
+    if (dev) {
+        printf("running against %s\n", dev);
+        test_capture(dev, false);
+        test_close_with_held_frames(dev, false);
+    }
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_v4l2_camera: ok\n");
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include "runner/LLM.hpp"
 #include "runner/Token2wav.hpp"
 #include "runner/utils/wav.hpp"
+#include "voice_cache.hpp"
 
 #include <signal.h>
 #include <sys/stat.h>
@@ -42,6 +43,11 @@ static std::string base_model_config_path_;
 
 typedef std::function<void(const std::string &data, bool finish)> task_callback_t;
 
+typedef struct {
+    std::string text;   // empty stops the inference thread
+    std::string voice;  // empty speaks with the task voice
+} inference_async_par;
+
 #define CONFIG_AUTO_SET(obj, key)             \
     if (config_body.contains(#key))           \
         mode_config_.key = config_body[#key]; \
@@ -60,20 +66,25 @@ private:
     std::atomic_bool tokenizer_server_flage_;
     unsigned int port_;
     pid_t tokenizer_pid_ = -1;
-    std::mutex g_buffer_mutex;
-    std::condition_variable g_buffer_cv;
-    std::atomic<bool> g_llm_finished{false};
     std::atomic<bool> g_stop{false};
-    TokenBuffer g_token_buffer;
-
-    std::vector<int> prompt_text_token;
-    std::vector<unsigned short> prompt_text_embeds;
-    std::vector<int> prompt_speech_token;
-    std::vector<unsigned short> prompt_speech_embeds;
 
-    std::vector<float> prompt_feat;
-    std::vector<float> prompt_speech_embeds_flow;
-    std::vector<float> spk_embeds;
+    // LLM -> flow -> vocoder pipeline of one utterance, the stages run on their own threads
+    typedef struct {
+        std::vector<float> mel;
+        int neg_offset;
+        bool finalize;
+    } mel_chunk_t;
+    TokenQueue token_queue_{1024};
+    spsc_queue<mel_chunk_t> mel_queue_{2};
+    std::vector<SpeechToken> tokens_;  // the flow chunks overlap, every token of the utterance is kept
+    std::vector<float> speech_;
+    std::vector<float> output_;  // whole utterance, only kept for file output
+    std::vector<float> resampled_pcm_;
+    std::vector<int16_t> wav_pcm_;
+
+    voice_store voices_;
+    voice_embed_cache voice_cache_;
+    voice_embed_ptr default_voice_;  // prompt_dir voice, always kept
 
 public:
     enum inference_status { INFERENCE_NONE = 0, INFERENCE_RUNNING };
@@ -83,6 +94,7 @@ public:
     std::unique_ptr<Token2Wav> lToken2Wav_;
     std::string model_;
     std::string response_format_;
+    std::string voice_;
     std::vector<std::string> inputs_;
     std::string prompt_;
     std::string last_reply;
@@ -98,7 +110,7 @@ public:
     bool enstream_;
 
     std::unique_ptr<std::thread> inference_run_;
-    thread_safe::list<std::string> async_list_;
+    thread_safe::list<inference_async_par> async_list_;
 
     void set_output(task_callback_t out_callback)
     {
@@ -111,6 +123,7 @@ public:
             model_           = config_body.at("model");
             response_format_ = config_body.at("response_format");
             enoutput_        = config_body.at("enoutput");
+            voice_           = config_body.value("voice", std::string());
 
             if (config_body.contains("input")) {
                 if (config_body["input"].is_string()) {
@@ -210,6 +223,8 @@ public:
             INFER_CONFIG_AUTO_SET(file_body["mode_param"], hift_p1_50_first);
             INFER_CONFIG_AUTO_SET(file_body["mode_param"], hift_p1_58);
             INFER_CONFIG_AUTO_SET(file_body["mode_param"], prompt_dir);
+            INFER_CONFIG_AUTO_SET(file_body["mode_param"], voice_dir);
+            INFER_CONFIG_AUTO_SET(file_body["mode_param"], voice_cache_num);
             {
                 auto has_http = [](const std::string &s) { return s.find("http") != std::string::npos; };
 
@@ -294,6 +309,7 @@ public:
                 (fs::path(base_model) / infer_mode_config_.prompt_dir / infer_mode_config_.prompt_speech_feat).string();
             infer_mode_config_.flow_embedding =
                 (fs::path(base_model) / infer_mode_config_.prompt_dir / infer_mode_config_.flow_embedding).string();
+            infer_mode_config_.voice_dir = (fs::path(base_model) / infer_mode_config_.voice_dir).string();
 
             mode_config_.runing_callback = [this](int *p_token, int n_token, const char *p_str, float token_per_sec,
                                                   void *reserve) {
@@ -302,10 +318,11 @@ public:
                 }
             };
 
-            if (readtxt(infer_mode_config_.prompt_text, prompt_text_token)) return -3;
-            if (readtxt(infer_mode_config_.llm_prompt_speech_token, prompt_speech_token)) return -3;
-            if (readtxt(infer_mode_config_.prompt_speech_feat, prompt_feat)) return -3;
-            if (readtxt<float>(infer_mode_config_.flow_embedding, spk_embeds)) return -3;
+            voice_prompt_t prompt;
+            if (readtxt(infer_mode_config_.prompt_text, prompt.text_token)) return -3;
+            if (readtxt(infer_mode_config_.llm_prompt_speech_token, prompt.speech_token)) return -3;
+            if (readtxt(infer_mode_config_.prompt_speech_feat, prompt.speech_feat)) return -3;
+            if (readtxt<float>(infer_mode_config_.flow_embedding, prompt.spk_embeds)) return -3;
 
             lLaMa_ = std::make_unique<LLM>();
             if (!lLaMa_->Init(mode_config_)) {
@@ -319,9 +336,27 @@ public:
                 lLaMa_.reset();
                 return -1;
             }
-            lLaMa_->TextToken2Embeds(prompt_text_token, prompt_text_embeds);
-            lLaMa_->SpeechToken2Embeds(prompt_speech_token, prompt_speech_embeds);
-            lToken2Wav_->SpeechToken2Embeds(prompt_speech_token, prompt_speech_embeds_flow);
+            std::string error;
+            if (check_voice(prompt, error)) {
+                SLOGE("prompt_dir voice: %s", error.c_str());
+                return -3;
+            }
+            auto voice = std::make_shared<voice_embed_t>();
+            compute_voice(prompt, *voice);
+            default_voice_ = voice;
+            voices_.set_dir(infer_mode_config_.voice_dir);
+            voice_cache_.set_capacity(std::max(infer_mode_config_.voice_cache_num, 0));
+            if (!get_voice(voice_)) {
+                SLOGE("voice %s not found", voice_.c_str());
+                return -3;
+            }
+
+            int chunk_mel_len = infer_mode_config_.token_hop_len * infer_mode_config_.token_mel_ratio *
+                                infer_mode_config_.max_infer_chunk_num;
+            for (size_t i = 0; i < mel_queue_.capacity(); i++) {
+                mel_queue_.slot(i).mel.reserve(80 * chunk_mel_len);
+            }
+            tokens_.reserve(mode_config_.kv_cache_num);
 
         } catch (...) {
             SLOGE("config false");
@@ -330,6 +365,106 @@ public:
         return 0;
     }
 
+    // a prompt indexes the embedding tables and fills fixed size encoder inputs, reject anything out of range
+    int check_voice(const voice_prompt_t &prompt, std::string &error)
+    {
+        const Token2WavAttr &attr = lToken2Wav_->_attr;
+        size_t feat_len           = attr.prompt_token_len * attr.token_mel_ratio * 80;
+        if (prompt.text_token.empty()) {
+            error = "prompt_text_token is empty";
+            return -1;
+        }
+        for (int token : prompt.text_token) {
+            if ((token < 0) || (token >= mode_config_.tokens_embed_num)) {
+                error = "prompt_text_token out of range: " + std::to_string(token);
+                return -1;
+            }
+        }
+        if (prompt.speech_token.size() < (size_t)attr.prompt_token_len) {
+            error = "prompt_speech_token needs at least " + std::to_string(attr.prompt_token_len) + " tokens";
+            return -1;
+        }
+        for (int token : prompt.speech_token) {
+            if ((token < 0) || (token >= attr.flow_embed_num)) {
+                error = "prompt_speech_token out of range: " + std::to_string(token);
+                return -1;
+            }
+        }
+        if ((prompt.speech_feat.size() < feat_len) || (prompt.speech_feat.size() % 80)) {
+            error = "prompt_speech_feat needs at least " + std::to_string(feat_len) + " values, 80 per frame";
+            return -1;
+        }
+        if (prompt.spk_embeds.size() != (size_t)attr.spk_embed_size) {
+            error = "flow_embedding needs " + std::to_string(attr.spk_embed_size) + " values";
+            return -1;
+        }
+        return 0;
+    }
+
+    // the flow encoders take a prompt of exactly prompt_token_len tokens, it is cut once here
+    void compute_voice(voice_prompt_t &prompt, voice_embed_t &voice)
+    {
+        const Token2WavAttr &attr = lToken2Wav_->_attr;
+        std::vector<int> flow_token(prompt.speech_token.begin(), prompt.speech_token.begin() + attr.prompt_token_len);
+        lLaMa_->TextToken2Embeds(prompt.text_token, voice.text_embeds);
+        lLaMa_->SpeechToken2Embeds(prompt.speech_token, voice.speech_embeds);
+        lToken2Wav_->SpeechToken2Embeds(flow_token, voice.speech_embeds_flow);
+        voice.feat.assign(prompt.speech_feat.begin(),
+                          prompt.speech_feat.begin() + attr.prompt_token_len * attr.token_mel_ratio * 80);
+        voice.spk_embeds = prompt.spk_embeds;
+    }
+
+    // empty or "default" is the prompt_dir voice, others come from the cache or the voice store
+    voice_embed_ptr get_voice(const std::string &name)
+    {
+        if (name.empty() || (name == "default")) return default_voice_;
+        voice_embed_ptr voice = voice_cache_.get(name);
+        if (voice) return voice;
+        voice_prompt_t prompt;
+        std::string error;
+        if (voices_.load(name, prompt)) return nullptr;
+        if (check_voice(prompt, error)) {
+            SLOGE("voice %s: %s", name.c_str(), error.c_str());
+            return nullptr;
+        }
+        auto embeds = std::make_shared<voice_embed_t>();
+        compute_voice(prompt, *embeds);
+        voice_cache_.put(name, embeds);
+        return embeds;
+    }
+
+    int register_voice(const std::string &name, voice_prompt_t &prompt, std::string &error)
+    {
+        if (!voice_store::valid_name(name) || (name == "default")) {
+            error = "invalid voice name";
+            return -1;
+        }
+        if (check_voice(prompt, error)) return -1;
+        if (voices_.save(name, prompt)) {
+            error = "voice save failed";
+            return -1;
+        }
+        auto embeds = std::make_shared<voice_embed_t>();
+        compute_voice(prompt, *embeds);
+        voice_cache_.put(name, embeds);
+        return 0;
+    }
+
+    int delete_voice(const std::string &name)
+    {
+        // the task voice has to stay loadable
+        if ((name == voice_) || voices_.remove(name)) return -1;
+        voice_cache_.erase(name);
+        return 0;
+    }
+
+    std::vector<std::string> list_voices()
+    {
+        std::vector<std::string> names = voices_.list();
+        names.insert(names.begin(), "default");
+        return names;
+    }
+
     std::string prompt_complete(const std::string &input)
     {
         std::ostringstream oss_prompt;
@@ -358,8 +493,10 @@ public:
 
     void reset()
     {
-        g_llm_finished = false;
-        g_token_buffer.erase(g_token_buffer.begin(), g_token_buffer.end());
+        tokens_.clear();
+        output_.clear();
+        token_queue_.reset();
+        mel_queue_.reset();
         lToken2Wav_->clear();
     }
 
@@ -402,191 +539,192 @@ public:
         return (dir / oss.str()).string();
     }
 
-    int tts(const std::string &text, std::vector<unsigned short> &prompt_text_embeds,
-            std::vector<unsigned short> &prompt_speech_embeds, const std::vector<float> &prompt_feat,
-            const std::vector<float> &prompt_speech_embeds_flow, std::vector<float> &spk_embeds)
+    // resample one chunk of speech to the output rate and send it as 16 bit pcm
+    void send_speech(std::vector<float> &speech, bool finish)
     {
-        std::vector<float> output;
-        timer time_total;
-        time_total.start();
-        try {
-            int llm_ret = 0;
-            std::promise<int> prom;
-            std::future<int> fut = prom.get_future();
-            auto llm_thread_func = [this, &text, &prompt_text_embeds, &prompt_speech_embeds, &llm_ret, &prom]() {
-                llm_ret = lLaMa_->Run(text, prompt_text_embeds, prompt_speech_embeds, g_token_buffer, g_buffer_mutex,
-                                      g_buffer_cv, g_llm_finished);
-                prom.set_value(llm_ret);
-            };
-            std::thread llm_thread(llm_thread_func);
-            llm_thread.detach();
-
-            if (fut.wait_for(std::chrono::milliseconds(10)) == std::future_status::ready) {
-                int llm_ret = fut.get();
-                if (llm_ret == -1) {
-                    SLOGE("Error, Generate failed");
-                    if (out_callback_) out_callback_("Error, Generate failed", true);
-                    return llm_ret;
-                }
+        double src_ratio  = static_cast<double>(mode_config_.audio_rate) / static_cast<double>(mode_config_.mode_rate);
+        int resampled_len = 0;
+        resampled_pcm_.resize(static_cast<size_t>(speech.size() * src_ratio + 1));
+        if (!speech.empty()) {
+            resample_audio(speech.data(), speech.size(), resampled_pcm_.data(), &resampled_len, src_ratio);
+        }
+        wav_pcm_.resize(resampled_len);
+        for (int i = 0; i < resampled_len; i++) {
+            float val = resampled_pcm_[i];
+            if (val > 1.0f) val = 1.0f;
+            if (val < -1.0f) val = -1.0f;
+            wav_pcm_[i] = static_cast<int16_t>(val * 32767.0f);
+        }
+        if (out_callback_) {
+            out_callback_(std::string(reinterpret_cast<char *>(wav_pcm_.data()), wav_pcm_.size() * sizeof(int16_t)),
+                          finish);
+        }
+    }
+
+    // flow stage: cuts the token stream into overlapping chunks and hands their mel frames to the vocoder stage
+    int run_flow(const std::vector<float> &prompt_speech_embeds_flow, const std::vector<float> &prompt_feat,
+                 const std::vector<float> &spk_embeds)
+    {
+        const Token2WavAttr &attr = lToken2Wav_->_attr;
+        int hop_len               = attr.token_hop_len;
+        int token_offset          = 0;
+        SpeechToken token;
+        for (;;) {
+            while ((int)tokens_.size() - token_offset < hop_len + attr.pre_lookahead_len) {
+                if (!token_queue_.pop(token)) break;
+                tokens_.push_back(token);
             }
+            if (g_stop) return 1;
+            if ((int)tokens_.size() - token_offset < hop_len + attr.pre_lookahead_len) break;
 
-            int prompt_token_len = prompt_speech_embeds_flow.size() / lToken2Wav_->_attr.flow_embed_size;
-            if (prompt_token_len < 75) {
-                SLOGE("Error, prompt speech token len %d < 75", prompt_token_len);
-                if (llm_thread.joinable()) llm_thread.join();
-                if (out_callback_) {
-                    out_callback_("Error, prompt speech token len %d < 75", true);
-                }
+            int start = token_offset - std::min(token_offset / hop_len, attr.max_infer_chunk_num - 1) * hop_len;
+            int end   = token_offset + hop_len + attr.pre_lookahead_len;
+
+            mel_chunk_t *chunk = mel_queue_.write_slot();
+            if (!chunk) return 1;
+            chunk->finalize = false;
+            if (lToken2Wav_->infer_mel(tokens_.data() + start, end - start, prompt_speech_embeds_flow, prompt_feat,
+                                       spk_embeds, token_offset, false, chunk->mel, chunk->neg_offset)) {
                 return -1;
             }
+            mel_queue_.commit();
+            token_offset += hop_len;
+        }
 
-            int prompt_token_align_len = 75;
-            std::vector<float> prompt_speech_embeds_flow1;
-            prompt_speech_embeds_flow1.insert(prompt_speech_embeds_flow1.begin(), prompt_speech_embeds_flow.begin(),
-                                              prompt_speech_embeds_flow.begin() + prompt_token_align_len * 512);
-            std::vector<float> prompt_feat1;
-            prompt_feat1.insert(prompt_feat1.begin(), prompt_feat.begin(),
-                                prompt_feat.begin() + prompt_token_align_len * 2 * 80);
-            int promot_token_pad = 0;
-            int this_token_hop_len;
-            int token_offset = 0;
-            int i            = 0;
-            while (true) {
-                this_token_hop_len = (token_offset == 0) ? lToken2Wav_->_attr.token_hop_len + promot_token_pad
-                                                         : lToken2Wav_->_attr.token_hop_len;
-                std::unique_lock<std::mutex> lock(g_buffer_mutex);
-                g_buffer_cv.wait(lock, [&] {
-                    return (g_token_buffer.size() - token_offset >=
-                            this_token_hop_len + lToken2Wav_->_attr.pre_lookahead_len) ||
-                           g_llm_finished.load() || g_stop.load();
-                });
-                if (g_stop) {
-                    lock.unlock();
-                    break;
-                } else if (g_token_buffer.size() - token_offset >=
-                           this_token_hop_len + lToken2Wav_->_attr.pre_lookahead_len) {
-                    std::vector<SpeechToken> token;
-                    int start = token_offset - std::min(int(token_offset / lToken2Wav_->_attr.token_hop_len),
-                                                        lToken2Wav_->_attr.max_infer_chunk_num - 1) *
-                                                   lToken2Wav_->_attr.token_hop_len;
-                    int end = token_offset + this_token_hop_len + lToken2Wav_->_attr.pre_lookahead_len;
-                    token.insert(token.end(), g_token_buffer.begin() + start, g_token_buffer.begin() + end);
-                    lock.unlock();
-                    auto speech = lToken2Wav_->infer(token, prompt_speech_embeds_flow1, prompt_feat1, spk_embeds,
-                                                     token_offset, false);
-                    token_offset += this_token_hop_len;
-                    output.insert(output.end(), speech.begin(), speech.end());
-                    double src_ratio =
-                        static_cast<double>(mode_config_.audio_rate) / static_cast<double>(mode_config_.mode_rate);
-                    std::vector<float> resampled_pcm(static_cast<size_t>(speech.size() * src_ratio + 1));
-                    int resampled_len = 0;
-                    resample_audio(speech.data(), speech.size(), resampled_pcm.data(), &resampled_len, src_ratio);
-                    std::vector<int16_t> wav_pcm_data;
-                    wav_pcm_data.reserve(resampled_len);
-                    for (int i = 0; i < resampled_len; i++) {
-                        float val = resampled_pcm[i];
-                        if (val > 1.0f) val = 1.0f;
-                        if (val < -1.0f) val = -1.0f;
-                        wav_pcm_data.push_back(static_cast<int16_t>(val * 32767.0f));
-                    }
-                    if (out_callback_) {
-                        out_callback_(std::string(reinterpret_cast<char *>(wav_pcm_data.data()),
-                                                  wav_pcm_data.size() * sizeof(int16_t)),
-                                      false);
-                    }
-                    ++i;
-                } else if (g_llm_finished.load()) {
-                    lock.unlock();
-                    break;
-                } else {
-                    lock.unlock();
-                }
-            }
+        int token_num = tokens_.size();
+        int start     = token_num - std::min(token_num / hop_len, attr.max_infer_chunk_num - 1) * hop_len;
 
-            if (g_stop) {
-                g_token_buffer.erase(g_token_buffer.begin(), g_token_buffer.end());
-                return 1;
+        mel_chunk_t *chunk = mel_queue_.write_slot();
+        if (!chunk) return 1;
+        chunk->finalize = true;
+        if (lToken2Wav_->infer_mel(tokens_.data() + start, token_num - start, prompt_speech_embeds_flow, prompt_feat,
+                                   spk_embeds, token_offset - start, true, chunk->mel, chunk->neg_offset)) {
+            return -1;
+        }
+        mel_queue_.commit();
+        return 0;
+    }
+
+    // vocoder stage: every mel chunk is sent as audio as soon as it is synthesized
+    int run_vocoder(bool keep_output)
+    {
+        while (mel_chunk_t *chunk = mel_queue_.read_slot()) {
+            if (g_stop) return 1;
+            bool finish = chunk->finalize;
+            if (lToken2Wav_->infer_speech(chunk->mel, chunk->finalize, chunk->neg_offset, speech_)) return -1;
+            mel_queue_.release();
+            if (keep_output) output_.insert(output_.end(), speech_.begin(), speech_.end());
+            send_speech(speech_, finish);
+            if (finish) return 0;
+        }
+        return g_stop ? 1 : -1;
+    }
+
+    int tts(const std::string &text, const voice_embed_t &voice)
+    {
+        timer time_total;
+        time_total.start();
+        g_stop = false;
+        reset();
+        bool save_file = (response_format_.find("file") != std::string::npos);
+
+        int llm_ret = 0;
+        std::thread llm_thread([&] {
+            try {
+                llm_ret = lLaMa_->Run(text, voice.text_embeds, voice.speech_embeds, token_queue_);
+            } catch (const std::exception &e) {
+                SLOGE("llm error: %s", e.what());
+                llm_ret = -1;
+            }
+            token_queue_.close();
+        });
+        int flow_ret = 0;
+        std::thread flow_thread([&] {
+            try {
+                flow_ret = run_flow(voice.speech_embeds_flow, voice.feat, voice.spk_embeds);
+            } catch (const std::exception &e) {
+                SLOGE("flow error: %s", e.what());
+                flow_ret = -1;
             }
+            // an early exit stops the LLM instead of leaving it blocked on a full queue
+            if (flow_ret != 0) token_queue_.abort();
+            mel_queue_.close();
+        });
+        int ret = 0;
+        try {
+            ret = run_vocoder(save_file);
+        } catch (const std::exception &e) {
+            SLOGE("vocoder error: %s", e.what());
+            ret = -1;
+        }
+        mel_queue_.abort();
+        flow_thread.join();
+        llm_thread.join();
 
-            std::vector<SpeechToken> token;
-            int start = g_token_buffer.size() - std::min(int(g_token_buffer.size() / lToken2Wav_->_attr.token_hop_len),
-                                                         lToken2Wav_->_attr.max_infer_chunk_num - 1) *
-                                                    lToken2Wav_->_attr.token_hop_len;
-            token.insert(token.end(), g_token_buffer.begin() + start, g_token_buffer.end());
-            auto speech = lToken2Wav_->infer(token, prompt_speech_embeds_flow1, prompt_feat1, spk_embeds,
-                                             token_offset - start, true);
-            output.insert(output.end(), speech.begin(), speech.end());
+        if (g_stop) {
+            reset();
+            return 1;
+        }
+        if (llm_ret == LLM_RUN_NO_SPEECH) {
+            // the flow stage found no tokens to synthesize; end the stream without audio
+            SLOGW("no speech generated for the text");
+            speech_.clear();
+            send_speech(speech_, true);
+            reset();
+            return 0;
+        }
+        // an LLM failure is reported even when token2wav finished the tokens it got
+        if ((llm_ret == -1) || (ret != 0)) {
+            const char *err = (llm_ret == -1) ? "Error, Generate failed" : "Error, token2wav failed";
+            SLOGE("%s", err);
+            if (out_callback_) out_callback_(err, true);
+            reset();
+            return -1;
+        }
+        if (save_file) {
             double src_ratio =
                 static_cast<double>(mode_config_.audio_rate) / static_cast<double>(mode_config_.mode_rate);
-            std::vector<float> resampled_pcm(static_cast<size_t>(speech.size() * src_ratio + 1));
+            std::vector<float> resampled_pcm(static_cast<size_t>(output_.size() * src_ratio + 1));
             int resampled_len = 0;
-            resample_audio(speech.data(), speech.size(), resampled_pcm.data(), &resampled_len, src_ratio);
-            std::vector<int16_t> wav_pcm_data;
-            wav_pcm_data.reserve(resampled_len);
-            for (int i = 0; i < resampled_len; i++) {
-                float val = resampled_pcm[i];
-                if (val > 1.0f) val = 1.0f;
-                if (val < -1.0f) val = -1.0f;
-                wav_pcm_data.push_back(static_cast<int16_t>(val * 32767.0f));
-            }
-            if (out_callback_) {
-                out_callback_(
-                    std::string(reinterpret_cast<char *>(wav_pcm_data.data()), wav_pcm_data.size() * sizeof(int16_t)),
-                    true);
-            }
-            if (response_format_.find("file") != std::string::npos) {
-                double src_ratio =
-                    static_cast<double>(mode_config_.audio_rate) / static_cast<double>(mode_config_.mode_rate);
-                std::vector<float> resampled_pcm(static_cast<size_t>(output.size() * src_ratio + 1));
-                int resampled_len = 0;
-                resample_audio(output.data(), output.size(), resampled_pcm.data(), &resampled_len, src_ratio);
-                std::vector<int16_t> wav_pcm_data_full;
-                wav_pcm_data_full.reserve(resampled_len);
-                for (int i = 0; i < resampled_len; i++) {
-                    float val = resampled_pcm[i];
-                    if (val > 1.0f) val = 1.0f;
-                    if (val < -1.0f) val = -1.0f;
-                    wav_pcm_data_full.push_back(static_cast<int16_t>(val * 32767.0f));
-                }
-                std::string wav_path;
-                if (mode_config_.output_path.empty()) {
-                    wav_path = generateFilename("/tmp");
+            resample_audio(output_.data(), output_.size(), resampled_pcm.data(), &resampled_len, src_ratio);
+            resampled_pcm.resize(resampled_len);
+            std::string wav_path;
+            if (mode_config_.output_path.empty()) {
+                wav_path = generateFilename("/tmp");
+            } else {
+                fs::path user_path(mode_config_.output_path);
+                if (!user_path.has_filename()) {
+                    wav_path = generateFilename(user_path);
                 } else {
-                    fs::path user_path(mode_config_.output_path);
-                    if (!user_path.has_filename()) {
-                        wav_path = generateFilename(user_path);
-                    } else {
-                        wav_path = user_path.string();
-                    }
+                    wav_path = user_path.string();
                 }
-                saveVectorAsWavFloat(resampled_pcm, wav_path, mode_config_.audio_rate, 1);
             }
-            SLOGI("tts total use time: %.3f s", time_total.cost() / 1000);
-            reset();
-        } catch (const std::exception &e) {
-            std::cerr << "Error in pipeline: " << e.what() << std::endl;
-            return 1;
+            saveVectorAsWavFloat(resampled_pcm, wav_path, mode_config_.audio_rate, 1);
         }
+        SLOGI("tts total use time: %.3f s", time_total.cost() / 1000);
+        reset();
         return 0;
     }
 
     void run()
     {
-        std::string par;
+        inference_async_par par;
         for (;;) {
             {
                 par = async_list_.get();
-                if (par.empty()) break;
-                inference(par);
+                if (par.text.empty()) break;
+                inference(par.text, par.voice);
             }
         }
     }
 
-    int inference_async(const std::string &msg)
+    int inference_async(const std::string &msg, const std::string &voice = "")
     {
         if (msg.empty()) return -1;
         if (async_list_.size() < 3) {
-            std::string par = msg;
+            inference_async_par par;
+            par.text  = msg;
+            par.voice = voice.empty() ? voice_ : voice;
             async_list_.put(par);
         } else {
             SLOGE("inference list is full\n");
@@ -594,10 +732,16 @@ public:
         return async_list_.size();
     }
 
-    void inference(const std::string &msg)
+    void inference(const std::string &msg, const std::string &voice_name)
     {
         try {
-            tts(msg, prompt_text_embeds, prompt_speech_embeds, prompt_feat, prompt_speech_embeds_flow, spk_embeds);
+            voice_embed_ptr voice = get_voice(voice_name);
+            if (!voice) {
+                SLOGE("voice %s not found", voice_name.c_str());
+                if (out_callback_) out_callback_("Error, voice not found", true);
+                return;
+            }
+            tts(msg, *voice);
         } catch (...) {
             SLOGW("lLaMa_->Run have error!");
         }
@@ -605,7 +749,11 @@ public:
 
     bool pause()
     {
+        g_stop = true;
         if (lLaMa_) lLaMa_->Stop();
+        // release a stage blocked on either queue, tts() resets them for the next request
+        token_queue_.abort();
+        mel_queue_.abort();
         return true;
     }
 
@@ -675,7 +823,7 @@ public:
     void stop()
     {
         if (inference_run_) {
-            std::string par;
+            inference_async_par par;
             async_list_.put(par);
             if (lLaMa_) lLaMa_->Stop();
             inference_run_->join();
@@ -705,6 +853,22 @@ int llm_task::ax_init_flage_ = 0;
 
 #undef CONFIG_AUTO_SET
 
+// prompt data is uploaded either as a json array or as base64 of the raw little endian values
+template <typename T>
+static void json_to_vector(const nlohmann::json &obj, std::vector<T> &out)
+{
+    if (!obj.is_string()) {
+        out = obj.get<std::vector<T>>();
+        return;
+    }
+    std::string raw;
+    if ((decode_base64(obj.get<std::string>(), raw) == -1) || (raw.size() % sizeof(T))) {
+        throw std::invalid_argument("base64 data error");
+    }
+    out.resize(raw.size() / sizeof(T));
+    memcpy(out.data(), raw.data(), raw.size());
+}
+
 class llm_cosy_voice : public StackFlow {
 private:
     std::unordered_map<int, std::shared_ptr<llm_task>> llm_task_;
@@ -814,6 +978,21 @@ public:
             }
             next_data = &tmp_msg2;
         }
+        if (object.find("json") != std::string::npos) {
+            std::string text, voice;
+            try {
+                nlohmann::json body = nlohmann::json::parse(*next_data);
+                text                = body.at("text");
+                if (body.contains("voice")) voice = body["voice"];
+            } catch (...) {
+                error_body["code"]    = -2;
+                error_body["message"] = "json format error.";
+                send("None", "None", error_body, unit_name_);
+                return;
+            }
+            llm_task_obj->inference_async(text, voice);
+            return;
+        }
         llm_task_obj->inference_async(sample_unescapeString(*next_data));
     }
 
@@ -893,6 +1072,67 @@ public:
         }
     }
 
+    void voice_register(const std::shared_ptr<llm_task> &llm_task_obj, const std::string &work_id,
+                        const std::string &data)
+    {
+        nlohmann::json error_body;
+        std::string name, error;
+        voice_prompt_t prompt;
+        try {
+            nlohmann::json body = nlohmann::json::parse(data);
+            name                = body.at("voice");
+            json_to_vector(body.at("prompt_text_token"), prompt.text_token);
+            json_to_vector(body.at("prompt_speech_token"), prompt.speech_token);
+            json_to_vector(body.at("prompt_speech_feat"), prompt.speech_feat);
+            json_to_vector(body.at("flow_embedding"), prompt.spk_embeds);
+        } catch (...) {
+            error_body["code"]    = -2;
+            error_body["message"] = "json format error.";
+            send("None", "None", error_body, work_id);
+            return;
+        }
+        if (llm_task_obj->register_voice(name, prompt, error)) {
+            SLOGE("voice %s register failed: %s", name.c_str(), error.c_str());
+            error_body["code"]    = -22;
+            error_body["message"] = error;
+            send("None", "None", error_body, work_id);
+            return;
+        }
+        SLOGI("voice %s registered", name.c_str());
+        send("None", "None", LLM_NO_ERROR, work_id);
+    }
+
+    void work(const std::string &work_id, const std::string &object, const std::string &data) override
+    {
+        SLOGI("llm_cosy_voice::work:%s", object.c_str());
+        nlohmann::json error_body;
+        int work_id_num = sample_get_work_id_num(work_id);
+        if (llm_task_.find(work_id_num) == llm_task_.end()) {
+            error_body["code"]    = -6;
+            error_body["message"] = "Unit Does Not Exist";
+            send("None", "None", error_body, work_id);
+            return;
+        }
+        auto llm_task_obj = llm_task_[work_id_num];
+        if (object.find("voice.register") != std::string::npos) {
+            voice_register(llm_task_obj, work_id, data);
+        } else if (object.find("voice.delete") != std::string::npos) {
+            if (llm_task_obj->delete_voice(data)) {
+                error_body["code"]    = -22;
+                error_body["message"] = "voice can not be deleted.";
+                send("None", "None", error_body, work_id);
+                return;
+            }
+            send("None", "None", LLM_NO_ERROR, work_id);
+        } else if (object.find("voice.list") != std::string::npos) {
+            send("cosy_voice.voice.list", llm_task_obj->list_voices(), LLM_NO_ERROR, work_id);
+        } else {
+            error_body["code"]    = -18;
+            error_body["message"] = "not have unit action!";
+            send("None", "None", error_body, work_id);
+        }
+    }
+
     void link(const std::string &work_id, const std::string &object, const std::string &data) override
     {
         SLOGI("llm_cosy_voice::link:%s", data.c_str());
@@ -977,6 +1217,7 @@ public:
             auto llm_task_obj           = llm_task_[work_id_num];
             req_body["model"]           = llm_task_obj->model_;
             req_body["response_format"] = llm_task_obj->response_format_;
+            req_body["voice"]           = llm_task_obj->voice_.empty() ? "default" : llm_task_obj->voice_;
             req_body["enoutput"]        = llm_task_obj->enoutput_;
             req_body["inputs"]          = llm_task_obj->inputs_;
             send("cosy_voice.taskinfo", req_body, LLM_NO_ERROR, work_id);
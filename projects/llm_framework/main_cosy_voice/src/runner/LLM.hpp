@@ -21,10 +21,13 @@
 #include "ax_engine_api.h"
 #include "utils/sampling.hpp"
 #include "utils/utils.hpp"
+#include "utils/spsc_queue.hpp"
 
 using SpeechToken = int;
-// The container for speech tokens. std::deque is efficient for front/back operations.
-using TokenBuffer = std::deque<SpeechToken>;
+// Generated speech tokens, read by the token2wav stage while the LLM is still decoding.
+using TokenQueue = spsc_queue<SpeechToken>;
+// Run() result when the first sampled token is already EOS: the text produced no speech, nothing failed.
+#define LLM_RUN_NO_SPEECH (-2)
 
 typedef std::function<void(int *, int, const char *, float, void *)> LLMRuningCallback;
 // typedef void (*LLMRuningCallback)(int *p_token, int n_token, float token_per_sec, void *reserve);
@@ -286,7 +289,8 @@ public:
     }
 
     int Encode(std::vector<unsigned short> &out_embed, std::vector<std::vector<int>> &position_ids, std::string text,
-               std::vector<unsigned short> &prompt_text_embeds, std::vector<unsigned short> &prompt_speech_embeds)
+               const std::vector<unsigned short> &prompt_text_embeds,
+               const std::vector<unsigned short> &prompt_speech_embeds)
     {
         // std::vector<int> prompt_ids = tokenizer->Encode(prompt_text, true);
         ImageInfo img_info;
@@ -337,19 +341,18 @@ public:
         return 0;
     }
 
-    int Run(std::string input_str, std::vector<unsigned short> &prompt_text_embeds,
-            std::vector<unsigned short> &prompt_speech_embeds, TokenBuffer &token_buffer, std::mutex &buffer_mutex,
-            std::condition_variable &buffer_cv, std::atomic<bool> &llm_finished)
+    // returns the number of speech tokens pushed, -1 on error or LLM_RUN_NO_SPEECH
+    int Run(std::string input_str, const std::vector<unsigned short> &prompt_text_embeds,
+            const std::vector<unsigned short> &prompt_speech_embeds, TokenQueue &token_queue)
     {
         std::vector<unsigned short> text_embed;
         std::vector<std::vector<int>> position_ids;
         if (Encode(text_embed, position_ids, input_str, prompt_text_embeds, prompt_speech_embeds)) return -1;
-        return Run(text_embed, position_ids, token_buffer, buffer_mutex, buffer_cv, llm_finished);
+        return Run(text_embed, position_ids, token_queue);
     }
 
     int Run(std::vector<unsigned short> &text_embed, std::vector<std::vector<int>> &position_ids,
-            TokenBuffer &token_buffer, std::mutex &buffer_mutex, std::condition_variable &buffer_cv,
-            std::atomic<bool> &llm_finished)
+            TokenQueue &token_queue)
     {
         b_stop = false;
         std::string final_out;
@@ -528,20 +531,14 @@ public:
             next_token = max_index;
 
             if (max_index >= _attr.speech_embed_num - 3) {
-                llm_finished = true;
-                buffer_cv.notify_all();
-                ALOGI("hit eos, llm finished");
-                return -1;
+                ALOGW("hit eos at the first token, no speech generated");
+                return LLM_RUN_NO_SPEECH;
             }
 
             token_ids.push_back(max_index);
             cached_token.push_back(max_index);
-            {
-                std::lock_guard<std::mutex> lock(buffer_mutex);
-                token_buffer.push_back(max_index);
-            }
-            buffer_cv.notify_one();
-            // ALOGI("token_buffer push %d", max_index);
+            // the consumer aborted the queue, nobody wants the rest of the speech
+            if (!token_queue.push(max_index)) b_stop = true;
             ALOGI("ttft: %.2f ms", ttft_timer.cost());
         }
         t_cost.start();
@@ -646,9 +643,7 @@ public:
                 next_token = max_index;
 
                 if (max_index == _attr.speech_embed_num - 3) {
-                    b_hit_eos    = true;
-                    llm_finished = true;
-                    buffer_cv.notify_all();
+                    b_hit_eos = true;
                     ALOGI("hit eos, llm finished");
                     break;
                 }
@@ -656,25 +651,16 @@ public:
                 if (max_index < _attr.speech_embed_num - 3) {
                     token_ids.push_back(max_index);
                     cached_token.push_back(max_index);
-                    {
-                        std::lock_guard<std::mutex> lock(buffer_mutex);
-                        token_buffer.push_back(max_index);
-                    }
-                    buffer_cv.notify_one();
-                    // ALOGI("token_buffer push %d", max_index);
+                    if (!token_queue.push(max_index)) b_stop = true;
                 }
             }
 
             if (b_hit_eos) {
-                llm_finished = true;
-                buffer_cv.notify_all();
                 ALOGI("hit eos, llm finished");
                 break;
             }
         }
 
-        llm_finished = true;
-        buffer_cv.notify_all();
         ALOGI("llm finished");
 
         printf("\n\n");
@@ -15,8 +15,6 @@
 #include "LLMEmbedSelector.hpp"
 #include "ax_model_runner/ax_model_runner_ax650.hpp"
 #include "utils/utils.hpp"
-#include "utils/slice_3d.h"
-#include "utils/concat_3d.h"
 #include "ax_cmm_utils.hpp"
 #include "cqdm.h"
 #include "timer.hpp"
@@ -33,6 +31,9 @@ struct Token2WavAttr {
     int mel_cache_len        = 8;
     int source_cache_len     = mel_cache_len * 480;
     int pre_lookahead_len    = 3;
+    int prompt_token_len     = 75;   // prompt speech tokens the flow encoders are exported for
+    int spk_embed_size       = 192;  // auto calc
+    int voice_cache_num      = 4;    // registered voices whose embeddings are kept in memory
     float inference_cfg_rate = 0.7;
 
     std::string flow_input_embedding    = "flow.input_embedding.float16.bin";
@@ -54,6 +55,7 @@ struct Token2WavAttr {
     std::string llm_prompt_speech_token = "llm_prompt_speech_token.txt";
     std::string prompt_speech_feat      = "prompt_speech_feat.txt";
     std::string flow_embedding          = "flow_embedding.txt";
+    std::string voice_dir               = "voices/";
     int n_timesteps                     = 10;
 };
 
@@ -76,9 +78,28 @@ private:
     std::vector<float> rand_noise;
     std::vector<float> t_span;
     LLaMaEmbedSelector flow_embed_selector;
-    std::unordered_map<std::string, std::vector<float>> hift_cache_dict;
     std::vector<float> speech_window;
 
+    // one flow encoder and the estimator that takes its output, resolved and size checked at Init
+    typedef struct {
+        ax_runner_ax650 *encoder;
+        ax_runner_ax650 *estimator;
+        int token_len;  // speech tokens after the prompt
+        bool finalize;
+        int mel_len;  // mel frames out of the encoder, prompt included
+    } flow_chunk_t;
+    std::vector<flow_chunk_t> flow_chunks;
+
+    // step buffers, sized at Init for the largest chunk and reused by every chunk
+    std::vector<float> flow_x;
+    std::vector<unsigned short> flow_embed_one;
+    std::vector<float> hift_mel;
+    std::vector<float> hift_speech;
+    std::vector<float> hift_cache_mel;
+    std::vector<float> hift_cache_source;
+    std::vector<float> hift_cache_speech;
+    bool hift_cached = false;
+
     int init_noise(const std::string &path)
     {
         return readtxt(path, rand_noise);
@@ -94,6 +115,112 @@ private:
         return 0;
     }
 
+    int add_flow_chunk(ax_runner_ax650 &encoder, int token_len, bool finalize)
+    {
+        flow_chunk_t chunk;
+        chunk.encoder   = &encoder;
+        chunk.token_len = token_len;
+        chunk.finalize  = finalize;
+        chunk.mel_len   = encoder.get_output("mu").nSize / (80 * sizeof(float));
+        if (chunk.mel_len == 200) {
+            chunk.estimator = &flow_estimator_200;
+        } else if (chunk.mel_len == 250) {
+            chunk.estimator = &flow_estimator_250;
+        } else if (chunk.mel_len == 300) {
+            chunk.estimator = &flow_estimator_300;
+        } else {
+            ALOGE("no flow estimator for %d frames", chunk.mel_len);
+            return -1;
+        }
+        // the estimator runs the conditional and the unconditional CFG pass as a batch of 2
+        int size = 80 * chunk.mel_len * sizeof(float);
+        if ((chunk.estimator->get_input("x").nSize != 2 * size) ||
+            (chunk.estimator->get_input("mu").nSize != 2 * encoder.get_output("mu").nSize) ||
+            (chunk.estimator->get_input("spks").nSize != 2 * encoder.get_output("spks").nSize) ||
+            (chunk.estimator->get_input("cond").nSize != 2 * encoder.get_output("cond").nSize) ||
+            (chunk.estimator->get_output("y").nSize != 2 * size) || (rand_noise.size() < 80 * chunk.mel_len)) {
+            ALOGE("flow estimator does not match the %d token encoder", token_len);
+            return -1;
+        }
+        flow_chunks.push_back(chunk);
+        if (flow_x.size() < 80 * chunk.mel_len) flow_x.resize(80 * chunk.mel_len);
+        return 0;
+    }
+
+    int infer_flow_encoder(const flow_chunk_t &chunk, const int *tokens, const std::vector<float> &prompt_speech_embeds,
+                           const std::vector<float> &prompt_feat, const std::vector<float> &spk_embeds)
+    {
+        ax_runner_ax650 *model = chunk.encoder;
+
+        // prompt and chunk token embeddings go straight into the input tensor
+        auto &input_embeds = model->get_input("token_embedding");
+        if ((prompt_speech_embeds.size() + chunk.token_len * _attr.flow_embed_size) * sizeof(float) >
+            input_embeds.nSize) {
+            ALOGE("prompt too long for the %d token encoder", chunk.token_len);
+            return -1;
+        }
+        float *p = (float *)input_embeds.pVirAddr;
+        memcpy(p, prompt_speech_embeds.data(), prompt_speech_embeds.size() * sizeof(float));
+        p += prompt_speech_embeds.size();
+        for (int i = 0; i < chunk.token_len; i++) {
+            flow_embed_selector.getByIndex(tokens[i], flow_embed_one.data());
+            for (int j = 0; j < _attr.flow_embed_size; j++) {
+                unsigned int proc = flow_embed_one[j] << 16;
+                *p++              = *reinterpret_cast<float *>(&proc);
+            }
+        }
+        memcpy(model->get_input("prompt_feat").pVirAddr, prompt_feat.data(), prompt_feat.size() * sizeof(float));
+        memcpy(model->get_input("embedding").pVirAddr, spk_embeds.data(), spk_embeds.size() * sizeof(float));
+
+        if (model->inference() != 0) return -1;
+
+        // mu, spks and cond are the conditional half of the estimator batch, the unconditional half is zero
+        for (const char *name : {"mu", "spks", "cond"}) {
+            auto &src = model->get_output(name);
+            auto &dst = chunk.estimator->get_input(name);
+            memcpy(dst.pVirAddr, src.pVirAddr, src.nSize);
+            memset((char *)dst.pVirAddr + src.nSize, 0, dst.nSize - src.nSize);
+        }
+        return 0;
+    }
+
+    // Euler solver of the flow matching ODE, the result is left in flow_x
+    int infer_flow_decoder(const flow_chunk_t &chunk)
+    {
+        ax_runner_ax650 *model = chunk.estimator;
+        int n                  = 80 * chunk.mel_len;
+        float *x_in            = (float *)model->get_input("x").pVirAddr;
+        float *t_in            = (float *)model->get_input("t").pVirAddr;
+        float *mask_in         = (float *)model->get_input("mask").pVirAddr;
+        auto &output           = model->get_output("y");
+
+        memcpy(flow_x.data(), rand_noise.data(), n * sizeof(float));
+        std::fill(mask_in, mask_in + 2 * chunk.mel_len, 1.0f);
+
+        float t  = t_span[0];
+        float dt = t_span[1] - t_span[0];
+        for (size_t step = 1; step < t_span.size(); step++) {
+            memcpy(x_in, flow_x.data(), n * sizeof(float));
+            memcpy(x_in + n, flow_x.data(), n * sizeof(float));
+            t_in[0] = t;
+            t_in[1] = t;
+
+            if (model->inference() != 0) return -1;
+
+            const float *dphi_dt = (const float *)output.pVirAddr;
+            for (int i = 0; i < n; i++) {
+                float v = (1.0 + _attr.inference_cfg_rate) * dphi_dt[i] - _attr.inference_cfg_rate * dphi_dt[n + i];
+                flow_x[i] += dt * v;
+            }
+
+            t = t + dt;
+            if (step < t_span.size() - 1) {
+                dt = t_span[step + 1] - t;
+            }
+        }
+        return 0;
+    }
+
 public:
     bool Init(const Token2WavAttr &attr)
     {
@@ -140,6 +267,24 @@ public:
         cfg58.onnx_model = _attr.hift_p1_58;
         hift_p1_58->load(cfg58);
 
+        flow_chunks.clear();
+        if (add_flow_chunk(flow_encoder_28, 28, false) != 0) return false;
+        if (add_flow_chunk(flow_encoder_53, 53, false) != 0) return false;
+        if (add_flow_chunk(flow_encoder_78, 78, false) != 0) return false;
+        if (add_flow_chunk(flow_encoder_50_final, 50, true) != 0) return false;
+        flow_embed_one.resize(_attr.flow_embed_size);
+        _attr.spk_embed_size = flow_encoder_28.get_input("embedding").nSize / sizeof(float);
+
+        int hift_frames = std::max(hift_p2_50_first.get_input("mel").nSize, hift_p2_58.get_input("mel").nSize) /
+                          (80 * sizeof(float));
+        hift_mel.reserve(80 * hift_frames);
+        hift_speech.reserve(std::max(hift_p2_50_first.get_output("audio").nSize, hift_p2_58.get_output("audio").nSize) /
+                            sizeof(float));
+        hift_cache_mel.reserve(80 * _attr.mel_cache_len);
+        hift_cache_source.reserve(_attr.source_cache_len);
+        hift_cache_speech.reserve(_attr.source_cache_len);
+        hift_cached = false;
+
         return true;
     }
 
@@ -178,246 +323,135 @@ public:
         return token_embeds.size();
     }
 
-    int infer_flow_encoder(std::vector<float> &token_embeds, std::vector<float> &prompt_feat,
-                           std::vector<float> &spk_embeds, int token_len, bool finalize, std::vector<float> &mu,
-                           std::vector<float> &spks, std::vector<float> &cond)
+    /**
+     * Flow stage of one chunk: token_num speech tokens (28/53/78, or 50 for the final chunk) to the mel frames that
+     * are new in this chunk, 80 x n written to tts_mel. neg_offset is set for the final chunk, infer_speech needs it.
+     */
+    int infer_mel(const int *tokens, int token_num, const std::vector<float> &prompt_speech_embeds,
+                  const std::vector<float> &prompt_feat, const std::vector<float> &spk_embeds, int token_offset,
+                  bool finalize, std::vector<float> &tts_mel, int &neg_offset)
     {
-        ax_runner_ax650 *model;
-        if (!finalize) {
-            if (token_len == 28) {
-                model = &flow_encoder_28;
-            } else if (token_len == 53) {
-                model = &flow_encoder_53;
-            } else if (token_len == 78) {
-                model = &flow_encoder_78;
-            } else {
-                return -1;
-            }
-        } else if (token_len == 50) {
-            model = &flow_encoder_50_final;
-        } else {
-            return -1;
+        const flow_chunk_t *chunk = nullptr;
+        for (const auto &c : flow_chunks) {
+            if ((c.token_len == token_num) && (c.finalize == finalize)) chunk = &c;
         }
-
-        void *p = model->get_input("token_embedding").pVirAddr;
-        memcpy(p, token_embeds.data(), token_embeds.size() * sizeof(float));
-        p = model->get_input("prompt_feat").pVirAddr;
-        memcpy(p, prompt_feat.data(), prompt_feat.size() * sizeof(float));
-        p = model->get_input("embedding").pVirAddr;
-        memcpy(p, spk_embeds.data(), spk_embeds.size() * sizeof(float));
-
-        model->inference();
-
-        auto &output_mu = model->get_output("mu");
-        if (mu.empty()) {
-            mu.resize(output_mu.nSize / sizeof(float));
-        }
-        memcpy(mu.data(), output_mu.pVirAddr, output_mu.nSize);
-
-        auto &output_spks = model->get_output("spks");
-        if (spks.empty()) {
-            spks.resize(output_spks.nSize / sizeof(float));
-        }
-        memcpy(spks.data(), output_spks.pVirAddr, output_spks.nSize);
-
-        auto &output_cond = model->get_output("cond");
-        if (cond.empty()) {
-            cond.resize(output_cond.nSize / sizeof(float));
+        if (!chunk) {
+            ALOGE("no flow model for %d tokens, finalize:%d", token_num, finalize);
+            return -1;
         }
-        memcpy(cond.data(), output_cond.pVirAddr, output_cond.nSize);
-
-        return 0;
-    }
+        if (infer_flow_encoder(*chunk, tokens, prompt_speech_embeds, prompt_feat, spk_embeds) != 0) return -1;
+        if (infer_flow_decoder(*chunk) != 0) return -1;
 
-    int infer_flow_estimator(std::vector<float> &x, std::vector<float> &mask, std::vector<float> &t,
-                             std::vector<float> &mu, std::vector<float> &spks, std::vector<float> &cond,
-                             std::vector<float> &dphi_dt)
-    {
-        ax_runner_ax650 *model;
-        int len = x.size() / (2 * 80);
-        if (len == 200) {
-            model = &flow_estimator_200;
-        } else if (len == 250) {
-            model = &flow_estimator_250;
-        } else if (len == 300) {
-            model = &flow_estimator_300;
+        int prompt_len = prompt_feat.size() / 80;
+        int new_len    = chunk->mel_len - prompt_len;
+        int start;
+        if (finalize) {
+            neg_offset = token_offset * _attr.token_mel_ratio - new_len;
+            start      = std::max(0, new_len - _attr.token_hop_len * _attr.token_mel_ratio);
         } else {
-            return -1;
+            neg_offset = 0;
+            start      = std::min(std::min(token_offset / _attr.token_hop_len, _attr.max_infer_chunk_num - 1) *
+                                      _attr.token_hop_len * _attr.token_mel_ratio,
+                                  new_len);
         }
-
-        void *p = model->get_input("x").pVirAddr;
-        memcpy(p, x.data(), x.size() * sizeof(float));
-        p = model->get_input("mask").pVirAddr;
-        memcpy(p, mask.data(), mask.size() * sizeof(float));
-        p = model->get_input("t").pVirAddr;
-        memcpy(p, t.data(), t.size() * sizeof(float));
-        p = model->get_input("mu").pVirAddr;
-        memcpy(p, mu.data(), mu.size() * sizeof(float));
-        p = model->get_input("spks").pVirAddr;
-        memcpy(p, spks.data(), spks.size() * sizeof(float));
-        p = model->get_input("cond").pVirAddr;
-        memcpy(p, cond.data(), cond.size() * sizeof(float));
-
-        model->inference();
-
-        auto &output_dphi_dt = model->get_output("y");
-        if (dphi_dt.empty() || dphi_dt.size() != output_dphi_dt.nSize / sizeof(float)) {
-            dphi_dt.resize(output_dphi_dt.nSize / sizeof(float));
+        int frames = new_len - start;
+        tts_mel.resize(80 * frames);
+        for (int c = 0; c < 80; c++) {
+            memcpy(tts_mel.data() + c * frames, flow_x.data() + c * chunk->mel_len + prompt_len + start,
+                   frames * sizeof(float));
         }
-        memcpy(dphi_dt.data(), output_dphi_dt.pVirAddr, output_dphi_dt.nSize);
-
         return 0;
     }
 
-    int infer_hift(std::vector<float> &mel, std::vector<float> &cache_source, std::vector<float> &tts_speech,
-                   std::vector<float> &tts_source)
+    /**
+     * Vocoder stage of one chunk: mel frames from infer_mel to speech samples, written to tts_speech.
+     * The chunks of one utterance must be passed in order, the tail of each is kept to overlap the next.
+     */
+    int infer_speech(const std::vector<float> &tts_mel, bool finalize, int neg_offset, std::vector<float> &tts_speech)
     {
+        int new_frames = tts_mel.size() / 80;
+        int cached     = hift_cached ? _attr.mel_cache_len : 0;
+        int frames     = cached + new_frames;
+
         std::shared_ptr<BaseRunner> model_p1;
         ax_runner_ax650 *model_p2;
-        int len = mel.size() / (80);
-
-        if (len == 50 && cache_source.empty()) {
+        if ((frames == 50) && !hift_cached) {
             model_p1 = hift_p1_50_first;
             model_p2 = &hift_p2_50_first;
-        } else if (len == 58 && !cache_source.empty()) {
+        } else if ((frames == 58) && hift_cached) {
             model_p1 = hift_p1_58;
             model_p2 = &hift_p2_58;
         } else {
-            ALOGE("invalid size: %d", len);
+            ALOGE("invalid size: %d", frames);
             return -1;
         }
 
-        float *p_input = (float *)model_p1->getInputPtr(0);
-        memcpy(p_input, mel.data(), mel.size() * sizeof(float));
-        model_p1->inference();
-
-        auto p_s = model_p2->get_input("s");
-        memcpy(p_s.pVirAddr, (void *)model_p1->getOutputPtr(0), len * 480 * sizeof(float));
-
-        void *p = (void *)model_p2->get_input("mel").pVirAddr;
-        memcpy(p, mel.data(), mel.size() * sizeof(float));
-
-        if (!cache_source.empty()) {
-            p = model_p2->get_input("hift_cache_source").pVirAddr;
-            memcpy(p, cache_source.data(), cache_source.size() * sizeof(float));
+        hift_mel.resize(80 * frames);
+        for (int c = 0; c < 80; c++) {
+            float *row = hift_mel.data() + c * frames;
+            memcpy(row, hift_cache_mel.data() + c * cached, cached * sizeof(float));
+            memcpy(row + cached, tts_mel.data() + c * new_frames, new_frames * sizeof(float));
         }
 
-        model_p2->inference();
+        memcpy(model_p1->getInputPtr(0), hift_mel.data(), hift_mel.size() * sizeof(float));
+        model_p1->inference();
 
-        auto &output_speech = model_p2->get_output("audio");
-        if (tts_speech.empty() || tts_speech.size() != output_speech.nSize / sizeof(float)) {
-            tts_speech.resize(output_speech.nSize / sizeof(float));
+        memcpy(model_p2->get_input("s").pVirAddr, model_p1->getOutputPtr(0), frames * 480 * sizeof(float));
+        memcpy(model_p2->get_input("mel").pVirAddr, hift_mel.data(), hift_mel.size() * sizeof(float));
+        if (hift_cached) {
+            memcpy(model_p2->get_input("hift_cache_source").pVirAddr, hift_cache_source.data(),
+                   hift_cache_source.size() * sizeof(float));
         }
-        memcpy(tts_speech.data(), output_speech.pVirAddr, output_speech.nSize);
+        if (model_p2->inference() != 0) return -1;
 
+        auto &output_speech = model_p2->get_output("audio");
         auto &output_source = model_p2->get_output(1);
-        if (tts_source.empty() || tts_source.size() != output_source.nSize / sizeof(float)) {
-            tts_source.resize(output_source.nSize / sizeof(float));
-        }
-        memcpy(tts_source.data(), output_source.pVirAddr, output_source.nSize);
-
-        return 0;
-    }
+        const float *speech = (const float *)output_speech.pVirAddr;
+        const float *source = (const float *)output_source.pVirAddr;
+        int source_size     = output_source.nSize / sizeof(float);
+        hift_speech.assign(speech, speech + output_speech.nSize / sizeof(float));
+        int speech_size = hift_speech.size();
 
-    int infer_flow_decoder_solve_euler(std::vector<float> &x, std::vector<float> &mu, std::vector<float> &spks,
-                                       std::vector<float> &cond, std::vector<float> &mask, std::vector<float> &mel)
-    {
-        int len = mu.size() / 80;
-
-        float t  = t_span[0];
-        float dt = t_span[1] - t_span[0];
-
-        std::vector<float> x_in(2 * 80 * len, 0);
-        std::vector<float> mask_in(2 * 1 * len, 0);
-        std::vector<float> mu_in(2 * 80 * len, 0);
-        std::vector<float> t_in(2, 0);
-        std::vector<float> spks_in(2 * 80, 0);
-        std::vector<float> cond_in(2 * 80 * len, 0);
-        for (int step = 1; step < t_span.size(); step++) {
-            memcpy(x_in.data(), x.data(), x.size() * sizeof(float));
-            memcpy(x_in.data() + x.size(), x.data(), x.size() * sizeof(float));
-
-            memcpy(mask_in.data(), mask.data(), mask.size() * sizeof(float));
-            memcpy(mask_in.data() + mask.size(), mask.data(), mask.size() * sizeof(float));
-
-            memcpy(mu_in.data(), mu.data(), mu.size() * sizeof(float));
-
-            t_in[0] = t;
-            t_in[1] = t;
-
-            memcpy(spks_in.data(), spks.data(), spks.size() * sizeof(float));
-            memcpy(cond_in.data(), cond.data(), cond.size() * sizeof(float));
-
-            std::vector<float> dphi_dt;
-            int ret = infer_flow_estimator(x_in, mask_in, t_in, mu_in, spks_in, cond_in, dphi_dt);
-            if (ret != 0) {
-                return ret;
+        if (!finalize) {
+            if (hift_cached) {
+                fade_in_out(hift_speech, hift_cache_speech, speech_window);
             }
 
-            for (int i = 0; i < 80 * len; i++) {
-                dphi_dt[i] =
-                    (1.0 + _attr.inference_cfg_rate) * dphi_dt[i] - _attr.inference_cfg_rate * dphi_dt[80 * len + i];
-                x[i] = x[i] + dt * dphi_dt[i];
+            hift_cache_mel.resize(80 * _attr.mel_cache_len);
+            for (int c = 0; c < 80; c++) {
+                memcpy(hift_cache_mel.data() + c * _attr.mel_cache_len,
+                       hift_mel.data() + c * frames + frames - _attr.mel_cache_len,
+                       _attr.mel_cache_len * sizeof(float));
             }
 
-            t = t + dt;
+            int offset = std::min(speech_size, _attr.source_cache_len);
+            hift_cache_source.assign(source + source_size - offset, source + source_size);
+            hift_cache_speech.assign(hift_speech.end() - offset, hift_speech.end());
+            tts_speech.assign(hift_speech.begin(), hift_speech.end() - offset);
+            hift_cached = true;
+        } else {
+            if (speech_size < _attr.source_cache_len) {
+                tts_speech.assign(hift_speech.begin(), hift_speech.end());
+            } else if (-neg_offset * 480 >= _attr.source_cache_len) {
+                tts_speech.assign(hift_speech.end() + neg_offset * 480, hift_speech.end());
 
-            if (step < t_span.size() - 1) {
-                dt = t_span[step + 1] - t;
+                if (hift_cached) {
+                    fade_in_out(tts_speech, hift_cache_speech, speech_window);
+                }
             } else {
-                if (mel.empty() || mel.size() != x.size()) {
-                    mel.resize(x.size());
+                tts_speech.assign(hift_speech.end() - _attr.source_cache_len, hift_speech.end());
+
+                if (hift_cached) {
+                    fade_in_out(tts_speech, hift_cache_speech, speech_window);
                 }
-                memcpy(mel.data(), x.data(), x.size() * sizeof(float));
+
+                int offset = speech_size + neg_offset * 480 - (speech_size - _attr.source_cache_len);
+                tts_speech.erase(tts_speech.begin(), tts_speech.begin() + offset);
             }
         }
-
         return 0;
     }
 
-    int infer_flow_decoder(std::vector<float> &mu, std::vector<float> &spks, std::vector<float> &cond,
-                           std::vector<float> &mask, std::vector<float> &mel)
-    {
-        std::vector<float> z;
-        z.insert(z.end(), rand_noise.begin(), rand_noise.begin() + mu.size());
-
-        int ret = infer_flow_decoder_solve_euler(z, mu, spks, cond, mask, mel);
-        return ret;
-    }
-
-    std::vector<float> infer_flow(std::vector<float> &token_embeds, std::vector<float> &prompt_feat,
-                                  std::vector<float> &spk_embeds, int token_len, bool finalize)
-    {
-        int ret;
-        int len;
-        std::vector<float> mu;
-        std::vector<float> spks;
-        std::vector<float> cond;
-
-        ret = infer_flow_encoder(token_embeds, prompt_feat, spk_embeds, token_len, finalize, mu, spks, cond);
-        if (ret != 0) {
-            return std::vector<float>{};
-        }
-
-        len = mu.size() / 80;
-
-        std::vector<float> mask(len, 1.0);
-        std::vector<float> all_mel;
-
-        ret = infer_flow_decoder(mu, spks, cond, mask, all_mel);
-        if (ret != 0) {
-            return std::vector<float>{};
-        }
-
-        int len_mel1 = prompt_feat.size() / 80;
-        int len_mel2 = all_mel.size() / 80 - len_mel1;
-
-        std::vector<float> mel(len_mel2 * 80, 0);
-        auto result = slice_3d_last_dim_from<float>(all_mel, 1, 80, all_mel.size() / 80, len_mel1);
-
-        return result;
-    }
-
     void fade_in_out(std::vector<float> &fade_in_mel_data, const std::vector<float> &fade_out_mel_data,
                      const std::vector<float> &window)
     {
@@ -466,102 +500,24 @@ public:
 
     void clear()
     {
-        std::unordered_map<std::string, std::vector<float>>().swap(hift_cache_dict);
+        hift_cached = false;
     }
 
     std::vector<float> infer(std::vector<int> &text_speech_token, std::vector<float> &prompt_speech_embeds,
                              std::vector<float> &prompt_feat, std::vector<float> &spk_embeds, int token_offset,
                              bool finalize)
     {
-        int ret = 0;
-        std::vector<float> speech_embeds(text_speech_token.size() * _attr.flow_embed_size + prompt_speech_embeds.size(),
-                                         0.0f);
-        std::vector<unsigned short> speech_embeds_one(_attr.flow_embed_size, 0);
-
-        memcpy(speech_embeds.data(), prompt_speech_embeds.data(), prompt_speech_embeds.size() * sizeof(float));
-
-        for (size_t i = 0; i < text_speech_token.size(); i++) {
-            flow_embed_selector.getByIndex(text_speech_token[i], speech_embeds_one.data());
-
-            for (int j = 0; j < _attr.flow_embed_size; j++) {
-                unsigned int proc = speech_embeds_one[j] << 16;
-                speech_embeds[prompt_speech_embeds.size() + i * _attr.flow_embed_size + j] =
-                    *reinterpret_cast<float *>(&proc);
-            }
-        }
-
-        std::vector<float> mel;
-
-        mel = infer_flow(speech_embeds, prompt_feat, spk_embeds, text_speech_token.size(), finalize);
-
         std::vector<float> tts_mel;
-        int neg_offset = 0, start;
-        if (finalize) {
-            neg_offset = token_offset * _attr.token_mel_ratio - mel.size() / 80;
-            start      = -_attr.token_hop_len * _attr.token_mel_ratio;
-        } else {
-            start = std::min(int(token_offset / _attr.token_hop_len), _attr.max_infer_chunk_num - 1) *
-                    _attr.token_hop_len * _attr.token_mel_ratio;
-        }
-
-        tts_mel = slice_3d_last_dim_from<float>(mel, 1, 80, mel.size() / 80, start);
-
-        std::vector<float> hift_cache_source;
-        std::vector<float> tts_mel1;
-        std::vector<float> speech, source, tts_speech;
-        if (!hift_cache_dict.empty()) {
-            auto hift_cache_mel = hift_cache_dict["mel"];
-            hift_cache_source   = hift_cache_dict["source"];
-            tts_mel1 = concat_3d_dim2<float>(hift_cache_mel, 1, 80, hift_cache_mel.size() / 80, tts_mel, 1, 80,
-                                             tts_mel.size() / 80);
-        } else {
-            tts_mel1 = tts_mel;
+        std::vector<float> tts_speech;
+        int neg_offset = 0;
+        if (infer_mel(text_speech_token.data(), text_speech_token.size(), prompt_speech_embeds, prompt_feat,
+                      spk_embeds, token_offset, finalize, tts_mel, neg_offset) != 0) {
+            return std::vector<float>{};
         }
-        ret = infer_hift(tts_mel1, hift_cache_source, speech, source);
-
-        if (ret != 0) {
+        if (infer_speech(tts_mel, finalize, neg_offset, tts_speech) != 0) {
             ALOGE("failed");
             return std::vector<float>{};
         }
-
-        if (!finalize) {
-            if (!hift_cache_dict.empty()) {
-                fade_in_out(speech, hift_cache_dict["speech"], speech_window);
-            }
-
-            hift_cache_dict["mel"] =
-                slice_3d_last_dim_from<float>(tts_mel1, 1, 80, tts_mel1.size() / 80, -_attr.mel_cache_len);
-
-            int offset = speech.size();
-            if (speech.size() > _attr.source_cache_len) {
-                offset = _attr.source_cache_len;
-            }
-
-            hift_cache_dict["source"].assign(source.end() - offset, source.end());
-            hift_cache_dict["speech"].assign(speech.end() - offset, speech.end());
-            tts_speech.assign(speech.begin(), speech.end() - offset);
-
-        } else {
-            if (speech.size() < _attr.source_cache_len) {
-                tts_speech.assign(speech.begin(), speech.end());
-            } else if (-neg_offset * 480 >= _attr.source_cache_len) {
-                tts_speech.assign(speech.end() + neg_offset * 480, speech.end());
-
-                if (!hift_cache_dict.empty()) {
-                    fade_in_out(tts_speech, hift_cache_dict["speech"], speech_window);
-                }
-            } else {
-                tts_speech.assign(speech.end() - _attr.source_cache_len, speech.end());
-
-                if (!hift_cache_dict.empty()) {
-                    fade_in_out(tts_speech, hift_cache_dict["speech"], speech_window);
-                }
-
-                int offset = speech.size() + neg_offset * 480 - (speech.size() - _attr.source_cache_len);
-                tts_speech.assign(tts_speech.begin() + offset, tts_speech.end());
-            }
-        }
-
         return tts_speech;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,162 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+ * Bounded single producer / single consumer ring connecting two pipeline stages.
+ * Slots are constructed once and reused, the producer fills a slot in place (write_slot / commit) and the consumer
+ * reads it in place (read_slot / release), so buffers kept in T are never reallocated. The data path is lock free;
+ * a side that finds the ring full or empty spins briefly, then sleeps until the other side moves.
+ * close() ends the stream after the queued items are read, abort() drops them and releases both sides at once.
+ */
+template <typename T>
+class spsc_queue {
+private:
+    size_t mask_;
+    std::unique_ptr<T[]> slots_;
+    alignas(64) std::atomic<size_t> head_;  // next slot to read
+    alignas(64) std::atomic<size_t> tail_;  // next slot to write
+    std::atomic<bool> closed_;
+    std::atomic<bool> aborted_;
+    std::atomic<int> waiters_;
+    std::mutex wait_mtx_;
+    std::condition_variable wait_cv_;
+
+    template <typename Pred>
+    void wait(Pred ready)
+    {
+        for (int i = 0; i < 64; i++) {
+            if (ready()) return;
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(wait_mtx_);
+        waiters_++;
+        wait_cv_.wait(lock, ready);
+        waiters_--;
+    }
+
+    void wake()
+    {
+        if (waiters_.load() == 0) return;
+        std::lock_guard<std::mutex> lock(wait_mtx_);
+        wait_cv_.notify_all();
+    }
+
+public:
+    explicit spsc_queue(size_t capacity) : head_(0), tail_(0), closed_(false), aborted_(false), waiters_(0)
+    {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        mask_  = size - 1;
+        slots_ = std::make_unique<T[]>(size);
+    }
+
+    size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+    /* Slot storage, for preallocating buffers before the queue is used. */
+    T &slot(size_t index)
+    {
+        return slots_[index & mask_];
+    }
+
+    /* Producer: the next free slot, waits while the ring is full. NULL once aborted. */
+    T *write_slot()
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        wait([&] { return aborted_.load() || (tail - head_.load() <= mask_); });
+        if (aborted_.load()) return nullptr;
+        return &slots_[tail & mask_];
+    }
+
+    void commit()
+    {
+        tail_.fetch_add(1);
+        wake();
+    }
+
+    bool push(const T &value)
+    {
+        T *p = write_slot();
+        if (!p) return false;
+        *p = value;
+        commit();
+        return true;
+    }
+
+    /* Consumer: the oldest filled slot, waits while the ring is empty. NULL once closed and drained, or aborted. */
+    T *read_slot()
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        wait([&] { return aborted_.load() || closed_.load() || (tail_.load() != head); });
+        if (aborted_.load() || (tail_.load() == head)) return nullptr;
+        return &slots_[head & mask_];
+    }
+
+    void release()
+    {
+        head_.fetch_add(1);
+        wake();
+    }
+
+    bool pop(T &value)
+    {
+        T *p = read_slot();
+        if (!p) return false;
+        value = *p;
+        release();
+        return true;
+    }
+
+    /* Consumer: take one item if there is one, never waits. */
+    bool try_pop(T &value)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (aborted_.load() || (tail_.load() == head)) return false;
+        value = slots_[head & mask_];
+        release();
+        return true;
+    }
+
+    bool closed() const
+    {
+        return closed_.load();
+    }
+
+    bool aborted() const
+    {
+        return aborted_.load();
+    }
+
+    void close()
+    {
+        closed_.store(true);
+        wake();
+    }
+
+    void abort()
+    {
+        aborted_.store(true);
+        wake();
+    }
+
+    /* Empty the queue for the next stream, only while neither side is using it. */
+    void reset()
+    {
+        head_.store(0);
+        tail_.store(0);
+        closed_.store(false);
+        aborted_.store(false);
+    }
+};
@@ -0,0 +1,252 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Speaker prompt of one voice as it is uploaded: the transcript tokens, the speech tokens and mel feature of the
+ * prompt audio and the speaker embedding. This is what the voice store keeps on disk.
+ */
+struct voice_prompt_t {
+    std::vector<int> text_token;
+    std::vector<int> speech_token;
+    std::vector<float> speech_feat;  // 80 mel bins per frame
+    std::vector<float> spk_embeds;
+};
+
+/**
+ * Everything tts() needs from a voice, computed once from its prompt.
+ * speech_embeds_flow and feat are already cut to the prompt length the flow encoders are exported for.
+ */
+struct voice_embed_t {
+    std::vector<unsigned short> text_embeds;
+    std::vector<unsigned short> speech_embeds;
+    std::vector<float> speech_embeds_flow;
+    std::vector<float> feat;
+    std::vector<float> spk_embeds;
+};
+
+typedef std::shared_ptr<const voice_embed_t> voice_embed_ptr;
+
+/**
+ * Registered voices, one binary file <name>.voice per voice:
+ *
+ *   char     magic[4]  "CVVP"
+ *   uint32   version, text token num, speech token num, feat num, spk embed num
+ *   int32    text tokens
+ *   uint16   speech tokens
+ *   float32  feat
+ *   float32  spk embeds
+ *
+ * Little endian, no padding. Files are written to a temporary name and renamed, a voice being replaced is never
+ * seen half written.
+ */
+class voice_store {
+public:
+    explicit voice_store(const std::string &dir = "") : dir_(dir)
+    {
+    }
+
+    void set_dir(const std::string &dir)
+    {
+        dir_ = dir;
+    }
+
+    // names are used as file names: 1 to 64 of [A-Za-z0-9_-]
+    static bool valid_name(const std::string &name)
+    {
+        if (name.empty() || (name.size() > 64)) return false;
+        return std::all_of(name.begin(), name.end(),
+                           [](char c) { return isalnum((unsigned char)c) || (c == '_') || (c == '-'); });
+    }
+
+    int save(const std::string &name, const voice_prompt_t &prompt) const
+    {
+        if (!valid_name(name)) return -1;
+        for (int token : prompt.speech_token) {
+            if ((token < 0) || (token > 0xffff)) return -1;
+        }
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        std::string file_path = path(name);
+        std::string tmp_path  = file_path + ".tmp";
+        FILE *fp              = fopen(tmp_path.c_str(), "wb");
+        if (!fp) return -1;
+
+        uint32_t header[5] = {version_, (uint32_t)prompt.text_token.size(), (uint32_t)prompt.speech_token.size(),
+                              (uint32_t)prompt.speech_feat.size(), (uint32_t)prompt.spk_embeds.size()};
+        std::vector<int32_t> text_token(prompt.text_token.begin(), prompt.text_token.end());
+        std::vector<uint16_t> speech_token(prompt.speech_token.begin(), prompt.speech_token.end());
+        bool ok = (fwrite(magic_, 1, 4, fp) == 4) && (fwrite(header, sizeof(header), 1, fp) == 1) &&
+                  write_array(fp, text_token) && write_array(fp, speech_token) &&
+                  write_array(fp, prompt.speech_feat) && write_array(fp, prompt.spk_embeds);
+        ok = (fclose(fp) == 0) && ok;
+        if (ok) {
+            std::filesystem::rename(tmp_path, file_path, ec);
+            ok = !ec;
+        }
+        if (!ok) std::filesystem::remove(tmp_path, ec);
+        return ok ? 0 : -1;
+    }
+
+    int load(const std::string &name, voice_prompt_t &prompt) const
+    {
+        if (!valid_name(name)) return -1;
+        FILE *fp = fopen(path(name).c_str(), "rb");
+        if (!fp) return -1;
+        fseek(fp, 0, SEEK_END);
+        long file_size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+
+        char magic[4];
+        uint32_t header[5];
+        bool ok = (fread(magic, 1, 4, fp) == 4) && (memcmp(magic, magic_, 4) == 0) &&
+                  (fread(header, sizeof(header), 1, fp) == 1) && (header[0] == version_);
+        // the sizes must account for the whole file, a truncated or foreign file is rejected before allocating
+        ok = ok && ((uint64_t)file_size == 4 + sizeof(header) + (uint64_t)header[1] * sizeof(int32_t) +
+                                              (uint64_t)header[2] * sizeof(uint16_t) +
+                                              ((uint64_t)header[3] + header[4]) * sizeof(float));
+        std::vector<int32_t> text_token;
+        std::vector<uint16_t> speech_token;
+        ok = ok && read_array(fp, text_token, header[1]) && read_array(fp, speech_token, header[2]) &&
+             read_array(fp, prompt.speech_feat, header[3]) && read_array(fp, prompt.spk_embeds, header[4]);
+        fclose(fp);
+        if (!ok) return -1;
+        prompt.text_token.assign(text_token.begin(), text_token.end());
+        prompt.speech_token.assign(speech_token.begin(), speech_token.end());
+        return 0;
+    }
+
+    int remove(const std::string &name) const
+    {
+        std::error_code ec;
+        if (!valid_name(name) || !std::filesystem::remove(path(name), ec)) return -1;
+        return 0;
+    }
+
+    std::vector<std::string> list() const
+    {
+        std::vector<std::string> names;
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(dir_, ec)) {
+            if (entry.path().extension() != ".voice") continue;
+            std::string name = entry.path().stem().string();
+            if (valid_name(name)) names.push_back(name);
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+private:
+    std::string path(const std::string &name) const
+    {
+        return (std::filesystem::path(dir_) / (name + ".voice")).string();
+    }
+
+    template <typename T>
+    static bool write_array(FILE *fp, const std::vector<T> &data)
+    {
+        return data.empty() || (fwrite(data.data(), sizeof(T), data.size(), fp) == data.size());
+    }
+
+    template <typename T>
+    static bool read_array(FILE *fp, std::vector<T> &data, uint32_t num)
+    {
+        data.resize(num);
+        return (num == 0) || (fread(data.data(), sizeof(T), num, fp) == num);
+    }
+
+    static constexpr char magic_[4]   = {'C', 'V', 'V', 'P'};
+    static constexpr uint32_t version_ = 1;
+    std::string dir_;
+};
+
+/**
+ * LRU of computed voice embeddings keyed by voice name, bounded by a number of voices.
+ * A hit skips reading the voice file and the embedding lookups, a request holds its voice_embed_ptr so an entry
+ * evicted or replaced meanwhile stays valid until the request ends.
+ */
+class voice_embed_cache {
+public:
+    explicit voice_embed_cache(size_t capacity = 0) : capacity_(capacity)
+    {
+    }
+
+    void set_capacity(size_t capacity)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        capacity_ = capacity;
+        evict_locked();
+    }
+
+    voice_embed_ptr get(const std::string &name)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        auto iter = index_.find(name);
+        if (iter == index_.end()) return nullptr;
+        lru_.splice(lru_.begin(), lru_, iter->second);
+        return iter->second->second;
+    }
+
+    void put(const std::string &name, voice_embed_ptr voice)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        if (capacity_ == 0) return;
+        auto iter = index_.find(name);
+        if (iter != index_.end()) {
+            lru_.erase(iter->second);
+            index_.erase(iter);
+        }
+        lru_.emplace_front(name, voice);
+        index_[name] = lru_.begin();
+        evict_locked();
+    }
+
+    void erase(const std::string &name)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        auto iter = index_.find(name);
+        if (iter == index_.end()) return;
+        lru_.erase(iter->second);
+        index_.erase(iter);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        lru_.clear();
+        index_.clear();
+    }
+
+private:
+    void evict_locked()
+    {
+        while (lru_.size() > capacity_) {
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+        }
+    }
+
+    typedef std::list<std::pair<std::string, voice_embed_ptr>> lru_list_t;
+
+    std::mutex mtx_;
+    size_t capacity_;
+    lru_list_t lru_;
+    std::unordered_map<std::string, lru_list_t::iterator> index_;
+};
@@ -6,9 +6,11 @@
 #include "StackFlow.h"
 #include "EngineWrapper.hpp"
 #include "base/common.hpp"
+#include "image_preprocess.hpp"
 #include <ax_sys_api.h>
 #include <sys/stat.h>
 #include <fstream>
+#include <mutex>
 #include "../../../../SDK/components/utilities/include/sample_log.h"
 #include "thread_safe_list.h"
 
@@ -33,8 +35,8 @@ typedef struct {
 } depth_anything_config;
 
 typedef struct {
-    cv::Mat inference_src;
-    bool inference_bgr2rgb;
+    // letterboxed RGB model input, null stops the inference thread
+    std::shared_ptr<std::vector<uint8_t>> inference_input;
 } inference_async_par;
 
 typedef std::function<void(const std::string &data, bool finish)> task_callback_t;
@@ -61,6 +63,8 @@ public:
     std::atomic_bool camera_flage_;
     std::unique_ptr<std::thread> inference_run_;
     thread_safe::list<inference_async_par> async_list_;
+    std::mutex input_pool_mtx_;
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> input_pool_;
 
     bool parse_config(const nlohmann::json &config_body)
     {
@@ -146,7 +150,7 @@ public:
     {
         cv::Mat src = cv::imdecode(std::vector<uint8_t>(msg.begin(), msg.end()), cv::IMREAD_COLOR);
         if (src.empty()) return true;
-        return inference_async(src) ? false : true;
+        return inference_async(src.data, src.cols, src.rows, src.step, StackFlows::IMAGE_FORMAT_BGR) ? false : true;
     }
 
     bool inference_raw_yuv(const std::string &msg)
@@ -154,10 +158,10 @@ public:
         if (msg.size() != mode_config_.img_w * mode_config_.img_h * 2) {
             throw std::string("img size error");
         }
-        cv::Mat camera_data(mode_config_.img_h, mode_config_.img_w, CV_8UC2, (void *)msg.data());
-        cv::Mat rgb;
-        cv::cvtColor(camera_data, rgb, cv::COLOR_YUV2RGB_YUYV);
-        return inference_async(rgb, true) ? false : true;
+        return inference_async((const uint8_t *)msg.data(), mode_config_.img_w, mode_config_.img_h, 0,
+                               StackFlows::IMAGE_FORMAT_YUYV)
+                   ? false
+                   : true;
     }
 
     bool inference_raw_rgb(const std::string &msg)
@@ -165,8 +169,10 @@ public:
         if (msg.size() != mode_config_.img_w * mode_config_.img_h * 3) {
             throw std::string("img size error");
         }
-        cv::Mat camera_data(mode_config_.img_h, mode_config_.img_w, CV_8UC3, (void *)msg.data());
-        return inference_async(camera_data, false) ? false : true;
+        return inference_async((const uint8_t *)msg.data(), mode_config_.img_w, mode_config_.img_h, 0,
+                               StackFlows::IMAGE_FORMAT_RGB)
+                   ? false
+                   : true;
     }
 
     bool inference_raw_bgr(const std::string &msg)
@@ -174,8 +180,10 @@ public:
         if (msg.size() != mode_config_.img_w * mode_config_.img_h * 3) {
             throw std::string("img size error");
         }
-        cv::Mat camera_data(mode_config_.img_h, mode_config_.img_w, CV_8UC3, (void *)msg.data());
-        return inference_async(camera_data) ? false : true;
+        return inference_async((const uint8_t *)msg.data(), mode_config_.img_w, mode_config_.img_h, 0,
+                               StackFlows::IMAGE_FORMAT_BGR)
+                   ? false
+                   : true;
     }
 
     void run()
@@ -184,18 +192,29 @@ public:
         for (;;) {
             {
                 par = async_list_.get();
-                if (par.inference_src.empty()) break;
-                inference(par.inference_src, par.inference_bgr2rgb);
+                if (!par.inference_input) break;
+                inference(*par.inference_input);
+                std::lock_guard<std::mutex> guard(input_pool_mtx_);
+                input_pool_.push_back(par.inference_input);
             }
         }
     }
 
-    int inference_async(cv::Mat &src, bool bgr2rgb = true)
+    // converts straight into a pooled model input buffer, the source is not kept
+    int inference_async(const uint8_t *src, int src_w, int src_h, int src_stride, StackFlows::image_format_t format)
     {
         if (async_list_.size() < 3) {
             inference_async_par par;
-            par.inference_src     = src.clone();
-            par.inference_bgr2rgb = bgr2rgb;
+            {
+                std::lock_guard<std::mutex> guard(input_pool_mtx_);
+                if (!input_pool_.empty()) {
+                    par.inference_input = input_pool_.back();
+                    input_pool_.pop_back();
+                }
+            }
+            if (!par.inference_input) par.inference_input = std::make_shared<std::vector<uint8_t>>();
+            StackFlows::image_letterbox(src, src_w, src_h, src_stride, format, *par.inference_input,
+                                        mode_config_.img_w, mode_config_.img_h);
             async_list_.put(par);
         } else {
             SLOGE("inference list is full\n");
@@ -203,12 +222,10 @@ public:
         return async_list_.size();
     }
 
-    bool inference(cv::Mat &src, bool bgr2rgb = true)
+    bool inference(std::vector<uint8_t> &image)
     {
         try {
             int ret = -1;
-            std::vector<uint8_t> image(mode_config_.img_w * mode_config_.img_h * 3, 0);
-            common::get_input_data_letterbox(src, image, mode_config_.img_h, mode_config_.img_w, bgr2rgb);
             cv::Mat img_mat(mode_config_.img_h, mode_config_.img_w, CV_8UC3, image.data());
             depth_anything_->SetInput((void *)image.data(), 0);
             if (0 != depth_anything_->Run()) {
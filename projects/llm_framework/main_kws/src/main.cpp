@@ -17,10 +17,9 @@
 #include <stdexcept>
 #include <thread_safe_list.h>
 #include "../../../../SDK/components/utilities/include/sample_log.h"
-#define BUFFER_IMPLEMENTATION
 #include <stdbool.h>
 #include <stdint.h>
-#include "libs/buffer.h"
+#include "audio_frontend.hpp"
 
 using namespace StackFlows;
 
@@ -63,7 +62,7 @@ private:
     std::atomic_bool audio_flage_;
     static int ax_init_flage_;
     task_callback_t out_callback_;
-    buffer_t *pcmdata;
+    audio_frontend pcm_frontend_{1.0f / INT16_MAX};
     std::string wake_wav_file_;
     std::function<void(const std::string &)> play_awake_wav;
     int delay_audio_frame_ = 10;
@@ -400,12 +399,12 @@ public:
         return triggered;
     }
 
-    std::vector<std::vector<float>> compute_fbank_kaldi(const std::vector<float> &waveform, int sample_rate,
+    std::vector<std::vector<float>> compute_fbank_kaldi(const float *waveform, size_t count, int sample_rate,
                                                         int num_mel_bins)
     {
         fbank_.reset();
         fbank_ = std::make_unique<knf::OnlineFbank>(fbank_opts_);
-        fbank_->AcceptWaveform(sample_rate, waveform.data(), waveform.size());
+        fbank_->AcceptWaveform(sample_rate, waveform, count);
         int num_frames = fbank_->NumFramesReady();
         std::vector<std::vector<float>> features;
         features.reserve(num_frames);
@@ -417,10 +416,11 @@ public:
         return features;
     }
 
-    std::vector<float> run_inference(const std::vector<float> &audio_chunk_16k)
+    // audio_chunk_16k is read in place, straight from the pcm frontend
+    std::vector<float> run_inference(const float *audio_chunk_16k, size_t count)
     {
         std::vector<std::vector<float>> fbank_feats =
-            compute_fbank_kaldi(audio_chunk_16k, axera_config_.RESAMPLE_RATE, axera_config_.FEAT_DIM);
+            compute_fbank_kaldi(audio_chunk_16k, count, axera_config_.RESAMPLE_RATE, axera_config_.FEAT_DIM);
         if (fbank_feats.empty()) return {};
 
         constexpr int FIX_T = 32;
@@ -483,32 +483,13 @@ public:
 
     void sys_pcm_on_data(const std::string &raw)
     {
-        static int count = 0;
-        if (count < delay_audio_frame_) {
-            buffer_write_char(pcmdata, raw.data(), raw.length());
-            count++;
-            return;
-        }
-        buffer_write_char(pcmdata, raw.data(), raw.length());
-        buffer_position_set(pcmdata, 0);
-
-        std::vector<float> floatSamples;
-        std::vector<int16_t> int16Samples;
-
-        int16_t audio_val;
-        while (buffer_read_i16(pcmdata, &audio_val, 1)) {
-            int16Samples.push_back(audio_val);
-            if (model_type_ == "axera") {
-                floatSamples.push_back(static_cast<float>(audio_val) / 1.0f);
-            } else {
-                floatSamples.push_back(static_cast<float>(audio_val) / INT16_MAX);
-            }
-        }
-        buffer_resize(pcmdata, 0);
-        count = 0;
+        pcm_frontend_.set_delay_frames(delay_audio_frame_);
+        pcm_frontend_.set_scale((model_type_ == "axera") ? 1.0f : 1.0f / INT16_MAX);
+        if (!pcm_frontend_.push(raw)) return;
 
         if (model_type_ == "axera") {
-            auto scores = run_inference(floatSamples);
+            auto scores = run_inference(pcm_frontend_.data(), pcm_frontend_.size());
+            pcm_frontend_.consume(pcm_frontend_.size());
             if (detect_wakeup(scores)) {
                 if (enwake_audio_ && (!wake_wav_file_.empty()) && play_awake_wav) {
                     play_awake_wav(wake_wav_file_);
@@ -518,8 +499,9 @@ public:
                 }
             }
         } else {
-            sherpa_stream_->AcceptWaveform(sherpa_config_.feat_config.sampling_rate, floatSamples.data(),
-                                           floatSamples.size());
+            sherpa_stream_->AcceptWaveform(sherpa_config_.feat_config.sampling_rate, pcm_frontend_.data(),
+                                           pcm_frontend_.size());
+            pcm_frontend_.consume(pcm_frontend_.size());
             while (sherpa_spotter_->IsReady(sherpa_stream_.get())) {
                 sherpa_spotter_->DecodeStream(sherpa_stream_.get());
             }
@@ -572,7 +554,6 @@ public:
 
     llm_task(const std::string &workid) : audio_flage_(false)
     {
-        pcmdata = buffer_create();
         _ax_init();
     }
 
@@ -615,7 +596,6 @@ public:
     ~llm_task()
     {
         stop();
-        buffer_destroy(pcmdata);
         if (axera_session_) axera_session_->Release();
         _ax_deinit();
     }
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: MIT
  */
 #include "StackFlow.h"
+#include "audio_play_monitor.hpp"
 #include "OnnxWrapper.hpp"
 #include "EngineWrapper.hpp"
 #include "Lexicon.hpp"
@@ -90,6 +91,8 @@ public:
     int awake_delay_ = 1000;
     bool cap_;
     std::string tts_string_stream_buff;
+    std::unique_ptr<audio_play_monitor> play_monitor_;
+    std::atomic<uint64_t> last_play_id_;
 
     bool parse_config(const nlohmann::json &config_body)
     {
@@ -204,6 +207,11 @@ public:
             }
             fread(g_matrix.data(), sizeof(float), g_matrix.size(), fp);
             fclose(fp);
+#if !defined(CONFIG_AX_620E_MSP_ENABLED) && !defined(CONFIG_AX_620Q_MSP_ENABLED)
+            if (response_format_.find("sys") != std::string::npos) {
+                play_monitor_ = std::make_unique<audio_play_monitor>();
+            }
+#endif
             encoder_ = std::make_unique<OnnxWrapper>();
             decoder_ = std::make_unique<EngineWrapper>();
             if (0 != encoder_->Init(mode_config_.encoder)) {
@@ -271,21 +279,25 @@ public:
                                                                             wav_pcm_data.size() * sizeof(int16_t));
                     out_callback_(output, finish);
 #if !defined(CONFIG_AX_620E_MSP_ENABLED) && !defined(CONFIG_AX_620Q_MSP_ENABLED)
-                    int none_count           = 0;
-                    const int max_iterations = 100;
-
-                    for (int i = 0; i < max_iterations; ++i) {
-                        std::string current_status = unit_call("audio", "audio_status", "sys");
-                        if (current_status.find("\"play\":\"None\"") != std::string::npos) {
-                            none_count++;
-                        } else {
-                            none_count = 0;
-                        }
-                        if (none_count >= 5) {
-                            break;
+                    if (play_monitor_ && play_monitor_->is_ready()) {
+                        if (last_play_id_) play_monitor_->wait(last_play_id_, 10000);
+                    } else {
+                        int none_count           = 0;
+                        const int max_iterations = 100;
+
+                        for (int i = 0; i < max_iterations; ++i) {
+                            std::string current_status = unit_call("audio", "audio_status", "sys");
+                            if (current_status.find("\"play\":\"None\"") != std::string::npos) {
+                                none_count++;
+                            } else {
+                                none_count = 0;
+                            }
+                            if (none_count >= 5) {
+                                break;
+                            }
+
+                            std::this_thread::sleep_for(std::chrono::milliseconds(100));
                         }
-
-                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
                     }
 
                     if (cap_) {
@@ -500,7 +512,8 @@ public:
 
     llm_task(const std::string &workid)
     {
-        enaudio_ = true;
+        enaudio_      = true;
+        last_play_id_ = 0;
         _ax_init();
     }
 
@@ -563,7 +576,10 @@ public:
 #if defined(CONFIG_AX_620E_MSP_ENABLED) || defined(CONFIG_AX_620Q_MSP_ENABLED)
             unit_call("audio", "queue_play", data);
 #else
-            unit_call("audio", "play_raw", data);
+            std::string play_id = unit_call("audio", "play_raw", data);
+            if (!play_id.empty() && isdigit((unsigned char)play_id[0])) {
+                llm_task_obj->last_play_id_ = std::stoull(play_id);
+            }
 #endif
         }
     }
@@ -0,0 +1,345 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Read-only word -> (phones, tones) table in one flat block, written once next to the text lexicon and
+ * mmapped on later loads.
+ *
+ * Layout, native endian:
+ *   CompiledLexiconHeader
+ *   CompiledLexiconEntry[entry_num]   sorted bytewise by key
+ *   int32_t values[value_num]          phones then tones of every entry
+ *   char keys[key_bytes]
+ */
+struct CompiledLexiconHeader {
+    uint32_t magic;
+    uint32_t version;
+    // size and mtime of the text files the table was compiled from
+    uint64_t source_stamp;
+    uint32_t entry_num;
+    uint32_t value_num;
+    uint32_t key_bytes;
+    uint32_t max_phrase_chars;
+};
+
+struct CompiledLexiconEntry {
+    uint32_t key_offset;
+    uint32_t key_len;
+    uint32_t value_offset;
+    uint16_t phone_num;
+    uint16_t tone_num;
+};
+
+struct CompiledLexiconValue {
+    const int32_t* phones = nullptr;
+    size_t phone_num      = 0;
+    const int32_t* tones  = nullptr;
+    size_t tone_num       = 0;
+};
+
+class CompiledLexicon {
+public:
+    static constexpr uint32_t MAGIC   = 0x4C584C4D;  // "MLXL"
+    static constexpr uint32_t VERSION = 1;
+
+    using SourceMap = std::unordered_map<std::string, std::pair<std::vector<int>, std::vector<int>>>;
+
+    CompiledLexicon() = default;
+    CompiledLexicon(const CompiledLexicon&)            = delete;
+    CompiledLexicon& operator=(const CompiledLexicon&) = delete;
+
+    ~CompiledLexicon()
+    {
+        unmap();
+    }
+
+    // byte length of the UTF-8 character starting at text[pos], clipped to the end of text
+    static size_t char_len(const std::string& text, size_t pos)
+    {
+        unsigned char c = text[pos];
+        size_t len      = 1;
+        if ((c & 0xE0) == 0xC0) {
+            len = 2;
+        } else if ((c & 0xF0) == 0xE0) {
+            len = 3;
+        } else if ((c & 0xF8) == 0xF0) {
+            len = 4;
+        }
+        return std::min(len, text.size() - pos);
+    }
+
+    static uint64_t source_stamp(const std::vector<std::string>& files)
+    {
+        uint64_t stamp = 1469598103934665603ULL;
+        for (const auto& file : files) {
+            struct stat st;
+            uint64_t parts[2] = {0, 0};
+            if (stat(file.c_str(), &st) == 0) {
+                parts[0] = (uint64_t)st.st_size;
+                parts[1] = (uint64_t)st.st_mtime;
+            }
+            for (uint64_t part : parts) {
+                stamp = (stamp ^ part) * 1099511628211ULL;
+            }
+        }
+        return stamp;
+    }
+
+    // maps a compiled table, false when it is missing, damaged or built from other sources
+    bool load(const std::string& path, uint64_t stamp)
+    {
+        unmap();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(CompiledLexiconHeader))) {
+            close(fd);
+            return false;
+        }
+        void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+        mapped_      = addr;
+        mapped_size_ = st.st_size;
+        if (!attach((const uint8_t*)addr, mapped_size_, stamp)) {
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    void build(const SourceMap& source, size_t max_phrase_chars, uint64_t stamp)
+    {
+        unmap();
+        std::vector<const SourceMap::value_type*> items;
+        items.reserve(source.size());
+        size_t value_num = 0;
+        size_t key_bytes = 0;
+        for (const auto& item : source) {
+            items.push_back(&item);
+            value_num += item.second.first.size() + item.second.second.size();
+            key_bytes += item.first.size();
+        }
+        std::sort(items.begin(), items.end(), [](const SourceMap::value_type* a, const SourceMap::value_type* b) {
+            return a->first < b->first;
+        });
+
+        size_t bytes = sizeof(CompiledLexiconHeader) + items.size() * sizeof(CompiledLexiconEntry) +
+                       value_num * sizeof(int32_t) + key_bytes;
+        owned_.assign((bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+        uint8_t* base = (uint8_t*)owned_.data();
+
+        CompiledLexiconHeader* header = (CompiledLexiconHeader*)base;
+        header->magic                 = MAGIC;
+        header->version               = VERSION;
+        header->source_stamp          = stamp;
+        header->entry_num             = items.size();
+        header->value_num             = value_num;
+        header->key_bytes             = key_bytes;
+        header->max_phrase_chars      = max_phrase_chars;
+
+        CompiledLexiconEntry* entries = (CompiledLexiconEntry*)(header + 1);
+        int32_t* values               = (int32_t*)(entries + items.size());
+        char* keys                    = (char*)(values + value_num);
+        uint32_t value_pos            = 0;
+        uint32_t key_pos              = 0;
+        for (size_t i = 0; i < items.size(); i++) {
+            const auto& key   = items[i]->first;
+            const auto& pair  = items[i]->second;
+            entries[i]        = {key_pos, (uint32_t)key.size(), value_pos, (uint16_t)pair.first.size(),
+                                 (uint16_t)pair.second.size()};
+            memcpy(keys + key_pos, key.data(), key.size());
+            key_pos += key.size();
+            std::copy(pair.first.begin(), pair.first.end(), values + value_pos);
+            value_pos += pair.first.size();
+            std::copy(pair.second.begin(), pair.second.end(), values + value_pos);
+            value_pos += pair.second.size();
+        }
+        attach(base, bytes, stamp);
+    }
+
+    /*
+     * Writes the table built in memory. The data goes to a temporary file with a unique name, created with
+     * O_EXCL by mkstemp, which is then renamed over path: loaders never see a partial table, and units
+     * compiling the same lexicon at the same time never write into one shared temporary.
+     */
+    bool save(const std::string& path) const
+    {
+        if (owned_.empty()) {
+            return false;
+        }
+        std::string tmp_path = path + ".XXXXXX";
+        int fd               = mkstemp(&tmp_path[0]);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok           = (fchmod(fd, 0644) == 0);
+        const uint8_t* at = data_;
+        size_t left       = size_;
+        while (ok && (left > 0)) {
+            ssize_t n = write(fd, at, left);
+            if ((n < 0) && (errno == EINTR)) {
+                continue;
+            }
+            if (n <= 0) {
+                ok = false;
+                break;
+            }
+            at += n;
+            left -= n;
+        }
+        ok = (close(fd) == 0) && ok;
+        if (!ok || (rename(tmp_path.c_str(), path.c_str()) != 0)) {
+            unlink(tmp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    size_t size() const
+    {
+        return entry_num_;
+    }
+
+    size_t max_phrase_chars() const
+    {
+        return max_phrase_chars_;
+    }
+
+    bool find(const char* key, size_t len, CompiledLexiconValue& value) const
+    {
+        size_t lo = 0;
+        size_t hi = entry_num_;
+        narrow(key, len, 0, lo, hi);
+        if ((lo < hi) && (entries_[lo].key_len == len)) {
+            fill(entries_[lo], value);
+            return true;
+        }
+        return false;
+    }
+
+    bool find(const std::string& key, CompiledLexiconValue& value) const
+    {
+        return find(key.data(), key.size(), value);
+    }
+
+    /*
+     * Longest entry of at most max_chars characters that text continues with at pos. The candidate range
+     * shrinks by one character at a time and the search stops as soon as no key shares the prefix. Returns
+     * the matched byte length, 0 when nothing matches.
+     */
+    size_t longest_match(const std::string& text, size_t pos, size_t max_chars, CompiledLexiconValue& value) const
+    {
+        size_t lo      = 0;
+        size_t hi      = entry_num_;
+        size_t end     = pos;
+        size_t matched = 0;
+        const char* s  = text.data() + pos;
+        for (size_t chars = 0; (chars < max_chars) && (end < text.size()); chars++) {
+            size_t prev_len = end - pos;
+            end += char_len(text, end);
+            size_t len = end - pos;
+            narrow(s, len, prev_len, lo, hi);
+            if (lo >= hi) {
+                break;
+            }
+            if (entries_[lo].key_len == len) {
+                fill(entries_[lo], value);
+                matched = len;
+            }
+        }
+        return matched;
+    }
+
+private:
+    bool attach(const uint8_t* base, size_t bytes, uint64_t stamp)
+    {
+        const CompiledLexiconHeader* header = (const CompiledLexiconHeader*)base;
+        if ((header->magic != MAGIC) || (header->version != VERSION) || (header->source_stamp != stamp)) {
+            return false;
+        }
+        size_t need = sizeof(CompiledLexiconHeader) + (size_t)header->entry_num * sizeof(CompiledLexiconEntry) +
+                      (size_t)header->value_num * sizeof(int32_t) + header->key_bytes;
+        if (need > bytes) {
+            return false;
+        }
+        data_             = base;
+        size_             = need;
+        entries_          = (const CompiledLexiconEntry*)(header + 1);
+        values_           = (const int32_t*)(entries_ + header->entry_num);
+        keys_             = (const char*)(values_ + header->value_num);
+        entry_num_        = header->entry_num;
+        max_phrase_chars_ = header->max_phrase_chars;
+        return true;
+    }
+
+    void unmap()
+    {
+        if (mapped_ != nullptr) {
+            munmap(mapped_, mapped_size_);
+            mapped_ = nullptr;
+        }
+        owned_.clear();
+        data_      = nullptr;
+        size_      = 0;
+        entry_num_ = 0;
+    }
+
+    // keys in [lo, hi) all start with key[0, known); shrinks the range to those starting with key[0, len)
+    void narrow(const char* key, size_t len, size_t known, size_t& lo, size_t& hi) const
+    {
+        auto compare = [&](const CompiledLexiconEntry& entry) {
+            size_t entry_len = entry.key_len < len ? entry.key_len : len;
+            if (entry_len <= known) {
+                return entry.key_len < len ? -1 : 0;
+            }
+            int r = memcmp(keys_ + entry.key_offset + known, key + known, entry_len - known);
+            if (r != 0) {
+                return r;
+            }
+            return entry.key_len < len ? -1 : 0;
+        };
+        const CompiledLexiconEntry* first = std::partition_point(
+            entries_ + lo, entries_ + hi, [&](const CompiledLexiconEntry& entry) { return compare(entry) < 0; });
+        const CompiledLexiconEntry* last = std::partition_point(
+            first, entries_ + hi, [&](const CompiledLexiconEntry& entry) { return compare(entry) == 0; });
+        lo = first - entries_;
+        hi = last - entries_;
+    }
+
+    void fill(const CompiledLexiconEntry& entry, CompiledLexiconValue& value) const
+    {
+        value.phones    = values_ + entry.value_offset;
+        value.phone_num = entry.phone_num;
+        value.tones     = value.phones + entry.phone_num;
+        value.tone_num  = entry.tone_num;
+    }
+
+    void* mapped_       = nullptr;
+    size_t mapped_size_ = 0;
+    std::vector<uint64_t> owned_;
+
+    const uint8_t* data_                 = nullptr;
+    size_t size_                         = 0;
+    const CompiledLexiconEntry* entries_ = nullptr;
+    const int32_t* values_               = nullptr;
+    const char* keys_                    = nullptr;
+    size_t entry_num_                    = 0;
+    size_t max_phrase_chars_             = 0;
+};
@@ -9,6 +9,7 @@
 #include <iostream>
 #include "../../../../../SDK/components/utilities/include/sample_log.h"
 #include "processor/wetext_processor.h"
+#include "CompiledLexicon.hpp"
 
 std::vector<std::string> split(const std::string& s, char delim)
 {
@@ -25,7 +26,7 @@ std::vector<std::string> split(const std::string& s, char delim)
 
 class Lexicon {
 private:
-    std::unordered_map<std::string, std::pair<std::vector<int>, std::vector<int>>> lexicon;
+    CompiledLexicon lexicon;
     size_t max_phrase_length;
     std::pair<std::vector<int>, std::vector<int>> unknown_token;
     std::unordered_map<int, std::string> reverse_tokens;
@@ -42,58 +43,7 @@ public:
 
         m_processor = new wetext::Processor(tagger_filename, verbalizer_filename);
 
-        std::unordered_map<std::string, int> tokens;
-        std::ifstream ifs(tokens_filename);
-        assert(ifs.is_open());
-        std::string line;
-        while (std::getline(ifs, line)) {
-            auto splitted_line = split(line, ' ');
-            if (splitted_line.size() >= 2) {
-                int token_id = std::stoi(splitted_line[1]);
-                tokens.insert({splitted_line[0], token_id});
-                reverse_tokens[token_id] = splitted_line[0];
-            }
-        }
-        ifs.close();
-        ifs.open(lexicon_filename);
-        assert(ifs.is_open());
-        while (std::getline(ifs, line)) {
-            auto splitted_line = split(line, ' ');
-            if (splitted_line.empty()) continue;
-            std::string word_or_phrase = splitted_line[0];
-            auto chars                 = splitEachChar(word_or_phrase);
-            max_phrase_length          = std::max(max_phrase_length, chars.size());
-            size_t phone_tone_len      = splitted_line.size() - 1;
-            size_t half_len            = phone_tone_len / 2;
-            std::vector<int> phones, tones;
-            for (size_t i = 0; i < phone_tone_len; i++) {
-                auto phone_or_tone = splitted_line[i + 1];
-                if (i < half_len) {
-                    if (tokens.find(phone_or_tone) != tokens.end()) {
-                        phones.push_back(tokens[phone_or_tone]);
-                    }
-                } else {
-                    tones.push_back(std::stoi(phone_or_tone));
-                }
-            }
-            lexicon[word_or_phrase] = std::make_pair(phones, tones);
-        }
-        const std::vector<std::string> punctuation{"!", "?", "…", ",", ".", "'", "-"};
-        for (const auto& p : punctuation) {
-            if (tokens.find(p) != tokens.end()) {
-                int i      = tokens[p];
-                lexicon[p] = std::make_pair(std::vector<int>{i}, std::vector<int>{0});
-            }
-        }
-        assert(tokens.find("_") != tokens.end());
-        unknown_token = std::make_pair(std::vector<int>{tokens["_"]}, std::vector<int>{0});
-        lexicon[" "]  = unknown_token;
-        lexicon["，"] = lexicon[","];
-        lexicon["。"] = lexicon["."];
-        lexicon["！"] = lexicon["!"];
-        lexicon["？"] = lexicon["?"];
-        SLOGI("Dictionary loading complete, containing %zu entries, longest phrase length: %zu", lexicon.size(),
-              max_phrase_length);
+        load(lexicon_filename, tokens_filename);
     }
 
     Lexicon(const std::string& lexicon_filename, const std::string& tokens_filename) : max_phrase_length(0)
@@ -101,58 +51,7 @@ public:
         SLOGI("Dictionary loading: %s Pronunciation table loading: %s", tokens_filename.c_str(),
               lexicon_filename.c_str());
 
-        std::unordered_map<std::string, int> tokens;
-        std::ifstream ifs(tokens_filename);
-        assert(ifs.is_open());
-        std::string line;
-        while (std::getline(ifs, line)) {
-            auto splitted_line = split(line, ' ');
-            if (splitted_line.size() >= 2) {
-                int token_id = std::stoi(splitted_line[1]);
-                tokens.insert({splitted_line[0], token_id});
-                reverse_tokens[token_id] = splitted_line[0];
-            }
-        }
-        ifs.close();
-        ifs.open(lexicon_filename);
-        assert(ifs.is_open());
-        while (std::getline(ifs, line)) {
-            auto splitted_line = split(line, ' ');
-            if (splitted_line.empty()) continue;
-            std::string word_or_phrase = splitted_line[0];
-            auto chars                 = splitEachChar(word_or_phrase);
-            max_phrase_length          = std::max(max_phrase_length, chars.size());
-            size_t phone_tone_len      = splitted_line.size() - 1;
-            size_t half_len            = phone_tone_len / 2;
-            std::vector<int> phones, tones;
-            for (size_t i = 0; i < phone_tone_len; i++) {
-                auto phone_or_tone = splitted_line[i + 1];
-                if (i < half_len) {
-                    if (tokens.find(phone_or_tone) != tokens.end()) {
-                        phones.push_back(tokens[phone_or_tone]);
-                    }
-                } else {
-                    tones.push_back(std::stoi(phone_or_tone));
-                }
-            }
-            lexicon[word_or_phrase] = std::make_pair(phones, tones);
-        }
-        const std::vector<std::string> punctuation{"!", "?", "…", ",", ".", "'", "-"};
-        for (const auto& p : punctuation) {
-            if (tokens.find(p) != tokens.end()) {
-                int i      = tokens[p];
-                lexicon[p] = std::make_pair(std::vector<int>{i}, std::vector<int>{0});
-            }
-        }
-        assert(tokens.find("_") != tokens.end());
-        unknown_token = std::make_pair(std::vector<int>{tokens["_"]}, std::vector<int>{0});
-        lexicon[" "]  = unknown_token;
-        lexicon["，"] = lexicon[","];
-        lexicon["。"] = lexicon["."];
-        lexicon["！"] = lexicon["!"];
-        lexicon["？"] = lexicon["?"];
-        SLOGI("Dictionary loading complete, containing %zu entries, longest phrase length: %zu", lexicon.size(),
-              max_phrase_length);
+        load(lexicon_filename, tokens_filename);
     }
 
     std::vector<std::string> splitEachChar(const std::string& text)
@@ -203,14 +102,13 @@ public:
                 std::string lower_sub_word = sub_word;
                 std::transform(lower_sub_word.begin(), lower_sub_word.end(), lower_sub_word.begin(),
                                [](unsigned char c) { return std::tolower(c); });
-                if (lexicon.find(lower_sub_word) != lexicon.end()) {
+                CompiledLexiconValue sub;
+                if (lexicon.find(lower_sub_word, sub)) {
                     // Substring found in lexicon
-                    auto& [sub_phones, sub_tones] = lexicon[lower_sub_word];
-                    phones.insert(phones.end(), sub_phones.begin(), sub_phones.end());
-                    tones.insert(tones.end(), sub_tones.begin(), sub_tones.end());
+                    append(sub, phones, tones);
                     parts.push_back(sub_word);
-                    phonetic_parts.push_back(phonesToString(sub_phones));
-                    SLOGD("  Matched: '%s' -> %s", sub_word.c_str(), phonesToString(sub_phones).c_str());
+                    phonetic_parts.push_back(phonesToString(sub.phones, sub.phone_num));
+                    SLOGD("  Matched: '%s' -> %s", sub_word.c_str(), phonetic_parts.back().c_str());
                     start += len;
                     matched = true;
                     break;
@@ -221,13 +119,12 @@ public:
                 std::string lower_char  = single_char;
                 std::transform(lower_char.begin(), lower_char.end(), lower_char.begin(),
                                [](unsigned char c) { return std::tolower(c); });
-                if (lexicon.find(lower_char) != lexicon.end()) {
-                    auto& [char_phones, char_tones] = lexicon[lower_char];
-                    phones.insert(phones.end(), char_phones.begin(), char_phones.end());
-                    tones.insert(tones.end(), char_tones.begin(), char_tones.end());
+                CompiledLexiconValue ch;
+                if (lexicon.find(lower_char, ch)) {
+                    append(ch, phones, tones);
                     parts.push_back(single_char);
-                    phonetic_parts.push_back(phonesToString(char_phones));
-                    SLOGD("  Single char: '%s' -> %s", single_char.c_str(), phonesToString(char_phones).c_str());
+                    phonetic_parts.push_back(phonesToString(ch.phones, ch.phone_num));
+                    SLOGD("  Single char: '%s' -> %s", single_char.c_str(), phonetic_parts.back().c_str());
                 } else {
                     phones.insert(phones.end(), unknown_token.first.begin(), unknown_token.first.end());
                     tones.insert(tones.end(), unknown_token.second.begin(), unknown_token.second.end());
@@ -269,73 +166,55 @@ public:
         tones.insert(tones.end(), unknown_token.second.begin(), unknown_token.second.end());
         SLOGD("<BOS>\t|\t%s\t|\t%s", phonesToString(unknown_token.first).c_str(),
               tonesToString(unknown_token.second).c_str());
-        auto chars = splitEachChar(normalizedText);
-        int i      = 0;
-        while (i < chars.size()) {
-            if (is_english(chars[i])) {
-                std::string eng_word;
-                int start = i;
-                while (i < chars.size() && is_english(chars[i])) {
-                    eng_word += chars[i++];
+        size_t pos = 0;
+        while (pos < normalizedText.size()) {
+            size_t len = CompiledLexicon::char_len(normalizedText, pos);
+            if ((len == 1) && is_english_char(normalizedText[pos])) {
+                size_t start = pos;
+                while ((pos < normalizedText.size()) && is_english_char(normalizedText[pos])) {
+                    pos++;
                 }
-                std::string orig_word = eng_word;
+                std::string orig_word = normalizedText.substr(start, pos - start);
+                std::string eng_word  = orig_word;
                 std::transform(eng_word.begin(), eng_word.end(), eng_word.begin(),
                                [](unsigned char c) { return std::tolower(c); });
-                if (lexicon.find(eng_word) != lexicon.end()) {
-                    auto& [eng_phones, eng_tones] = lexicon[eng_word];
-                    phones.insert(phones.end(), eng_phones.begin(), eng_phones.end());
-                    tones.insert(tones.end(), eng_tones.begin(), eng_tones.end());
-                    SLOGD("%s\t|\t%s\t|\t%s", orig_word.c_str(), phonesToString(eng_phones).c_str(),
-                          tonesToString(eng_tones).c_str());
+                CompiledLexiconValue eng;
+                if (lexicon.find(eng_word, eng)) {
+                    append(eng, phones, tones);
+                    SLOGD("%s\t|\t%s\t|\t%s", orig_word.c_str(), phonesToString(eng.phones, eng.phone_num).c_str(),
+                          tonesToString(eng.tones, eng.tone_num).c_str());
                 } else {
                     process_unknown_english(orig_word, phones, tones);
                 }
                 continue;
             }
-            std::string c = chars[i++];
-            if (c == " ") continue;
-            i--;
-            bool matched = false;
-            for (size_t len = std::min(max_phrase_length, chars.size() - i); len > 0 && !matched; --len) {
-                std::string phrase;
-                for (size_t j = 0; j < len; ++j) {
-                    phrase += chars[i + j];
-                }
-                if (lexicon.find(phrase) != lexicon.end()) {
-                    auto& [phrase_phones, phrase_tones] = lexicon[phrase];
-                    phones.insert(phones.end(), phrase_phones.begin(), phrase_phones.end());
-                    tones.insert(tones.end(), phrase_tones.begin(), phrase_tones.end());
-                    SLOGD("%s\t|\t%s\t|\t%s", phrase.c_str(), phonesToString(phrase_phones).c_str(),
-                          tonesToString(phrase_tones).c_str());
-                    i += len;
-                    matched = true;
-                    break;
-                }
+            if ((len == 1) && (normalizedText[pos] == ' ')) {
+                pos++;
+                continue;
             }
-            if (!matched) {
-                std::string c         = chars[i++];
-                std::string s         = c;
-                std::string orig_char = s;
-                if (s == "，")
-                    s = ",";
-                else if (s == "。")
-                    s = ".";
-                else if (s == "！")
-                    s = "!";
-                else if (s == "？")
-                    s = "?";
-                if (lexicon.find(s) != lexicon.end()) {
-                    auto& [char_phones, char_tones] = lexicon[s];
-                    phones.insert(phones.end(), char_phones.begin(), char_phones.end());
-                    tones.insert(tones.end(), char_tones.begin(), char_tones.end());
-                    SLOGD("%s\t|\t%s\t|\t%s", orig_char.c_str(), phonesToString(char_phones).c_str(),
-                          tonesToString(char_tones).c_str());
-                } else {
-                    phones.insert(phones.end(), unknown_token.first.begin(), unknown_token.first.end());
-                    tones.insert(tones.end(), unknown_token.second.begin(), unknown_token.second.end());
-                    SLOGD("%s\t|\t%s (Not matched)\t|\t%s", orig_char.c_str(),
-                          phonesToString(unknown_token.first).c_str(), tonesToString(unknown_token.second).c_str());
-                }
+            CompiledLexiconValue phrase;
+            size_t phrase_len = lexicon.longest_match(normalizedText, pos, max_phrase_length, phrase);
+            if (phrase_len > 0) {
+                append(phrase, phones, tones);
+                SLOGD("%s\t|\t%s\t|\t%s", normalizedText.substr(pos, phrase_len).c_str(),
+                      phonesToString(phrase.phones, phrase.phone_num).c_str(),
+                      tonesToString(phrase.tones, phrase.tone_num).c_str());
+                pos += phrase_len;
+                continue;
+            }
+            std::string orig_char = normalizedText.substr(pos, len);
+            std::string s         = fullwidthToAscii(orig_char);
+            pos += len;
+            CompiledLexiconValue ch;
+            if (lexicon.find(s, ch)) {
+                append(ch, phones, tones);
+                SLOGD("%s\t|\t%s\t|\t%s", orig_char.c_str(), phonesToString(ch.phones, ch.phone_num).c_str(),
+                      tonesToString(ch.tones, ch.tone_num).c_str());
+            } else {
+                phones.insert(phones.end(), unknown_token.first.begin(), unknown_token.first.end());
+                tones.insert(tones.end(), unknown_token.second.begin(), unknown_token.second.end());
+                SLOGD("%s\t|\t%s (Not matched)\t|\t%s", orig_char.c_str(),
+                      phonesToString(unknown_token.first).c_str(), tonesToString(unknown_token.second).c_str());
             }
         }
         phones.insert(phones.end(), unknown_token.first.begin(), unknown_token.first.end());
@@ -350,43 +229,131 @@ public:
     }
 
 private:
-    void processChar(const std::string& c, std::vector<int>& phones, std::vector<int>& tones)
+    // parses the text lexicon into the table, or maps the copy compiled by an earlier load
+    void load(const std::string& lexicon_filename, const std::string& tokens_filename)
     {
-        std::string s = c;
-        if (s == "，")
-            s = ",";
-        else if (s == "。")
-            s = ".";
-        else if (s == "！")
-            s = "!";
-        else if (s == "？")
-            s = "?";
-        auto& phones_and_tones = (lexicon.find(s) != lexicon.end()) ? lexicon[s] : unknown_token;
-        phones.insert(phones.end(), phones_and_tones.first.begin(), phones_and_tones.first.end());
-        tones.insert(tones.end(), phones_and_tones.second.begin(), phones_and_tones.second.end());
+        std::unordered_map<std::string, int> tokens;
+        std::ifstream ifs(tokens_filename);
+        assert(ifs.is_open());
+        std::string line;
+        while (std::getline(ifs, line)) {
+            auto splitted_line = split(line, ' ');
+            if (splitted_line.size() >= 2) {
+                int token_id = std::stoi(splitted_line[1]);
+                tokens.insert({splitted_line[0], token_id});
+                reverse_tokens[token_id] = splitted_line[0];
+            }
+        }
+        ifs.close();
+        assert(tokens.find("_") != tokens.end());
+        unknown_token = std::make_pair(std::vector<int>{tokens["_"]}, std::vector<int>{0});
+
+        std::string compiled_filename = lexicon_filename + ".bin";
+        uint64_t stamp                = CompiledLexicon::source_stamp({lexicon_filename, tokens_filename});
+        if (lexicon.load(compiled_filename, stamp)) {
+            max_phrase_length = lexicon.max_phrase_chars();
+            SLOGI("Compiled dictionary mapped: %s, containing %zu entries, longest phrase length: %zu",
+                  compiled_filename.c_str(), lexicon.size(), max_phrase_length);
+            return;
+        }
+
+        CompiledLexicon::SourceMap source;
+        ifs.open(lexicon_filename);
+        assert(ifs.is_open());
+        while (std::getline(ifs, line)) {
+            auto splitted_line = split(line, ' ');
+            if (splitted_line.empty()) continue;
+            std::string word_or_phrase = splitted_line[0];
+            auto chars                 = splitEachChar(word_or_phrase);
+            max_phrase_length          = std::max(max_phrase_length, chars.size());
+            size_t phone_tone_len      = splitted_line.size() - 1;
+            size_t half_len            = phone_tone_len / 2;
+            std::vector<int> phones, tones;
+            for (size_t i = 0; i < phone_tone_len; i++) {
+                auto phone_or_tone = splitted_line[i + 1];
+                if (i < half_len) {
+                    if (tokens.find(phone_or_tone) != tokens.end()) {
+                        phones.push_back(tokens[phone_or_tone]);
+                    }
+                } else {
+                    tones.push_back(std::stoi(phone_or_tone));
+                }
+            }
+            source[word_or_phrase] = std::make_pair(phones, tones);
+        }
+        const std::vector<std::string> punctuation{"!", "?", "…", ",", ".", "'", "-"};
+        for (const auto& p : punctuation) {
+            if (tokens.find(p) != tokens.end()) {
+                int i     = tokens[p];
+                source[p] = std::make_pair(std::vector<int>{i}, std::vector<int>{0});
+            }
+        }
+        source[" "]  = unknown_token;
+        source["，"] = source[","];
+        source["。"] = source["."];
+        source["！"] = source["!"];
+        source["？"] = source["?"];
+
+        lexicon.build(source, max_phrase_length, stamp);
+        if (!lexicon.save(compiled_filename)) {
+            SLOGW("Compiled dictionary not saved: %s", compiled_filename.c_str());
+        }
+        SLOGI("Dictionary loading complete, containing %zu entries, longest phrase length: %zu", lexicon.size(),
+              max_phrase_length);
     }
 
-    std::string phonesToString(const std::vector<int>& phones)
+    static bool is_english_char(char c)
+    {
+        return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+    }
+
+    static std::string fullwidthToAscii(const std::string& c)
+    {
+        if (c == "，") return ",";
+        if (c == "。") return ".";
+        if (c == "！") return "!";
+        if (c == "？") return "?";
+        return c;
+    }
+
+    static void append(const CompiledLexiconValue& value, std::vector<int>& phones, std::vector<int>& tones)
+    {
+        phones.insert(phones.end(), value.phones, value.phones + value.phone_num);
+        tones.insert(tones.end(), value.tones, value.tones + value.tone_num);
+    }
+
+    std::string phonesToString(const int32_t* phones, size_t num)
     {
         std::string result;
-        for (auto id : phones) {
+        for (size_t i = 0; i < num; i++) {
             if (!result.empty()) result += " ";
-            if (reverse_tokens.find(id) != reverse_tokens.end()) {
-                result += reverse_tokens[id];
+            auto iter = reverse_tokens.find(phones[i]);
+            if (iter != reverse_tokens.end()) {
+                result += iter->second;
             } else {
-                result += "<" + std::to_string(id) + ">";
+                result += "<" + std::to_string(phones[i]) + ">";
             }
         }
         return result;
     }
 
-    std::string tonesToString(const std::vector<int>& tones)
+    std::string phonesToString(const std::vector<int>& phones)
+    {
+        return phonesToString(phones.data(), phones.size());
+    }
+
+    std::string tonesToString(const int32_t* tones, size_t num)
     {
         std::string result;
-        for (auto tone : tones) {
+        for (size_t i = 0; i < num; i++) {
             if (!result.empty()) result += " ";
-            result += std::to_string(tone);
+            result += std::to_string(tones[i]);
         }
         return result;
     }
-};
\ No newline at end of file
+
+    std::string tonesToString(const std::vector<int>& tones)
+    {
+        return tonesToString(tones.data(), tones.size());
+    }
+};
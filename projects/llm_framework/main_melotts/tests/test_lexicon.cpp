@@ -0,0 +1,195 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * The compiled lexicon against the word -> (phones, tones) map it is built from: the table written to disk
+ * and mapped back holds every entry unchanged, and the longest-prefix search picks the same phrase as trying
+ * every candidate length against the map.
+ */
+#include "CompiledLexicon.hpp"
+#include <dirent.h>
+#include <random>
+#include <thread>
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+// few distinct characters, so phrases share prefixes and most texts hit several candidate lengths
+static const char *alphabet[] = {"你", "好", "世", "界", "中", "国", "人", "民", "a", "b", ",", "。"};
+static const size_t alphabet_size = sizeof(alphabet) / sizeof(alphabet[0]);
+
+static std::string random_text(std::mt19937 &rng, size_t chars)
+{
+    std::string text;
+    for (size_t i = 0; i < chars; i++) text += alphabet[rng() % alphabet_size];
+    return text;
+}
+
+static CompiledLexicon::SourceMap random_source(std::mt19937 &rng, size_t entries, size_t max_chars)
+{
+    CompiledLexicon::SourceMap source;
+    while (source.size() < entries) {
+        std::vector<int> phones, tones;
+        size_t n = 1 + rng() % 5;
+        for (size_t i = 0; i < n; i++) {
+            phones.push_back(rng() % 100);
+            tones.push_back(rng() % 6);
+        }
+        // some entries without tones, as for phones missing from the token list
+        if (rng() % 8 == 0) tones.clear();
+        source[random_text(rng, 1 + rng() % max_chars)] = std::make_pair(phones, tones);
+    }
+    return source;
+}
+
+static bool same_value(const CompiledLexiconValue &value, const std::pair<std::vector<int>, std::vector<int>> &ref)
+{
+    return (value.phone_num == ref.first.size()) && (value.tone_num == ref.second.size()) &&
+           std::equal(ref.first.begin(), ref.first.end(), value.phones) &&
+           std::equal(ref.second.begin(), ref.second.end(), value.tones);
+}
+
+// the lookup the table replaced: longest candidate first, one map probe per length
+static size_t reference_match(const CompiledLexicon::SourceMap &source, const std::string &text, size_t pos,
+                              size_t max_chars)
+{
+    std::vector<size_t> ends;
+    for (size_t end = pos; (end < text.size()) && (ends.size() < max_chars);) {
+        end += CompiledLexicon::char_len(text, end);
+        ends.push_back(end);
+    }
+    for (size_t i = ends.size(); i > 0; i--) {
+        if (source.count(text.substr(pos, ends[i - 1] - pos))) return ends[i - 1] - pos;
+    }
+    return 0;
+}
+
+static void test_round_trip(const std::string &dir)
+{
+    std::mt19937 rng(1);
+    const size_t max_chars            = 4;
+    CompiledLexicon::SourceMap source = random_source(rng, 2000, max_chars);
+    std::string path                  = dir + "/lexicon.txt.bin";
+
+    CompiledLexicon built;
+    built.build(source, max_chars, 42);
+    CHECK(built.save(path));
+
+    CompiledLexicon lexicon;
+    CHECK(lexicon.load(path, 42));
+    CHECK(lexicon.size() == source.size());
+    CHECK(lexicon.max_phrase_chars() == max_chars);
+
+    for (const auto &item : source) {
+        CompiledLexiconValue value;
+        CHECK(lexicon.find(item.first, value) && same_value(value, item.second));
+    }
+    for (int i = 0; i < 2000; i++) {
+        std::string key = random_text(rng, 1 + rng() % (max_chars + 1));
+        CompiledLexiconValue value;
+        CHECK(lexicon.find(key, value) == (source.count(key) > 0));
+    }
+
+    for (int i = 0; i < 500; i++) {
+        std::string text = random_text(rng, 1 + rng() % 12);
+        for (size_t pos = 0; pos < text.size(); pos += CompiledLexicon::char_len(text, pos)) {
+            CompiledLexiconValue value;
+            size_t len = lexicon.longest_match(text, pos, max_chars, value);
+            CHECK(len == reference_match(source, text, pos, max_chars));
+            if (len > 0) CHECK(same_value(value, source.at(text.substr(pos, len))));
+        }
+    }
+
+    // tables compiled from other sources, or cut short, are rejected
+    CompiledLexicon stale;
+    CHECK(!stale.load(path, 43));
+    CHECK(truncate(path.c_str(), 64) == 0);
+    CHECK(!stale.load(path, 42));
+    unlink(path.c_str());
+}
+
+// the stamp follows size and mtime of every source file
+static void test_source_stamp(const std::string &dir)
+{
+    std::string lexicon = dir + "/lexicon.txt";
+    std::string tokens  = dir + "/tokens.txt";
+    FILE *fp            = fopen(lexicon.c_str(), "w");
+    fputs("你好 n i h ao 3 3\n", fp);
+    fclose(fp);
+    fp = fopen(tokens.c_str(), "w");
+    fputs("_ 0\n", fp);
+    fclose(fp);
+
+    uint64_t stamp = CompiledLexicon::source_stamp({lexicon, tokens});
+    CHECK(stamp == CompiledLexicon::source_stamp({lexicon, tokens}));
+    fp = fopen(tokens.c_str(), "a");
+    fputs("n 1\n", fp);
+    fclose(fp);
+    CHECK(stamp != CompiledLexicon::source_stamp({lexicon, tokens}));
+    unlink(lexicon.c_str());
+    unlink(tokens.c_str());
+}
+
+// several units compiling the same lexicon at once: every load sees a whole table, no temporary is left over
+static void test_concurrent_save(const std::string &dir)
+{
+    std::mt19937 rng(2);
+    CompiledLexicon::SourceMap source = random_source(rng, 5000, 4);
+    std::string path                  = dir + "/shared.txt.bin";
+
+    std::vector<std::thread> threads;
+    std::vector<int> bad(4, 0);
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 10; i++) {
+                CompiledLexicon lexicon;
+                if (!lexicon.load(path, 7)) {
+                    lexicon.build(source, 4, 7);
+                    if (!lexicon.save(path)) bad[t]++;
+                }
+                if (lexicon.size() != source.size()) bad[t]++;
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+    for (int b : bad) CHECK(b == 0);
+
+    CompiledLexicon lexicon;
+    CHECK(lexicon.load(path, 7) && (lexicon.size() == source.size()));
+    unlink(path.c_str());
+
+    int left = 0;
+    DIR *d   = opendir(dir.c_str());
+    while (struct dirent *entry = readdir(d)) {
+        if (entry->d_name[0] != '.') left++;
+    }
+    closedir(d);
+    CHECK(left == 0);
+}
+
+int main()
+{
+    char dir[] = "/tmp/test_lexicon_XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    test_round_trip(dir);
+    test_source_stamp(dir);
+    test_concurrent_save(dir);
+    rmdir(dir);
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_lexicon: ok\n");
+    return 0;
+}
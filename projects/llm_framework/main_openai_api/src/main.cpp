@@ -3,21 +3,94 @@
  *
  * SPDX-License-Identifier: MIT
  */
+#include <getopt.h>
+#include <signal.h>
 #include <stdio.h>
-#include <unistd.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "openai_api.h"
+#include "sample_log.h"
+
+int main_exit_flage = 0;
+static void __sigint(int iSigNo)
+{
+    SLOGW("llm_openai_api will be exit!");
+    main_exit_flage = 1;
+}
 
-int main()
+static void usage(const char *name)
 {
-    setenv("PYTHONPATH", "/opt/m5stack/lib/openai-api/site-packages", 1);
+    printf(
+        "usage: %s [options]\n"
+        "  --host <addr>            listen address (0.0.0.0)\n"
+        "  --port <port>            listen port (8000)\n"
+        "  --threads <n>            HTTP worker threads (8)\n"
+        "  --max-sessions <n>       unit tasks kept set up (2)\n"
+        "  --max-instances <n>      tasks per model and configuration (1)\n"
+        "  --timeout <ms>           longest wait for a unit output (60000)\n",
+        name);
+}
 
-    if (access("/opt/m5stack/bin/ModuleLLM-OpenAI-Plugin/api_server.py", F_OK) == 0) {
-        char *args[] = {(char *)"python3", (char *)"/opt/m5stack/bin/ModuleLLM-OpenAI-Plugin/api_server.py", NULL};
-        if (execvp("python3", args) == -1) {
-            perror("execvp");
-            return 1;
+int main(int argc, char *argv[])
+{
+    openai_api_config_t config;
+    config.host          = "0.0.0.0";
+    config.port          = 8000;
+    config.threads       = 8;
+    config.max_sessions  = 2;
+    config.max_instances = 1;
+    config.timeout_ms    = 60000;
+
+    static const struct option long_options[] = {{"host", required_argument, NULL, 'H'},
+                                                 {"port", required_argument, NULL, 'p'},
+                                                 {"threads", required_argument, NULL, 't'},
+                                                 {"max-sessions", required_argument, NULL, 's'},
+                                                 {"max-instances", required_argument, NULL, 'i'},
+                                                 {"timeout", required_argument, NULL, 'T'},
+                                                 {"help", no_argument, NULL, 'h'},
+                                                 {NULL, 0, NULL, 0}};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "H:p:t:s:i:T:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'H':
+                config.host = optarg;
+                break;
+            case 'p':
+                config.port = atoi(optarg);
+                break;
+            case 't':
+                config.threads = atoi(optarg);
+                break;
+            case 's':
+                config.max_sessions = atoi(optarg);
+                break;
+            case 'i':
+                config.max_instances = atoi(optarg);
+                break;
+            case 'T':
+                config.timeout_ms = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? 0 : 1;
         }
     }
-    perror("_tokenizer.py miss");
+    if ((config.threads < 1) || (config.max_sessions < 1) || (config.max_instances < 1) || (config.timeout_ms < 1)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGTERM, __sigint);
+    signal(SIGINT, __sigint);
+    signal(SIGPIPE, SIG_IGN);
+    mkdir("/tmp/llm", 0777);
+    openai_api api(config);
+    if (api.start()) return 1;
+    while (!main_exit_flage) {
+        sleep(1);
+    }
+    api.stop();
     return 0;
 }
@@ -0,0 +1,639 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "openai_api.h"
+
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include "StackFlowUtil.h"
+#include "sample_log.h"
+
+using namespace StackFlows;
+
+#define SETUP_TIMEOUT_MS 120000
+
+session_pool::session_pool(int max_sessions, int max_instances)
+    : max_sessions_(max_sessions), max_instances_(max_instances), next_url_(0), tick_(0)
+{
+}
+
+session_pool::~session_pool()
+{
+    std::list<entry> entries;
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        entries.swap(entries_);
+    }
+    entries.clear();
+}
+
+std::shared_ptr<unit_session> session_pool::acquire(const std::string &unit, const nlohmann::json &config, bool reset,
+                                                    std::string &error, int timeout_ms)
+{
+    std::string key = unit + config.dump();
+    auto deadline   = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    std::unique_lock<std::mutex> lock(mtx_);
+    for (;;) {
+        int same  = 0;
+        auto idle = entries_.end();
+        for (auto iter = entries_.begin(); iter != entries_.end(); ++iter) {
+            if (iter->key != key) continue;
+            if (!iter->busy) {
+                idle = iter;
+                break;
+            }
+            same++;
+        }
+        if (idle != entries_.end()) {
+            idle->busy                            = true;
+            std::shared_ptr<unit_session> session = idle->session;
+            if (!reset) return session;
+            // the previous request left its conversation in the task
+            lock.unlock();
+            int ret = session->reset(error, timeout_ms);
+            lock.lock();
+            if (ret == 0) return session;
+            SLOGW("%s reset failed: %s", session->work_id().c_str(), error.c_str());
+            error.clear();
+            entries_.erase(idle);
+            cond_.notify_all();
+            lock.unlock();
+            session.reset();
+            lock.lock();
+            continue;
+        }
+        if (same < max_instances_) {
+            if ((int)entries_.size() < max_sessions_) break;
+            auto victim = entries_.end();
+            for (auto iter = entries_.begin(); iter != entries_.end(); ++iter) {
+                if (!iter->busy && ((victim == entries_.end()) || (iter->last_used < victim->last_used))) {
+                    victim = iter;
+                }
+            }
+            if (victim != entries_.end()) {
+                // exit the task outside the lock, the unit may take a while to unload the model
+                std::shared_ptr<unit_session> session = victim->session;
+                entries_.erase(victim);
+                lock.unlock();
+                session.reset();
+                lock.lock();
+                continue;
+            }
+        }
+        if (cond_.wait_until(lock, deadline) == std::cv_status::timeout) {
+            error = "all " + unit + " tasks are busy";
+            return nullptr;
+        }
+    }
+
+    char reply_url[64];
+    snprintf(reply_url, sizeof(reply_url), "ipc:///tmp/llm/openai_api.%u.sock", next_url_++);
+    auto slot = entries_.insert(entries_.end(), entry{key, nullptr, true, 0});
+    lock.unlock();
+    auto session = std::make_shared<unit_session>(unit, reply_url);
+    int ret      = session->setup(config, error, SETUP_TIMEOUT_MS);
+    lock.lock();
+    if (ret) {
+        entries_.erase(slot);
+        cond_.notify_all();
+        return nullptr;
+    }
+    slot->session = session;
+    return session;
+}
+
+void session_pool::release(const std::shared_ptr<unit_session> &session, bool reuse)
+{
+    std::shared_ptr<unit_session> broken;
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        for (auto iter = entries_.begin(); iter != entries_.end(); ++iter) {
+            if (iter->session != session) continue;
+            if (reuse) {
+                iter->busy      = false;
+                iter->last_used = ++tick_;
+            } else {
+                broken = iter->session;
+                entries_.erase(iter);
+            }
+            break;
+        }
+        cond_.notify_all();
+    }
+}
+
+static std::string model_unit(const std::string &name, const std::string &type)
+{
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if ((type == "llm") || (type == "vlm")) return type;
+    if (type == "asr") return (lower.find("whisper") != std::string::npos) ? "whisper" : "asr";
+    if (type == "tts") {
+        if (lower.find("melotts") != std::string::npos) return "melotts";
+        if (lower.find("cosyvoice") != std::string::npos) return "cosy_voice";
+        return "tts";
+    }
+    return "";
+}
+
+static std::string request_id(const char *prefix)
+{
+    static std::atomic<uint64_t> count{0};
+    return std::string(prefix) + std::to_string(time(NULL)) + std::to_string(count++);
+}
+
+/**
+ * Reads the outputs of a task until it finishes. on_delta returning false stops the generation, the rest of the
+ * outputs are then read and dropped so the task is left idle.
+ */
+static bool read_outputs(unit_session &session, int timeout_ms, const std::function<bool(const std::string &)> &on_delta,
+                         std::string &error)
+{
+    bool stopped = false;
+    for (;;) {
+        nlohmann::json msg;
+        if (!session.read(msg, timeout_ms)) {
+            error = session.work_id() + " output timeout";
+            return false;
+        }
+        if (msg.contains("error") && (msg["error"].value("code", 0) != 0)) {
+            error = msg["error"].value("message", std::string("unit error"));
+            return false;
+        }
+        const nlohmann::json &data = msg["data"];
+        if (data.is_string()) {
+            if (!stopped) on_delta(data.get<std::string>());
+            return true;
+        }
+        if (!data.is_object()) continue;
+        std::string delta = data.value("delta", std::string());
+        if (!stopped && !delta.empty() && !on_delta(delta)) {
+            stopped = true;
+            session.pause();
+        }
+        if (data.value("finish", false)) return true;
+    }
+}
+
+/**
+ * The units put their input into the model's chat template as one user turn, so a conversation is written into it
+ * as a transcript, one "role: text" line per message. A single user message is sent as it is.
+ */
+static std::string chat_prompt(const std::list<std::pair<std::string, std::string>> &turns)
+{
+    if ((turns.size() == 1) && (turns.front().first == "user")) return turns.front().second;
+    std::string prompt;
+    for (const auto &turn : turns) {
+        if (!prompt.empty()) prompt += "\n";
+        prompt += turn.first + ": " + turn.second;
+    }
+    return prompt;
+}
+
+/**
+ * Checks for what the asr units decode: a RIFF/WAVE file of 16 bit mono pcm at 16 kHz with a data chunk. The units
+ * drop anything else without an answer.
+ */
+static bool check_wav(const std::string &wav, std::string &error)
+{
+    auto get32 = [&wav](size_t pos) {
+        uint32_t val;
+        memcpy(&val, &wav[pos], 4);
+        return val;
+    };
+    auto get16 = [&wav](size_t pos) {
+        uint16_t val;
+        memcpy(&val, &wav[pos], 2);
+        return val;
+    };
+    if ((wav.size() < 12) || (wav.compare(0, 4, "RIFF") != 0) || (wav.compare(8, 4, "WAVE") != 0)) {
+        error = "file is not a wav file";
+        return false;
+    }
+    bool has_fmt = false;
+    for (size_t pos = 12; pos + 8 <= wav.size();) {
+        uint32_t size = get32(pos + 4);
+        if (wav.compare(pos, 4, "fmt ") == 0) {
+            if ((size < 16) || (pos + 8 + 16 > wav.size())) break;
+            if ((get16(pos + 8) != 1) || (get16(pos + 10) != 1) || (get32(pos + 12) != 16000) ||
+                (get16(pos + 22) != 16)) {
+                error = "file must be 16 kHz mono 16 bit pcm wav";
+                return false;
+            }
+            has_fmt = true;
+        } else if (wav.compare(pos, 4, "data") == 0) {
+            if (has_fmt && (size > 0)) return true;
+            break;
+        }
+        pos += 8 + (size_t)size + (size & 1);
+    }
+    error = "wav file has no audio data";
+    return false;
+}
+
+openai_api::openai_api(const openai_api_config_t &config)
+    : config_(config), pool_(config.max_sessions, config.max_instances)
+{
+}
+
+openai_api::~openai_api()
+{
+    stop();
+}
+
+int openai_api::start()
+{
+    model_dir_ = sample_unescapeString(unit_call("sys", "sql_select", "config_lsmod_dir"));
+    if (model_dir_.empty()) model_dir_ = "/opt/m5stack/data/models/";
+
+    int threads            = config_.threads;
+    server_.new_task_queue = [threads] { return new httplib::ThreadPool(threads); };
+    server_.Get("/v1/models", [this](const httplib::Request &req, httplib::Response &res) { models(req, res); });
+    server_.Post("/v1/chat/completions",
+                 [this](const httplib::Request &req, httplib::Response &res) { chat_completions(req, res); });
+    server_.Post("/v1/audio/speech",
+                 [this](const httplib::Request &req, httplib::Response &res) { audio_speech(req, res); });
+    server_.Post("/v1/audio/transcriptions",
+                 [this](const httplib::Request &req, httplib::Response &res) { audio_transcriptions(req, res); });
+    if (!server_.bind_to_port(config_.host, config_.port)) {
+        SLOGE("openai api bind %s:%d failed", config_.host.c_str(), config_.port);
+        return -1;
+    }
+    server_thread_ = std::thread([this] { server_.listen_after_bind(); });
+    SLOGI("openai api listen on %s:%d", config_.host.c_str(), config_.port);
+    return 0;
+}
+
+void openai_api::stop()
+{
+    server_.stop();
+    if (server_thread_.joinable()) server_thread_.join();
+}
+
+bool openai_api::find_model(const std::string &name, openai_model_t &model)
+{
+    if (name.empty() || (name.find('/') != std::string::npos)) return false;
+    std::ifstream file(model_dir_ + "mode_" + name + ".json");
+    if (!file.is_open()) return false;
+    nlohmann::json mode_body = nlohmann::json::parse(file, nullptr, false);
+    if (mode_body.is_discarded()) return false;
+    model.name       = mode_body.value("mode", name);
+    model.type       = mode_body.value("type", std::string());
+    model.unit       = model_unit(model.name, model.type);
+    model.mode_param = mode_body.value("mode_param", nlohmann::json::object());
+    return !model.unit.empty();
+}
+
+std::list<openai_model_t> openai_api::list_models()
+{
+    std::list<openai_model_t> out;
+    for (const auto &path : glob_files({model_dir_ + "mode_*.json"})) {
+        std::string name = path.substr(path.rfind("/mode_") + 6);
+        name             = name.substr(0, name.length() - 5);
+        openai_model_t model;
+        if (find_model(name, model)) out.push_back(model);
+    }
+    return out;
+}
+
+void openai_api::send_error(httplib::Response &res, int status, const std::string &message)
+{
+    nlohmann::json body;
+    body["error"]["message"] = message;
+    body["error"]["type"]    = (status >= 500) ? "server_error" : "invalid_request_error";
+    body["error"]["code"]    = nullptr;
+    res.status               = status;
+    res.set_content(body.dump(), "application/json");
+    SLOGW("%d %s", status, message.c_str());
+}
+
+void openai_api::models(const httplib::Request &req, httplib::Response &res)
+{
+    nlohmann::json body;
+    body["object"] = "list";
+    body["data"]   = nlohmann::json::array();
+    for (const auto &model : list_models()) {
+        nlohmann::json item;
+        item["id"]       = model.name;
+        item["object"]   = "model";
+        item["created"]  = 0;
+        item["owned_by"] = "m5stack";
+        body["data"].push_back(item);
+    }
+    res.set_content(body.dump(), "application/json");
+}
+
+void openai_api::chat_completions(const httplib::Request &req, httplib::Response &res)
+{
+    nlohmann::json body = nlohmann::json::parse(req.body, nullptr, false);
+    if (body.is_discarded() || !body.contains("messages") || !body["messages"].is_array()) {
+        send_error(res, 400, "messages is required");
+        return;
+    }
+    openai_model_t model;
+    std::string model_name = body.value("model", std::string());
+    if (!find_model(model_name, model) || ((model.type != "llm") && (model.type != "vlm"))) {
+        send_error(res, 404, "chat model not found: " + model_name);
+        return;
+    }
+
+    // system messages are part of the task setup, the rest of the conversation is the input
+    std::string system_prompt;
+    std::list<std::pair<std::string, std::string>> turns;
+    std::list<std::string> images;
+    bool has_user = false;
+    for (auto &msg : body["messages"]) {
+        if (!msg.is_object()) continue;
+        std::string role = msg.value("role", std::string());
+        std::string text;
+        const nlohmann::json &content = msg["content"];
+        if (content.is_string()) {
+            text = content.get<std::string>();
+        } else if (content.is_array()) {
+            for (const auto &part : content) {
+                std::string type = part.value("type", std::string());
+                if (type == "text") {
+                    text += part.value("text", std::string());
+                } else if ((type == "image_url") && (role == "user")) {
+                    std::string url = part["image_url"].is_object() ? part["image_url"].value("url", std::string())
+                                                                    : part.value("image_url", std::string());
+                    size_t pos      = url.find(";base64,");
+                    if ((url.compare(0, 5, "data:") != 0) || (pos == std::string::npos)) {
+                        send_error(res, 400, "only base64 data URLs are supported for images");
+                        return;
+                    }
+                    images.push_back(url.substr(pos + 8));
+                }
+            }
+        }
+        if ((role == "system") || (role == "developer")) {
+            system_prompt += system_prompt.empty() ? text : "\n" + text;
+        } else if (!role.empty()) {
+            has_user = has_user || (role == "user");
+            turns.emplace_back(role, text);
+        }
+    }
+    if (!has_user) {
+        send_error(res, 400, "no user message");
+        return;
+    }
+    if (system_prompt.empty()) system_prompt = "You are a helpful assistant.";
+    std::string prompt = chat_prompt(turns);
+    if (!images.empty() && (model.type != "vlm")) {
+        send_error(res, 400, model.name + " does not take images");
+        return;
+    }
+
+    nlohmann::json config;
+    config["model"]           = model.name;
+    config["response_format"] = model.unit + ".utf-8.stream";
+    config["input"]           = model.unit + ".utf-8";
+    config["enoutput"]        = true;
+    config["prompt"]          = system_prompt;
+    if (body.contains("max_tokens") && body["max_tokens"].is_number_integer()) {
+        config["max_token_len"] = body["max_tokens"];
+    }
+    std::string error;
+    // models with precompute_len carry the conversation from one input to the next
+    bool context = model.mode_param.value("precompute_len", 0) > 0;
+    auto session = pool_.acquire(model.unit, config, context, error, config_.timeout_ms);
+    if (!session) {
+        send_error(res, 503, error);
+        return;
+    }
+    for (const auto &image : images) {
+        if (session->inference(model.unit + ".jpeg.base64", image, error)) break;
+    }
+    if (!error.empty() || session->inference(model.unit + ".utf-8", prompt, error)) {
+        pool_.release(session, false);
+        send_error(res, 503, error);
+        return;
+    }
+
+    std::string id = request_id("chatcmpl-");
+    time_t created = time(NULL);
+    if (!body.value("stream", false)) {
+        std::string content;
+        bool ok = read_outputs(
+            *session, config_.timeout_ms,
+            [&content](const std::string &delta) {
+                content += delta;
+                return true;
+            },
+            error);
+        pool_.release(session, ok);
+        if (!ok) {
+            send_error(res, 500, error);
+            return;
+        }
+        nlohmann::json choice;
+        choice["index"]              = 0;
+        choice["message"]["role"]    = "assistant";
+        choice["message"]["content"] = content;
+        choice["finish_reason"]      = "stop";
+        nlohmann::json out;
+        out["id"]      = id;
+        out["object"]  = "chat.completion";
+        out["created"] = created;
+        out["model"]   = model.name;
+        out["choices"] = nlohmann::json::array({choice});
+        res.set_content(out.dump(), "application/json");
+        return;
+    }
+
+    // every delta is written as one chunk the moment the unit sends it
+    auto reuse = std::make_shared<std::atomic_bool>(false);
+    res.set_header("Cache-Control", "no-cache");
+    res.set_chunked_content_provider(
+        "text/event-stream",
+        [this, session, reuse, id, created, model](size_t offset, httplib::DataSink &sink) {
+            auto send_chunk = [&](const nlohmann::json &delta, const nlohmann::json &finish_reason) {
+                nlohmann::json choice;
+                choice["index"]         = 0;
+                choice["delta"]         = delta;
+                choice["finish_reason"] = finish_reason;
+                nlohmann::json out;
+                out["id"]          = id;
+                out["object"]      = "chat.completion.chunk";
+                out["created"]     = created;
+                out["model"]       = model.name;
+                out["choices"]     = nlohmann::json::array({choice});
+                std::string event = "data: " + out.dump() + "\n\n";
+                return sink.write(event.data(), event.size());
+            };
+            nlohmann::json delta;
+            delta["role"]    = "assistant";
+            delta["content"] = "";
+            bool connected   = send_chunk(delta, nullptr);
+            std::string error;
+            bool ok = read_outputs(
+                *session, config_.timeout_ms,
+                [&](const std::string &text) {
+                    nlohmann::json delta;
+                    delta["content"] = text;
+                    connected        = connected && send_chunk(delta, nullptr);
+                    return connected;
+                },
+                error);
+            reuse->store(ok);
+            if (!connected) return false;
+            if (ok) {
+                send_chunk(nlohmann::json::object(), "stop");
+            } else {
+                nlohmann::json out;
+                out["error"]["message"] = error;
+                out["error"]["type"]    = "server_error";
+                std::string event       = "data: " + out.dump() + "\n\n";
+                sink.write(event.data(), event.size());
+            }
+            static const char done[] = "data: [DONE]\n\n";
+            sink.write(done, sizeof(done) - 1);
+            sink.done();
+            return true;
+        },
+        [this, session, reuse](bool success) { pool_.release(session, reuse->load()); });
+}
+
+void openai_api::audio_speech(const httplib::Request &req, httplib::Response &res)
+{
+    nlohmann::json body = nlohmann::json::parse(req.body, nullptr, false);
+    if (body.is_discarded() || !body.contains("input") || !body["input"].is_string()) {
+        send_error(res, 400, "input is required");
+        return;
+    }
+    openai_model_t model;
+    std::string model_name = body.value("model", std::string());
+    if (!find_model(model_name, model) || (model.type != "tts")) {
+        send_error(res, 404, "speech model not found: " + model_name);
+        return;
+    }
+    std::string format = body.value("response_format", std::string("wav"));
+    if ((format != "wav") && (format != "pcm")) {
+        send_error(res, 400, "response_format must be wav or pcm");
+        return;
+    }
+
+    nlohmann::json config;
+    config["model"]           = model.name;
+    config["response_format"] = "tts.base64.wav.stream";
+    config["input"]           = "tts.utf-8";
+    config["enoutput"]        = true;
+    std::string error;
+    auto session = pool_.acquire(model.unit, config, false, error, config_.timeout_ms);
+    if (!session) {
+        send_error(res, 503, error);
+        return;
+    }
+    if (session->inference("tts.utf-8", body["input"], error)) {
+        pool_.release(session, false);
+        send_error(res, 503, error);
+        return;
+    }
+    std::string pcm;
+    bool ok = read_outputs(
+        *session, config_.timeout_ms,
+        [&pcm](const std::string &delta) {
+            std::string chunk;
+            if (decode_base64(delta, chunk) > 0) pcm += chunk;
+            return true;
+        },
+        error);
+    pool_.release(session, ok);
+    if (!ok) {
+        send_error(res, 500, error);
+        return;
+    }
+    if (format == "pcm") {
+        res.set_content(std::move(pcm), "audio/pcm");
+        return;
+    }
+
+    // 16 bit mono at the model's output rate
+    uint32_t rate      = model.mode_param.value("audio_rate", 16000);
+    uint32_t data_size = pcm.size();
+    std::string wav(44, '\0');
+    auto put32 = [&wav](int pos, uint32_t val) { memcpy(&wav[pos], &val, 4); };
+    auto put16 = [&wav](int pos, uint16_t val) { memcpy(&wav[pos], &val, 2); };
+    memcpy(&wav[0], "RIFF", 4);
+    put32(4, 36 + data_size);
+    memcpy(&wav[8], "WAVEfmt ", 8);
+    put32(16, 16);
+    put16(20, 1);
+    put16(22, 1);
+    put32(24, rate);
+    put32(28, rate * 2);
+    put16(32, 2);
+    put16(34, 16);
+    memcpy(&wav[36], "data", 4);
+    put32(40, data_size);
+    wav += pcm;
+    res.set_content(std::move(wav), "audio/wav");
+}
+
+void openai_api::audio_transcriptions(const httplib::Request &req, httplib::Response &res)
+{
+    if (!req.is_multipart_form_data() || !req.has_file("file")) {
+        send_error(res, 400, "file is required");
+        return;
+    }
+    openai_model_t model;
+    std::string model_name = req.has_file("model") ? req.get_file_value("model").content : std::string();
+    if (!find_model(model_name, model) || (model.type != "asr")) {
+        send_error(res, 404, "transcription model not found: " + model_name);
+        return;
+    }
+    std::string wav = req.get_file_value("file").content;
+    std::string error;
+    if (!check_wav(wav, error)) {
+        send_error(res, 400, error);
+        return;
+    }
+    std::string language = req.has_file("language") ? req.get_file_value("language").content : std::string("en");
+    std::string format =
+        req.has_file("response_format") ? req.get_file_value("response_format").content : std::string("json");
+
+    nlohmann::json config;
+    config["model"]           = model.name;
+    config["response_format"] = "asr.utf-8";
+    config["input"]           = model.unit + ".base64.wav";
+    config["enoutput"]        = true;
+    config["language"]        = language;
+    auto session = pool_.acquire(model.unit, config, false, error, config_.timeout_ms);
+    if (!session) {
+        send_error(res, 503, error);
+        return;
+    }
+    std::string wav_base64;
+    encode_base64(wav, wav_base64);
+    if (session->inference(model.unit + ".base64.wav", wav_base64, error)) {
+        pool_.release(session, false);
+        send_error(res, 503, error);
+        return;
+    }
+    std::string text;
+    bool ok = read_outputs(
+        *session, config_.timeout_ms,
+        [&text](const std::string &delta) {
+            text += delta;
+            return true;
+        },
+        error);
+    pool_.release(session, ok);
+    if (!ok) {
+        send_error(res, 500, error);
+        return;
+    }
+    if (format == "text") {
+        res.set_content(text, "text/plain");
+        return;
+    }
+    nlohmann::json out;
+    out["text"] = text;
+    res.set_content(out.dump(), "application/json");
+}
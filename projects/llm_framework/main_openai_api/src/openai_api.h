@@ -0,0 +1,101 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "json.hpp"
+#include "unit_session.h"
+#include "utils/httplib.h"
+
+typedef struct {
+    std::string host;
+    int port;
+    int threads;        // HTTP worker threads, the number of clients served at once
+    int max_sessions;   // unit tasks kept set up at the same time
+    int max_instances;  // tasks set up for the same model and configuration
+    int timeout_ms;     // longest wait for the next output of a unit
+} openai_api_config_t;
+
+typedef struct {
+    std::string name;
+    std::string type;  // llm, vlm, tts, asr ...
+    std::string unit;  // StackFlow unit serving the model
+    nlohmann::json mode_param;
+} openai_model_t;
+
+/**
+ * Unit tasks kept set up between requests, keyed by unit and setup config.
+ * A task is lent to one request at a time. When max_sessions are set up the least recently used idle task is exited
+ * to make room, when every task is busy the request waits for one to be handed back. Tasks of context models are
+ * reset before they are lent again, so one client never continues the conversation of another.
+ */
+class session_pool {
+public:
+    session_pool(int max_sessions, int max_instances);
+    ~session_pool();
+
+    std::shared_ptr<unit_session> acquire(const std::string &unit, const nlohmann::json &config, bool reset,
+                                          std::string &error, int timeout_ms);
+    // a task that failed mid-request is exited instead of being lent again
+    void release(const std::shared_ptr<unit_session> &session, bool reuse);
+
+private:
+    struct entry {
+        std::string key;
+        std::shared_ptr<unit_session> session;  // NULL while the task is being set up
+        bool busy;
+        uint64_t last_used;
+    };
+
+    int max_sessions_;
+    int max_instances_;
+    unsigned int next_url_;
+    uint64_t tick_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::list<entry> entries_;
+};
+
+/**
+ * OpenAI compatible HTTP gateway in front of the StackFlow units.
+ *
+ *   GET  /v1/models                 installed models
+ *   POST /v1/chat/completions       llm and vlm models, "stream": true answers with server-sent events
+ *   POST /v1/audio/speech           tts models, wav or raw pcm
+ *   POST /v1/audio/transcriptions   asr models, multipart upload of a 16 kHz mono wav
+ *
+ * Each request runs on its own worker thread, streamed tokens are written to the client as they arrive.
+ */
+class openai_api {
+public:
+    openai_api(const openai_api_config_t &config);
+    ~openai_api();
+
+    // returns 0 on success, -1 if the port cannot be bound
+    int start();
+    void stop();
+
+private:
+    void models(const httplib::Request &req, httplib::Response &res);
+    void chat_completions(const httplib::Request &req, httplib::Response &res);
+    void audio_speech(const httplib::Request &req, httplib::Response &res);
+    void audio_transcriptions(const httplib::Request &req, httplib::Response &res);
+
+    bool find_model(const std::string &name, openai_model_t &model);
+    std::list<openai_model_t> list_models();
+    void send_error(httplib::Response &res, int status, const std::string &message);
+
+    openai_api_config_t config_;
+    std::string model_dir_;
+    session_pool pool_;
+    httplib::Server server_;
+    std::thread server_thread_;
+};
@@ -0,0 +1,144 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "unit_session.h"
+
+#include <chrono>
+#include "StackFlowUtil.h"
+#include "sample_log.h"
+
+using namespace StackFlows;
+
+std::atomic<unsigned int> unit_session::next_request_id_{1};
+
+unit_session::unit_session(const std::string &unit_name, const std::string &reply_url)
+    : unit_name_(unit_name), reply_url_(reply_url)
+{
+    reply_ = std::make_unique<pzmq>(reply_url_, ZMQ_PULL, [this](pzmq *_pzmq, const std::shared_ptr<pzmq_data> &data) {
+        this->on_message(data->string());
+    });
+}
+
+unit_session::~unit_session()
+{
+    exit();
+    reply_.reset();
+}
+
+nlohmann::json unit_session::request(const std::string &action, bool track)
+{
+    nlohmann::json body;
+    std::string request_id = "openai_" + std::to_string(next_request_id_++);
+    if (track) {
+        std::lock_guard<std::mutex> guard(mtx_);
+        messages_.clear();
+        request_id_ = request_id;
+    }
+    body["request_id"] = request_id;
+    body["work_id"]    = work_id_.empty() ? unit_name_ : work_id_;
+    body["action"]     = action;
+    return body;
+}
+
+std::string unit_session::call(const std::string &action, const nlohmann::json &body)
+{
+    std::string value;
+    pzmq _call(unit_name_);
+    _call.call_rpc_action(action, pzmq_data::set_param(reply_url_, body.dump()),
+                          [&value](pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw) { value = raw->string(); });
+    return value;
+}
+
+void unit_session::on_message(const std::string &raw)
+{
+    nlohmann::json msg = nlohmann::json::parse(raw, nullptr, false);
+    if (msg.is_discarded()) {
+        SLOGW("%s: drop malformed output", unit_name_.c_str());
+        return;
+    }
+    std::lock_guard<std::mutex> guard(mtx_);
+    // outputs of an earlier, abandoned request are dropped here
+    if (msg.value("request_id", std::string()) != request_id_) return;
+    messages_.push_back(std::move(msg));
+    cond_.notify_one();
+}
+
+bool unit_session::read(nlohmann::json &msg, int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(mtx_);
+    if (!cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return !messages_.empty(); })) {
+        return false;
+    }
+    msg = std::move(messages_.front());
+    messages_.pop_front();
+    return true;
+}
+
+int unit_session::setup(const nlohmann::json &config, std::string &error, int timeout_ms)
+{
+    nlohmann::json body = request("setup", true);
+    body["object"]      = unit_name_ + ".setup";
+    body["data"]        = config;
+    if (call("setup", body) != "None") {
+        error = unit_name_ + " unit is not running";
+        return -1;
+    }
+    nlohmann::json msg;
+    if (!read(msg, timeout_ms)) {
+        error = unit_name_ + " setup timeout";
+        return -1;
+    }
+    if (msg["error"].value("code", 0) != 0) {
+        error = msg["error"].value("message", std::string("setup failed"));
+        return -1;
+    }
+    work_id_ = msg.value("work_id", std::string());
+    SLOGI("%s setup %s", work_id_.c_str(), config.dump().c_str());
+    return work_id_.empty() ? -1 : 0;
+}
+
+int unit_session::inference(const std::string &object, const nlohmann::json &data, std::string &error)
+{
+    nlohmann::json body = request("inference", true);
+    body["object"]      = object;
+    body["data"]        = data;
+    std::string ret     = unit_call("sys", "unit_inference", pzmq_data::set_param(reply_url_, body.dump()));
+    if (ret != "Success") {
+        error = work_id_ + " inference push failed";
+        return -1;
+    }
+    return 0;
+}
+
+int unit_session::reset(std::string &error, int timeout_ms)
+{
+    if (inference(unit_name_ + ".utf-8", "reset", error)) return -1;
+    nlohmann::json msg;
+    while (read(msg, timeout_ms)) {
+        if (msg.contains("error") && (msg["error"].value("code", 0) != 0)) {
+            error = msg["error"].value("message", std::string("reset failed"));
+            return -1;
+        }
+        const nlohmann::json &data = msg["data"];
+        if (data.is_string() || (data.is_object() && data.value("finish", false))) return 0;
+    }
+    error = work_id_ + " reset timeout";
+    return -1;
+}
+
+void unit_session::pause()
+{
+    if (work_id_.empty()) return;
+    // the outputs of the running request keep its id, the reply to the pause itself is dropped
+    call("pause", request("pause", false));
+}
+
+void unit_session::exit()
+{
+    if (work_id_.empty()) return;
+    call("exit", request("exit", false));
+    SLOGI("%s exit", work_id_.c_str());
+    work_id_.clear();
+}
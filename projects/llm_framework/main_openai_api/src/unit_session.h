@@ -0,0 +1,65 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "json.hpp"
+#include "pzmq.hpp"
+
+/**
+ * Client side of one task on a StackFlow unit.
+ * The task is set up and torn down over the unit's RPC, inference goes through the sys unit_inference RPC and
+ * everything the task outputs is pushed back to a PULL socket owned by the session. A session serves one request at
+ * a time, the pool hands it out exclusively.
+ */
+class unit_session {
+public:
+    unit_session(const std::string &unit_name, const std::string &reply_url);
+    ~unit_session();
+
+    // creates the task, returns 0 on success and fills error with the unit's message otherwise
+    int setup(const nlohmann::json &config, std::string &error, int timeout_ms);
+    // sends one input to the task, the outputs are read back with read()
+    int inference(const std::string &object, const nlohmann::json &data, std::string &error);
+    // next output of the last inference, false on timeout
+    bool read(nlohmann::json &msg, int timeout_ms);
+    // drops the conversation a context model keeps between inputs, returns 0 once the unit confirmed it
+    int reset(std::string &error, int timeout_ms);
+    // asks the task to stop generating, the unit still sends its final message
+    void pause();
+    void exit();
+
+    const std::string &unit_name() const
+    {
+        return unit_name_;
+    }
+
+    const std::string &work_id() const
+    {
+        return work_id_;
+    }
+
+private:
+    void on_message(const std::string &raw);
+    std::string call(const std::string &action, const nlohmann::json &body);
+    // a tracked request replaces the one whose outputs read() returns
+    nlohmann::json request(const std::string &action, bool track);
+
+    std::string unit_name_;
+    std::string reply_url_;
+    std::string work_id_;
+    std::string request_id_;
+    std::unique_ptr<StackFlows::pzmq> reply_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::deque<nlohmann::json> messages_;
+    static std::atomic<unsigned int> next_request_id_;
+};
@@ -0,0 +1,246 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * Stand-ins for llm-sys and the llm, melotts and whisper units, speaking as much of the StackFlow protocol as the
+ * gateway uses: setup, pause and exit on each unit's RPC, inference through the unit_inference RPC of sys, outputs
+ * pushed to the reply url of the request.
+ *
+ *   llm      a context model: answers "[turn N] <input>" word by word, N counting the inputs since setup or the
+ *            last "reset". An input starting with "long" streams 200 words.
+ *   melotts  answers the input text three times as base64 pcm chunks.
+ *   whisper  answers "heard N bytes" for a wav with a data chunk, and nothing at all otherwise, like the real one.
+ *
+ * Every call is logged as "<action> <work_id> [<data>]" so tests can check what the gateway sent.
+ */
+#pragma once
+
+#include <unistd.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "StackFlowUtil.h"
+#include "json.hpp"
+#include "pzmq.hpp"
+
+class mock_units {
+public:
+    explicit mock_units(const std::string &model_dir) : model_dir_(model_dir), next_work_id_(1000)
+    {
+        using namespace StackFlows;
+        sys_ = std::make_unique<pzmq>("sys");
+        sys_->register_rpc_action("sql_select", [this](pzmq *, const std::shared_ptr<pzmq_data> &) {
+            return model_dir_;
+        });
+        sys_->register_rpc_action("unit_inference", [this](pzmq *, const std::shared_ptr<pzmq_data> &raw) {
+            return inference(raw->get_param(0), raw->get_param(1));
+        });
+        for (std::string unit : {"llm", "melotts", "whisper"}) {
+            units_.push_back(std::make_unique<pzmq>(unit));
+            units_.back()->register_rpc_action("setup", [this, unit](pzmq *, const std::shared_ptr<pzmq_data> &raw) {
+                return setup(unit, raw->get_param(0), raw->get_param(1));
+            });
+            units_.back()->register_rpc_action("pause", [this](pzmq *, const std::shared_ptr<pzmq_data> &raw) {
+                return pause(raw->get_param(1));
+            });
+            units_.back()->register_rpc_action("exit", [this](pzmq *, const std::shared_ptr<pzmq_data> &raw) {
+                return exit(raw->get_param(1));
+            });
+        }
+    }
+
+    ~mock_units()
+    {
+        std::vector<std::thread> workers;
+        {
+            std::lock_guard<std::mutex> guard(mtx_);
+            workers.swap(workers_);
+        }
+        for (auto &worker : workers) worker.join();
+        units_.clear();
+        sys_.reset();
+    }
+
+    std::vector<std::string> calls()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        return calls_;
+    }
+
+    // calls logged since the given count
+    std::vector<std::string> calls_since(size_t count)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        if (count >= calls_.size()) return {};
+        return std::vector<std::string>(calls_.begin() + count, calls_.end());
+    }
+
+    // setup config of a task, null once it has exited
+    nlohmann::json config(const std::string &work_id)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        auto iter = tasks_.find(work_id);
+        return (iter == tasks_.end()) ? nlohmann::json() : iter->second->config;
+    }
+
+private:
+    struct task {
+        std::string unit;
+        nlohmann::json config;
+        int turns = 0;
+        std::atomic_bool paused{false};
+    };
+
+    static void push(const std::string &url, const nlohmann::json &request, const std::string &object,
+                     const nlohmann::json &data)
+    {
+        nlohmann::json out;
+        out["request_id"]       = request["request_id"];
+        out["work_id"]          = request["work_id"];
+        out["created"]          = 0;
+        out["object"]           = object;
+        out["data"]             = data;
+        out["error"]["code"]    = 0;
+        out["error"]["message"] = "";
+        StackFlows::pzmq push(url, ZMQ_PUSH);
+        push.send_data(out.dump());
+    }
+
+    static void push_delta(const std::string &url, const nlohmann::json &request, const std::string &object,
+                           const std::string &delta, int index, bool finish)
+    {
+        nlohmann::json data;
+        data["delta"]  = delta;
+        data["index"]  = index;
+        data["finish"] = finish;
+        push(url, request, object, data);
+    }
+
+    void log(const std::string &call)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        calls_.push_back(call);
+    }
+
+    std::string setup(const std::string &unit, const std::string &url, const std::string &raw)
+    {
+        nlohmann::json request = nlohmann::json::parse(raw);
+        auto t                 = std::make_shared<task>();
+        t->unit                = unit;
+        t->config              = request["data"];
+        std::string work_id    = unit + "." + std::to_string(next_work_id_++);
+        {
+            std::lock_guard<std::mutex> guard(mtx_);
+            tasks_[work_id] = t;
+            calls_.push_back("setup " + work_id);
+        }
+        request["work_id"] = work_id;
+        push(url, request, "None", "None");
+        return "None";
+    }
+
+    std::string pause(const std::string &raw)
+    {
+        nlohmann::json request = nlohmann::json::parse(raw);
+        std::string work_id    = request.value("work_id", std::string());
+        std::lock_guard<std::mutex> guard(mtx_);
+        calls_.push_back("pause " + work_id);
+        auto iter = tasks_.find(work_id);
+        if (iter != tasks_.end()) iter->second->paused = true;
+        return "None";
+    }
+
+    std::string exit(const std::string &raw)
+    {
+        nlohmann::json request = nlohmann::json::parse(raw);
+        std::string work_id    = request.value("work_id", std::string());
+        std::lock_guard<std::mutex> guard(mtx_);
+        calls_.push_back("exit " + work_id);
+        tasks_.erase(work_id);
+        return "None";
+    }
+
+    std::string inference(const std::string &url, const std::string &raw)
+    {
+        nlohmann::json request = nlohmann::json::parse(raw, nullptr, false);
+        if (request.is_discarded()) return "None";
+        std::string work_id = request.value("work_id", std::string());
+        std::string data    = request["data"].is_string() ? request["data"].get<std::string>() : request["data"].dump();
+        std::lock_guard<std::mutex> guard(mtx_);
+        auto iter = tasks_.find(work_id);
+        if (iter == tasks_.end()) return "None";
+        std::shared_ptr<task> t = iter->second;
+        calls_.push_back("inference " + work_id + " " + ((t->unit == "llm") ? data : request.value("object", "")));
+        workers_.emplace_back([this, t, url, request, data] {
+            if (t->unit == "llm") {
+                llm(*t, url, request, data);
+            } else if (t->unit == "melotts") {
+                melotts(url, request, data);
+            } else {
+                whisper(url, request, data);
+            }
+        });
+        return "Success";
+    }
+
+    static void llm(task &t, const std::string &url, const nlohmann::json &request, const std::string &input)
+    {
+        const std::string object = "llm.utf-8.stream";
+        t.paused                 = false;
+        if (input == "reset") {
+            t.turns = 0;
+            push_delta(url, request, object, "", 0, true);
+            return;
+        }
+        std::vector<std::string> words = {"[turn " + std::to_string(++t.turns) + "]"};
+        if (input.compare(0, 4, "long") == 0) {
+            for (int i = 0; i < 200; i++) words.push_back(" w" + std::to_string(i));
+        } else {
+            std::istringstream in(input);
+            for (std::string word; std::getline(in, word, ' ');) words.push_back(" " + word);
+        }
+        int index = 0;
+        for (const auto &word : words) {
+            if (t.paused) break;
+            push_delta(url, request, object, word, index++, false);
+            usleep(5000);
+        }
+        push_delta(url, request, object, "", index, true);
+    }
+
+    static void melotts(const std::string &url, const nlohmann::json &request, const std::string &input)
+    {
+        const std::string object = "tts.base64.wav.stream";
+        for (int i = 0; i < 3; i++) {
+            std::string chunk;
+            StackFlows::encode_base64(input, chunk);
+            push_delta(url, request, object, chunk, i, false);
+        }
+        push_delta(url, request, object, "", 3, true);
+    }
+
+    static void whisper(const std::string &url, const nlohmann::json &request, const std::string &input)
+    {
+        std::string wav;
+        StackFlows::decode_base64(input, wav);
+        size_t pos = wav.find("data");
+        if ((wav.compare(0, 4, "RIFF") != 0) || (pos == std::string::npos)) return;
+        push(url, request, "asr.utf-8", "heard " + std::to_string(wav.size() - pos - 8) + " bytes");
+    }
+
+    std::string model_dir_;
+    std::atomic<int> next_work_id_;
+    std::unique_ptr<StackFlows::pzmq> sys_;
+    std::vector<std::unique_ptr<StackFlows::pzmq>> units_;
+    std::mutex mtx_;
+    std::vector<std::string> calls_;
+    std::map<std::string, std::shared_ptr<task>> tasks_;
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/* Stands in for the SDK's sample_log.h in host builds, only warnings and errors are printed. */
+#pragma once
+#include <stdio.h>
+
+#define SLOGI(fmt, ...) do {} while (0)
+#define SLOGW(fmt, ...) fprintf(stderr, "[W] " fmt "\n", ##__VA_ARGS__)
+#define SLOGE(fmt, ...) fprintf(stderr, "[E] " fmt "\n", ##__VA_ARGS__)
@@ -0,0 +1,334 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * The OpenAI gateway over HTTP against the mock units: model listing, chat with and without streaming, the
+ * conversation sent as one input, context models reset between requests, a client hanging up mid-stream, speech,
+ * and transcriptions including files that are not 16 kHz mono wav.
+ */
+#include "openai_api.h"
+#include "mock_units.hpp"
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+static const char *models[][2] = {
+    {"qwen-ctx", R"({"mode":"qwen-ctx","type":"llm","mode_param":{"precompute_len":1024}})"},
+    {"qwen-plain", R"({"mode":"qwen-plain","type":"llm","mode_param":{}})"},
+    {"melotts-en-us", R"({"mode":"melotts-en-us","type":"tts","mode_param":{"audio_rate":44100}})"},
+    {"whisper-tiny", R"({"mode":"whisper-tiny","type":"asr","mode_param":{}})"},
+    {"yolo11n", R"({"mode":"yolo11n","type":"cv","mode_param":{}})"},
+};
+
+static std::string model_dir()
+{
+    return "/tmp/openai_api_test." + std::to_string(getpid()) + "/";
+}
+
+static void write_models()
+{
+    mkdir(model_dir().c_str(), 0777);
+    for (const auto &model : models) {
+        std::ofstream(model_dir() + "mode_" + model[0] + ".json") << model[1];
+    }
+}
+
+static void remove_models()
+{
+    for (const auto &model : models) unlink((model_dir() + "mode_" + model[0] + ".json").c_str());
+    rmdir(model_dir().c_str());
+}
+
+static nlohmann::json chat_body(const std::string &model, const nlohmann::json &messages, bool stream = false)
+{
+    nlohmann::json body;
+    body["model"]    = model;
+    body["messages"] = messages;
+    body["stream"]   = stream;
+    return body;
+}
+
+static nlohmann::json user(const std::string &text)
+{
+    return {{"role", "user"}, {"content", text}};
+}
+
+// content of a non-streamed answer, empty on any error
+static std::string chat(httplib::Client &cli, const nlohmann::json &body, int *status = nullptr)
+{
+    auto res = cli.Post("/v1/chat/completions", body.dump(), "application/json");
+    if (status) *status = res ? res->status : 0;
+    if (!res || (res->status != 200)) return "";
+    nlohmann::json out = nlohmann::json::parse(res->body, nullptr, false);
+    if (out.is_discarded() || !out["choices"].is_array() || out["choices"].empty()) return "";
+    return out["choices"][0]["message"].value("content", std::string());
+}
+
+static bool has_call(const std::vector<std::string> &calls, const std::string &prefix)
+{
+    for (const auto &call : calls) {
+        if (call.compare(0, prefix.size(), prefix) == 0) return true;
+    }
+    return false;
+}
+
+// work id of the first task of the unit set up since the given call count
+static std::string work_id_since(mock_units &units, size_t count, const std::string &unit)
+{
+    for (const auto &call : units.calls_since(count)) {
+        if (call.compare(0, 6 + unit.size() + 1, "setup " + unit + ".") == 0) return call.substr(6);
+    }
+    return "";
+}
+
+static void test_models(httplib::Client &cli)
+{
+    auto res = cli.Get("/v1/models");
+    CHECK(res && (res->status == 200));
+    if (!res) return;
+    nlohmann::json out = nlohmann::json::parse(res->body, nullptr, false);
+    std::vector<std::string> ids;
+    for (const auto &item : out["data"]) ids.push_back(item.value("id", std::string()));
+    std::sort(ids.begin(), ids.end());
+    CHECK((ids == std::vector<std::string>{"melotts-en-us", "qwen-ctx", "qwen-plain", "whisper-tiny"}));
+}
+
+static void test_chat_errors(httplib::Client &cli)
+{
+    int status;
+    chat(cli, chat_body("nope", nlohmann::json::array({user("hi")})), &status);
+    CHECK(status == 404);
+    chat(cli, chat_body("yolo11n", nlohmann::json::array({user("hi")})), &status);
+    CHECK(status == 404);
+    chat(cli, chat_body("qwen-plain", nlohmann::json::array({{{"role", "system"}, {"content", "x"}}})), &status);
+    CHECK(status == 400);
+    nlohmann::json text  = {{"type", "text"}, {"text", "what is it"}};
+    nlohmann::json jpeg  = {{"type", "image_url"}, {"image_url", {{"url", "data:image/jpeg;base64,AAAA"}}}};
+    nlohmann::json image = {{"role", "user"}, {"content", nlohmann::json::array({text, jpeg})}};
+    chat(cli, chat_body("qwen-plain", nlohmann::json::array({image})), &status);
+    CHECK(status == 400);
+    auto res = cli.Post("/v1/chat/completions", "{", "application/json");
+    CHECK(res && (res->status == 400));
+}
+
+// a second request on the same context model task starts from a reset context, a plain model is never reset
+static void test_chat_reset(httplib::Client &cli, mock_units &units)
+{
+    size_t mark = units.calls().size();
+    CHECK(chat(cli, chat_body("qwen-ctx", nlohmann::json::array({user("hello there")}))) == "[turn 1] hello there");
+    std::string work_id = work_id_since(units, mark, "llm");
+    CHECK(!work_id.empty());
+    CHECK(units.config(work_id).value("prompt", std::string()) == "You are a helpful assistant.");
+    CHECK(chat(cli, chat_body("qwen-ctx", nlohmann::json::array({user("again")}))) == "[turn 1] again");
+    auto calls = units.calls_since(mark);
+    CHECK((calls == std::vector<std::string>{"setup " + work_id, "inference " + work_id + " hello there",
+                                             "inference " + work_id + " reset", "inference " + work_id + " again"}));
+
+    mark = units.calls().size();
+    CHECK(chat(cli, chat_body("qwen-plain", nlohmann::json::array({user("one")}))) == "[turn 1] one");
+    CHECK(chat(cli, chat_body("qwen-plain", nlohmann::json::array({user("two")}))) == "[turn 2] two");
+    CHECK(!has_call(units.calls_since(mark), "inference " + work_id_since(units, mark, "llm") + " reset"));
+}
+
+// every message reaches the unit, the system messages through the task setup
+static void test_chat_messages(httplib::Client &cli, mock_units &units)
+{
+    size_t mark           = units.calls().size();
+    nlohmann::json system = {{"role", "system"}, {"content", "Be brief."}};
+    nlohmann::json part   = {{"type", "text"}, {"text", "my name is Ann"}};
+    nlohmann::json first  = {{"role", "user"}, {"content", nlohmann::json::array({part})}};
+    nlohmann::json reply  = {{"role", "assistant"}, {"content", "hi Ann"}};
+    nlohmann::json convo  = nlohmann::json::array({system, first, reply, user("who am I")});
+    std::string content   = chat(cli, chat_body("qwen-ctx", convo));
+    CHECK(content == "[turn 1] user: my name is Ann\nassistant: hi Ann\nuser: who am I");
+    std::string work_id = work_id_since(units, mark, "llm");
+    CHECK(units.config(work_id).value("prompt", std::string()) == "Be brief.");
+}
+
+static void test_chat_stream(httplib::Client &cli)
+{
+    nlohmann::json body = chat_body("qwen-ctx", nlohmann::json::array({user("stream me")}), true);
+    auto res            = cli.Post("/v1/chat/completions", body.dump(), "application/json");
+    CHECK(res && (res->status == 200));
+    if (!res) return;
+    CHECK(res->get_header_value("Content-Type") == "text/event-stream");
+
+    std::string content, finish;
+    bool done = false;
+    std::istringstream events(res->body);
+    for (std::string line; std::getline(events, line);) {
+        if (line.compare(0, 6, "data: ") != 0) continue;
+        if (line == "data: [DONE]") {
+            done = true;
+            continue;
+        }
+        nlohmann::json chunk = nlohmann::json::parse(line.substr(6), nullptr, false);
+        CHECK(!chunk.is_discarded() && (chunk.value("object", std::string()) == "chat.completion.chunk"));
+        if (chunk.is_discarded()) continue;
+        const nlohmann::json &choice = chunk["choices"][0];
+        content += choice["delta"].value("content", std::string());
+        if (choice["finish_reason"].is_string()) finish = choice["finish_reason"];
+    }
+    CHECK(content == "[turn 1] stream me");
+    CHECK(finish == "stop");
+    CHECK(done);
+}
+
+// hanging up mid-stream pauses the task, which is reset and lent to the next request
+static void test_chat_hang_up(httplib::Client &cli, mock_units &units)
+{
+    size_t mark = units.calls().size();
+    httplib::Request req;
+    req.method = "POST";
+    req.path   = "/v1/chat/completions";
+    req.body   = chat_body("qwen-ctx", nlohmann::json::array({user("long answer")}), true).dump();
+    req.set_header("Content-Type", "application/json");
+    int chunks           = 0;
+    req.content_receiver = [&chunks](const char *, size_t, uint64_t, uint64_t) { return ++chunks < 3; };
+    httplib::Response res;
+    httplib::Error error;
+    auto start = std::chrono::steady_clock::now();
+    cli.send(req, res, error);
+    CHECK(chunks == 3);
+
+    CHECK(chat(cli, chat_body("qwen-ctx", nlohmann::json::array({user("next")}))) == "[turn 1] next");
+    // 200 words at 5 ms would take a second
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(900));
+    auto calls = units.calls_since(mark);
+    CHECK(has_call(calls, "pause llm."));
+    CHECK(has_call(calls, "inference llm.") && !has_call(calls, "setup llm."));
+}
+
+static void test_speech(httplib::Client &cli)
+{
+    nlohmann::json body = {{"model", "melotts-en-us"}, {"input", "abcd"}};
+    auto res            = cli.Post("/v1/audio/speech", body.dump(), "application/json");
+    CHECK(res && (res->status == 200));
+    if (res && (res->status == 200)) {
+        const std::string &wav = res->body;
+        CHECK(res->get_header_value("Content-Type") == "audio/wav");
+        CHECK((wav.size() == 44 + 12) && (wav.compare(0, 4, "RIFF") == 0) && (wav.compare(8, 4, "WAVE") == 0));
+        uint32_t rate = 0, data_size = 0;
+        memcpy(&rate, wav.data() + 24, 4);
+        memcpy(&data_size, wav.data() + 40, 4);
+        CHECK((rate == 44100) && (data_size == 12));
+        CHECK(wav.substr(44) == "abcdabcdabcd");
+    }
+    body["response_format"] = "pcm";
+    res                     = cli.Post("/v1/audio/speech", body.dump(), "application/json");
+    CHECK(res && (res->status == 200) && (res->body == "abcdabcdabcd"));
+    body["response_format"] = "mp3";
+    res                     = cli.Post("/v1/audio/speech", body.dump(), "application/json");
+    CHECK(res && (res->status == 400));
+    body = {{"model", "whisper-tiny"}, {"input", "abcd"}};
+    res  = cli.Post("/v1/audio/speech", body.dump(), "application/json");
+    CHECK(res && (res->status == 404));
+}
+
+static std::string wav_file(uint16_t format, uint16_t channels, uint32_t rate, uint16_t bits, uint32_t samples)
+{
+    std::string wav(44, '\0');
+    auto put32 = [&wav](int pos, uint32_t val) { memcpy(&wav[pos], &val, 4); };
+    auto put16 = [&wav](int pos, uint16_t val) { memcpy(&wav[pos], &val, 2); };
+    uint32_t data_size = samples * channels * bits / 8;
+    memcpy(&wav[0], "RIFF", 4);
+    put32(4, 36 + data_size);
+    memcpy(&wav[8], "WAVEfmt ", 8);
+    put32(16, 16);
+    put16(20, format);
+    put16(22, channels);
+    put32(24, rate);
+    put32(28, rate * channels * bits / 8);
+    put16(32, channels * bits / 8);
+    put16(34, bits);
+    memcpy(&wav[36], "data", 4);
+    put32(40, data_size);
+    wav.append(data_size, '\x01');
+    return wav;
+}
+
+static httplib::Result transcribe(httplib::Client &cli, const std::string &file, const std::string &format = "")
+{
+    httplib::MultipartFormDataItems items = {{"file", file, "speech.wav", "audio/wav"},
+                                             {"model", "whisper-tiny", "", ""}};
+    if (!format.empty()) items.push_back({"response_format", format, "", ""});
+    return cli.Post("/v1/audio/transcriptions", items);
+}
+
+static void test_transcriptions(httplib::Client &cli, mock_units &units)
+{
+    auto res = transcribe(cli, wav_file(1, 1, 16000, 16, 800));
+    CHECK(res && (res->status == 200));
+    if (res) CHECK(nlohmann::json::parse(res->body, nullptr, false).value("text", "") == "heard 1600 bytes");
+    res = transcribe(cli, wav_file(1, 1, 16000, 16, 8), "text");
+    CHECK(res && (res->status == 200) && (res->body == "heard 16 bytes"));
+
+    // a LIST chunk before the audio is skipped
+    std::string listed = wav_file(1, 1, 16000, 16, 8);
+    listed.insert(36, std::string("LIST\x03\0\0\0abc\0", 12));
+    res = transcribe(cli, listed, "text");
+    CHECK(res && (res->status == 200) && (res->body == "heard 16 bytes"));
+
+    // files the unit would drop without an answer are refused before they are sent
+    size_t mark     = units.calls().size();
+    auto start      = std::chrono::steady_clock::now();
+    std::string bad[] = {"ID3 not a wav at all", wav_file(1, 2, 16000, 16, 8), wav_file(1, 1, 44100, 16, 8),
+                         wav_file(3, 1, 16000, 32, 8), wav_file(1, 1, 16000, 16, 0),
+                         wav_file(1, 1, 16000, 16, 8).substr(0, 36)};
+    for (const auto &file : bad) {
+        res = transcribe(cli, file);
+        CHECK(res && (res->status == 400));
+    }
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+    CHECK(!has_call(units.calls_since(mark), "inference"));
+
+    res = cli.Post("/v1/audio/transcriptions", httplib::MultipartFormDataItems{{"model", "whisper-tiny", "", ""}});
+    CHECK(res && (res->status == 400));
+}
+
+int main()
+{
+    mkdir("/tmp/llm", 0777);
+    write_models();
+    int port = 20000 + getpid() % 20000;
+    {
+        mock_units units(model_dir());
+        // a short timeout, so a request the gateway fails to answer shows up as a failure rather than a hang
+        openai_api_config_t config = {"127.0.0.1", port, 4, 2, 1, 3000};
+        openai_api api(config);
+        CHECK(api.start() == 0);
+
+        httplib::Client cli("127.0.0.1", port);
+        cli.set_read_timeout(10, 0);
+        test_models(cli);
+        test_chat_errors(cli);
+        test_chat_reset(cli, units);
+        test_chat_messages(cli, units);
+        test_chat_stream(cli);
+        test_chat_hang_up(cli, units);
+        test_speech(cli);
+        test_transcriptions(cli, units);
+        api.stop();
+    }
+    remove_models();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_openai_api: ok\n");
+    return 0;
+}
@@ -38,6 +38,7 @@ public:
 };
 
 int zmq_bus_publisher_push(const std::string &work_id, const std::string &json_str);
+int zmq_bus_inference_push(const std::string &work_id, const std::string &zmq_com, const std::string &json_str);
 void zmq_com_send(int com_id, const std::string &out_str);
 
 class zmq_bus_com {
@@ -814,16 +814,8 @@ void unit_action_match(int com_id, const std::string &json_str)
     if (fragment.length()) work_id_fragment.push_back(fragment);
     if (action == "inference") {
         char zmq_push_url[128];
-        int post = sprintf(zmq_push_url, zmq_c_format.c_str(), com_id);
-        std::string inference_raw_data;
-        inference_raw_data.resize(post + json_str.length() + 13);
-        post = sprintf(inference_raw_data.data(), "{\"zmq_com\":\"");
-        post += sprintf(inference_raw_data.data() + post, "%s", zmq_push_url);
-        post += sprintf(inference_raw_data.data() + post, "\",");
-        memcpy(inference_raw_data.data() + post, json_str.data() + 1, json_str.length() - 1);
-        // post += json_str.length() - 1;
-        // SLOGI("inference_raw_data:%s  size:%d  %d", inference_raw_data.c_str(), inference_raw_data.length(), post);
-        int ret = zmq_bus_publisher_push(work_id, inference_raw_data);
+        sprintf(zmq_push_url, zmq_c_format.c_str(), com_id);
+        int ret = zmq_bus_inference_push(work_id, zmq_push_url, json_str);
         if (ret) {
             usr_print_error(request_id, work_id, "{\"code\":-4, \"message\":\"inference data push false\"}", com_id);
         }
@@ -184,6 +184,16 @@ std::string rpc_release_unit(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw)
     return "Success";
 }
 
+// inference from a local client: param 0 is the url the unit replies to, param 1 the request json
+std::string rpc_unit_inference(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw)
+{
+    std::string zmq_com  = raw->get_param(0);
+    std::string json_str = raw->get_param(1);
+    if (zmq_com.empty() || json_str.empty() || (json_str[0] != '{')) return "False";
+    std::string work_id = sample_json_str_get(json_str, "work_id");
+    return zmq_bus_inference_push(work_id, zmq_com, json_str) ? "False" : "Success";
+}
+
 std::string rpc_sql_select(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw)
 {
     return sys_sql_select(raw->string());
@@ -219,6 +229,8 @@ void remote_server_work()
                                          std::bind(rpc_allocate_unit, std::placeholders::_1, std::placeholders::_2));
     sys_rpc_server_->register_rpc_action("release_unit",
                                          std::bind(rpc_release_unit, std::placeholders::_1, std::placeholders::_2));
+    sys_rpc_server_->register_rpc_action("unit_inference",
+                                         std::bind(rpc_unit_inference, std::placeholders::_1, std::placeholders::_2));
     sys_rpc_server_->register_rpc_action("sql_set",
                                          std::bind(rpc_sql_set, std::placeholders::_1, std::placeholders::_2));
     sys_rpc_server_->register_rpc_action("sql_unset",
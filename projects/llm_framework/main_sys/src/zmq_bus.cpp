@@ -163,17 +163,31 @@ int zmq_bus_publisher_push(const std::string &work_id, const std::string &json_s
         SLOGW("work_id is empty");
         return -1;
     }
+    static std::mutex publisher_mtx;
     unit_data *unit_p = NULL;
     SAFE_READING(unit_p, unit_data *, work_id);
-    if (unit_p)
+    if (unit_p) {
+        std::lock_guard<std::mutex> guard(publisher_mtx);
         unit_p->send_msg(json_str);
-    else {
+    } else {
         SLOGW("zmq_bus_publisher_push failed, not have work_id:%s", work_id.c_str());
         return -1;
     }
     return 0;
 }
 
+// the unit pushes its results to zmq_com, which is put in front of the first key of the request
+int zmq_bus_inference_push(const std::string &work_id, const std::string &zmq_com, const std::string &json_str)
+{
+    std::string inference_raw_data;
+    inference_raw_data.reserve(zmq_com.length() + json_str.length() + 13);
+    inference_raw_data += "{\"zmq_com\":\"";
+    inference_raw_data += zmq_com;
+    inference_raw_data += "\",";
+    inference_raw_data.append(json_str, 1, std::string::npos);
+    return zmq_bus_publisher_push(work_id, inference_raw_data);
+}
+
 void *usr_context;
 
 void zmq_com_send(int com_id, const std::string &out_str)
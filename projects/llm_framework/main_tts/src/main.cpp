@@ -13,7 +13,9 @@
 #include <unistd.h>
 #include <base64.h>
 #include <fstream>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
 #include "../../../../SDK/components/utilities/include/sample_log.h"
 
 using namespace StackFlows;
@@ -29,13 +31,50 @@ static std::string base_model_path_;
 static std::string base_model_config_path_;
 
 struct SynthesizerTrn_config {
-    int spacker_role    = 0;
-    float spacker_speed = 1.0;
+    int spacker_role        = 0;
+    float spacker_speed     = 1.0;
+    int num_threads         = 1;
+    // lines whose front-end result the shared model keeps, 0 disables the cache
+    int frontend_cache_size = 256;
     std::string ttsModelName;
 };
 
 typedef std::function<void(const std::string &data, bool finish)> task_callback_t;
 
+// A mapped model file. The conv weights, fp32 or converted to fp16/int8, are read from the mapping in place and
+// nothing writes to it, so every task using the same file shares one mapping and synthesizes through its own
+// SynthesizerTrnSession.
+struct tts_model_image {
+    float *data  = NULL;
+    int32_t size = 0;
+    std::unique_ptr<SynthesizerTrn> synthesizer;
+
+    ~tts_model_image()
+    {
+        synthesizer.reset();
+        if (data) ttsUnmapModel(data, size);
+    }
+};
+
+static std::shared_ptr<tts_model_image> tts_model_acquire(const std::string &model_path)
+{
+    static std::mutex models_mtx;
+    static std::unordered_map<std::string, std::weak_ptr<tts_model_image>> models;
+    std::lock_guard<std::mutex> guard(models_mtx);
+    std::shared_ptr<tts_model_image> image = models[model_path].lock();
+    if (image) return image;
+    image              = std::make_shared<tts_model_image>();
+    int32_t model_size = ttsMapModel((char *)model_path.c_str(), &image->data);
+    if (model_size <= 0) {
+        image->data = NULL;
+        return nullptr;
+    }
+    image->size        = model_size;
+    image->synthesizer = std::make_unique<SynthesizerTrn>(image->data, model_size);
+    models[model_path] = image;
+    return image;
+}
+
 #define CONFIG_AUTO_SET(obj, key)             \
     if (config_body.contains(#key))           \
         mode_config_.key = config_body[#key]; \
@@ -44,11 +83,12 @@ typedef std::function<void(const std::string &data, bool finish)> task_callback_
 
 class llm_task {
 private:
-    float *dataW = NULL;
-    int modelSize;
+    std::shared_ptr<tts_model_image> tts_model_;
+    // reused between utterances, the synthesizer keeps its capacity
+    std::vector<int16_t> pcm_;
 
 public:
-    std::unique_ptr<SynthesizerTrn> synthesizer_;
+    std::unique_ptr<SynthesizerTrnSession> synthesizer_;
     SynthesizerTrn_config mode_config_;
     std::vector<std::string> inputs_;
     bool enoutput_;
@@ -59,6 +99,9 @@ public:
     std::string response_format_;
     task_callback_t out_callback_;
     int awake_delay_ = 1000;
+    // per task, tasks may run side by side on the shared model
+    int stream_index_ = 0;
+    std::string faster_stream_buff_;
 
     void set_output(task_callback_t out_callback)
     {
@@ -126,14 +169,23 @@ public:
             CONFIG_AUTO_SET(file_body["mode_param"], spacker_role);
             CONFIG_AUTO_SET(file_body["mode_param"], spacker_speed);
             CONFIG_AUTO_SET(file_body["mode_param"], ttsModelName);
+            CONFIG_AUTO_SET(file_body["mode_param"], num_threads);
+            CONFIG_AUTO_SET(file_body["mode_param"], frontend_cache_size);
             mode_config_.ttsModelName = base_model + mode_config_.ttsModelName;
             if (config_body.contains("awake_delay"))
                 awake_delay_ = config_body["awake_delay"].get<int>();
             else if (file_body["mode_param"].contains("awake_delay"))
                 awake_delay_ = file_body["mode_param"]["awake_delay"];
-            int32_t modelSize = ttsLoadModel((char *)mode_config_.ttsModelName.c_str(), &dataW);
-            synthesizer_      = std::make_unique<SynthesizerTrn>(dataW, modelSize);
-            int32_t spkNum    = synthesizer_->getSpeakerNum();
+            tts_model_ = tts_model_acquire(mode_config_.ttsModelName);
+            if (!tts_model_) {
+                SLOGE("load model %s failed", mode_config_.ttsModelName.c_str());
+                return -3;
+            }
+            // the cache belongs to the shared model, the task set up last decides its size
+            tts_model_->synthesizer->setFrontendCacheSize(mode_config_.frontend_cache_size);
+            synthesizer_ = std::make_unique<SynthesizerTrnSession>(tts_model_->synthesizer.get());
+            synthesizer_->setThreadNum(mode_config_.num_threads);
+            int32_t spkNum = tts_model_->synthesizer->getSpeakerNum();
             SLOGI("Available speakers in the model are %d", spkNum);
         } catch (...) {
             SLOGE("config false");
@@ -142,24 +194,40 @@ public:
         return 0;
     }
 
+    static int32_t stream_pcm_callback(const int16_t *pcm, int32_t sampleNum, bool isLast, void *userData)
+    {
+        llm_task *self = (llm_task *)userData;
+        self->out_callback_(std::string((char *)pcm, sampleNum * sizeof(int16_t)), false);
+        return 0;
+    }
+
     bool TTS(const std::string &msg)
     {
         SLOGI("TTS msg:%s", msg.c_str());
-        int32_t dataLen;
-        int16_t *rawData = synthesizer_->infer(msg, mode_config_.spacker_role, mode_config_.spacker_speed, dataLen);
-        if (!rawData) {
+        if (enstream_) {
+            // publish every vocoded block right away instead of after the whole sentence
+            int32_t dataLen = synthesizer_->inferStream(msg, mode_config_.spacker_role, mode_config_.spacker_speed,
+                                                        stream_pcm_callback, this);
+            if (dataLen <= 0) {
+                SLOGW("tts infer false!");
+                return true;
+            }
+            out_callback_(std::string(), true);
+            return false;
+        }
+        int32_t dataLen = synthesizer_->infer(msg, mode_config_.spacker_role, mode_config_.spacker_speed, pcm_);
+        if (dataLen <= 0) {
             SLOGW("tts infer false!");
             return true;
         }
-        std::vector<int16_t> wavData(rawData, rawData + dataLen);
-        out_callback_(std::string((char *)rawData, dataLen * sizeof(int16_t)), true);
-        free(rawData);
+        out_callback_(std::string((char *)pcm_.data(), dataLen * sizeof(int16_t)), true);
         return false;
     }
 
     bool delete_model()
     {
         synthesizer_.reset();
+        tts_model_.reset();
         return true;
     }
 
@@ -191,7 +259,7 @@ private:
 public:
     llm_tts() : StackFlow("tts")
     {
-        task_count_ = 1;
+        task_count_ = 2;
     }
 
     void task_output(const std::weak_ptr<llm_task> llm_task_obj_weak,
@@ -205,20 +273,19 @@ public:
         std::string base64_data;
         int len = encode_base64(data, base64_data);
         if (llm_channel->enstream_) {
-            static int count = 0;
             nlohmann::json data_body;
-            data_body["index"] = count++;
+            data_body["index"] = llm_task_obj->stream_index_++;
             if (!finish)
                 data_body["delta"] = base64_data;
             else
                 data_body["delta"] = std::string("");
             data_body["finish"] = finish;
-            if (finish) count = 0;
+            if (finish) llm_task_obj->stream_index_ = 0;
             llm_channel->send(llm_task_obj->response_format_, data_body, LLM_NO_ERROR);
         } else if (finish) {
             llm_channel->send(llm_task_obj->response_format_, base64_data, LLM_NO_ERROR);
         }
-        if (llm_task_obj->response_format_.find("sys") != std::string::npos) {
+        if ((!data.empty()) && (llm_task_obj->response_format_.find("sys") != std::string::npos)) {
             unit_call("audio", "queue_play", data);
         }
     }
@@ -256,7 +323,7 @@ public:
             return;
         }
         if (data.empty() || (data == "None")) return;
-        static std::string faster_stream_buff;
+        std::string &faster_stream_buff = llm_task_obj->faster_stream_buff_;
         nlohmann::json error_body;
         const std::string *next_data = &data;
         bool enbase64                = (object.find("base64") == std::string::npos) ? false : true;
@@ -3,17 +3,63 @@
 
 #include "stdint.h"
 #include "string"
+#include <vector>
 
 using namespace std;
 
+// Receives the PCM of one streamed block, isLast is set on the final block. Return non-zero to stop synthesis.
+typedef int32_t (*tts_pcm_callback_t)(const int16_t * pcm, int32_t sampleNum, bool isLast, void * userData);
+
+class SynthesizerTrnSession;
+
+/*
+ * Loaded model. The calls below go through one built-in session, so they must not overlap; concurrent
+ * requests each use their own SynthesizerTrnSession on the same model.
+ */
 class SynthesizerTrn
 {
 public:
+    // Conv weights (the bulk of the model) and biases are read from modelData in place, so it must stay valid
+    // until the model is destroyed. Small tables (embeddings, norms) are copied, and the text normalization
+    // and jieba dictionaries are parsed into their own structures at load.
     SynthesizerTrn(float * modelData, int32_t modelSize);
     int16_t * infer(const string & line, int32_t sid, float lengthScale, int32_t & dataLen);
+    // PCM goes to pcm, whose capacity is kept between calls. Returns the number of samples, -1 on error.
+    int32_t infer(const string & line, int32_t sid, float lengthScale, std::vector<int16_t> & pcm);
+    // Vocodes the latent sequence in chunks and hands every block to callback as soon as it is ready.
+    // Returns the number of samples delivered, -1 on error.
+    int32_t inferStream(const string & line, int32_t sid, float lengthScale, tts_pcm_callback_t callback,
+                        void * userData);
+    // latent frames per streamed block and the context decoded on each side of it
+    void setStreamParams(int32_t chunkFrames, int32_t contextFrames);
     int32_t getSpeakerNum();
+    // lines whose front-end result (TN, segmentation, phone ids) is kept across sessions, 0 disables the cache
+    void setFrontendCacheSize(int32_t entryNum);
+    // worker threads used inside infer(), 1 runs everything on the calling thread
+    void setThreadNum(int32_t threadNum);
     ~SynthesizerTrn();
 
+private:
+    friend class SynthesizerTrnSession;
+    void * priv_;
+};
+
+/*
+ * Per-request state (segmentation buffer, workspace, worker pool, stream buffer) over a shared model. A
+ * session serves one request at a time; any number of sessions may run on one model concurrently. The
+ * model must outlive its sessions.
+ */
+class SynthesizerTrnSession
+{
+public:
+    SynthesizerTrnSession(SynthesizerTrn * model);
+    ~SynthesizerTrnSession();
+    int32_t infer(const string & line, int32_t sid, float lengthScale, std::vector<int16_t> & pcm);
+    int32_t inferStream(const string & line, int32_t sid, float lengthScale, tts_pcm_callback_t callback,
+                        void * userData);
+    void setThreadNum(int32_t threadNum);
+    void setStreamParams(int32_t chunkFrames, int32_t contextFrames);
+
 private:
     void * priv_;
 };
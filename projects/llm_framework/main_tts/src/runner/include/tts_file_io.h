@@ -17,5 +17,8 @@ int32_t tts_stat(char * filePath, TTS_STAT_t * ttsSt);
 TTS_FILE_t * tts_fopen(char * filePath);
 void tts_fclose(TTS_FILE_t * ttsFP);
 int32_t tts_fread(void * buf,int32_t size, TTS_FILE_t * ttsFP);
+// Private (copy-on-write) mapping of a whole file, pages are read in on first touch. NULL on failure.
+void * tts_mmap(char * filePath, int32_t * size);
+void tts_munmap(void * addr, int32_t size);
 
 #endif
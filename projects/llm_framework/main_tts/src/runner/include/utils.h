@@ -3,5 +3,8 @@
 
 int ttsLoadModel(char * ttsModelName, float **ttsModel);
 void tts_free_data(void * data);
+// Maps the model file read-only instead of reading it; the model uses the mapping in place, unmap it after the model.
+int ttsMapModel(char * ttsModelName, float **ttsModel);
+void ttsUnmapModel(float * ttsModel, int size);
 
 #endif
@@ -313,7 +313,7 @@ string replaceNum(const string & str)
 {
     string ret;
     int32_t insertPos = 0;
-    for(int32_t i = 0; i<str.length(); i++)
+    for(int32_t i = 0; i<(int32_t)str.length(); i++)
     {
         switch(str[i])
         {
@@ -399,7 +399,7 @@ vector<PROCESS_UNIT_t> preProcess(const string & str)
         auto c = word[word.length()-1];
 
         bool found = false;
-        for(int32_t i=0; i<symbols.length(); i++)
+        for(int32_t i=0; i<(int32_t)symbols.length(); i++)
         {
             if(symbols[i] == c)
             {
@@ -465,7 +465,7 @@ vector<int> EnglishText2Id::getIPAId(const string & strEng)
     vector<PROCESS_UNIT_t> processVec =  preProcess(strEngNumReplaced);
 
     vector<wstring> vecIPAs;
-    for(int32_t idx = 0; idx<processVec.size(); idx++)
+    for(int32_t idx = 0; idx<(int32_t)processVec.size(); idx++)
     {
         PROCESS_UNIT_t pu = processVec[idx];
 
@@ -546,16 +546,21 @@ vector<int> EnglishText2Id::getIPAId(const string & strEng)
                     }
                     
                     wstring predPhones;
-                    for(int32_t i = 0; i<preds.size(); i++)
+                    for(int32_t i = 0; i<(int32_t)preds.size(); i++)
                     {
-                        string phone = engText2idData->id2Phone_[preds[i]];
+                        string phone;
+                        auto phoneIt = engText2idData->id2Phone_.find(preds[i]);
+                        if(phoneIt != engText2idData->id2Phone_.end())
+                        {
+                            phone = phoneIt->second;
+                        }
                         deleteNumFromStr(phone);
                         transform(phone.begin(),phone.end(),phone.begin(),::tolower);
                 
                         auto it = engText2idData->phone2ipa_.find(phone);
                         if(it != engText2idData->phone2ipa_.end())
                         {
-                            predPhones.append(engText2idData->phone2ipa_[phone]);
+                            predPhones.append(it->second);
                     
                         }
                         else
@@ -575,7 +580,7 @@ vector<int> EnglishText2Id::getIPAId(const string & strEng)
         
     }
 
-    for(int32_t i = 0; i<vecIPAs.size(); i++)
+    for(int32_t i = 0; i<(int32_t)vecIPAs.size(); i++)
     {
         wstring onePhone = vecIPAs[i];
         int32_t onePhoneSize = vecIPAs[i].length();
@@ -583,7 +588,7 @@ vector<int> EnglishText2Id::getIPAId(const string & strEng)
         for(int32_t j = 0; j<onePhoneSize ; j++)
         {
             bool foundPhone = false;
-            for(int32_t k = 0; k< engText2idData->ipaSymbols_.size(); k++)
+            for(int32_t k = 0; k< (int32_t)engText2idData->ipaSymbols_.size(); k++)
             {
                 if(engText2idData->ipaSymbols_[k] == onePhone[j])
                 {
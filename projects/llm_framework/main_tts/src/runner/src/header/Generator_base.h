@@ -6,6 +6,9 @@
 
 using Eigen::MatrixXf;
 
+class nn_conv1d_transposed;
+class ResBlock1;
+
 class Generator_base
 {
 public:
@@ -14,4 +17,13 @@ public:
 
 };
 
+// Output shape of the upsampling trunk for inLen input frames.
+void generator_upsample_shape(nn_conv1d_transposed ** upList, int32_t upNum, int32_t inLen,
+                              int32_t & outLen, int32_t & outCh);
+
+// leaky_relu -> transposed conv -> mean of resBlockNum ResBlock1 per upsample rate, shared by all generators.
+// Intermediate activations come from the workspace.
+void generator_upsample(nn_conv1d_transposed ** upList, ResBlock1 ** resBlockList, int32_t upNum, int32_t resBlockNum,
+                        const Eigen::Ref<const MatrixXf> & x, Eigen::Ref<MatrixXf> out);
+
 #endif
@@ -12,6 +12,8 @@ public:
     ResBlock1(float * modelData, int32_t & offset);
     ~ResBlock1();
     MatrixXf forward(const MatrixXf & x);
+    // out may not alias x, scratch comes from the workspace
+    void forward(const Eigen::Ref<const MatrixXf> & x, Eigen::Ref<MatrixXf> out);
 
 private:
     void * priv_;
@@ -4,6 +4,7 @@
 #include <string>
 #include <map>
 #include <vector>
+#include "stdint.h"
 
 using namespace std;
 
@@ -15,7 +16,19 @@ public:
     int32_t * convert(string line, int32_t & len, const vector<string> & jiebaWords);
     
 private:
+    // pronunciation of one hanzi, resolved to phone ids when the object is built
+    typedef struct
+    {
+        int32_t ids_[3];
+        int32_t idNum_;
+        // 1 + index into polyPinyin_ for characters with several readings, 0 otherwise
+        int32_t poly_;
+    }HANZI_PHONE_t;
+
     vector<string> searchForMultiPhone(const string & word);
+    int32_t phoneId(const string & phone) const;
+    void appendPinyin(const string & pinyin, int32_t * idList, int32_t & insertIdx) const;
+    void compileHanziTable();
     void initMultiPhoneMap(std::istream & streamWords, std::istream & streamPinyin);
     multimap<string, vector<string> >  pinyMap_;
     map<uint16_t, uint16_t>  numMap_;
@@ -23,6 +36,11 @@ private:
 
     multimap<string, vector<string> >  multiPhoneMap_;
 
+    // indexed by unicode - 0x4E00, replaces the per character string lookups of convert()
+    vector<HANZI_PHONE_t> hanziTable_;
+    vector<string> polyPinyin_;
+    int32_t silId_;
+
 };
 
 #endif
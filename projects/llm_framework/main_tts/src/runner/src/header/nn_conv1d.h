@@ -2,14 +2,16 @@
 #define _TTS_NN_CONV1D_H_
 
 #include <Eigen/Dense>
+#include "nn_quant.h"
 
 using Eigen::MatrixXf;
 
 int32_t parse_conv1d_parameter(float * modelData, int32_t & offset,
                                int32_t & inCh, int32_t & outCh, int32_t & kSize,
                                int32_t & padding, int32_t & dilation_, int32_t & hasBias,
-                               MatrixXf & weight, MatrixXf & bias);
+                               NN_WEIGHTS_t & weights, const float *& bias);
 
+// Layers built from modelData read their weights (in any storage type) and bias in place, modelData must outlive them.
 class nn_conv1d
 {
 public:
@@ -21,6 +23,9 @@ public:
     int32_t get_in_channels_num();
     int32_t get_out_channels_num();
     MatrixXf forward(MatrixXf inputMat);
+    // writes get_out_len(inputMat.rows()) x outCh rows into outputMat, no temporaries
+    void forward(const Eigen::Ref<const MatrixXf> & inputMat, Eigen::Ref<MatrixXf> outputMat);
+    int32_t get_out_len(int32_t inLen);
     void print_p();
     ~nn_conv1d();
 private:
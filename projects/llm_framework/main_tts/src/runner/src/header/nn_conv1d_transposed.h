@@ -2,6 +2,7 @@
 #define _TTS_NN_CONV1D_TRANSPOSED_H_
 
 #include <Eigen/Dense>
+#include "nn_quant.h"
 
 using Eigen::MatrixXf;
 using Eigen::MatrixXd;
@@ -14,8 +15,9 @@ int32_t parse_conv1d_transposed_parameter(float * modelData, int32_t & offset,
                                           int32_t & inCh, int32_t & outCh, int32_t & kSize,
                                           int32_t & padding, int32_t & dilation, 
                                           int32_t & hasBias,int32_t & stride,
-                                          MatrixXf & weight, MatrixXf & bias);
+                                          NN_WEIGHTS_t & weights, const float *& bias);
 
+// Layers built from modelData read their weights (in any storage type) and bias in place, modelData must outlive them.
 class nn_conv1d_transposed
 {
 public:
@@ -30,6 +32,9 @@ public:
     int32_t get_out_channels_num();
 
     MatrixXf forward(const MatrixXf & inputMat);
+    // writes get_out_len(inputMat.rows()) x outCh rows into outputMat, scratch comes from the workspace
+    void forward(const Eigen::Ref<const MatrixXf> & inputMat, Eigen::Ref<MatrixXf> outputMat);
+    int32_t get_out_len(int32_t inLen);
     ~nn_conv1d_transposed();
 private:
     void * priv_;
@@ -11,6 +11,7 @@ class nn_layer_norm
 public:
     nn_layer_norm(float * modelData, int32_t & offset);
     nn_layer_norm(int32_t size, const MatrixXf & gamma, const MatrixXf & beta);
+    ~nn_layer_norm();
     MatrixXf forward(const MatrixXf & x);
 
 private:
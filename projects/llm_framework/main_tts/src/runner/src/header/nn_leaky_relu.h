@@ -8,5 +8,7 @@ using Eigen::MatrixXf;
 
 MatrixXf nn_leaky_relu(const MatrixXf & x);
 MatrixXf nn_leaky_relu(const MatrixXf & x, float slope);
+// out may alias x
+void nn_leaky_relu(const Eigen::Ref<const MatrixXf> & x, Eigen::Ref<MatrixXf> out, float slope);
 
 #endif
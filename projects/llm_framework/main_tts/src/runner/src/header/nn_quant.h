@@ -0,0 +1,82 @@
+#ifndef _TTS_NN_QUANT_H_
+#define _TTS_NN_QUANT_H_
+
+#include "stdint.h"
+
+/*
+ * Storage type of conv weights in the model blob, kept in bits 4-7 of the hasBias header field so fp32
+ * blobs read as before. Every type is padded to whole floats:
+ *   NN_WEIGHT_FP16  one IEEE half per weight
+ *   NN_WEIGHT_INT8  outCh float scales, then one int8 per weight, symmetric per output channel
+ */
+typedef enum
+{
+    NN_WEIGHT_FP32 = 0,
+    NN_WEIGHT_FP16 = 1,
+    NN_WEIGHT_INT8 = 2
+}NN_WEIGHT_TYPE_t;
+
+/*
+ * Order of the weights, bit 8 of the same field:
+ *   NN_WEIGHT_ORDER_ROW  [outCh][kSize][inCh] as exported, tap k is a view with an outer stride of kSize*inCh
+ *   NN_WEIGHT_ORDER_TAP  [kSize][outCh][inCh], tap k is a contiguous inCh x outCh column-major block;
+ *                        written by tts_quantize so the per-tap GEMMs read the mapped file in place
+ */
+typedef enum
+{
+    NN_WEIGHT_ORDER_ROW = 0,
+    NN_WEIGHT_ORDER_TAP = 1
+}NN_WEIGHT_ORDER_t;
+
+#define NN_WEIGHT_TYPE_SHIFT (4)
+#define NN_WEIGHT_ORDER_SHIFT (8)
+
+typedef struct
+{
+    int32_t type_;
+    int32_t order_;
+    const float * f32_;
+    const uint16_t * f16_;
+    const int8_t * i8_;
+    const float * scale_;
+}NN_WEIGHTS_t;
+
+void nn_weights_decode_flags(int32_t flags, int32_t & hasBias, int32_t & type, int32_t & order);
+int32_t nn_weights_encode_flags(int32_t hasBias, int32_t type, int32_t order);
+
+// floats taken by the weights of one layer in the blob
+int32_t nn_weights_size(int32_t type, int32_t weightNum, int32_t outCh);
+void nn_weights_bind(const float * data, int32_t type, int32_t order, int32_t outCh, NN_WEIGHTS_t & weights);
+/*
+ * Where tap k lies in the stored weights: element (i, o) of the inCh x outCh tap is weight
+ * offset + o*outerStride + i, for fp32 data at f32_ and for the quantized values at f16_ / i8_.
+ */
+void nn_weights_tap_layout(const NN_WEIGHTS_t & weights, int32_t outCh, int32_t kSize, int32_t inCh, int32_t k,
+                           int64_t & offset, int32_t & outerStride);
+// columns [o0, o0+colNum) of tap k as an inCh x colNum column-major fp32 matrix
+void nn_weights_expand_tile(const NN_WEIGHTS_t & weights, int32_t outCh, int32_t kSize, int32_t inCh, int32_t k,
+                            int32_t o0, int32_t colNum, float * dst);
+// tap k as an inCh x outCh column-major fp32 matrix
+void nn_weights_expand_tap(const NN_WEIGHTS_t & weights, int32_t outCh, int32_t kSize, int32_t inCh, int32_t k,
+                           float * dst);
+/*
+ * Output channels per dequantized tile of an fp16/int8 layer: the layers expand one inCh x tileCols tile at a
+ * time right before its GEMM, so the stored format is what stays in memory and the tile stays in cache.
+ */
+int32_t nn_weights_tile_cols(int32_t outCh, int32_t inCh);
+// stores fp32 [outCh][kSize][inCh] weights as type and order into dst (nn_weights_size() floats), returns the
+// floats written
+int32_t nn_weights_pack(const float * src, int32_t type, int32_t order, int32_t outCh, int32_t kSize,
+                        int32_t inCh, float * dst);
+
+uint16_t nn_fp32_to_fp16(float x);
+float nn_fp16_to_fp32(uint16_t h);
+void nn_fp16_to_fp32_n(const uint16_t * src, float * dst, int32_t n);
+
+// Called for every conv layer read from a model blob; lets the offline converter locate the weights.
+typedef void (*nn_weights_observer_t)(void * ctx, const float * flags, const float * weights,
+                                      int32_t outCh, int32_t kSize, int32_t inCh);
+void nn_set_weights_observer(nn_weights_observer_t observer, void * ctx);
+void nn_weights_notify(const float * flags, const float * weights, int32_t outCh, int32_t kSize, int32_t inCh);
+
+#endif
@@ -7,5 +7,7 @@
 using Eigen::MatrixXf;
 
 MatrixXf nn_tanh(const MatrixXf & x);
+// out may alias x, both must be densely stored
+void nn_tanh(const Eigen::Ref<const MatrixXf> & x, Eigen::Ref<MatrixXf> out);
 
 #endif
@@ -0,0 +1,48 @@
+#ifndef _TTS_THREAD_POOL_H_
+#define _TTS_THREAD_POOL_H_
+
+#include "stdint.h"
+
+// fn(ctx, begin, end) computes the chunk [begin, end)
+typedef void (*tts_parallel_fn_t)(void * ctx, int32_t begin, int32_t end);
+
+/*
+ * Fixed worker pool for intra-op parallelism of the nn_op kernels.
+ *
+ * Work is always cut into chunks of a fixed grain that does not depend on the number of threads, and every
+ * chunk is computed by exactly one thread with the same code, so results are bit-identical for any thread
+ * count. The calling thread takes chunks too, so a pool of N threads starts N-1 workers.
+ *
+ * Every worker has its own tts_workspace set as current, so tts_workspace_mat inside a chunk does not touch
+ * the heap once the worker has seen a region of that size. Chunks on the calling thread use its workspace.
+ */
+class tts_thread_pool
+{
+public:
+    tts_thread_pool(int32_t threadNum);
+    ~tts_thread_pool();
+
+    int32_t get_thread_num();
+
+    // fn is called once for every chunk [begin, end) of [0, total)
+    void parallel_for(int32_t total, int32_t grain, tts_parallel_fn_t fn, void * ctx);
+
+private:
+    void * priv_;
+};
+
+// Pool used by tts_parallel_for on the calling thread, NULL runs every chunk inline.
+void tts_set_thread_pool(tts_thread_pool * pool);
+tts_thread_pool * tts_get_thread_pool();
+
+void tts_parallel_for(int32_t total, int32_t grain, tts_parallel_fn_t fn, void * ctx);
+
+// Lambda form; the callable is passed by address, so capturing does not allocate.
+template<typename F>
+inline void tts_parallel_for(int32_t total, int32_t grain, const F & f)
+{
+    tts_parallel_for(total, grain, [](void * ctx, int32_t begin, int32_t end){ (*(const F *)ctx)(begin, end); },
+                     (void *)&f);
+}
+
+#endif
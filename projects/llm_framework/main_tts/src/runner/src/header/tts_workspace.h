@@ -0,0 +1,68 @@
+#ifndef _TTS_WORKSPACE_H_
+#define _TTS_WORKSPACE_H_
+
+#include "stdint.h"
+#include <Eigen/Dense>
+
+using Eigen::MatrixXf;
+using Eigen::Map;
+
+/*
+ * Per-session arena for the activations of one synthesis.
+ *
+ * Buffers are handed out in stack order (mark/release) from one preallocated block. When a run needs more
+ * than the block holds, the excess is served from temporary spill blocks and the peak is remembered; the
+ * next reset() replaces the block by one of the peak size. After the first utterance of a given length
+ * the steady state does not touch the heap.
+ */
+class tts_workspace
+{
+public:
+    tts_workspace();
+    ~tts_workspace();
+
+    // start of a synthesis, every buffer handed out before becomes invalid
+    void reset();
+    // plan the block size up front, in floats
+    void reserve(int64_t floatNum);
+
+    float * alloc(int64_t floatNum);
+    int64_t mark();
+    void release(int64_t mark);
+
+    int64_t get_capacity();
+    // largest amount in use since the last reset()
+    int64_t get_peak();
+    int32_t get_grow_count();
+
+private:
+    void * priv_;
+};
+
+// Workspace used by the kernels on the calling thread, NULL falls back to heap temporaries.
+void tts_set_workspace(tts_workspace * workspace);
+tts_workspace * tts_get_workspace();
+
+/*
+ * Scoped rows x cols matrix view. Drawn from the current workspace and released on destruction, or owned
+ * on the heap when no workspace is set. Scopes must end in reverse order of construction.
+ */
+class tts_workspace_mat
+{
+public:
+    tts_workspace_mat(int32_t rows, int32_t cols);
+    ~tts_workspace_mat();
+
+    Map<MatrixXf> & mat()
+    {
+        return mat_;
+    }
+
+private:
+    tts_workspace * workspace_;
+    int64_t mark_;
+    MatrixXf owned_;
+    Map<MatrixXf> mat_;
+};
+
+#endif
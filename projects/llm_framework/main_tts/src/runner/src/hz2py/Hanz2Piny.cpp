@@ -1,7 +1,11 @@
 // last modified 
 
 #include "Hanz2Piny.h"
+// utf8-cpp is vendored unchanged, its iterators derive from std::iterator (deprecated in C++17)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 #include "./utf8/utf8.h"
+#pragma GCC diagnostic pop
 #include <iostream>
 #include <algorithm>
 #include <fstream>
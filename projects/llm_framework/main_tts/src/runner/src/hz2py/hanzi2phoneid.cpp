@@ -1,5 +1,9 @@
 #include "hanzi2phoneid.h"
+// utf8-cpp is vendored unchanged, its iterators derive from std::iterator (deprecated in C++17)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 #include "./utf8/utf8.h"
+#pragma GCC diagnostic pop
 #include <iostream>
 #include <fstream>
 #include "Hanz2Piny.h"
@@ -15,10 +19,51 @@ hanzi2phoneid::hanzi2phoneid(std::istream & streamWords, std::istream & streamPi
     pinyMap_ = initPinyin2Phone();
     numMap_ = initNumMap();
     phoneIdMap_ = initPhoneIDMap();    
+    silId_ = phoneId("sil");
 
     initMultiPhoneMap(streamWords, streamPinyin);
+    compileHanziTable();
 }
 
+// Resolves the built-in pinyin table to phone ids once, so that convert() only looks up characters with
+// several readings by string.
+void hanzi2phoneid::compileHanziTable()
+{
+    const Hanz2Piny hanz2piny;
+    hanziTable_.resize(0x9FA5 - 0x4E00 + 1);
+
+    for(int32_t ii = 0; ii<(int32_t)hanziTable_.size(); ii++)
+    {
+        HANZI_PHONE_t & entry = hanziTable_[ii];
+        entry.idNum_ = 0;
+        entry.poly_ = 0;
+
+        vector<string> pinyinList = hanz2piny.toPinyinFromUnicode(0x4E00 + ii, true);
+        if(pinyinList.empty())
+        {
+            continue;
+        }
+
+        string pinyin = pinyinList[0];
+        size_t cStrIdx = pinyin.find(":");
+        if(cStrIdx != string::npos)
+        {
+            pinyin.erase(cStrIdx,1);
+        }
+
+        if(pinyin.find(",") != string::npos)
+        {
+            polyPinyin_.push_back(pinyin);
+            entry.poly_ = polyPinyin_.size();
+        }
+        else
+        {
+            appendPinyin(pinyin, entry.ids_, entry.idNum_);
+        }
+    }
+}
+
+
 hanzi2phoneid:: ~hanzi2phoneid()
 {
 
@@ -53,6 +98,40 @@ void hanzi2phoneid::initMultiPhoneMap(std::istream & streamWords, std::istream &
     }
 }
 
+// read-only lookup, convert() may run on several threads at once
+int32_t hanzi2phoneid::phoneId(const string & phone) const
+{
+    auto iter = phoneIdMap_.find(phone);
+    if (iter != phoneIdMap_.end())
+    {
+        return iter->second;
+    }
+
+    return 0;
+}
+
+// pinyin with tone digit -> initial, final+tone, #0; nothing for an unknown syllable
+void hanzi2phoneid::appendPinyin(const string & pinyin, int32_t * idList, int32_t & insertIdx) const
+{
+    if(pinyin.empty())
+    {
+        return;
+    }
+
+    string strTone = pinyin.substr(pinyin.size()-1,1);
+    string pinyin_notone = pinyin.substr(0,pinyin.size()-1);
+
+    auto iter = pinyMap_.find(pinyin_notone);
+    if (iter != pinyMap_.end())
+    {
+        const vector<string> & phones = iter->second;
+
+        idList[insertIdx++] = phoneId(phones[0]);
+        idList[insertIdx++] = phoneId(phones[1]+strTone);
+        idList[insertIdx++] = phoneId("#0");
+    }
+}
+
 vector<string> hanzi2phoneid::searchForMultiPhone(const string & word)
 {
     auto iter = multiPhoneMap_.find(word);
@@ -68,148 +147,111 @@ vector<string> hanzi2phoneid::searchForMultiPhone(const string & word)
 
 int32_t * hanzi2phoneid::convert(string line, int32_t & len, const vector<string> & jiebaWordsIn)
 {
-    int32_t maxSize = line.size()*4;
-
     const Hanz2Piny hanz2piny;
     if (hanz2piny.isStartWithBom(line)) 
     {
         line = string(line.cbegin() + 3, line.cend());
     }
 
-    vector<string> jiebaWords = jiebaWordsIn;
-
-    for(int32_t ii= 0; ii<jiebaWords.size(); ii++)
-    {
-        string s = jiebaWords[ii];
-        
-        bool bDummyReplace = false;
-        string dummyStr="";
-        for (auto iter = s.cbegin(); iter != s.cend(); NULL) 
-        {
-            auto iter_old = iter;
-            utf8::next(iter, s.cend());
-            unsigned short unicode;
-            utf8::utf8to16(iter_old, iter, &unicode);
-
-            if(!hanz2piny.isHanziUnicode(unicode))
-            {
-                bDummyReplace = true;
-                dummyStr.append("AAA");
-                //break;
-            }
-        }
-        
-        if(bDummyReplace == true)
-        {
-            jiebaWords[ii] = dummyStr;
-        }
-    }
-
-    vector<pair<bool, vector<string>>> pinyin_list_list  = hanz2piny.toPinyinFromUtf8(line,numMap_, true, true, "-");
-
+    // at most three ids per character plus the start and end marks
+    int32_t maxSize = line.size()*4 + 4;
     int32_t * idList = new int32_t[maxSize];
     memset(idList,0,sizeof(int32_t)*maxSize);
 
     int32_t insertIdx = 0;
     idList[insertIdx++] = 0;
 
+    if (!hanz2piny.isUtf8(line))
+    {
+        line.clear();
+    }
+
+    // words with non-hanzi characters are masked, only needed for characters with several readings
+    vector<string> jiebaWords;
+    bool jiebaReady = false;
+
     int32_t charIdx = 0;
-    for (const auto& e : pinyin_list_list)
+    for (auto lineIter = line.cbegin(); lineIter != line.cend(); charIdx++)
     {
-        const bool ok = e.first;
-        auto pinyin_list = e.second;
-        auto pinyin = pinyin_list[0];
+        uint32_t unicode = utf8::next(lineIter, line.cend());
 
-        int32_t cStrIdx = pinyin.find(":");
-        if(cStrIdx < pinyin.size())
+        if(unicode <= 0xFFFF)
         {
-            pinyin.erase(cStrIdx,1);
+            auto numIter = numMap_.find((uint16_t)unicode);
+            if(numIter != numMap_.end())
+            {
+                unicode = numIter->second;
+            }
         }
 
-        if(pinyin=="-")
+        if((unicode > 0xFFFF) || !hanz2piny.isHanziUnicode((uint16_t)unicode))
         {
-            idList[insertIdx++] = phoneIdMap_["sil"];
-            idList[insertIdx++] = phoneIdMap_["sil"];
+            idList[insertIdx++] = silId_;
+            idList[insertIdx++] = silId_;
+            continue;
         }
-        else
+
+        const HANZI_PHONE_t & entry = hanziTable_[unicode - 0x4E00];
+        if(entry.poly_ == 0)
+        {
+            for(int32_t ii = 0; ii<entry.idNum_; ii++)
+            {
+                idList[insertIdx++] = entry.ids_[ii];
+            }
+            continue;
+        }
+
+        if(!jiebaReady)
         {
-            int32_t cStrIdx = pinyin.find(",");
-            if(cStrIdx < pinyin.size())
+            jiebaWords = jiebaWordsIn;
+            for(int32_t ii= 0; ii<(int32_t)jiebaWords.size(); ii++)
             {
-                int32_t jiebaSearchIdx = 0;
-                for(int32_t wordIdx = 0; wordIdx < jiebaWords.size(); wordIdx++)
+                string s = jiebaWords[ii];
+                
+                bool bDummyReplace = false;
+                string dummyStr="";
+                for (auto iter = s.cbegin(); iter != s.cend(); NULL) 
                 {
-                    int32_t jiebaSearchPre = jiebaSearchIdx;
-                    jiebaSearchIdx = jiebaSearchIdx + (jiebaWords[wordIdx].length()/3);
+                    uint32_t wordUnicode = utf8::next(iter, s.cend());
 
-                    if(jiebaSearchIdx > charIdx)
+                    if((wordUnicode > 0xFFFF) || !hanz2piny.isHanziUnicode((uint16_t)wordUnicode))
                     {
-                        vector<string> wordPhones = searchForMultiPhone(jiebaWords[wordIdx]);
-                        
-                        if(wordPhones.size() == 0)
-                        {
-                            pinyin = pinyin.substr(0,cStrIdx);
-                            string strTone = pinyin.substr(pinyin.size()-1,1);
-                            string pinyin_notone = pinyin.substr(0,pinyin.size()-1);
-
-                            auto iter = pinyMap_.find(pinyin_notone);
-                            if (iter != pinyMap_.end())
-                            {
-                                vector<string> phones = iter->second;
-                                string a1 = phones[0];
-                                string a2 = phones[1]+strTone;
-
-                                idList[insertIdx++] = phoneIdMap_[a1];
-                                idList[insertIdx++] = phoneIdMap_[a2];
-                                idList[insertIdx++] = phoneIdMap_["#0"];
-                            }
-                        }
-                        else
-                        {
-                            int32_t letterIdx = charIdx - (jiebaSearchIdx - (jiebaWords[wordIdx].length()/3));
-                            
-                            pinyin = wordPhones[letterIdx];
-                            string strTone = pinyin.substr(pinyin.size()-1,1);
-                            string pinyin_notone = pinyin.substr(0,pinyin.size()-1);
-
-                            auto iter = pinyMap_.find(pinyin_notone);
-                            if (iter != pinyMap_.end())
-                            {
-                                vector<string> phones = iter->second;
-                                string a1 = phones[0];
-                                string a2 = phones[1]+strTone;
-
-                                idList[insertIdx++] = phoneIdMap_[a1];
-                                idList[insertIdx++] = phoneIdMap_[a2];
-                                idList[insertIdx++] = phoneIdMap_["#0"];
-                            }
-
-                        }
-                        break;
+                        bDummyReplace = true;
+                        dummyStr.append("AAA");
                     }
                 }
-                    
+                
+                if(bDummyReplace == true)
+                {
+                    jiebaWords[ii] = dummyStr;
+                }
             }
-            else
-            {
-                string strTone = pinyin.substr(pinyin.size()-1,1);
-                string pinyin_notone = pinyin.substr(0,pinyin.size()-1);
+            jiebaReady = true;
+        }
 
-                auto iter = pinyMap_.find(pinyin_notone);
-                if (iter != pinyMap_.end())
-                {
-                    vector<string> phones = iter->second;
-                    string a1 = phones[0];
-                    string a2 = phones[1]+strTone;
+        const string & pinyin = polyPinyin_[entry.poly_ - 1];
+        int32_t cStrIdx = pinyin.find(",");
+        int32_t jiebaSearchIdx = 0;
+        for(int32_t wordIdx = 0; wordIdx < (int32_t)jiebaWords.size(); wordIdx++)
+        {
+            jiebaSearchIdx = jiebaSearchIdx + (jiebaWords[wordIdx].length()/3);
 
-                    idList[insertIdx++] = phoneIdMap_[a1];
-                    idList[insertIdx++] = phoneIdMap_[a2];
-                    idList[insertIdx++] = phoneIdMap_["#0"];
+            if(jiebaSearchIdx > charIdx)
+            {
+                vector<string> wordPhones = searchForMultiPhone(jiebaWords[wordIdx]);
+                
+                if(wordPhones.size() == 0)
+                {
+                    appendPinyin(pinyin.substr(0,cStrIdx), idList, insertIdx);
+                }
+                else
+                {
+                    int32_t letterIdx = charIdx - (jiebaSearchIdx - (jiebaWords[wordIdx].length()/3));
+                    appendPinyin(wordPhones[letterIdx], idList, insertIdx);
                 }
+                break;
             }
         }
-
-        charIdx = charIdx + 1;
     }
 
     idList[insertIdx++] = 0;
@@ -217,5 +259,4 @@ int32_t * hanzi2phoneid::convert(string line, int32_t & len, const vector<string
     len = insertIdx;
 
     return idList;
-    
 }
@@ -72,7 +72,7 @@ void FixDurationPredictor::setMSSpk(int32_t isMS, int32_t ginChannels)
     durPredData->gin_channels_ = ginChannels;
 }
 
-MatrixXf FixDurationPredictor::forward(const MatrixXf & x, const MatrixXf & g,float noiseScale)
+MatrixXf FixDurationPredictor::forward(const MatrixXf & x, const MatrixXf & g,float /*noiseScale*/)
 {
     DUR_PRED_t * durPredData = (DUR_PRED_t *)priv_;
 
@@ -4,6 +4,7 @@
 #include "nn_conv1d_transposed.h"
 #include "ResBlock1.h"
 #include "nn_leaky_relu.h"
+#include "tts_workspace.h"
 #include "nn_tanh.h"
 #include "iStft.h"
 #include <vector>
@@ -63,7 +64,7 @@ Generator_Istft::Generator_Istft(float * modelData, int32_t & offset,int32_t isM
         generatorData->upSampleKernelSizesList_[i] = modelData[curOffset++];
     }
     generatorData->resBlocKernelSizeNum_ = (int32_t)modelData[curOffset++];
-    generatorData->resBlockKernelSizeList_ = new int32_t(generatorData->resBlocKernelSizeNum_);
+    generatorData->resBlockKernelSizeList_ = new int32_t[generatorData->resBlocKernelSizeNum_];
     for(int32_t i = 0; i<generatorData->resBlocKernelSizeNum_; i++)
     {
         generatorData->resBlockKernelSizeList_[i] = (int32_t)modelData[curOffset++];
@@ -146,53 +147,44 @@ Generator_Istft::~Generator_Istft()
     delete generatorData;
 }
 
-MatrixXf Generator_Istft::forward(const MatrixXf & x, const MatrixXf & g)
+MatrixXf Generator_Istft::forward(const MatrixXf & x, const MatrixXf & /*g*/)
 {
     GENERATOR_ISTFT_DATA_t * generatorData = (GENERATOR_ISTFT_DATA_t *)priv_;
     
-    MatrixXf xx = x;
-
-    xx = generatorData->conv_pre_->forward(xx);
-
-    for(int32_t i = 0; i<generatorData->upSampleRatesNum_; i++)
+    tts_workspace_mat preBuf(generatorData->conv_pre_->get_out_len(x.rows()),
+                             generatorData->conv_pre_->get_out_channels_num());
+    Map<MatrixXf> & pre = preBuf.mat();
+    generatorData->conv_pre_->forward(x, pre);
+
+    int32_t upLen, upCh;
+    generator_upsample_shape(generatorData->upList_, generatorData->upSampleRatesNum_, pre.rows(), upLen, upCh);
+    tts_workspace_mat upBuf(upLen, upCh);
+    Map<MatrixXf> & up = upBuf.mat();
+    generator_upsample(generatorData->upList_, generatorData->resBlockList_, generatorData->upSampleRatesNum_,
+                       generatorData->resBlocKernelSizeNum_, pre, up);
+
+    // leaky_relu written straight into a reflection padded copy (one leading row)
+    tts_workspace_mat padBuf(upLen+1, upCh);
+    Map<MatrixXf> & xx_refpad = padBuf.mat();
+    nn_leaky_relu(up, xx_refpad.bottomRows(upLen), 0.01);
+    if(upLen > 1)
     {
-        xx = nn_leaky_relu(xx,0.1);
-        xx = generatorData->upList_[i]->forward(xx);
-        
-        int32_t xs_none = 1;
-        MatrixXf xs;
-        for(int32_t j = 0; j<generatorData->resBlocKernelSizeNum_; j++)
-        {
-            if(xs_none == 1)
-            {
-                xs = generatorData->resBlockList_[i*generatorData->resBlocKernelSizeNum_ + j]->forward(xx);
-                xs_none = 0;
-            }
-            else
-            {
-                MatrixXf xs_tmp = generatorData->resBlockList_[i*generatorData->resBlocKernelSizeNum_ + j]->forward(xx);
-                xs = xs + xs_tmp;
-            }
-
-        }
-        xx = xs.array()/(float)(generatorData->resBlocKernelSizeNum_);
+        xx_refpad.row(0) = xx_refpad.row(2);
     }
-    xx = nn_leaky_relu(xx);
-    
-    MatrixXf xx_refpad = MatrixXf::Zero(xx.rows()+1,xx.cols());
-    xx_refpad.block(1,0,xx.rows(),xx.cols()) = xx;
-
-    if(xx.rows() > 1)
+    else
     {
-        xx_refpad.row(0) = xx.row(1);
+        xx_refpad.row(0).setZero();
     }
 
-    xx = generatorData->subband_conv_post_->forward(xx_refpad);
+    tts_workspace_mat postBuf(generatorData->subband_conv_post_->get_out_len(upLen+1),
+                              generatorData->subband_conv_post_->get_out_channels_num());
+    Map<MatrixXf> & post = postBuf.mat();
+    generatorData->subband_conv_post_->forward(xx_refpad, post);
     int32_t halfSubBandCols = generatorData->gen_istft_n_fft_/2+1;
 
-    MatrixXf sub1 = xx.block(0,0,xx.rows(),halfSubBandCols);
-    MatrixXf sub2 = xx.block(0,halfSubBandCols,xx.rows(),halfSubBandCols);
-    xx = generatorData->istft_->forward((sub1.array().exp()).matrix(),
+    MatrixXf sub1 = post.block(0,0,post.rows(),halfSubBandCols);
+    MatrixXf sub2 = post.block(0,halfSubBandCols,post.rows(),halfSubBandCols);
+    MatrixXf xx = generatorData->istft_->forward((sub1.array().exp()).matrix(),
                                         ((sub2.array().sin())*M_PI).matrix()); 
     return xx;
 }
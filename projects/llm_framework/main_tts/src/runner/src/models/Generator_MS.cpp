@@ -4,6 +4,7 @@
 #include "nn_conv1d_transposed.h"
 #include "ResBlock1.h"
 #include "nn_leaky_relu.h"
+#include "tts_workspace.h"
 #include "nn_tanh.h"
 #include "iStft.h"
 #include <vector>
@@ -65,7 +66,7 @@ Generator_MS::Generator_MS(float * modelData, int32_t & offset,int32_t isMS)
         generatorData->upSampleKernelSizesList_[i] = modelData[curOffset++];
     }
     generatorData->resBlocKernelSizeNum_ = (int32_t)modelData[curOffset++];
-    generatorData->resBlockKernelSizeList_ = new int32_t(generatorData->resBlocKernelSizeNum_);
+    generatorData->resBlockKernelSizeList_ = new int32_t[generatorData->resBlocKernelSizeNum_];
     for(int32_t i = 0; i<generatorData->resBlocKernelSizeNum_; i++)
     {
         generatorData->resBlockKernelSizeList_[i] = (int32_t)modelData[curOffset++];
@@ -163,58 +164,49 @@ Generator_MS::~Generator_MS()
     delete generatorData;
 }
 
-MatrixXf Generator_MS::forward(const MatrixXf & x, const MatrixXf & g)
+MatrixXf Generator_MS::forward(const MatrixXf & x, const MatrixXf & /*g*/)
 {
 
     GENERATOR_MS_DATA_t * generatorData = (GENERATOR_MS_DATA_t *)priv_;
     
-    MatrixXf xx = x;
-
-    xx = generatorData->conv_pre_->forward(xx);
-
-    for(int32_t i = 0; i<generatorData->upSampleRatesNum_; i++)
+    tts_workspace_mat preBuf(generatorData->conv_pre_->get_out_len(x.rows()),
+                             generatorData->conv_pre_->get_out_channels_num());
+    Map<MatrixXf> & pre = preBuf.mat();
+    generatorData->conv_pre_->forward(x, pre);
+
+    int32_t upLen, upCh;
+    generator_upsample_shape(generatorData->upList_, generatorData->upSampleRatesNum_, pre.rows(), upLen, upCh);
+    tts_workspace_mat upBuf(upLen, upCh);
+    Map<MatrixXf> & up = upBuf.mat();
+    generator_upsample(generatorData->upList_, generatorData->resBlockList_, generatorData->upSampleRatesNum_,
+                       generatorData->resBlocKernelSizeNum_, pre, up);
+
+    // leaky_relu written straight into a reflection padded copy (one leading row)
+    tts_workspace_mat padBuf(upLen+1, upCh);
+    Map<MatrixXf> & xx_refpad = padBuf.mat();
+    nn_leaky_relu(up, xx_refpad.bottomRows(upLen), 0.01);
+    if(upLen > 1)
     {
-        xx = nn_leaky_relu(xx,0.1);
-        xx = generatorData->upList_[i]->forward(xx);
-        
-        int32_t xs_none = 1;
-        MatrixXf xs;
-        for(int32_t j = 0; j<generatorData->resBlocKernelSizeNum_; j++)
-        {
-            if(xs_none == 1)
-            {
-                xs = generatorData->resBlockList_[i*generatorData->resBlocKernelSizeNum_ + j]->forward(xx);
-                xs_none = 0;
-            }
-            else
-            {
-                MatrixXf xs_tmp = generatorData->resBlockList_[i*generatorData->resBlocKernelSizeNum_ + j]->forward(xx);
-                xs = xs + xs_tmp;
-            }
-
-        }
-        xx = xs.array()/(float)(generatorData->resBlocKernelSizeNum_);
+        xx_refpad.row(0) = xx_refpad.row(2);
     }
-    xx = nn_leaky_relu(xx);
-    
-    MatrixXf xx_refpad = MatrixXf::Zero(xx.rows()+1,xx.cols());
-    xx_refpad.block(1,0,xx.rows(),xx.cols()) = xx;
-
-    if(xx.rows() > 1)
+    else
     {
-        xx_refpad.row(0) = xx.row(1);
+        xx_refpad.row(0).setZero();
     }
     
-    xx = generatorData->subband_conv_post_->forward(xx_refpad);
+    tts_workspace_mat postBuf(generatorData->subband_conv_post_->get_out_len(upLen+1),
+                              generatorData->subband_conv_post_->get_out_channels_num());
+    Map<MatrixXf> & post = postBuf.mat();
+    generatorData->subband_conv_post_->forward(xx_refpad, post);
     
-    MatrixXf timeMat = MatrixXf::Zero(((xx.rows()-1)*4),generatorData->subBands_);
+    MatrixXf timeMat = MatrixXf::Zero(((post.rows()-1)*4),generatorData->subBands_);
 
-    int32_t subBandCols = xx.cols()/generatorData->subBands_;
+    int32_t subBandCols = post.cols()/generatorData->subBands_;
     int32_t halfSubBandCols = generatorData->gen_istft_n_fft_/2+1;
 
     for(int32_t bIdx = 0; bIdx < generatorData->subBands_; bIdx++)
     {
-        MatrixXf subBandX = xx.block(0,bIdx*subBandCols,xx.rows(),subBandCols);
+        MatrixXf subBandX = post.block(0,bIdx*subBandCols,post.rows(),subBandCols);
         MatrixXf subBandp1 = subBandX.block(0,0,subBandX.rows(),halfSubBandCols);
         MatrixXf subBandp2 = subBandX.block(0,halfSubBandCols,subBandX.rows(),halfSubBandCols);
         MatrixXf subBandTime = generatorData->istft_->forward((subBandp1.array().exp()).matrix(),
@@ -222,7 +214,7 @@ MatrixXf Generator_MS::forward(const MatrixXf & x, const MatrixXf & g)
         timeMat.col(bIdx) = subBandTime.transpose();
     }
 
-    xx = generatorData->upDownConv_->forward(timeMat);
+    MatrixXf xx = generatorData->upDownConv_->forward(timeMat);
     xx = generatorData->multistream_conv_post_->forward(xx);
     
     return xx;
@@ -1,6 +1,82 @@
 #include "Generator_base.h"
+#include "nn_conv1d_transposed.h"
+#include "ResBlock1.h"
+#include "nn_leaky_relu.h"
+#include "tts_workspace.h"
+
+using Eigen::Map;
 
 Generator_base::~Generator_base()
 {
 
 }
+
+void generator_upsample_shape(nn_conv1d_transposed ** upList, int32_t upNum, int32_t inLen,
+                              int32_t & outLen, int32_t & outCh)
+{
+    outLen = inLen;
+    outCh = 0;
+    for(int32_t i = 0; i<upNum; i++)
+    {
+        outLen = upList[i]->get_out_len(outLen);
+        outCh = upList[i]->get_out_channels_num();
+    }
+}
+
+void generator_upsample(nn_conv1d_transposed ** upList, ResBlock1 ** resBlockList, int32_t upNum, int32_t resBlockNum,
+                        const Eigen::Ref<const MatrixXf> & x, Eigen::Ref<MatrixXf> out)
+{
+    // one buffer per role, sized for the largest stage and reused by every stage
+    int64_t maxIn = (int64_t)x.rows()*x.cols();
+    int64_t maxOut = 0;
+    int32_t len = x.rows();
+    for(int32_t i = 0; i<upNum; i++)
+    {
+        len = upList[i]->get_out_len(len);
+        int64_t size = (int64_t)len*upList[i]->get_out_channels_num();
+        maxOut = size > maxOut ? size : maxOut;
+        if(i < upNum-1)
+        {
+            maxIn = size > maxIn ? size : maxIn;
+        }
+    }
+
+    tts_workspace_mat actBuf(maxIn, 1);
+    tts_workspace_mat upBuf(maxOut, 1);
+    tts_workspace_mat accBuf(maxOut, 1);
+    tts_workspace_mat tmpBuf(maxOut, 1);
+
+    Map<const MatrixXf> src(NULL, 0, 0);
+    len = x.rows();
+    for(int32_t i = 0; i<upNum; i++)
+    {
+        Map<MatrixXf> act(actBuf.mat().data(), len, (i == 0) ? x.cols() : src.cols());
+        if(i == 0)
+        {
+            nn_leaky_relu(x, act, 0.1);
+        }
+        else
+        {
+            nn_leaky_relu(src, act, 0.1);
+        }
+
+        len = upList[i]->get_out_len(len);
+        int32_t ch = upList[i]->get_out_channels_num();
+        Map<MatrixXf> up(upBuf.mat().data(), len, ch);
+        upList[i]->forward(act, up);
+
+        Map<MatrixXf> acc(accBuf.mat().data(), len, ch);
+        Map<MatrixXf> tmp(tmpBuf.mat().data(), len, ch);
+        resBlockList[i*resBlockNum]->forward(up, acc);
+        for(int32_t j = 1; j<resBlockNum; j++)
+        {
+            resBlockList[i*resBlockNum + j]->forward(up, tmp);
+            acc += tmp;
+        }
+        acc.array() /= (float)resBlockNum;
+
+        new (&src) Map<const MatrixXf>(acc.data(), len, ch);
+    }
+
+    out = src;
+}
@@ -4,6 +4,7 @@
 #include "nn_conv1d_transposed.h"
 #include "ResBlock1.h"
 #include "nn_leaky_relu.h"
+#include "tts_workspace.h"
 #include "nn_tanh.h"
 
 using Eigen::Map;
@@ -55,7 +56,7 @@ Generator_hifiGan::Generator_hifiGan(float * modelData, int32_t & offset,int32_t
         generatorData->upSampleKernelSizesList_[i] = modelData[curOffset++];
     }
     generatorData->resBlocKernelSizeNum_ = (int32_t)modelData[curOffset++];
-    generatorData->resBlockKernelSizeList_ = new int32_t(generatorData->resBlocKernelSizeNum_);
+    generatorData->resBlockKernelSizeList_ = new int32_t[generatorData->resBlocKernelSizeNum_];
     for(int32_t i = 0; i<generatorData->resBlocKernelSizeNum_; i++)
     {
         generatorData->resBlockKernelSizeList_[i] = (int32_t)modelData[curOffset++];
@@ -140,43 +141,33 @@ MatrixXf Generator_hifiGan::forward(const MatrixXf & x, const MatrixXf & g)
 {
     GENERATOR_DATA_t * generatorData = (GENERATOR_DATA_t *)priv_;
 
-    MatrixXf xx = generatorData->conv_pre_->forward(x);
+    tts_workspace_mat preBuf(generatorData->conv_pre_->get_out_len(x.rows()),
+                             generatorData->conv_pre_->get_out_channels_num());
+    Map<MatrixXf> & pre = preBuf.mat();
+    generatorData->conv_pre_->forward(x, pre);
 
     MatrixXf gg;
     if(generatorData->isMS_== 1)
     {
         gg = generatorData->cond_->forward(g);
-        xx = xx.rowwise() + gg.row(0);
+        pre = pre.rowwise() + gg.row(0);
     }
 
-    for(int32_t i = 0; i<generatorData->upSampleRatesNum_; i++)
-    {
-        xx = nn_leaky_relu(xx,0.1);
-        xx = generatorData->upList_[i]->forward(xx);
-        
-        int32_t xs_none = 1;
-        MatrixXf xs;
-        for(int32_t j = 0; j<generatorData->resBlocKernelSizeNum_; j++)
-        {
-            if(xs_none == 1)
-            {
-                xs = generatorData->resBlockList_[i*generatorData->resBlocKernelSizeNum_ + j]->forward(xx);
-                xs_none = 0;
-            }
-            else
-            {
-                MatrixXf xs_tmp = generatorData->resBlockList_[i*generatorData->resBlocKernelSizeNum_ + j]->forward(xx);
-                xs = xs + xs_tmp;
-            }
-
-        }
-        xx = xs.array()/(float)(generatorData->resBlocKernelSizeNum_);
-
-    }
-
-    xx = nn_leaky_relu(xx);
-    xx = generatorData->conv_post_->forward(xx);
-    xx = nn_tanh(xx);
+    int32_t upLen, upCh;
+    generator_upsample_shape(generatorData->upList_, generatorData->upSampleRatesNum_, pre.rows(), upLen, upCh);
+    tts_workspace_mat upBuf(upLen, upCh);
+    Map<MatrixXf> & up = upBuf.mat();
+    generator_upsample(generatorData->upList_, generatorData->resBlockList_, generatorData->upSampleRatesNum_,
+                       generatorData->resBlocKernelSizeNum_, pre, up);
+
+    nn_leaky_relu(up, up, 0.01);
+    tts_workspace_mat postBuf(generatorData->conv_post_->get_out_len(upLen),
+                              generatorData->conv_post_->get_out_channels_num());
+    Map<MatrixXf> & post = postBuf.mat();
+    generatorData->conv_post_->forward(up, post);
+
+    MatrixXf xx(post.rows(), post.cols());
+    nn_tanh(post, xx);
 
     return xx;
 }
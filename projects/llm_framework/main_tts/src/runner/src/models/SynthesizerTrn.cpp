@@ -19,12 +19,33 @@
 #include "utils/flags.h"
 #include <iostream>
 #include <streambuf>
+// cppjieba is vendored unchanged
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
 #include "cppjieba/Jieba.hpp"
+#pragma GCC diagnostic pop
 #include "EnglishText2Id.h"
+#include "tts_thread_pool.h"
+#include "tts_workspace.h"
+#include <mutex>
+#include <list>
+#include <unordered_map>
 
 using Eigen::MatrixXf;
 using Eigen::Map;
 
+/*
+ * Streaming defaults. The flow runs once over the whole latent sequence, the generator then decodes blocks
+ * of STREAM_CHUNK_FRAMES with STREAM_CONTEXT_FRAMES of their neighbours on each side and keeps only the
+ * samples of the block itself. The context covers the generators' receptive field, so the stitched output
+ * matches a batch run to float rounding.
+ */
+#define STREAM_CHUNK_FRAMES (64)
+#define STREAM_CONTEXT_FRAMES (16)
+
+// lines whose phone ids are kept by the front-end cache
+#define FRONTEND_CACHE_ENTRIES (256)
+
 struct membuf : std::streambuf
 {
     membuf(char* begin, char* end) 
@@ -33,6 +54,16 @@ struct membuf : std::streambuf
     }
 };
 
+// a dictionary section of the model blob, streamed from it into its parser at load without a copy
+typedef struct
+{
+    char * data_;
+    int32_t size_;
+}SYN_SECTION_t;
+
+// front-end cache, most recently used line first
+typedef std::list<std::pair<string, vector<int32_t> > > SYN_CACHE_LIST_t;
+
 typedef struct
 {
     int32_t isMS_;
@@ -41,7 +72,6 @@ typedef struct
     int32_t decType_;
     int32_t spkNum_;
     int32_t gin_channels_;
-    vector<string> jieba_words_;
     
     hanzi2phoneid * hz2ID_;
     TextEncoder * textEncoder_;
@@ -53,8 +83,43 @@ typedef struct
     cppjieba::Jieba * jieba_;
     
     EnglishText2Id * eng2Ipa_;
+
+    // Chinese frontend sources in the model blob, parsed into tnProcessor_, jieba_ and hz2ID_ at load
+    SYN_SECTION_t tnTagger_;
+    SYN_SECTION_t tnVerbalizer_;
+    SYN_SECTION_t jiebaDict_;
+    SYN_SECTION_t jiebaHmmModel_;
+    SYN_SECTION_t jiebaUsrDict_;
+    SYN_SECTION_t jiebaIdf_;
+    SYN_SECTION_t jiebaStopword_;
+    SYN_SECTION_t multiPhoneWords_;
+    SYN_SECTION_t multiPhonePinyin_;
+
+    // line -> phone ids, the only part of the model written after loading; guarded by cacheMtx_
+    std::mutex cacheMtx_;
+    SYN_CACHE_LIST_t cacheList_;
+    std::unordered_map<string, SYN_CACHE_LIST_t::iterator> cacheIndex_;
+    int32_t cacheEntryNum_;
+
+    // backs the single-caller API of SynthesizerTrn
+    SynthesizerTrnSession * session_;
 }SYN_DATA_t;
 
+// Everything a synthesis writes. The model above is only read once it is loaded.
+typedef struct
+{
+    SYN_DATA_t * synData_;
+    vector<string> jieba_words_;
+    vector<int32_t> phoneIds_;
+    tts_thread_pool * threadPool_;
+    tts_workspace * workspace_;
+    // decoder workspace per latent frame seen so far, used to size the workspace before decoding
+    int64_t wsFloatsPerFrame_;
+    int32_t streamChunkFrames_;
+    int32_t streamContextFrames_;
+    std::vector<int16_t> streamPcm_;
+}SYN_SESSION_DATA_t;
+
 typedef enum
 {
     LANG_TYPE_CHS=0,
@@ -76,6 +141,134 @@ typedef enum
     DEC_TYPE_MBB = 3
 }DEC_TYPE_t;
 
+// a section of size 0 is treated as absent
+static void syn_set_section(SYN_SECTION_t & section, char * data, int32_t size)
+{
+    section.data_ = (size > 0) ? data : NULL;
+    section.size_ = (size > 0) ? size : 0;
+}
+
+static void syn_load_frontend(SYN_DATA_t * synData)
+{
+    if(NULL != synData->tnTagger_.data_)
+    {
+        membuf sbufTagger(synData->tnTagger_.data_, synData->tnTagger_.data_ + synData->tnTagger_.size_);
+        membuf sbufVerb(synData->tnVerbalizer_.data_, synData->tnVerbalizer_.data_ + synData->tnVerbalizer_.size_);
+
+        std::istream inTagger(&sbufTagger);
+        std::istream inVerb(&sbufVerb);
+
+        synData->tnProcessor_ = new wetext::Processor(inTagger, inVerb);
+    }
+
+    if(NULL != synData->jiebaDict_.data_)
+    {
+        membuf sbufDict(synData->jiebaDict_.data_, synData->jiebaDict_.data_ + synData->jiebaDict_.size_);
+        membuf sbufModel(synData->jiebaHmmModel_.data_,
+                         synData->jiebaHmmModel_.data_ + synData->jiebaHmmModel_.size_);
+        membuf sbufUsrDict(synData->jiebaUsrDict_.data_, synData->jiebaUsrDict_.data_ + synData->jiebaUsrDict_.size_);
+        membuf sbufIdf(synData->jiebaIdf_.data_, synData->jiebaIdf_.data_ + synData->jiebaIdf_.size_);
+        membuf sbufStopword(synData->jiebaStopword_.data_,
+                            synData->jiebaStopword_.data_ + synData->jiebaStopword_.size_);
+
+        std::istream inDict(&sbufDict);
+        std::istream inModel(&sbufModel);
+        std::istream inUsrDict(&sbufUsrDict);
+        std::istream inIdf(&sbufIdf);
+        std::istream inStopword(&sbufStopword);
+
+        synData->jieba_ = new cppjieba::Jieba(inDict, inModel,
+                                              inUsrDict, inIdf, inStopword);
+    }
+
+    // without the multi-reading tables every character takes its first reading from the built-in table
+    membuf sbufMultiPhoneWords(synData->multiPhoneWords_.data_,
+                               synData->multiPhoneWords_.data_ + synData->multiPhoneWords_.size_);
+    membuf sbufMultiPhoneWordsPinyin(synData->multiPhonePinyin_.data_,
+                                     synData->multiPhonePinyin_.data_ + synData->multiPhonePinyin_.size_);
+
+    std::istream inMultiPhonewords(&sbufMultiPhoneWords);
+    std::istream inMultiPhonewordsPinyin(&sbufMultiPhoneWordsPinyin);
+    synData->hz2ID_ = new hanzi2phoneid(inMultiPhonewords,inMultiPhonewordsPinyin);
+}
+
+/*
+ * True when the TN grammar has nothing to rewrite in line: only Hanzi, sentence punctuation and spaces. Digits,
+ * Latin letters and symbols (units, dates, currency, ...) all go through the FST.
+ */
+static bool syn_tn_passthrough(const string & line)
+{
+    const unsigned char * str = (const unsigned char *)line.data();
+    size_t len = line.size();
+    size_t ii = 0;
+    while(ii < len)
+    {
+        unsigned char c = str[ii];
+        if(c < 0x80)
+        {
+            if((c != ' ') && (c != ',') && (c != '.') && (c != '!') && (c != '?') && (c != ';'))
+            {
+                return false;
+            }
+            ii++;
+            continue;
+        }
+
+        if(((c & 0xF0) != 0xE0) || (ii + 2 >= len))
+        {
+            return false;
+        }
+        uint32_t code = ((uint32_t)(c & 0x0F) << 12) | ((uint32_t)(str[ii + 1] & 0x3F) << 6) | (str[ii + 2] & 0x3F);
+        bool isHanzi = (code >= 0x4E00) && (code <= 0x9FFF);
+        // 、。！，：；？
+        bool isPunct = (code == 0x3001) || (code == 0x3002) || (code == 0xFF01) || (code == 0xFF0C) ||
+                       (code == 0xFF1A) || (code == 0xFF1B) || (code == 0xFF1F);
+        if(!isHanzi && !isPunct)
+        {
+            return false;
+        }
+        ii += 3;
+    }
+    return true;
+}
+
+static bool syn_cache_lookup(SYN_DATA_t * synData, const string & line, vector<int32_t> & ids)
+{
+    std::lock_guard<std::mutex> lock(synData->cacheMtx_);
+    auto it = synData->cacheIndex_.find(line);
+    if(it == synData->cacheIndex_.end())
+    {
+        return false;
+    }
+    synData->cacheList_.splice(synData->cacheList_.begin(), synData->cacheList_, it->second);
+    ids = it->second->second;
+    return true;
+}
+
+static void syn_cache_insert(SYN_DATA_t * synData, const string & line, const vector<int32_t> & ids)
+{
+    std::lock_guard<std::mutex> lock(synData->cacheMtx_);
+    if((synData->cacheEntryNum_ <= 0) || (synData->cacheIndex_.count(line) > 0))
+    {
+        return;
+    }
+
+    if((int32_t)synData->cacheList_.size() >= synData->cacheEntryNum_)
+    {
+        // reuse the least recently used node, its buffers included
+        SYN_CACHE_LIST_t::iterator last = std::prev(synData->cacheList_.end());
+        synData->cacheIndex_.erase(last->first);
+        last->first = line;
+        last->second = ids;
+        synData->cacheList_.splice(synData->cacheList_.begin(), synData->cacheList_, last);
+    }
+    else
+    {
+        synData->cacheList_.emplace_front(line, ids);
+    }
+    synData->cacheIndex_[line] = synData->cacheList_.begin();
+}
+
 int32_t SynthesizerTrn::getSpeakerNum()
 {
     SYN_DATA_t * synData = (SYN_DATA_t *)priv_;
@@ -88,6 +281,12 @@ int32_t SynthesizerTrn::getSpeakerNum()
     return spkNum;
 }
 
+void SynthesizerTrn::setThreadNum(int32_t threadNum)
+{
+    SYN_DATA_t * synData = (SYN_DATA_t *)priv_;
+    synData->session_->setThreadNum(threadNum);
+}
+
 SynthesizerTrn::SynthesizerTrn(float * modelData, int32_t modelSize)
 {
     SYN_DATA_t * synData = new SYN_DATA_t();
@@ -96,7 +295,6 @@ SynthesizerTrn::SynthesizerTrn(float * modelData, int32_t modelSize)
         tts_log(TTS_LOG_ERROR, "SynthesizerTrn: Failed to allocate memory for internal data block\n");
         return;
     }
-    memset(synData, 0, sizeof(SYN_DATA_t));
 
     int32_t offset = 0;
 
@@ -168,7 +366,7 @@ SynthesizerTrn::SynthesizerTrn(float * modelData, int32_t modelSize)
     
     if(synData->langType_ == LANG_TYPE_ENG)
     {
-        if(modelSize > (offset +1)*sizeof(float))
+        if(modelSize > (int32_t)((offset +1)*sizeof(float)))
         {
             int32_t curOffset = 0;
             synData->eng2Ipa_ = new EnglishText2Id(modelData+offset, curOffset);
@@ -176,16 +374,16 @@ SynthesizerTrn::SynthesizerTrn(float * modelData, int32_t modelSize)
     }
     else if(synData->langType_ == LANG_TYPE_CHS)
     {
+        // locate the dictionary sections, syn_load_frontend() parses them once they are all known
         int32_t offset_char = offset*sizeof(float);
     
-        if(offset*sizeof(float)+1 < modelSize)
+        if((int32_t)(offset*sizeof(float)+1) < modelSize)
         {
             int32_t tnTaggerSize = (int32_t)modelData[offset++];
             int32_t tnVerSize = (int32_t)modelData[offset++];
 
-            membuf sbufTagger((char *)(modelData + offset), (char *)(modelData + offset) + tnTaggerSize);
-
-            membuf sbufVerb((char *)(modelData + offset)+tnTaggerSize, (char *)(modelData + offset) + tnTaggerSize + tnVerSize);
+            syn_set_section(synData->tnTagger_, (char *)(modelData + offset), tnTaggerSize);
+            syn_set_section(synData->tnVerbalizer_, (char *)(modelData + offset) + tnTaggerSize, tnVerSize);
 
             offset_char = offset*sizeof(float) + tnTaggerSize + tnVerSize;
 
@@ -195,15 +393,6 @@ SynthesizerTrn::SynthesizerTrn(float * modelData, int32_t modelSize)
             }
 
             offset = offset_char/sizeof(float);
-
-            std::istream inTagger(&sbufTagger);
-            std::istream inVerb(&sbufVerb);
-
-            synData->tnProcessor_ = new wetext::Processor(inTagger, inVerb);
-        }
-        else
-        {
-            synData->tnProcessor_ = NULL;
         }
 
         if((offset_char +1) < modelSize)
@@ -213,51 +402,17 @@ SynthesizerTrn::SynthesizerTrn(float * modelData, int32_t modelSize)
             int32_t jiebaUsrdictSize = (int32_t)modelData[offset++];
             int32_t jiebaIdfSize = (int32_t)modelData[offset++];
             int32_t jiebaStopwordSize = (int32_t)modelData[offset++];
-        
-            membuf sbufDict((char *)(modelData + offset), (char *)(modelData + offset) + 
-                                                              jiebaDictSize);
-
-            membuf sbufModel((char *)(modelData + offset)+
-                                 jiebaDictSize, (char *)(modelData + offset) + 
-                                                jiebaDictSize + 
-                                                jiebaHmmModelSize);
-
-            membuf sbufUsrDict((char *)(modelData + offset)+
-                                   jiebaDictSize+
-                                   jiebaHmmModelSize, (char *)(modelData + offset) + 
-                                                                       jiebaDictSize + 
-                                                                       jiebaHmmModelSize +
-                                                                       jiebaUsrdictSize );
-                                                                       
-            membuf sbufIdf((char *)(modelData + offset)+
-                                jiebaDictSize +
-                                jiebaHmmModelSize+
-                                jiebaUsrdictSize,    (char *)(modelData + offset) + 
-                                                             jiebaDictSize + 
-                                                             jiebaHmmModelSize +
-                                                             jiebaUsrdictSize +
-                                                             jiebaIdfSize);
-                                                                           
-            membuf sbufStopword((char *)(modelData + offset)+
-                            jiebaDictSize+
-                            jiebaHmmModelSize+
-                            jiebaUsrdictSize+
-                            jiebaIdfSize ,    (char *)(modelData + offset) + 
-                                                jiebaDictSize + 
-                                                jiebaHmmModelSize +
-                                                jiebaUsrdictSize +
-                                                jiebaIdfSize +
-                                                jiebaStopwordSize);
-            std::istream inDict(&sbufDict);
-            std::istream inModel(&sbufModel);
-            std::istream inUsrDict(&sbufUsrDict);
-            std::istream inIdf(&sbufIdf);
-            std::istream inStopword(&sbufStopword);
-
-
-
-            synData->jieba_ = new cppjieba::Jieba(inDict, inModel,
-                                              inUsrDict, inIdf, inStopword);
+
+            char * section = (char *)(modelData + offset);
+            syn_set_section(synData->jiebaDict_, section, jiebaDictSize);
+            section += jiebaDictSize;
+            syn_set_section(synData->jiebaHmmModel_, section, jiebaHmmModelSize);
+            section += jiebaHmmModelSize;
+            syn_set_section(synData->jiebaUsrDict_, section, jiebaUsrdictSize);
+            section += jiebaUsrdictSize;
+            syn_set_section(synData->jiebaIdf_, section, jiebaIdfSize);
+            section += jiebaIdfSize;
+            syn_set_section(synData->jiebaStopword_, section, jiebaStopwordSize);
 
             offset_char = offset*sizeof(float) + jiebaDictSize + jiebaHmmModelSize + jiebaUsrdictSize + jiebaIdfSize + jiebaStopwordSize;
 
@@ -273,18 +428,10 @@ SynthesizerTrn::SynthesizerTrn(float * modelData, int32_t modelSize)
         {
             int32_t multiPhoneWordSize = (int32_t)modelData[offset++];
             int32_t multiPhonePinyinSize = (int32_t)modelData[offset++];
-        
-            membuf sbufMultiPhoneWords((char *)(modelData + offset), (char *)(modelData + offset) + 
-                                                                  multiPhoneWordSize);
-
-            membuf sbufMultiPhoneWordsPinyin((char *)(modelData + offset)+
-                                                    multiPhoneWordSize, (char *)(modelData + offset) + 
-                                                                        multiPhoneWordSize + 
-                                                                        multiPhonePinyinSize);
 
-            std::istream inMultiPhonewords(&sbufMultiPhoneWords);
-            std::istream inMultiPhonewordsPinyin(&sbufMultiPhoneWordsPinyin);
-            synData->hz2ID_ = new hanzi2phoneid(inMultiPhonewords,inMultiPhonewordsPinyin);
+            syn_set_section(synData->multiPhoneWords_, (char *)(modelData + offset), multiPhoneWordSize);
+            syn_set_section(synData->multiPhonePinyin_, (char *)(modelData + offset) + multiPhoneWordSize,
+                            multiPhonePinyinSize);
 
             offset_char = offset*sizeof(float) + multiPhoneWordSize + multiPhonePinyinSize;
 
@@ -296,9 +443,16 @@ SynthesizerTrn::SynthesizerTrn(float * modelData, int32_t modelSize)
             offset = offset_char/sizeof(float);
         }
     }
-    
+
+    if(synData->langType_ == LANG_TYPE_CHS)
+    {
+        syn_load_frontend(synData);
+    }
+
+    synData->cacheEntryNum_ = FRONTEND_CACHE_ENTRIES;
 
     priv_ = synData;
+    synData->session_ = new SynthesizerTrnSession(this);
 }
 
 MatrixXf expandM(const MatrixXf & x, const MatrixXf lengthM)
@@ -322,35 +476,59 @@ MatrixXf expandM(const MatrixXf & x, const MatrixXf lengthM)
 
 int16_t * SynthesizerTrn::infer(const string & line, int32_t sid, float lengthScale, int32_t & dataLen)
 {
-    SYN_DATA_t * synData = (SYN_DATA_t *)priv_;
-
-    int32_t * strIDs = NULL;
-    int32_t strLen = 0;
-    if(synData->langType_ == LANG_TYPE_CHS)
+    std::vector<int16_t> pcm;
+    dataLen = infer(line, sid, lengthScale, pcm);
+    if(dataLen < 0)
     {
-        string tnString = line;
-        if(synData->tnProcessor_ != NULL)
-        {
-            string tagged_text = synData->tnProcessor_->tag(line);
-            tnString = synData->tnProcessor_->verbalize(tagged_text);
-        }
+        dataLen = 0;
+        return NULL;
+    }
 
-        synData->jieba_->Cut(tnString, synData->jieba_words_, true);
+    int16_t * retData = (int16_t *)malloc(sizeof(int16_t)*dataLen);
+    memcpy(retData, pcm.data(), sizeof(int16_t)*dataLen);
 
-        strIDs = synData->hz2ID_->convert(tnString,strLen, synData->jieba_words_);
+    return retData;
+}
 
-    }
-    else if(synData->langType_ == LANG_TYPE_ENG)
+// text frontend, encoder and duration expansion, leaves the prior latent sequence in z_p
+static void syn_prior_latent(SYN_SESSION_DATA_t * sesData, const string & line, int32_t sid, float lengthScale,
+                             MatrixXf & z_p, MatrixXf & g)
+{
+    SYN_DATA_t * synData = sesData->synData_;
+
+    vector<int32_t> & ids = sesData->phoneIds_;
+    if(!syn_cache_lookup(synData, line, ids))
     {
-        vector<int> engIDVec = synData->eng2Ipa_->getIPAId(line);
-        strLen = engIDVec.size();
+        if(synData->langType_ == LANG_TYPE_CHS)
+        {
+            string tnString = line;
+            if((synData->tnProcessor_ != NULL) && !syn_tn_passthrough(line))
+            {
+                string tagged_text = synData->tnProcessor_->tag(line);
+                tnString = synData->tnProcessor_->verbalize(tagged_text);
+            }
 
-        strIDs = new int32_t[strLen];
+            sesData->jieba_words_.clear();
+            if(synData->jieba_ != NULL)
+            {
+                synData->jieba_->Cut(tnString, sesData->jieba_words_, true);
+            }
 
-        for(int32_t ii = 0; ii<strLen; ii++)
+            int32_t strLen = 0;
+            int32_t * strIDs = synData->hz2ID_->convert(tnString,strLen, sesData->jieba_words_);
+            ids.assign(strIDs, strIDs + strLen);
+            delete [] strIDs;
+        }
+        else if(synData->langType_ == LANG_TYPE_ENG)
         {
-            strIDs[ii] = engIDVec[ii];
+            vector<int> engIDVec = synData->eng2Ipa_->getIPAId(line);
+            ids.assign(engIDVec.begin(), engIDVec.end());
         }
+        syn_cache_insert(synData, line, ids);
+    }
+
+    if(synData->langType_ == LANG_TYPE_ENG)
+    {
         lengthScale = lengthScale*0.83;
     }
 
@@ -358,9 +536,8 @@ int16_t * SynthesizerTrn::infer(const string & line, int32_t sid, float lengthSc
 
     MatrixXf m;
     MatrixXf logs;
-    MatrixXf XX = synData->textEncoder_->forward(strIDs,strLen,m,logs);
+    MatrixXf XX = synData->textEncoder_->forward(ids.data(),(int32_t)ids.size(),m,logs);
 
-    MatrixXf g;
     if(synData->isMS_ == 1)
     {
         if((sid<0) || (sid >= synData->spkNum_))
@@ -375,34 +552,203 @@ int16_t * SynthesizerTrn::infer(const string & line, int32_t sid, float lengthSc
     
     MatrixXf w = logw.array().exp() * lengthScale;
     MatrixXf w_ceil = w.array().ceil();
-    MatrixXf y_lengths = nn_clamp_min(w_ceil.colwise().sum(),1.0);
-    
-    MatrixXf m_expand = expandM(m, w_ceil);
-    MatrixXf logs_expand = expandM(logs,w_ceil);
     
-    MatrixXf z_p = m_expand.array() + rand_gen(m_expand.rows(), m_expand.cols(), 0.0, 1.0).array() * logs_expand.array() * noiseScale;
+    z_p = expandM(m, w_ceil);
+    if(noiseScale > 0)
+    {
+        MatrixXf logs_expand = expandM(logs,w_ceil);
+        z_p = z_p.array() + rand_gen(z_p.rows(), z_p.cols(), 0.0, 1.0).array() * logs_expand.array() * noiseScale;
+    }
+}
 
-    MatrixXf z = synData->flow_->forward(z_p,g);
+// generator over a span of latent frames
+static MatrixXf syn_decode(SYN_SESSION_DATA_t * sesData, const MatrixXf & z, const MatrixXf & g)
+{
+    // plan the decoder workspace from the latent length before decoding, so it does not grow mid utterance
+    sesData->workspace_->reset();
+    sesData->workspace_->reserve(sesData->wsFloatsPerFrame_ * z.rows());
     
-    MatrixXf o = synData->dec_->forward(z,g);
+    MatrixXf o = sesData->synData_->dec_->forward(z,g);
 
-    dataLen = o.rows()*o.cols();
+    int64_t perFrame = (sesData->workspace_->get_peak() + z.rows() - 1) / (z.rows() > 0 ? z.rows() : 1);
+    if(perFrame > sesData->wsFloatsPerFrame_)
+    {
+        sesData->wsFloatsPerFrame_ = perFrame;
+    }
 
-    int16_t * retData = (int16_t *)malloc(sizeof(int16_t)*dataLen);
+    return o;
+}
 
+static void syn_to_pcm(const float * data, int32_t dataLen, int16_t * pcm)
+{
     for(int32_t i = 0; i< dataLen; i++)
     {
-        retData[i] = (int16_t)(o.data()[i]*32737);
+        pcm[i] = (int16_t)(data[i]*32737);
     }
+}
 
-    delete [] strIDs;
+int32_t SynthesizerTrnSession::infer(const string & line, int32_t sid, float lengthScale, std::vector<int16_t> & pcm)
+{
+    SYN_SESSION_DATA_t * sesData = (SYN_SESSION_DATA_t *)priv_;
+    SYN_DATA_t * synData = sesData->synData_;
 
-    return retData;
+    tts_set_thread_pool(sesData->threadPool_);
+    tts_set_workspace(sesData->workspace_);
+
+    MatrixXf z_p;
+    MatrixXf g;
+    syn_prior_latent(sesData, line, sid, lengthScale, z_p, g);
+
+    MatrixXf z = synData->flow_->forward(z_p,g);
+    MatrixXf o = syn_decode(sesData, z, g);
+
+    int32_t dataLen = o.rows()*o.cols();
+    pcm.resize(dataLen);
+    syn_to_pcm(o.data(), dataLen, pcm.data());
+
+    tts_set_workspace(NULL);
+    tts_set_thread_pool(NULL);
+
+    return dataLen;
+}
+
+int32_t SynthesizerTrnSession::inferStream(const string & line, int32_t sid, float lengthScale,
+                                           tts_pcm_callback_t callback, void * userData)
+{
+    SYN_SESSION_DATA_t * sesData = (SYN_SESSION_DATA_t *)priv_;
+    SYN_DATA_t * synData = sesData->synData_;
+
+    if(NULL == callback)
+    {
+        tts_log(TTS_LOG_ERROR, "SynthesizerTrn: stream callback is NULL\n");
+        return -1;
+    }
+
+    tts_set_thread_pool(sesData->threadPool_);
+    tts_set_workspace(sesData->workspace_);
+
+    MatrixXf z_p;
+    MatrixXf g;
+    syn_prior_latent(sesData, line, sid, lengthScale, z_p, g);
+
+    MatrixXf z = synData->flow_->forward(z_p,g);
+
+    int32_t totalFrames = z.rows();
+    int32_t chunkFrames = sesData->streamChunkFrames_;
+    int32_t contextFrames = sesData->streamContextFrames_;
+    int32_t dataLen = 0;
+
+    for(int32_t start = 0; start < totalFrames; start += chunkFrames)
+    {
+        int32_t end = (start + chunkFrames < totalFrames) ? (start + chunkFrames) : totalFrames;
+        int32_t ctxStart = (start - contextFrames > 0) ? (start - contextFrames) : 0;
+        int32_t ctxEnd = (end + contextFrames < totalFrames) ? (end + contextFrames) : totalFrames;
+
+        MatrixXf o = syn_decode(sesData, z.middleRows(ctxStart, ctxEnd - ctxStart), g);
+
+        // every generator produces a whole number of samples per latent frame
+        int32_t samplesPerFrame = (o.rows()*o.cols())/(ctxEnd - ctxStart);
+        int32_t blockLen = (end - start)*samplesPerFrame;
+
+        sesData->streamPcm_.resize(blockLen);
+        syn_to_pcm(o.data() + (start - ctxStart)*samplesPerFrame, blockLen, sesData->streamPcm_.data());
+        dataLen += blockLen;
+
+        if(0 != callback(sesData->streamPcm_.data(), blockLen, end == totalFrames, userData))
+        {
+            break;
+        }
+    }
+
+    tts_set_workspace(NULL);
+    tts_set_thread_pool(NULL);
+
+    return dataLen;
+}
+
+void SynthesizerTrnSession::setStreamParams(int32_t chunkFrames, int32_t contextFrames)
+{
+    SYN_SESSION_DATA_t * sesData = (SYN_SESSION_DATA_t *)priv_;
+
+    sesData->streamChunkFrames_ = (chunkFrames > 0) ? chunkFrames : STREAM_CHUNK_FRAMES;
+    sesData->streamContextFrames_ = (contextFrames >= 0) ? contextFrames : STREAM_CONTEXT_FRAMES;
+}
+
+void SynthesizerTrnSession::setThreadNum(int32_t threadNum)
+{
+    SYN_SESSION_DATA_t * sesData = (SYN_SESSION_DATA_t *)priv_;
+
+    delete sesData->threadPool_;
+    sesData->threadPool_ = NULL;
+
+    if(threadNum > 1)
+    {
+        sesData->threadPool_ = new tts_thread_pool(threadNum);
+    }
+}
+
+SynthesizerTrnSession::SynthesizerTrnSession(SynthesizerTrn * model)
+{
+    SYN_SESSION_DATA_t * sesData = new SYN_SESSION_DATA_t();
+    if(NULL == sesData)
+    {
+        tts_log(TTS_LOG_ERROR, "SynthesizerTrnSession: Failed to allocate memory for internal data block\n");
+        return;
+    }
+
+    sesData->synData_ = (SYN_DATA_t *)model->priv_;
+    sesData->threadPool_ = NULL;
+    sesData->workspace_ = new tts_workspace();
+    sesData->wsFloatsPerFrame_ = 0;
+    sesData->streamChunkFrames_ = STREAM_CHUNK_FRAMES;
+    sesData->streamContextFrames_ = STREAM_CONTEXT_FRAMES;
+
+    priv_ = (void *)sesData;
+}
+
+SynthesizerTrnSession::~SynthesizerTrnSession()
+{
+    SYN_SESSION_DATA_t * sesData = (SYN_SESSION_DATA_t *)priv_;
+    delete sesData->threadPool_;
+    delete sesData->workspace_;
+    delete sesData;
+}
+
+int32_t SynthesizerTrn::infer(const string & line, int32_t sid, float lengthScale, std::vector<int16_t> & pcm)
+{
+    SYN_DATA_t * synData = (SYN_DATA_t *)priv_;
+    return synData->session_->infer(line, sid, lengthScale, pcm);
+}
+
+int32_t SynthesizerTrn::inferStream(const string & line, int32_t sid, float lengthScale, tts_pcm_callback_t callback,
+                                    void * userData)
+{
+    SYN_DATA_t * synData = (SYN_DATA_t *)priv_;
+    return synData->session_->inferStream(line, sid, lengthScale, callback, userData);
+}
+
+void SynthesizerTrn::setFrontendCacheSize(int32_t entryNum)
+{
+    SYN_DATA_t * synData = (SYN_DATA_t *)priv_;
+    std::lock_guard<std::mutex> lock(synData->cacheMtx_);
+    synData->cacheEntryNum_ = entryNum;
+    while(!synData->cacheList_.empty() && ((int32_t)synData->cacheList_.size() > entryNum))
+    {
+        synData->cacheIndex_.erase(synData->cacheList_.back().first);
+        synData->cacheList_.pop_back();
+    }
+}
+
+void SynthesizerTrn::setStreamParams(int32_t chunkFrames, int32_t contextFrames)
+{
+    SYN_DATA_t * synData = (SYN_DATA_t *)priv_;
+    synData->session_->setStreamParams(chunkFrames, contextFrames);
 }
 
 SynthesizerTrn::~SynthesizerTrn()
 {
     SYN_DATA_t * synData = (SYN_DATA_t *)priv_;
+    delete synData->session_;
     delete synData->textEncoder_;
     delete synData->durPredicator_;
     delete synData->flow_;
@@ -25,8 +25,6 @@ TextEncoder::TextEncoder(float * modelData, int32_t & offset)
         tts_log(TTS_LOG_ERROR, "Text Encoder: Failed to allocate memory for internal data block\n");
         return;
     }
-    memset(textEncoderData, 0, sizeof(TEXT_ENCODER_DATA_t));
-    
     int32_t curOffset = offset;
 
     textEncoderData->hiddenChannels_ = (int32_t)modelData[curOffset++];
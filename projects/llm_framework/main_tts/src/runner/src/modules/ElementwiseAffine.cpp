@@ -20,8 +20,6 @@ ElementwiseAffine::ElementwiseAffine(float * modelData, int32_t & offset, int32_
         return;
     }
     
-    memset(elementAffineData,0,sizeof(ELEMENT_AFFINE_DATA_t));
-    
     elementAffineData->channels_ = channels;
 
     int32_t curOffset = offset;
@@ -2,6 +2,7 @@
 #include "nn_conv1d.h"
 #include "tts_logger.h"
 #include "nn_leaky_relu.h"
+#include "tts_workspace.h"
 
 typedef struct
 {
@@ -49,23 +50,34 @@ ResBlock1::~ResBlock1()
         delete resBlockData->convs1_[i];
         delete resBlockData->convs2_[i];
     }
+    free(resBlockData->convs1_);
+    free(resBlockData->convs2_);
     delete resBlockData;
 }
 
 MatrixXf ResBlock1::forward(const MatrixXf & x)
+{
+    MatrixXf xx(x.rows(), x.cols());
+    forward(x, xx);
+    return xx;
+}
+
+void ResBlock1::forward(const Eigen::Ref<const MatrixXf> & x, Eigen::Ref<MatrixXf> xx)
 {
     RESBLOCK1_DATA_t * resBlockData =  (RESBLOCK1_DATA_t *)priv_;
 
-    MatrixXf xx = x;
+    tts_workspace_mat xtBuf(x.rows(), x.cols());
+    tts_workspace_mat xt2Buf(x.rows(), x.cols());
+    Map<MatrixXf> & xt = xtBuf.mat();
+    Map<MatrixXf> & xt2 = xt2Buf.mat();
+
+    xx = x;
     for(int32_t i = 0; i<resBlockData->blockNums_; i++)
     {
-        MatrixXf xt = nn_leaky_relu(xx,0.1);
-        xt = resBlockData->convs1_[i]->forward(xt);
-        xt = nn_leaky_relu(xt,0.1);
-        xt = resBlockData->convs2_[i]->forward(xt);
-        xx = xt + xx;
+        nn_leaky_relu(xx, xt, 0.1);
+        resBlockData->convs1_[i]->forward(xt, xt2);
+        nn_leaky_relu(xt2, xt2, 0.1);
+        resBlockData->convs2_[i]->forward(xt2, xt);
+        xx += xt;
     }
-    return xx;
 }
-
-
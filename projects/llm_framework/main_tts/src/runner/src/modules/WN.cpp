@@ -1,8 +1,12 @@
 #include "WN.h"
 #include "tts_logger.h"
 #include "nn_conv1d.h"
-#include "nn_sigmoid.h"
 #include "nn_tanh.h"
+#include "tts_thread_pool.h"
+#include "tts_workspace.h"
+
+// time steps per parallel chunk of the gated activation
+#define WN_ACT_GRAIN (64)
 
 typedef struct
 {
@@ -86,13 +90,21 @@ MatrixXf fused_add_tanh_sigmoid_multiply(const MatrixXf & input_a, const MatrixX
 {
     MatrixXf in_act = input_a.rowwise() + input_b.row(0);
 
-    MatrixXf in_act_1 = in_act.block(0,0,in_act.rows(),n_channels);
-    MatrixXf in_act_2 = in_act.block(0,n_channels,in_act.rows(),in_act.cols() - n_channels);
-
-    MatrixXf t_act = nn_tanh(in_act_1);
-    MatrixXf s_act = nn_sigmoid(in_act_2);
-
-    MatrixXf acts = t_act.array()*s_act.array();
+    MatrixXf acts(in_act.rows(), n_channels);
+    tts_parallel_for(in_act.rows(), WN_ACT_GRAIN, [&](int32_t begin, int32_t end)
+    {
+        // per-chunk scratch from the workspace of the thread running the chunk
+        tts_workspace_mat tBuf(end-begin, n_channels);
+        tts_workspace_mat sBuf(end-begin, in_act.cols() - n_channels);
+        Map<MatrixXf> & t_act = tBuf.mat();
+        Map<MatrixXf> & s_act = sBuf.mat();
+
+        t_act = in_act.block(begin,0,end-begin,n_channels);
+        nn_tanh(t_act, t_act);
+        s_act = 1.0/(1.0 + (-in_act.block(begin,n_channels,end-begin,in_act.cols() - n_channels)).array().exp());
+
+        acts.middleRows(begin, end-begin) = t_act.array()*s_act.array();
+    });
 
     return acts;
 }
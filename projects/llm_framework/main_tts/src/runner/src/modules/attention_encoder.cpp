@@ -72,6 +72,9 @@ attention_encoder::~attention_encoder()
     }
 
     free((void *)attenEncoderData->multiHeadAttnList);
+    free((void *)attenEncoderData->layerNormList1_);
+    free((void *)attenEncoderData->ffnList_);
+    free((void *)attenEncoderData->layerNormList2_);
     delete attenEncoderData;
 }
 
@@ -1,13 +1,15 @@
 #include "iStft.h"
-#include <unsupported/Eigen/FFT>
 #include "stdio.h"
-#include <complex> 
-#include <iostream>
+#include <math.h>
+#include "tts_thread_pool.h"
+#include "tts_workspace.h"
 
 #define eps (1e-14)
 
+// frames per parallel chunk of the inverse transform
+#define ISTFT_FRAME_GRAIN (64)
+
 using Eigen::Map;
-using Eigen::MatrixXcf;
 
 extern float hann_w[];
 extern float hann_w_pow[];
@@ -17,7 +19,14 @@ typedef struct
     int32_t filterLen_;
     int32_t hopLen_;
     int32_t winLen_;
+    int32_t binNum_;
+
+    // windowed inverse real DFT, [mag*cos(phase), mag*sin(phase)] x basis gives the frames as rows
+    MatrixXf basis_;
+    // 1/window sum of a sample covered by filterLen_/hopLen_ frames, periodic in hopLen_
+    MatrixXf invWsumFull_;
 
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 }ISFT_DATA_t;
 
 iStft::iStft(int32_t filterLen, int32_t hopLen, int32_t winLen)
@@ -27,13 +36,41 @@ iStft::iStft(int32_t filterLen, int32_t hopLen, int32_t winLen)
     {
         return;
     }
-    
-    memset(istftData,0,sizeof(ISFT_DATA_t));
 
     istftData->filterLen_ = filterLen;
     istftData->hopLen_ = hopLen;
     istftData->winLen_ = winLen;
-    
+    istftData->binNum_ = filterLen/2 + 1;
+
+    /*
+     * x[n] = (Re X0 + (-1)^n Re X(N/2) + 2 sum_k (Re Xk cos(2 pi k n/N) - Im Xk sin(2 pi k n/N)))/N, the same as
+     * the inverse FFT of the mirrored spectrum. The imaginary parts of the DC and Nyquist bins do not reach
+     * the real output, exactly as in the FFT path.
+     */
+    int32_t binNum = istftData->binNum_;
+    istftData->basis_ = MatrixXf::Zero(2*binNum, filterLen);
+    for(int32_t k = 0; k<binNum; k++)
+    {
+        double scale = ((k == 0) || (2*k == filterLen)) ? 1.0 : 2.0;
+        for(int32_t n = 0; n<filterLen; n++)
+        {
+            double angle = 2.0*M_PI*(double)(((int64_t)k*n) % filterLen)/filterLen;
+            istftData->basis_(k, n) = (float)(scale*cos(angle)/filterLen*hann_w[n]);
+            istftData->basis_(binNum + k, n) = (float)(-scale*sin(angle)/filterLen*hann_w[n]);
+        }
+    }
+
+    istftData->invWsumFull_ = MatrixXf::Zero(1, hopLen);
+    for(int32_t r = 0; r<hopLen; r++)
+    {
+        float wsum = 0;
+        for(int32_t n = r; n<filterLen; n += hopLen)
+        {
+            wsum += hann_w_pow[n];
+        }
+        istftData->invWsumFull_(0, r) = (wsum > eps) ? 1.0f/wsum : 1.0f;
+    }
+
     priv_ = (void *) istftData;
 }
 
@@ -48,79 +85,60 @@ MatrixXf iStft::forward(const MatrixXf & mag, const MatrixXf & phase)
     ISFT_DATA_t * istftData = (ISFT_DATA_t *)priv_;
 
     int32_t frames = mag.rows();
-    int32_t oneSizeLen = mag.cols();
-
-    MatrixXf ret = MatrixXf::Zero(1,(frames-1)*istftData->hopLen_+istftData->filterLen_);
-    MatrixXf wsum = MatrixXf::Zero(1,(frames-1)*istftData->hopLen_+istftData->filterLen_);
-
-    Eigen::FFT<float> fft;
-    
-    MatrixXf hann_mat = Map<MatrixXf>(hann_w,1,istftData->filterLen_);
-    MatrixXf hann_pow_mat = Map<MatrixXf>(hann_w_pow,1,istftData->filterLen_);
-
-    for(int32_t frameIdx = 0; frameIdx< (frames); frameIdx ++)
+    int32_t binNum = istftData->binNum_;
+    int32_t filterLen = istftData->filterLen_;
+    int32_t hopLen = istftData->hopLen_;
+    int32_t fullLen = (frames-1)*hopLen + filterLen;
+
+    // polar to rectangular for all frames at once
+    tts_workspace_mat specBuf(frames, 2*binNum);
+    Map<MatrixXf> & spec = specBuf.mat();
+    spec.leftCols(binNum) = mag.leftCols(binNum).array()*phase.leftCols(binNum).array().cos();
+    spec.rightCols(binNum) = mag.leftCols(binNum).array()*phase.leftCols(binNum).array().sin();
+
+    // windowed inverse transform of every frame, one row per frame
+    tts_workspace_mat framesBuf(frames, filterLen);
+    Map<MatrixXf> & framesMat = framesBuf.mat();
+    tts_parallel_for(frames, ISTFT_FRAME_GRAIN, [&](int32_t begin, int32_t end)
     {
-        MatrixXcf frameC = MatrixXcf::Zero(1,istftData->filterLen_) ;
-
-        for(int32_t i = 0; i< oneSizeLen; i++)
-        {
-            frameC.imag()(0,i) = phase(frameIdx,i);
-        }
+        framesMat.middleRows(begin, end-begin).noalias() = spec.middleRows(begin, end-begin)*istftData->basis_;
+    });
 
-        frameC = frameC.array().exp();
+    // overlap-add, one strided pass per window tap
+    MatrixXf ret = MatrixXf::Zero(1, fullLen);
+    for(int32_t n = 0; n<filterLen; n++)
+    {
+        Map<Eigen::RowVectorXf, 0, Eigen::InnerStride<> > dst(ret.data() + n, frames, Eigen::InnerStride<>(hopLen));
+        dst += framesMat.col(n).transpose();
+    }
 
-        for(int32_t i = 0; i< oneSizeLen; i++)
+    // window sum normalization, precomputed where a sample is covered by every overlapping frame
+    int32_t fullBegin = filterLen - hopLen;
+    int32_t fullEnd = (frames-1)*hopLen + hopLen;
+    for(int32_t i = 0; i<fullLen; i++)
+    {
+        if((i >= fullBegin) && (i < fullEnd))
         {
-            frameC(0,i) = frameC(0,i)*mag(frameIdx,i);
+            ret(0,i) *= istftData->invWsumFull_(0, i % hopLen);
+            continue;
         }
 
-        int32_t s = 1;
-        for(int32_t i = oneSizeLen; i < istftData->filterLen_; i++)
+        float wsum = 0;
+        for(int32_t n = i % hopLen; n<filterLen; n += hopLen)
         {
-            int32_t symIdx = i-(s++)*2;
-            frameC.real()(0,i) = frameC.real()(0,symIdx);
-            frameC.imag()(0,i) = frameC.imag()(0,symIdx)*(-1.0);
+            int32_t frameIdx = (i - n)/hopLen;
+            if((i >= n) && (frameIdx < frames))
+            {
+                wsum += hann_w_pow[n];
+            }
         }
-        
-        std::vector<std::complex<float> > freqvec;
-        
-        for(int32_t i = 0; i<istftData->filterLen_; i++)
+        if(wsum > eps)
         {
-            std::complex<float> f(frameC.real()(0,i),frameC.imag()(0,i));
-            freqvec.push_back(f);
+            ret(0,i) = ret(0,i)/wsum;
         }
-
-        std::vector<float> timevec;
-        fft.inv(timevec,freqvec);
-
-        MatrixXf frameMat(1,istftData->filterLen_);
-
-        for(int32_t i = 0; i<istftData->filterLen_; i++)
-        {
-            frameMat(0,i) = timevec[i];            
-        }
-
-        frameMat = frameMat.array() * hann_mat.array();
-        
-        wsum.block(0,frameIdx*istftData->hopLen_,1,istftData->filterLen_) = 
-        wsum.block(0,frameIdx*istftData->hopLen_,1,istftData->filterLen_).array() + hann_pow_mat.array();
-
-        ret.block(0,frameIdx*istftData->hopLen_,1,istftData->filterLen_) = 
-        ret.block(0,frameIdx*istftData->hopLen_,1,istftData->filterLen_) + frameMat;
-
     }
 
-    for(int32_t i = 0; i<wsum.cols(); i++)
-    {
-        if(wsum(0,i) > eps)
-        {
-            ret(0,i) = ret(0,i)/wsum(0,i);
-        }
-    }
-    
-    MatrixXf retCentered = ret.block(0,(int32_t)(istftData->filterLen_/2),1,(frames-1)*istftData->hopLen_);
+    MatrixXf retCentered = ret.block(0,(int32_t)(filterLen/2),1,(frames-1)*hopLen);
 
     return retCentered;
 }
-
-
@@ -2,6 +2,7 @@
 #include "tts_logger.h"
 #include "nn_conv1d.h"
 #include "nn_softmax.h"
+#include "tts_thread_pool.h"
 #include <vector>
 
 using Eigen::Map;
@@ -33,8 +34,6 @@ multi_head_attention::multi_head_attention(float * modelData, int32_t & offset)
         return;
     }
 
-    memset(multiAttnData,0,sizeof(MODULE_MULTI_HEAD_ATTN_DATA_t));
-    
     int32_t curOffset = offset;
 
     multiAttnData->channels_ = (int32_t)modelData[curOffset++];
@@ -134,12 +133,8 @@ MatrixXf multi_head_attention::get_relative_embeddings(const MatrixXf & relative
 {
     MODULE_MULTI_HEAD_ATTN_DATA_t * multiAttnData = (MODULE_MULTI_HEAD_ATTN_DATA_t* )priv_;
 
-    int32_t maxRelativePosition = 2 * multiAttnData->winSize_ + 1;
     int32_t padLength = max(length - (multiAttnData->winSize_ + 1), 0);
 
-    int32_t sliceStartPosition = max((multiAttnData->winSize_ + 1) - length, 0);
-    int32_t sliceEndPosition = sliceStartPosition + 2 * length - 1;
-
     MatrixXf paddedRelativeEmbeddings = relativeEmbeddings;
     if (padLength > 0)
     {
@@ -205,8 +200,6 @@ MatrixXf multi_head_attention::attention(const MatrixXf & query, const MatrixXf
     MatrixXf keyT = key.transpose();
     MatrixXf valueT = value.transpose();
 
-    int32_t b = 1;
-
     int32_t d = keyT.rows();
     int32_t t_s = keyT.cols();
     
@@ -232,21 +225,27 @@ MatrixXf multi_head_attention::attention(const MatrixXf & query, const MatrixXf
         kMatVec.push_back(keyT.block(i*keyRowSplit,0,keyRowSplit,keyT.cols()));
     }
     
-    std::vector<MatrixXf> scoreMatVec;
-    for(int32_t i = 0; i<multiAttnData->nHeads_; i++)
+    std::vector<MatrixXf> scoreMatVec(multiAttnData->nHeads_);
+    tts_parallel_for(multiAttnData->nHeads_, 1, [&](int32_t begin, int32_t end)
     {
-        scoreMatVec.push_back(qMatVec[i] * kMatVec[i]);
-    }
+        for(int32_t i = begin; i<end; i++)
+        {
+            scoreMatVec[i] = qMatVec[i] * kMatVec[i];
+        }
+    });
    
     if(multiAttnData->winSize_ > 0)
     {
         MatrixXf keyRelativeEmbeddings = get_relative_embeddings(multiAttnData->embRelK_,t_s);
 
-        std::vector<MatrixXf> relLogitsVec;
-        for(int32_t i = 0; i<multiAttnData->nHeads_; i++)
+        std::vector<MatrixXf> relLogitsVec(multiAttnData->nHeads_);
+        tts_parallel_for(multiAttnData->nHeads_, 1, [&](int32_t begin, int32_t end)
         {
-            relLogitsVec.push_back(qMatVec[i]*keyRelativeEmbeddings.transpose());
-        }
+            for(int32_t i = begin; i<end; i++)
+            {
+                relLogitsVec[i] = qMatVec[i]*keyRelativeEmbeddings.transpose();
+            }
+        });
 
         std::vector<MatrixXf> scores_local = relative_position_to_absolute_position(relLogitsVec); 
    
@@ -256,20 +255,20 @@ MatrixXf multi_head_attention::attention(const MatrixXf & query, const MatrixXf
         }
     }
 
-    std::vector<MatrixXf> p_attnVec;
-    for(int32_t i =0; i<multiAttnData->nHeads_; i++)
+    std::vector<MatrixXf> p_attnVec(multiAttnData->nHeads_);
+    std::vector<MatrixXf> outputVec(multiAttnData->nHeads_);
+    tts_parallel_for(multiAttnData->nHeads_, 1, [&](int32_t begin, int32_t end)
     {
-        p_attnVec.push_back(nn_softmax(scoreMatVec[i],0));
-    }
-    
-    std::vector<MatrixXf> outputVec;
-    for(int32_t i =0; i<multiAttnData->nHeads_; i++)
-    {
-        MatrixXf valueBlock = value.block(0,i*(int)(value.cols()/multiAttnData->nHeads_),
-                                          value.rows(),(int)(value.cols()/multiAttnData->nHeads_));
-                                          
-        outputVec.push_back(p_attnVec[i]*valueBlock);
-    }
+        for(int32_t i = begin; i<end; i++)
+        {
+            p_attnVec[i] = nn_softmax(scoreMatVec[i],0);
+
+            MatrixXf valueBlock = value.block(0,i*(int)(value.cols()/multiAttnData->nHeads_),
+                                              value.rows(),(int)(value.cols()/multiAttnData->nHeads_));
+
+            outputVec[i] = p_attnVec[i]*valueBlock;
+        }
+    });
 
     if(multiAttnData->winSize_ > 0)
     {
@@ -1,6 +1,5 @@
 #include "pqmf.h"
 #include "nn_conv1d.h"
-#include "nn_conv1d_transposed.h"
 #include "tts_logger.h"
 
 using Eigen::Map;
@@ -24,14 +23,19 @@ float h_filter[] = {
  5.05711124e-05,  2.68017852e-05,  8.36595339e-06
  };
 
+/*
+ * Synthesis is upsampling by zero insertion followed by the 63 tap filter bank. Only every subBands-th
+ * upsampled sample is non-zero, so both steps fold into one conv over the sub-band signals with one output
+ * channel per phase: output sample t*subBands + r is column r of row t.
+ */
+#define PQMF_TAPS (62)
+
 typedef struct
 {
     int32_t subBands_;
     MatrixXf h_synthesis_;
-    MatrixXf updown_filter_;
 
-    nn_conv1d_transposed * upDownConv_;
-    nn_conv1d * conv1d_;
+    nn_conv1d * polyConv_;
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 }PQMF_DATA_t;
@@ -52,7 +56,7 @@ pqmf::pqmf(int32_t subBands)
 
     MatrixXf h_proto = Map<MatrixXf>(h_filter, 1,filterLen);
 
-    int32_t taps = 62;
+    int32_t taps = PQMF_TAPS;
 
     MatrixXf tapsMat = MatrixXf::Zero(taps+1,1);
     for(int32_t itap = 0; itap <(taps+1); itap++)
@@ -74,29 +78,33 @@ pqmf::pqmf(int32_t subBands)
         h_syntmp.row(idx) = h_proto.array()*2*tmp2.array();
     }
 
-    pqmfData->h_synthesis_ = h_syntmp.reshaped(filterLen*subBands,1);
-
-    pqmfData->updown_filter_ = MatrixXf::Zero(subBands,subBands*subBands);
+    pqmfData->h_synthesis_ = h_syntmp;
 
-    for(int32_t i = 0; i< subBands; i++)
+    /*
+     * Phase r of the output at sub-band step t takes input step t + k - pad through filter tap
+     * subBands*(k - pad) - r + taps/2, scaled by the upsampling gain subBands.
+     */
+    int32_t pad = (taps/2 + subBands - 1)/subBands;
+    int32_t kSize = 2*pad + 1;
+    MatrixXf polyW = MatrixXf::Zero(kSize*subBands, subBands);
+    for(int32_t k = 0; k<kSize; k++)
     {
-        pqmfData->updown_filter_(i,i*4) = subBands;    
+        for(int32_t r = 0; r<subBands; r++)
+        {
+            int32_t j = subBands*(k - pad) - r + taps/2;
+            if((j < 0) || (j >= filterLen))
+            {
+                continue;
+            }
+            for(int32_t ch = 0; ch<subBands; ch++)
+            {
+                polyW(k*subBands + ch, r) = subBands*h_syntmp(ch, j);
+            }
+        }
     }
 
     MatrixXf biasDummy;
-    pqmfData->upDownConv_ = new nn_conv1d_transposed(subBands,
-                                                          subBands,
-                                                          subBands,
-                                                          0,
-                                                          1,
-                                                          0,
-                                                          subBands,
-                                                          pqmfData->updown_filter_,
-                                                          biasDummy);
-
-    MatrixXf biasDummy2;
-    MatrixXf h_synthesis_t = pqmfData->h_synthesis_;
-    pqmfData->conv1d_ = new nn_conv1d(subBands,1,filterLen,0,1,0,h_synthesis_t ,biasDummy2);
+    pqmfData->polyConv_ = new nn_conv1d(subBands, subBands, kSize, pad, 1, 0, polyW, biasDummy);
     priv_ = (void *)pqmfData;
 
 }
@@ -105,18 +113,16 @@ MatrixXf pqmf::forward(const MatrixXf & inputMat)
 {
     PQMF_DATA_t * pqmfData = (PQMF_DATA_t*)priv_;
 
-    MatrixXf xx = pqmfData->upDownConv_->forward(inputMat);
+    MatrixXf phases(inputMat.rows(), pqmfData->subBands_);
+    pqmfData->polyConv_->forward(inputMat, phases);
 
-    MatrixXf xx_pad = MatrixXf::Zero(xx.rows()+2*31,xx.cols());
-    xx_pad.block(31,0,xx.rows(),xx.cols()) = xx;
-
-    xx = pqmfData->conv1d_->forward(xx_pad);
+    MatrixXf xx = phases.transpose().reshaped(phases.size(), 1);
     return xx;
 }
 
 pqmf::~pqmf()
 {
     PQMF_DATA_t * pqmfData = (PQMF_DATA_t*)priv_;
+    delete pqmfData->polyConv_;
     delete pqmfData;
 }
-
@@ -6,10 +6,10 @@ using namespace Eigen;
 
 MatrixXf rand_gen(int32_t row, int32_t col, float mean, float std)
 {
-    static default_random_engine e(time(0));
-    static normal_distribution<float> n(mean,std);
+    static thread_local default_random_engine e(time(0));
+    static thread_local normal_distribution<float> n(mean,std);
 
-    MatrixXf m = MatrixXf::Zero(row,col).unaryExpr([](float dummy){return n(e);});
+    MatrixXf m = MatrixXf::Zero(row,col).unaryExpr([](float){return n(e);});
     return m;
 }
 
@@ -1,8 +1,18 @@
 #include "nn_conv1d.h"
 #include "tts_logger.h"
+#include "tts_thread_pool.h"
+#include "tts_workspace.h"
+
+// output rows per parallel chunk, fixed so results do not depend on the thread count
+#define CONV1D_ROW_GRAIN (64)
+// rows per chunk of fp16/int8 layers, larger so every dequantized weight tile serves more rows
+#define CONV1D_QUANT_ROW_GRAIN (256)
 
 using Eigen::Map;
 
+// tap k of the weights as an inCh x outCh column-major fp32 view
+typedef Map<const MatrixXf, 0, Eigen::OuterStride<> > CONV1D_TAP_t;
+
 typedef struct
 {
     int32_t outCh_;
@@ -13,19 +23,80 @@ typedef struct
     int32_t hasBias_;
     int32_t sep_;
 
-    MatrixXf w_;
-    MatrixXf b_;
+    // weights as stored in the model blob, which stays mapped read-only and is read in place
+    NN_WEIGHTS_t weights_;
+    const float * b_;
+    // output channels per dequantized tile of fp16/int8 weights, see forward()
+    int32_t tileCols_;
+    // storage for layers built from matrices
+    MatrixXf wOwned_;
+    MatrixXf bOwned_;
     
     int32_t print_;
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 }NN_CONV1D_DATA_t;
 
+/*
+ * Output rows [r0, r0+n) of tap k inside [begin, end) for which input row i + k*dilation - padding is inside
+ * the input. Rows outside read the implicit zero padding and are skipped.
+ */
+static inline void conv1d_tap_range(int32_t k, int32_t dilation, int32_t padding, int32_t inLen,
+                                    int32_t begin, int32_t end, int32_t & r0, int32_t & n, int32_t & shift)
+{
+    shift = k*dilation - padding;
+    r0 = shift < 0 ? -shift : 0;
+    if(r0 < begin)
+    {
+        r0 = begin;
+    }
+    int32_t r1 = inLen - shift;
+    if(r1 > end)
+    {
+        r1 = end;
+    }
+    n = r1 - r0;
+}
+
+/*
+ * fp32 weights are used where they are, in either order (see nn_quant.h); the per-tap GEMM packs its operand
+ * itself, so a strided tap costs no more than a contiguous one. fp16/int8 weights stay in the stored format
+ * and are dequantized a column tile at a time in forward(). Depthwise (sep) layers have inCh 1, their tap k
+ * is the row of per-channel weights.
+ */
+static void conv1d_bind_weights(NN_CONV1D_DATA_t * nn1dConvData)
+{
+    nn1dConvData->tileCols_ = nn_weights_tile_cols(nn1dConvData->outCh_, nn1dConvData->inCh_);
+}
+
+// out += in * wTap for one tap, in holds the inCh input columns (the outCh channels of a sep layer)
+template<typename In, typename W, typename Out>
+static inline void conv1d_tap_product(int32_t sep, const In & in, const W & wTap, Out out)
+{
+    if(sep != 0)
+    {
+        out.array() += in.array().rowwise() * wTap.row(0).array();
+    }
+    else
+    {
+        out.noalias() += in * wTap;
+    }
+}
+
+static inline CONV1D_TAP_t conv1d_tap(const NN_CONV1D_DATA_t * nn1dConvData, int32_t k)
+{
+    int64_t offset;
+    int32_t outerStride;
+    nn_weights_tap_layout(nn1dConvData->weights_, nn1dConvData->outCh_, nn1dConvData->kSize_,
+                          nn1dConvData->inCh_, k, offset, outerStride);
+    return CONV1D_TAP_t(nn1dConvData->weights_.f32_ + offset, nn1dConvData->inCh_, nn1dConvData->outCh_,
+                        Eigen::OuterStride<>(outerStride));
+}
 
 int32_t parse_conv1d_parameter(float * modelData, int32_t & offset,
                                int32_t & inCh, int32_t & outCh, int32_t & kSize,
                                int32_t & padding, int32_t & dilation, int32_t & hasBias,
-                               MatrixXf & weight, MatrixXf & bias)
+                               NN_WEIGHTS_t & weights, const float *& bias)
 {
     int32_t curOffset = offset;
 
@@ -34,14 +105,19 @@ int32_t parse_conv1d_parameter(float * modelData, int32_t & offset,
     kSize = (int32_t)modelData[curOffset++];
     padding = (int32_t)modelData[curOffset++];
     dilation = (int32_t)modelData[curOffset++];
-    hasBias = (int32_t)modelData[curOffset++];
+    const float * flags = modelData+curOffset;
+    int32_t weightType, weightOrder;
+    nn_weights_decode_flags((int32_t)modelData[curOffset++], hasBias, weightType, weightOrder);
 
-    weight = Map<MatrixXf>(modelData+curOffset, inCh * kSize,outCh);
-    curOffset = curOffset + inCh * kSize * outCh;
+    int32_t weightNum = inCh * kSize * outCh;
+    nn_weights_bind(modelData+curOffset, weightType, weightOrder, outCh, weights);
+    nn_weights_notify(flags, modelData+curOffset, outCh, kSize, inCh);
+    curOffset = curOffset + nn_weights_size(weightType, weightNum, outCh);
 
+    bias = NULL;
     if(1 == hasBias)
     {
-        bias = Map<MatrixXf>(modelData+curOffset,1, outCh);
+        bias = modelData+curOffset;
         curOffset = curOffset + 1*outCh;
     }
 
@@ -63,11 +139,12 @@ nn_conv1d::nn_conv1d(float * modelData, int32_t & offset, int32_t padding, int32
     parse_conv1d_parameter(modelData, curOffset, nn1dConvData->inCh_, nn1dConvData->outCh_,
                                       nn1dConvData->kSize_, nn1dConvData->padding_,
                                       nn1dConvData->dilation_, nn1dConvData->hasBias_,
-                                      nn1dConvData->w_, nn1dConvData->b_);
+                                      nn1dConvData->weights_, nn1dConvData->b_);
 
     nn1dConvData->padding_ = padding;
     nn1dConvData->dilation_ = dilation;
     nn1dConvData->sep_ = sep;
+    conv1d_bind_weights(nn1dConvData);
 
     offset = curOffset;
     priv_ = (void*)nn1dConvData;
@@ -85,8 +162,9 @@ nn_conv1d::nn_conv1d(float * modelData, int32_t & offset)
     parse_conv1d_parameter(modelData, curOffset, nn1dConvData->inCh_, nn1dConvData->outCh_,
                                       nn1dConvData->kSize_, nn1dConvData->padding_,
                                       nn1dConvData->dilation_, nn1dConvData->hasBias_,
-                                      nn1dConvData->w_, nn1dConvData->b_);
+                                      nn1dConvData->weights_, nn1dConvData->b_);
     nn1dConvData->sep_ = 0;
+    conv1d_bind_weights(nn1dConvData);
 
     offset = curOffset;
     priv_ = (void*)nn1dConvData;
@@ -108,94 +186,87 @@ nn_conv1d::nn_conv1d(int32_t inCh, int32_t outCh, int32_t kSize,
     nn1dConvData->padding_ = padding;
     nn1dConvData->dilation_ = dilation;
     nn1dConvData->hasBias_ = hasBias;
-    nn1dConvData->w_ = weight;
-    nn1dConvData->b_ = bias;
+    nn1dConvData->wOwned_ = weight;
+    nn1dConvData->bOwned_ = bias;
+    nn_weights_bind(nn1dConvData->wOwned_.data(), NN_WEIGHT_FP32, NN_WEIGHT_ORDER_ROW, outCh,
+                    nn1dConvData->weights_);
+    nn1dConvData->b_ = nn1dConvData->bOwned_.data();
+    nn1dConvData->sep_ = 0;
+    conv1d_bind_weights(nn1dConvData);
 
     priv_ = (void*)nn1dConvData;
 
 }
 
+int32_t nn_conv1d::get_out_len(int32_t inLen)
+{
+    NN_CONV1D_DATA_t * nn1dConvData = (NN_CONV1D_DATA_t *)priv_;
+    int32_t outLen = inLen + 2*nn1dConvData->padding_ - nn1dConvData->dilation_*(nn1dConvData->kSize_ -1);
+    return outLen > 0 ? outLen : 0;
+}
+
 MatrixXf nn_conv1d::forward(MatrixXf inputMat)
 {
     NN_CONV1D_DATA_t * nn1dConvData = (NN_CONV1D_DATA_t *)priv_;
 
-    MatrixXf paddingMat = MatrixXf::Zero(inputMat.rows()+2*nn1dConvData->padding_,inputMat.cols());
-    
-    if(nn1dConvData->padding_ == 0)
-    {
-        paddingMat = inputMat;
-    }
-    else
-    {
-        paddingMat.block(nn1dConvData->padding_,0,inputMat.rows(),inputMat.cols()) = inputMat;
-    }
+    MatrixXf result(get_out_len(inputMat.rows()), nn1dConvData->outCh_);
+    forward(inputMat, result);
+    return result;
+}
 
-    int32_t dilatedKSize = nn1dConvData->w_.rows();
-    if(nn1dConvData->dilation_ !=1)
-    {
-        dilatedKSize = nn1dConvData->inCh_*((nn1dConvData->kSize_-1)*(nn1dConvData->dilation_-1)+nn1dConvData->kSize_);
-    }
+void nn_conv1d::forward(const Eigen::Ref<const MatrixXf> & inputMat, Eigen::Ref<MatrixXf> result)
+{
+    NN_CONV1D_DATA_t * nn1dConvData = (NN_CONV1D_DATA_t *)priv_;
 
-    MatrixXf dilationMat = MatrixXf::Zero(dilatedKSize,nn1dConvData->w_.cols());
+    int32_t inLen = inputMat.rows();
+    int32_t inCh = nn1dConvData->inCh_;
+    int32_t outCh = nn1dConvData->outCh_;
+    int32_t outLen = get_out_len(inLen);
 
-    if(nn1dConvData->dilation_ == 1)
-    {
-        dilationMat = nn1dConvData->w_;
-    }
-    else
-    {
-        MatrixXf newKernel = MatrixXf::Zero(dilatedKSize,nn1dConvData->w_.cols());
-        for(int32_t i = 0; i<nn1dConvData->kSize_; i++)
-        {
-            newKernel.block(i*(nn1dConvData->dilation_)*nn1dConvData->inCh_,0
-                            ,nn1dConvData->inCh_,nn1dConvData->w_.cols()) = 
-            nn1dConvData->w_.block(i*nn1dConvData->inCh_,0,nn1dConvData->inCh_,nn1dConvData->w_.cols());
-        }
-        dilationMat = newKernel;
-    }
-    
-    int32_t outLen =  paddingMat.rows() - nn1dConvData->dilation_*(nn1dConvData->kSize_ -1);
+    int32_t sep = nn1dConvData->sep_;
+    int32_t tapCh = sep != 0 ? outCh : inCh;
+    bool quantized = (NN_WEIGHT_FP32 != nn1dConvData->weights_.type_);
+    int32_t tileCols = quantized ? nn1dConvData->tileCols_ : 0;
 
-    MatrixXf result = MatrixXf::Zero(outLen,nn1dConvData->outCh_);
-    
-    int32_t newKSize = nn1dConvData->kSize_;
-    if(nn1dConvData->dilation_ != 1)
+    int32_t grain = quantized ? CONV1D_QUANT_ROW_GRAIN : CONV1D_ROW_GRAIN;
+    tts_parallel_for(outLen, grain, [&](int32_t begin, int32_t end)
     {
-        newKSize = (nn1dConvData->kSize_-1)*(nn1dConvData->dilation_-1)+nn1dConvData->kSize_;
-    }
-    
-    if(nn1dConvData->sep_ != 0)
-    {
-        for(int32_t i = 0; i<outLen; i++)
+        result.middleRows(begin, end-begin).setZero();
+        // fp16/int8 weights are dequantized one column tile at a time, each tile serves every row of the chunk
+        tts_workspace_mat tileBuf(inCh, tileCols);
+
+        int32_t r0, n, shift;
+        for(int32_t k = 0; k<nn1dConvData->kSize_; k++)
         {
-        
-            MatrixXf InputBlock = paddingMat.block(i,0,newKSize,nn1dConvData->outCh_).transpose();
-            for(int32_t j = 0; j < nn1dConvData->outCh_; j++)
+            conv1d_tap_range(k, nn1dConvData->dilation_, nn1dConvData->padding_, inLen, begin, end, r0, n, shift);
+            if(n <= 0)
             {
-                result(i,j) = InputBlock.row(j)*dilationMat.col(j);
+                continue;
             }
-        }
 
-    }
-    else
-    {
-        MatrixXf inputMatForCalc = MatrixXf::Zero(outLen,newKSize*nn1dConvData->inCh_);
+            if(!quantized)
+            {
+                conv1d_tap_product(sep, inputMat.block(r0+shift,0,n,tapCh), conv1d_tap(nn1dConvData, k),
+                                   result.block(r0,0,n,outCh));
+                continue;
+            }
 
-        for(int32_t i = 0; i<outLen; i++)
-        {
-            inputMatForCalc.row(i) = paddingMat.block(i,0,newKSize,nn1dConvData->inCh_).reshaped<Eigen::RowMajor>().transpose();
+            for(int32_t o0 = 0; o0<outCh; o0 += tileCols)
+            {
+                int32_t nc = outCh - o0 < tileCols ? outCh - o0 : tileCols;
+                Map<MatrixXf> tile(tileBuf.mat().data(), inCh, nc);
+                nn_weights_expand_tile(nn1dConvData->weights_, outCh, nn1dConvData->kSize_, inCh, k, o0, nc,
+                                       tile.data());
+                conv1d_tap_product(sep, inputMat.block(r0+shift, sep != 0 ? o0 : 0, n, sep != 0 ? nc : inCh), tile,
+                                   result.block(r0,o0,n,nc));
+            }
         }
 
-        result = inputMatForCalc * dilationMat;
-        
-    }
-
-    if(1 == nn1dConvData->hasBias_)
-    {
-        result = result.rowwise() + nn1dConvData->b_.row(0);
-    }
-    
-    return result;
+        if(1 == nn1dConvData->hasBias_)
+        {
+            result.middleRows(begin, end-begin).rowwise() += Map<const Eigen::RowVectorXf>(nn1dConvData->b_, outCh);
+        }
+    });
 }
 
 void nn_conv1d::print_p()
@@ -1,5 +1,15 @@
 #include "nn_conv1d_transposed.h"
 #include "tts_logger.h"
+#include "tts_thread_pool.h"
+#include "tts_workspace.h"
+
+// input / output steps per parallel chunk, fixed so results do not depend on the thread count
+#define CONV1D_TRANSPOSED_GRAIN (64)
+// input steps per chunk of the tap GEMMs of fp16/int8 layers, larger so every dequantized weight tile serves more
+#define CONV1D_TRANSPOSED_QUANT_GRAIN (256)
+
+// tap k of the weights as an inCh x outCh column-major fp32 view
+typedef Map<const MatrixXf, 0, Eigen::OuterStride<> > CONV1D_TRANSPOSED_TAP_t;
 
 typedef struct
 {
@@ -12,20 +22,36 @@ typedef struct
     int32_t stride_;
     
 
-    MatrixXf w_;
-    MatrixXf b_;
+    // weights as stored in the model blob, which stays mapped read-only and is read in place
+    NN_WEIGHTS_t weights_;
+    const float * b_;
+    // output channels per dequantized tile of fp16/int8 weights
+    int32_t tileCols_;
+    // storage for layers built from matrices
+    MatrixXf wOwned_;
+    MatrixXf bOwned_;
     
     int32_t print_;
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 }NN_CONV1D_TRANSPOSED_DATA_t;
 
+/*
+ * The weights are inCh x (kSize*outCh), columns ordered channel-major (o*kSize + k) as exported or tap-major
+ * when converted, so tap k is a view into them either way (see nn_quant.h). fp32 weights are read in place,
+ * fp16/int8 weights are dequantized a column tile at a time in forward().
+ */
+static void conv1d_transposed_bind_weights(NN_CONV1D_TRANSPOSED_DATA_t * nn1dConvTransposedData)
+{
+    nn1dConvTransposedData->tileCols_ = nn_weights_tile_cols(nn1dConvTransposedData->outCh_,
+                                                             nn1dConvTransposedData->inCh_);
+}
 
 int32_t parse_conv1d_transposed_parameter(float * modelData, int32_t & offset,
                                           int32_t & inCh, int32_t & outCh, int32_t & kSize,
                                           int32_t & padding, int32_t & dilation, 
                                           int32_t & hasBias,int32_t & stride,
-                                          MatrixXf & weight, MatrixXf & bias)
+                                          NN_WEIGHTS_t & weights, const float *& bias)
 {
 
     int32_t curOffset = offset;
@@ -35,15 +61,20 @@ int32_t parse_conv1d_transposed_parameter(float * modelData, int32_t & offset,
     kSize = (int32_t)modelData[curOffset++];
     padding = (int32_t)modelData[curOffset++];
     dilation = (int32_t)modelData[curOffset++];
-    hasBias = (int32_t)modelData[curOffset++];
+    const float * flags = modelData+curOffset;
+    int32_t weightType, weightOrder;
+    nn_weights_decode_flags((int32_t)modelData[curOffset++], hasBias, weightType, weightOrder);
     stride = (int32_t)modelData[curOffset++];
 
-    weight = Map<MatrixXf>(modelData+curOffset, inCh, kSize*outCh);
-    curOffset = curOffset + inCh * kSize * outCh;
+    int32_t weightNum = inCh * kSize * outCh;
+    nn_weights_bind(modelData+curOffset, weightType, weightOrder, outCh, weights);
+    nn_weights_notify(flags, modelData+curOffset, outCh, kSize, inCh);
+    curOffset = curOffset + nn_weights_size(weightType, weightNum, outCh);
 
+    bias = NULL;
     if(1 == hasBias)
     {
-        bias = Map<MatrixXf>(modelData+curOffset,1, outCh);
+        bias = modelData+curOffset;
         curOffset = curOffset + 1*outCh;
     }
 
@@ -67,10 +98,11 @@ nn_conv1d_transposed::nn_conv1d_transposed(float * modelData, int32_t & offset,
                                       nn1dConvTransposedData->kSize_, nn1dConvTransposedData->padding_,
                                       nn1dConvTransposedData->dilation_, nn1dConvTransposedData->hasBias_,
                                       nn1dConvTransposedData->stride_,
-                                      nn1dConvTransposedData->w_, nn1dConvTransposedData->b_);
+                                      nn1dConvTransposedData->weights_, nn1dConvTransposedData->b_);
 
     nn1dConvTransposedData->stride_ = stride;
     nn1dConvTransposedData->padding_ = padding;
+    conv1d_transposed_bind_weights(nn1dConvTransposedData);
 
     offset = curOffset;
     priv_ = (void*)nn1dConvTransposedData;
@@ -96,57 +128,114 @@ nn_conv1d_transposed::nn_conv1d_transposed(int32_t inCh, int32_t outCh, int32_t
     nn1dConvTransposedData->dilation_ = dilation;
     nn1dConvTransposedData->hasBias_ = hasBias;
     nn1dConvTransposedData->stride_ = stride;
-    nn1dConvTransposedData->w_ = weight;
-    nn1dConvTransposedData->b_ = bias;
+    nn1dConvTransposedData->wOwned_ = weight;
+    nn1dConvTransposedData->bOwned_ = bias;
+    nn_weights_bind(nn1dConvTransposedData->wOwned_.data(), NN_WEIGHT_FP32, NN_WEIGHT_ORDER_ROW, outCh,
+                    nn1dConvTransposedData->weights_);
+    nn1dConvTransposedData->b_ = nn1dConvTransposedData->bOwned_.data();
+    conv1d_transposed_bind_weights(nn1dConvTransposedData);
 
     priv_ = (void*)nn1dConvTransposedData;
 
 }
 
-MatrixXf  nn_conv1d_transposed::forward(const MatrixXf & inputMat)
+int32_t nn_conv1d_transposed::get_out_len(int32_t inLen)
 {
     NN_CONV1D_TRANSPOSED_DATA_t * nn1dConvTransposedData = (NN_CONV1D_TRANSPOSED_DATA_t *)priv_;
-
-    int32_t inLen = inputMat.rows();
     int32_t outLen = (inLen-1)*nn1dConvTransposedData->stride_-
                      2*nn1dConvTransposedData->padding_+
                      nn1dConvTransposedData->dilation_*(nn1dConvTransposedData->kSize_-1)+1;
+    return outLen > 0 ? outLen : 0;
+}
 
-    MatrixXf result = MatrixXf::Zero(nn1dConvTransposedData->outCh_,outLen+2*(nn1dConvTransposedData->padding_)+nn1dConvTransposedData->kSize_);
-    MatrixXf w = nn1dConvTransposedData->w_; 
-
-    MatrixXf outMat = inputMat * w;
+MatrixXf  nn_conv1d_transposed::forward(const MatrixXf & inputMat)
+{
+    NN_CONV1D_TRANSPOSED_DATA_t * nn1dConvTransposedData = (NN_CONV1D_TRANSPOSED_DATA_t *)priv_;
 
-    int outIndex = 0;
-    for(int32_t i = 0; i<inLen; i++)
-    {
-        MatrixXf outRow = outMat.row(i).transpose();
+    MatrixXf result(get_out_len(inputMat.rows()), nn1dConvTransposedData->outCh_);
+    forward(inputMat, result);
+    return result;
+}
 
-        MatrixXf outRowReshaped = outRow.reshaped(nn1dConvTransposedData->kSize_,nn1dConvTransposedData->outCh_);
-        MatrixXf outRowT = outRowReshaped.transpose();
+void nn_conv1d_transposed::forward(const Eigen::Ref<const MatrixXf> & inputMat, Eigen::Ref<MatrixXf> result)
+{
+    NN_CONV1D_TRANSPOSED_DATA_t * nn1dConvTransposedData = (NN_CONV1D_TRANSPOSED_DATA_t *)priv_;
 
-        result.block(0,outIndex,nn1dConvTransposedData->outCh_,nn1dConvTransposedData->kSize_)
-        = result.block(0,outIndex,nn1dConvTransposedData->outCh_,nn1dConvTransposedData->kSize_) + outRowT;
+    int32_t inLen = inputMat.rows();
+    int32_t outCh = nn1dConvTransposedData->outCh_;
+    int32_t stride = nn1dConvTransposedData->stride_;
+    int32_t padding = nn1dConvTransposedData->padding_;
+    int32_t dilation = nn1dConvTransposedData->dilation_;
+    int32_t outLen = get_out_len(inLen);
+    if(outLen <= 0)
+    {
+        return;
+    }
 
-        outIndex = outIndex + nn1dConvTransposedData->stride_;
+    int32_t kSize = nn1dConvTransposedData->kSize_;
+    int32_t inCh = nn1dConvTransposedData->inCh_;
 
-        if((outIndex + (int32_t)(nn1dConvTransposedData->kSize_))>= result.cols())
+    // one GEMM per tap: column i holds the kSize*outCh contributions of input step i, rows ordered tap-major
+    tts_workspace_mat outMatBuf(kSize*outCh, inLen);
+    Map<MatrixXf> & outMat = outMatBuf.mat();
+    bool quantized = (NN_WEIGHT_FP32 != nn1dConvTransposedData->weights_.type_);
+    int32_t tileCols = quantized ? nn1dConvTransposedData->tileCols_ : 0;
+    tts_parallel_for(inLen, quantized ? CONV1D_TRANSPOSED_QUANT_GRAIN : CONV1D_TRANSPOSED_GRAIN,
+                     [&](int32_t begin, int32_t end)
+    {
+        // fp16/int8 weights are dequantized one column tile at a time, each tile serves every step of the chunk
+        tts_workspace_mat tileBuf(inCh, tileCols);
+        for(int32_t k = 0; k<kSize; k++)
         {
-            break;
+            if(quantized)
+            {
+                for(int32_t o0 = 0; o0<outCh; o0 += tileCols)
+                {
+                    int32_t nc = outCh - o0 < tileCols ? outCh - o0 : tileCols;
+                    Map<MatrixXf> tile(tileBuf.mat().data(), inCh, nc);
+                    nn_weights_expand_tile(nn1dConvTransposedData->weights_, outCh, kSize, inCh, k, o0, nc,
+                                           tile.data());
+                    outMat.block(k*outCh + o0, begin, nc, end-begin).noalias() =
+                        tile.transpose() * inputMat.middleRows(begin, end-begin).transpose();
+                }
+                continue;
+            }
+
+            int64_t tapOffset;
+            int32_t outerStride;
+            nn_weights_tap_layout(nn1dConvTransposedData->weights_, outCh, kSize, inCh, k, tapOffset, outerStride);
+            CONV1D_TRANSPOSED_TAP_t wTap(nn1dConvTransposedData->weights_.f32_ + tapOffset, inCh, outCh,
+                                         Eigen::OuterStride<>(outerStride));
+            outMat.block(k*outCh, begin, outCh, end-begin).noalias() =
+                wTap.transpose() * inputMat.middleRows(begin, end-begin).transpose();
         }
-    }
-
-    MatrixXf resultT = result.transpose();
+    });
 
-    if(1 == nn1dConvTransposedData->hasBias_)
+    // gather every output step from the input steps that reach it, straight into the cropped output
+    tts_workspace_mat accBuf(outCh, (outLen + CONV1D_TRANSPOSED_GRAIN - 1)/CONV1D_TRANSPOSED_GRAIN);
+    tts_parallel_for(outLen, CONV1D_TRANSPOSED_GRAIN, [&](int32_t begin, int32_t end)
     {
-        resultT = resultT.rowwise() + nn1dConvTransposedData->b_.row(0);
-    }
-
-    MatrixXf resultTBlocked = resultT.block(nn1dConvTransposedData->padding_,0,
-                                            outLen,nn1dConvTransposedData->outCh_);
-
-    return resultTBlocked;
+        auto acc = accBuf.mat().col(begin/CONV1D_TRANSPOSED_GRAIN);
+        for(int32_t t = begin; t<end; t++)
+        {
+            acc.setZero();
+            for(int32_t k = kSize-1; k>=0; k--)
+            {
+                int32_t pos = t + padding - k*dilation;
+                if((pos < 0) || (pos % stride != 0) || (pos/stride >= inLen))
+                {
+                    continue;
+                }
+                acc += outMat.col(pos/stride).segment(k*outCh, outCh);
+            }
+
+            if(1 == nn1dConvTransposedData->hasBias_)
+            {
+                acc += Map<const Eigen::VectorXf>(nn1dConvTransposedData->b_, outCh);
+            }
+            result.row(t) = acc.transpose();
+        }
+    });
 }
 
 int32_t nn_conv1d_transposed::get_in_channels_num()
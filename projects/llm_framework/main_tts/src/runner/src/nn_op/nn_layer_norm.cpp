@@ -61,6 +61,11 @@ nn_layer_norm::nn_layer_norm(int32_t size, const MatrixXf & gamma, const MatrixX
     priv_ = (void *)nnLayerNormData;
 }
 
+nn_layer_norm::~nn_layer_norm()
+{
+    NN_LAYER_NORM_t * nnLayerNormData = (NN_LAYER_NORM_t*)priv_;
+    delete nnLayerNormData;
+}
 
 MatrixXf nn_layer_norm::forward(const MatrixXf & x)
 {
@@ -25,3 +25,8 @@ MatrixXf nn_leaky_relu(const MatrixXf & x, float slope)
 
     return result;
 }
+
+void nn_leaky_relu(const Eigen::Ref<const MatrixXf> & x, Eigen::Ref<MatrixXf> out, float slope)
+{
+    out = (x.array() < 0).select(x.array()*slope, x.array());
+}
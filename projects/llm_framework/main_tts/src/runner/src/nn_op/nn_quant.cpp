@@ -0,0 +1,262 @@
+#include "nn_quant.h"
+#include <math.h>
+#include <string.h>
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// floats in one dequantized weight tile, sized to stay in L2 next to the GEMM blocks
+#define NN_WEIGHT_TILE_FLOATS (16384)
+
+static nn_weights_observer_t weightsObserver = NULL;
+static void * weightsObserverCtx = NULL;
+
+void nn_weights_decode_flags(int32_t flags, int32_t & hasBias, int32_t & type, int32_t & order)
+{
+    hasBias = flags & ((1 << NN_WEIGHT_TYPE_SHIFT) - 1);
+    type = (flags >> NN_WEIGHT_TYPE_SHIFT) & 0xF;
+    order = (flags >> NN_WEIGHT_ORDER_SHIFT) & 1;
+}
+
+int32_t nn_weights_encode_flags(int32_t hasBias, int32_t type, int32_t order)
+{
+    return hasBias | (type << NN_WEIGHT_TYPE_SHIFT) | (order << NN_WEIGHT_ORDER_SHIFT);
+}
+
+int32_t nn_weights_size(int32_t type, int32_t weightNum, int32_t outCh)
+{
+    if(NN_WEIGHT_FP16 == type)
+    {
+        return (weightNum + 1)/2;
+    }
+    if(NN_WEIGHT_INT8 == type)
+    {
+        return outCh + (weightNum + 3)/4;
+    }
+    return weightNum;
+}
+
+void nn_weights_bind(const float * data, int32_t type, int32_t order, int32_t outCh, NN_WEIGHTS_t & weights)
+{
+    memset(&weights, 0, sizeof(NN_WEIGHTS_t));
+    weights.type_ = type;
+    weights.order_ = order;
+    if(NN_WEIGHT_FP16 == type)
+    {
+        weights.f16_ = (const uint16_t *)data;
+    }
+    else if(NN_WEIGHT_INT8 == type)
+    {
+        weights.scale_ = data;
+        weights.i8_ = (const int8_t *)(data + outCh);
+    }
+    else
+    {
+        weights.f32_ = data;
+    }
+}
+
+void nn_weights_tap_layout(const NN_WEIGHTS_t & weights, int32_t outCh, int32_t kSize, int32_t inCh, int32_t k,
+                           int64_t & offset, int32_t & outerStride)
+{
+    if(NN_WEIGHT_ORDER_TAP == weights.order_)
+    {
+        offset = (int64_t)k*outCh*inCh;
+        outerStride = inCh;
+    }
+    else
+    {
+        offset = (int64_t)k*inCh;
+        outerStride = kSize*inCh;
+    }
+}
+
+float nn_fp16_to_fp32(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t expMant = h & 0x7FFF;
+    uint32_t bits;
+    if(expMant >= 0x7C00)
+    {
+        bits = 0x7F800000 | ((expMant & 0x3FF) << 13);
+    }
+    else
+    {
+        // moving the fields into place and scaling by 2^112 rebiases normals and subnormals alike
+        float f;
+        bits = expMant << 13;
+        memcpy(&f, &bits, sizeof(f));
+        f *= 5.192296858534828e+33f;
+        memcpy(&bits, &f, sizeof(f));
+    }
+    bits |= sign;
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+uint16_t nn_fp32_to_fp16(float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t absBits = bits & 0x7FFFFFFF;
+
+    if(absBits >= 0x7F800000)
+    {
+        return sign | 0x7C00 | (absBits > 0x7F800000 ? 0x200 : 0);
+    }
+    // 65520 and up rounds to infinity
+    if(absBits >= 0x477FF000)
+    {
+        return sign | 0x7C00;
+    }
+    // below half the smallest subnormal
+    if(absBits < 0x33000001)
+    {
+        return sign;
+    }
+
+    int32_t exp = (int32_t)(absBits >> 23) - 127;
+    uint32_t mant = (absBits & 0x7FFFFF) | 0x800000;
+    int32_t shift = exp < -14 ? (-14 - exp) + 13 : 13;
+    uint32_t half = mant >> shift;
+    uint32_t rest = mant & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if((rest > halfway) || ((rest == halfway) && (half & 1)))
+    {
+        half++;
+    }
+    if(exp >= -14)
+    {
+        // normal: drop the implicit bit, carries from rounding move into the exponent
+        half = ((uint32_t)(exp + 15) << 10) + (half - 0x400);
+    }
+    return sign | (uint16_t)half;
+}
+
+void nn_fp16_to_fp32_n(const uint16_t * src, float * dst, int32_t n)
+{
+    int32_t i = 0;
+#if defined(__aarch64__)
+    for(; i + 4 <= n; i += 4)
+    {
+        vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+    }
+#endif
+    for(; i<n; i++)
+    {
+        dst[i] = nn_fp16_to_fp32(src[i]);
+    }
+}
+
+void nn_weights_expand_tile(const NN_WEIGHTS_t & weights, int32_t outCh, int32_t kSize, int32_t inCh, int32_t k,
+                            int32_t o0, int32_t colNum, float * dst)
+{
+    int64_t offset;
+    int32_t outerStride;
+    nn_weights_tap_layout(weights, outCh, kSize, inCh, k, offset, outerStride);
+    for(int32_t o = o0; o<o0 + colNum; o++)
+    {
+        int64_t src = offset + (int64_t)o*outerStride;
+        float * out = dst + (int64_t)(o - o0)*inCh;
+        if(NN_WEIGHT_FP16 == weights.type_)
+        {
+            nn_fp16_to_fp32_n(weights.f16_ + src, out, inCh);
+        }
+        else if(NN_WEIGHT_INT8 == weights.type_)
+        {
+            const int8_t * in = weights.i8_ + src;
+            float scale = weights.scale_[o];
+            for(int32_t i = 0; i<inCh; i++)
+            {
+                out[i] = in[i]*scale;
+            }
+        }
+        else
+        {
+            memcpy(out, weights.f32_ + src, inCh*sizeof(float));
+        }
+    }
+}
+
+void nn_weights_expand_tap(const NN_WEIGHTS_t & weights, int32_t outCh, int32_t kSize, int32_t inCh, int32_t k,
+                           float * dst)
+{
+    nn_weights_expand_tile(weights, outCh, kSize, inCh, k, 0, outCh, dst);
+}
+
+int32_t nn_weights_tile_cols(int32_t outCh, int32_t inCh)
+{
+    int32_t cols = NN_WEIGHT_TILE_FLOATS/(inCh > 0 ? inCh : 1);
+    cols = cols < 16 ? 16 : cols;
+    return cols < outCh ? cols : outCh;
+}
+
+int32_t nn_weights_pack(const float * src, int32_t type, int32_t order, int32_t outCh, int32_t kSize,
+                        int32_t inCh, float * dst)
+{
+    int32_t weightNum = outCh*kSize*inCh;
+    int32_t rowLen = kSize*inCh;
+    int32_t size = nn_weights_size(type, weightNum, outCh);
+    memset(dst, 0, size*sizeof(float));
+
+    NN_WEIGHTS_t weights;
+    nn_weights_bind(dst, type, order, outCh, weights);
+    for(int32_t o = 0; o<outCh; o++)
+    {
+        const float * row = src + (int64_t)o*rowLen;
+        float scale = 1.0f;
+        if(NN_WEIGHT_INT8 == type)
+        {
+            float maxAbs = 0;
+            for(int32_t i = 0; i<rowLen; i++)
+            {
+                maxAbs = fabsf(row[i]) > maxAbs ? fabsf(row[i]) : maxAbs;
+            }
+            scale = maxAbs > 0 ? maxAbs/127.0f : 1.0f;
+            dst[o] = scale;
+        }
+
+        for(int32_t k = 0; k<kSize; k++)
+        {
+            int64_t offset;
+            int32_t outerStride;
+            nn_weights_tap_layout(weights, outCh, kSize, inCh, k, offset, outerStride);
+            int64_t pos = offset + (int64_t)o*outerStride;
+            const float * tapRow = row + k*inCh;
+            for(int32_t i = 0; i<inCh; i++)
+            {
+                if(NN_WEIGHT_FP16 == type)
+                {
+                    ((uint16_t *)weights.f16_)[pos + i] = nn_fp32_to_fp16(tapRow[i]);
+                }
+                else if(NN_WEIGHT_INT8 == type)
+                {
+                    float q = roundf(tapRow[i]/scale);
+                    ((int8_t *)weights.i8_)[pos + i] = (int8_t)(q > 127 ? 127 : (q < -127 ? -127 : q));
+                }
+                else
+                {
+                    dst[pos + i] = tapRow[i];
+                }
+            }
+        }
+    }
+    return size;
+}
+
+void nn_set_weights_observer(nn_weights_observer_t observer, void * ctx)
+{
+    weightsObserver = observer;
+    weightsObserverCtx = ctx;
+}
+
+void nn_weights_notify(const float * flags, const float * weights, int32_t outCh, int32_t kSize, int32_t inCh)
+{
+    if(NULL != weightsObserver)
+    {
+        weightsObserver(weightsObserverCtx, flags, weights, outCh, kSize, inCh);
+    }
+}
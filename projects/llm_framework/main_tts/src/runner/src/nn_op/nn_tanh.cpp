@@ -2,6 +2,10 @@
 
 #define BIG_NUM (1e+10)
 #define SMALL_NUM (1e-8)
+// elements per step of the in-place form, the step temporaries stay on the stack
+#define TANH_BLOCK (256)
+
+typedef Eigen::Array<float, Eigen::Dynamic, 1, 0, TANH_BLOCK, 1> TANH_BLOCK_t;
 
 MatrixXf nn_tanh(const MatrixXf & x)
 {
@@ -19,3 +23,33 @@ MatrixXf nn_tanh(const MatrixXf & x)
 
    return ret;
 }
+
+void nn_tanh(const Eigen::Ref<const MatrixXf> & x, Eigen::Ref<MatrixXf> out)
+{
+    if((x.outerStride() != x.rows()) || (out.outerStride() != out.rows()))
+    {
+        out = nn_tanh(MatrixXf(x));
+        return;
+    }
+
+    const int64_t total = (int64_t)x.size();
+    const float * src = x.data();
+    float * dst = out.data();
+
+    for(int64_t begin = 0; begin < total; begin += TANH_BLOCK)
+    {
+        int32_t n = (int32_t)((total - begin) < TANH_BLOCK ? (total - begin) : TANH_BLOCK);
+        Eigen::Map<const Eigen::ArrayXf> xs(src + begin, n);
+
+        TANH_BLOCK_t x_exp = xs.exp();
+        x_exp = (x_exp.isInf()).select(BIG_NUM,x_exp);
+
+        TANH_BLOCK_t x_n_exp = (xs*(-1.0)).exp();
+        x_n_exp = (x_n_exp.isInf()).select(BIG_NUM,x_n_exp);
+
+        TANH_BLOCK_t m1 = x_exp + x_n_exp;
+        m1 = (m1 < SMALL_NUM).select(SMALL_NUM,m1);
+
+        Eigen::Map<Eigen::ArrayXf>(dst + begin, n) = (x_exp - x_n_exp)/m1;
+    }
+}
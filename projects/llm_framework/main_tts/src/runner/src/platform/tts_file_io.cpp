@@ -3,6 +3,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include "stdio.h"
 #include <cstring>
 
@@ -43,4 +45,37 @@ int32_t tts_fread(void * buf,int32_t size, TTS_FILE_t * ttsFP)
     return fread(buf, size, 1, (FILE *)ttsFP->fp_);
 }
 
+void * tts_mmap(char * filePath, int32_t * size)
+{
+    int fd = open(filePath, O_RDONLY);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+
+    struct stat st;
+    if((fstat(fd, &st) != 0) || (st.st_size <= 0))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // read-only: layers copy whatever they repack, so the pages stay clean and backed by the file
+    void * addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(MAP_FAILED == addr)
+    {
+        return NULL;
+    }
+
+    *size = st.st_size;
+    return addr;
+}
 
+void tts_munmap(void * addr, int32_t size)
+{
+    if(NULL != addr)
+    {
+        munmap(addr, size);
+    }
+}
@@ -0,0 +1,223 @@
+#include "tts_thread_pool.h"
+#include "tts_logger.h"
+#include "tts_workspace.h"
+#include <Eigen/Core>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef struct
+{
+    int32_t threadNum_;
+    std::vector<std::thread> workers_;
+
+    std::mutex submitMtx_;
+    std::mutex mtx_;
+    std::condition_variable startCv_;
+    std::condition_variable doneCv_;
+    uint64_t generation_;
+    int32_t busy_;
+    bool exit_;
+
+    tts_parallel_fn_t fn_;
+    void * ctx_;
+    int32_t total_;
+    int32_t grain_;
+    int32_t chunks_;
+    std::atomic<int32_t> next_;
+}TTS_THREAD_POOL_DATA_t;
+
+static thread_local tts_thread_pool * curPool = NULL;
+static thread_local int32_t inParallel = 0;
+
+static void run_chunks(TTS_THREAD_POOL_DATA_t * poolData)
+{
+    inParallel++;
+    int32_t chunk;
+    while((chunk = poolData->next_.fetch_add(1)) < poolData->chunks_)
+    {
+        int32_t begin = chunk*poolData->grain_;
+        int32_t end = begin + poolData->grain_;
+        if(end > poolData->total_)
+        {
+            end = poolData->total_;
+        }
+        poolData->fn_(poolData->ctx_, begin, end);
+    }
+    inParallel--;
+}
+
+static void worker_loop(TTS_THREAD_POOL_DATA_t * poolData)
+{
+    // scratch of the chunks run by this worker, grown to the largest region seen so far
+    tts_workspace workspace;
+    tts_set_workspace(&workspace);
+
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(poolData->mtx_);
+    for(;;)
+    {
+        poolData->startCv_.wait(lock, [&]{ return poolData->exit_ || (poolData->generation_ != seen); });
+        if(poolData->exit_)
+        {
+            return;
+        }
+        seen = poolData->generation_;
+
+        lock.unlock();
+        workspace.reset();
+        run_chunks(poolData);
+        lock.lock();
+
+        if(--poolData->busy_ == 0)
+        {
+            poolData->doneCv_.notify_all();
+        }
+    }
+}
+
+static void run_inline(int32_t total, int32_t grain, tts_parallel_fn_t fn, void * ctx)
+{
+    for(int32_t begin = 0; begin < total; begin += grain)
+    {
+        int32_t end = begin + grain;
+        fn(ctx, begin, end > total ? total : end);
+    }
+}
+
+tts_thread_pool::tts_thread_pool(int32_t threadNum)
+{
+    TTS_THREAD_POOL_DATA_t * poolData = new TTS_THREAD_POOL_DATA_t();
+    if(NULL == poolData)
+    {
+        tts_log(TTS_LOG_ERROR, "tts_thread_pool: Failed to allocate memory for internal data block\n");
+        return;
+    }
+
+    if(threadNum < 1)
+    {
+        threadNum = 1;
+    }
+
+    poolData->threadNum_ = threadNum;
+    poolData->generation_ = 0;
+    poolData->busy_ = 0;
+    poolData->exit_ = false;
+    poolData->fn_ = NULL;
+    poolData->ctx_ = NULL;
+    poolData->next_ = 0;
+
+    if(threadNum > 1)
+    {
+        // parallelism comes from the pool, keep Eigen's own GEMM threading out of the workers. The setting is
+        // process-wide and sessions create their pools concurrently, so it is written once.
+        static std::once_flag eigenThreadsOnce;
+        std::call_once(eigenThreadsOnce, []() { Eigen::setNbThreads(1); });
+    }
+
+    for(int32_t i = 1; i<threadNum; i++)
+    {
+        poolData->workers_.push_back(std::thread(worker_loop, poolData));
+    }
+
+    priv_ = (void *)poolData;
+}
+
+tts_thread_pool::~tts_thread_pool()
+{
+    TTS_THREAD_POOL_DATA_t * poolData = (TTS_THREAD_POOL_DATA_t *)priv_;
+    {
+        std::lock_guard<std::mutex> lock(poolData->mtx_);
+        poolData->exit_ = true;
+    }
+    poolData->startCv_.notify_all();
+
+    for(size_t i = 0; i<poolData->workers_.size(); i++)
+    {
+        poolData->workers_[i].join();
+    }
+    delete poolData;
+}
+
+int32_t tts_thread_pool::get_thread_num()
+{
+    TTS_THREAD_POOL_DATA_t * poolData = (TTS_THREAD_POOL_DATA_t *)priv_;
+    return poolData->threadNum_;
+}
+
+void tts_thread_pool::parallel_for(int32_t total, int32_t grain, tts_parallel_fn_t fn, void * ctx)
+{
+    TTS_THREAD_POOL_DATA_t * poolData = (TTS_THREAD_POOL_DATA_t *)priv_;
+
+    if(grain < 1)
+    {
+        grain = 1;
+    }
+    int32_t chunks = (total + grain - 1)/grain;
+
+    // nested calls, single chunks and a pool already serving another caller run on this thread
+    if((chunks < 2) || poolData->workers_.empty() || (inParallel > 0))
+    {
+        run_inline(total, grain, fn, ctx);
+        return;
+    }
+
+    std::unique_lock<std::mutex> submitLock(poolData->submitMtx_, std::try_to_lock);
+    if(!submitLock.owns_lock())
+    {
+        run_inline(total, grain, fn, ctx);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(poolData->mtx_);
+        poolData->fn_ = fn;
+        poolData->ctx_ = ctx;
+        poolData->total_ = total;
+        poolData->grain_ = grain;
+        poolData->chunks_ = chunks;
+        poolData->next_ = 0;
+        poolData->busy_ = (int32_t)poolData->workers_.size();
+        poolData->generation_++;
+    }
+    poolData->startCv_.notify_all();
+
+    run_chunks(poolData);
+
+    std::unique_lock<std::mutex> lock(poolData->mtx_);
+    poolData->doneCv_.wait(lock, [&]{ return poolData->busy_ == 0; });
+    poolData->fn_ = NULL;
+}
+
+void tts_set_thread_pool(tts_thread_pool * pool)
+{
+    curPool = pool;
+}
+
+tts_thread_pool * tts_get_thread_pool()
+{
+    return curPool;
+}
+
+void tts_parallel_for(int32_t total, int32_t grain, tts_parallel_fn_t fn, void * ctx)
+{
+    if(total <= 0)
+    {
+        return;
+    }
+
+    if(grain < 1)
+    {
+        grain = 1;
+    }
+
+    if(NULL == curPool)
+    {
+        run_inline(total, grain, fn, ctx);
+        return;
+    }
+
+    curPool->parallel_for(total, grain, fn, ctx);
+}
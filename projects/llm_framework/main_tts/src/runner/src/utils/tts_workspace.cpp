@@ -0,0 +1,205 @@
+#include "tts_workspace.h"
+#include "tts_logger.h"
+#include "stdlib.h"
+#include <vector>
+
+// every buffer starts on a 64 byte boundary
+#define WORKSPACE_ALIGN_FLOATS (16)
+
+typedef struct
+{
+    float * ptr_;
+    int64_t start_;
+}WORKSPACE_SPILL_t;
+
+typedef struct
+{
+    float * base_;
+    int64_t capacity_;
+    int64_t used_;
+    int64_t peak_;
+    int32_t growCount_;
+    std::vector<WORKSPACE_SPILL_t> spills_;
+}TTS_WORKSPACE_DATA_t;
+
+static thread_local tts_workspace * curWorkspace = NULL;
+
+static float * workspace_block_alloc(int64_t floatNum)
+{
+    void * ptr = NULL;
+    if(0 != posix_memalign(&ptr, WORKSPACE_ALIGN_FLOATS*sizeof(float), floatNum*sizeof(float)))
+    {
+        return NULL;
+    }
+    return (float *)ptr;
+}
+
+tts_workspace::tts_workspace()
+{
+    TTS_WORKSPACE_DATA_t * wsData = new TTS_WORKSPACE_DATA_t();
+    if(NULL == wsData)
+    {
+        tts_log(TTS_LOG_ERROR, "tts_workspace: Failed to allocate memory for internal data block\n");
+        return;
+    }
+
+    wsData->base_ = NULL;
+    wsData->capacity_ = 0;
+    wsData->used_ = 0;
+    wsData->peak_ = 0;
+    wsData->growCount_ = 0;
+
+    priv_ = (void *)wsData;
+}
+
+tts_workspace::~tts_workspace()
+{
+    TTS_WORKSPACE_DATA_t * wsData = (TTS_WORKSPACE_DATA_t *)priv_;
+    release(0);
+    free(wsData->base_);
+    delete wsData;
+}
+
+void tts_workspace::reserve(int64_t floatNum)
+{
+    TTS_WORKSPACE_DATA_t * wsData = (TTS_WORKSPACE_DATA_t *)priv_;
+
+    if((floatNum <= wsData->capacity_) || (wsData->used_ > 0))
+    {
+        return;
+    }
+
+    float * base = workspace_block_alloc(floatNum);
+    if(NULL == base)
+    {
+        tts_log(TTS_LOG_ERROR, "tts_workspace: Failed to allocate workspace block\n");
+        return;
+    }
+
+    free(wsData->base_);
+    wsData->base_ = base;
+    wsData->capacity_ = floatNum;
+    wsData->growCount_++;
+}
+
+void tts_workspace::reset()
+{
+    TTS_WORKSPACE_DATA_t * wsData = (TTS_WORKSPACE_DATA_t *)priv_;
+
+    release(0);
+    if(wsData->peak_ > wsData->capacity_)
+    {
+        reserve(wsData->peak_);
+    }
+    wsData->peak_ = 0;
+}
+
+float * tts_workspace::alloc(int64_t floatNum)
+{
+    TTS_WORKSPACE_DATA_t * wsData = (TTS_WORKSPACE_DATA_t *)priv_;
+
+    floatNum = (floatNum + WORKSPACE_ALIGN_FLOATS - 1) & ~((int64_t)WORKSPACE_ALIGN_FLOATS - 1);
+
+    int64_t start = wsData->used_;
+    wsData->used_ += floatNum;
+    if(wsData->used_ > wsData->peak_)
+    {
+        wsData->peak_ = wsData->used_;
+    }
+
+    if(wsData->used_ <= wsData->capacity_)
+    {
+        return wsData->base_ + start;
+    }
+
+    // over the planned size, served from the heap until the next reset()
+    WORKSPACE_SPILL_t spill;
+    spill.ptr_ = workspace_block_alloc(floatNum);
+    spill.start_ = start;
+    if(NULL == spill.ptr_)
+    {
+        tts_log(TTS_LOG_ERROR, "tts_workspace: Failed to allocate spill block\n");
+        wsData->used_ = start;
+        return NULL;
+    }
+    wsData->spills_.push_back(spill);
+    return spill.ptr_;
+}
+
+int64_t tts_workspace::mark()
+{
+    TTS_WORKSPACE_DATA_t * wsData = (TTS_WORKSPACE_DATA_t *)priv_;
+    return wsData->used_;
+}
+
+void tts_workspace::release(int64_t mark)
+{
+    TTS_WORKSPACE_DATA_t * wsData = (TTS_WORKSPACE_DATA_t *)priv_;
+
+    while(!wsData->spills_.empty() && (wsData->spills_.back().start_ >= mark))
+    {
+        free(wsData->spills_.back().ptr_);
+        wsData->spills_.pop_back();
+    }
+
+    if(mark < wsData->used_)
+    {
+        wsData->used_ = mark;
+    }
+}
+
+int64_t tts_workspace::get_capacity()
+{
+    TTS_WORKSPACE_DATA_t * wsData = (TTS_WORKSPACE_DATA_t *)priv_;
+    return wsData->capacity_;
+}
+
+int64_t tts_workspace::get_peak()
+{
+    TTS_WORKSPACE_DATA_t * wsData = (TTS_WORKSPACE_DATA_t *)priv_;
+    return wsData->peak_;
+}
+
+int32_t tts_workspace::get_grow_count()
+{
+    TTS_WORKSPACE_DATA_t * wsData = (TTS_WORKSPACE_DATA_t *)priv_;
+    return wsData->growCount_;
+}
+
+void tts_set_workspace(tts_workspace * workspace)
+{
+    curWorkspace = workspace;
+}
+
+tts_workspace * tts_get_workspace()
+{
+    return curWorkspace;
+}
+
+tts_workspace_mat::tts_workspace_mat(int32_t rows, int32_t cols)
+    : workspace_(curWorkspace), mark_(0), mat_(NULL, rows, cols)
+{
+    float * data = NULL;
+    if(NULL != workspace_)
+    {
+        mark_ = workspace_->mark();
+        data = workspace_->alloc((int64_t)rows*cols);
+    }
+
+    if(NULL == data)
+    {
+        workspace_ = NULL;
+        owned_.resize(rows, cols);
+        data = owned_.data();
+    }
+
+    new (&mat_) Map<MatrixXf>(data, rows, cols);
+}
+
+tts_workspace_mat::~tts_workspace_mat()
+{
+    if(NULL != workspace_)
+    {
+        workspace_->release(mark_);
+    }
+}
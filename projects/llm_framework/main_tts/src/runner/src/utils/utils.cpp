@@ -35,3 +35,23 @@ void tts_free_data(void * data)
 {
      free(data);
 }
+
+int ttsMapModel(char * ttsModelName, float **ttsModel)
+{
+    int32_t size = 0;
+    void * modelData = tts_mmap(ttsModelName, &size);
+    if(NULL == modelData)
+    {
+        tts_log(TTS_LOG_ERROR,"TTS_SYNC: Fail to map am model file\n");
+        return -1;
+    }
+
+    *ttsModel = (float *)modelData;
+
+    return size;
+}
+
+void ttsUnmapModel(float * ttsModel, int size)
+{
+    tts_munmap(ttsModel, size);
+}
@@ -0,0 +1,319 @@
+/*
+ * Offline weight converter for main_tts models.
+ *
+ * Rewrites the conv / transposed conv / attention projection weights of an fp32 model blob as fp16 or
+ * per-output-channel int8 (see nn_quant.h); everything else is copied unchanged. Every layer is also
+ * reordered tap-major, the order the runner's per-tap GEMMs read, so --type fp32 gives a blob that is only
+ * repacked. The layers are found by loading the model with the runner itself, so any blob the runner reads
+ * can be converted.
+ *
+ *   tts_quantize <in.bin> --list
+ *   tts_quantize <in.bin> <out.bin> [--type int8|fp16|fp32] [--keep 0,3,17] [--min-weights N]
+ *                [--check "text"] [--min-snr dB]
+ *
+ * --list prints every layer with its index and the error int8/fp16 would introduce. Layers named by --keep
+ * and layers with fewer than --min-weights weights (default 4096) stay fp32. --check synthesizes the text
+ * with both blobs and prints the SNR of the converted output against the fp32 one; with --min-snr the tool
+ * exits non-zero when the SNR is below it, the converted blob is still written.
+ *
+ * Host build, from the runner directory:
+ *   g++ -O2 -std=c++17 -pthread -Ieigen-3.4.0 -Isrc/header -Iinclude -Isrc/tn/header -Isrc/tn \
+ *       -Isrc/header/cppjieba -Isrc tools/tts_quantize.cpp $(find src -name '*.cpp' -o -name '*.cc') \
+ *       -lfst -lglog -o tts_quantize
+ */
+#include "SynthesizerTrn.h"
+#include "utils.h"
+#include "nn_quant.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <set>
+#include <string>
+#include <vector>
+
+typedef struct
+{
+    int32_t flagsOffset_;
+    int32_t weightsOffset_;
+    int32_t outCh_;
+    int32_t kSize_;
+    int32_t inCh_;
+}QUANT_LAYER_t;
+
+typedef struct
+{
+    const float * base_;
+    std::vector<QUANT_LAYER_t> layers_;
+}QUANT_SCAN_t;
+
+static void collect_layer(void * ctx, const float * flags, const float * weights, int32_t outCh, int32_t kSize,
+                          int32_t inCh)
+{
+    QUANT_SCAN_t * scan = (QUANT_SCAN_t *)ctx;
+    QUANT_LAYER_t layer;
+    layer.flagsOffset_ = flags - scan->base_;
+    layer.weightsOffset_ = weights - scan->base_;
+    layer.outCh_ = outCh;
+    layer.kSize_ = kSize;
+    layer.inCh_ = inCh;
+    scan->layers_.push_back(layer);
+}
+
+static int32_t layer_weight_num(const QUANT_LAYER_t & layer)
+{
+    return layer.outCh_*layer.kSize_*layer.inCh_;
+}
+
+// relative RMS error of storing the layer as type
+static double layer_error(const float * model, const QUANT_LAYER_t & layer, int32_t type)
+{
+    int32_t weightNum = layer_weight_num(layer);
+    const float * src = model + layer.weightsOffset_;
+
+    std::vector<float> packed(nn_weights_size(type, weightNum, layer.outCh_));
+    nn_weights_pack(src, type, NN_WEIGHT_ORDER_ROW, layer.outCh_, layer.kSize_, layer.inCh_, packed.data());
+    NN_WEIGHTS_t weights;
+    nn_weights_bind(packed.data(), type, NN_WEIGHT_ORDER_ROW, layer.outCh_, weights);
+
+    std::vector<float> tap(layer.inCh_*layer.outCh_);
+    double err = 0;
+    double ref = 0;
+    for(int32_t k = 0; k<layer.kSize_; k++)
+    {
+        nn_weights_expand_tap(weights, layer.outCh_, layer.kSize_, layer.inCh_, k, tap.data());
+        for(int32_t o = 0; o<layer.outCh_; o++)
+        {
+            for(int32_t i = 0; i<layer.inCh_; i++)
+            {
+                double w = src[o*layer.kSize_*layer.inCh_ + k*layer.inCh_ + i];
+                double d = tap[o*layer.inCh_ + i] - w;
+                err += d*d;
+                ref += w*w;
+            }
+        }
+    }
+    return ref > 0 ? sqrt(err/ref) : 0;
+}
+
+static bool scan_model(float * model, int32_t size, QUANT_SCAN_t & scan)
+{
+    scan.base_ = model;
+    scan.layers_.clear();
+    nn_set_weights_observer(collect_layer, &scan);
+    SynthesizerTrn * synthesizer = new SynthesizerTrn(model, size);
+    nn_set_weights_observer(NULL, NULL);
+    delete synthesizer;
+
+    std::sort(scan.layers_.begin(), scan.layers_.end(), [](const QUANT_LAYER_t & a, const QUANT_LAYER_t & b)
+    {
+        return a.weightsOffset_ < b.weightsOffset_;
+    });
+
+    for(size_t i = 0; i<scan.layers_.size(); i++)
+    {
+        int32_t hasBias, type, order;
+        nn_weights_decode_flags((int32_t)model[scan.layers_[i].flagsOffset_], hasBias, type, order);
+        if((NN_WEIGHT_FP32 != type) || (NN_WEIGHT_ORDER_ROW != order))
+        {
+            fprintf(stderr, "tts_quantize: the model is already converted\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::vector<float> convert_model(const float * model, int32_t size, const QUANT_SCAN_t & scan,
+                                        const std::vector<int32_t> & types)
+{
+    int32_t floatNum = size/sizeof(float);
+    std::vector<float> out;
+    out.reserve(floatNum);
+
+    int32_t cursor = 0;
+    for(size_t i = 0; i<scan.layers_.size(); i++)
+    {
+        const QUANT_LAYER_t & layer = scan.layers_[i];
+        int32_t start = out.size();
+        out.insert(out.end(), model + cursor, model + layer.weightsOffset_);
+
+        int32_t weightNum = layer_weight_num(layer);
+        int32_t hasBias, type, order;
+        nn_weights_decode_flags((int32_t)model[layer.flagsOffset_], hasBias, type, order);
+        out[start + layer.flagsOffset_ - cursor] = (float)nn_weights_encode_flags(hasBias, types[i],
+                                                                                  NN_WEIGHT_ORDER_TAP);
+
+        int32_t packedPos = out.size();
+        out.resize(packedPos + nn_weights_size(types[i], weightNum, layer.outCh_));
+        nn_weights_pack(model + layer.weightsOffset_, types[i], NN_WEIGHT_ORDER_TAP, layer.outCh_, layer.kSize_,
+                        layer.inCh_, out.data() + packedPos);
+        cursor = layer.weightsOffset_ + weightNum;
+    }
+    out.insert(out.end(), model + cursor, model + floatNum);
+
+    // trailing bytes of a size that is not a multiple of four
+    int32_t tail = size - floatNum*sizeof(float);
+    if(tail > 0)
+    {
+        float last = 0;
+        memcpy(&last, (const char *)model + floatNum*sizeof(float), tail);
+        out.push_back(last);
+    }
+    return out;
+}
+
+static double synth_snr(float * ref, int32_t refSize, float * test, int32_t testSize, const std::string & text)
+{
+    std::vector<int16_t> refPcm;
+    std::vector<int16_t> testPcm;
+
+    SynthesizerTrn * refModel = new SynthesizerTrn(ref, refSize);
+    refModel->infer(text, 0, 1.0, refPcm);
+    delete refModel;
+
+    SynthesizerTrn * testModel = new SynthesizerTrn(test, testSize);
+    testModel->infer(text, 0, 1.0, testPcm);
+    delete testModel;
+
+    if(refPcm.size() != testPcm.size())
+    {
+        printf("length differs: %zu fp32 samples, %zu converted\n", refPcm.size(), testPcm.size());
+    }
+
+    size_t len = std::min(refPcm.size(), testPcm.size());
+    double sig = 0;
+    double noise = 0;
+    for(size_t i = 0; i<len; i++)
+    {
+        double d = (double)refPcm[i] - testPcm[i];
+        sig += (double)refPcm[i]*refPcm[i];
+        noise += d*d;
+    }
+    return noise > 0 ? 10*log10(sig/noise) : INFINITY;
+}
+
+int main(int argc, char ** argv)
+{
+    if(argc < 3)
+    {
+        fprintf(stderr, "usage: %s <in.bin> --list\n"
+                        "       %s <in.bin> <out.bin> [--type int8|fp16|fp32] [--keep i,j,..] [--min-weights N]"
+                        " [--check text] [--min-snr dB]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    bool list = (0 == strcmp(argv[2], "--list"));
+    int32_t type = NN_WEIGHT_INT8;
+    int32_t minWeights = 4096;
+    std::set<int32_t> keep;
+    std::string checkText;
+    double minSnr = -INFINITY;
+    for(int32_t i = 3; i<argc; i++)
+    {
+        if((0 == strcmp(argv[i], "--type")) && (i+1 < argc))
+        {
+            i++;
+            type = (0 == strcmp(argv[i], "fp16")) ? NN_WEIGHT_FP16 :
+                   ((0 == strcmp(argv[i], "fp32")) ? NN_WEIGHT_FP32 : NN_WEIGHT_INT8);
+        }
+        else if((0 == strcmp(argv[i], "--min-weights")) && (i+1 < argc))
+        {
+            minWeights = atoi(argv[++i]);
+        }
+        else if((0 == strcmp(argv[i], "--keep")) && (i+1 < argc))
+        {
+            char * item = strtok(argv[++i], ",");
+            while(NULL != item)
+            {
+                keep.insert(atoi(item));
+                item = strtok(NULL, ",");
+            }
+        }
+        else if((0 == strcmp(argv[i], "--check")) && (i+1 < argc))
+        {
+            checkText = argv[++i];
+        }
+        else if((0 == strcmp(argv[i], "--min-snr")) && (i+1 < argc))
+        {
+            minSnr = atof(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "tts_quantize: unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    float * model = NULL;
+    int32_t size = ttsLoadModel(argv[1], &model);
+    if(size <= 0)
+    {
+        fprintf(stderr, "tts_quantize: cannot read %s\n", argv[1]);
+        return 1;
+    }
+
+    QUANT_SCAN_t scan;
+    if(!scan_model(model, size, scan))
+    {
+        tts_free_data(model);
+        return 1;
+    }
+
+    if(list)
+    {
+        printf("%5s %6s %6s %4s %10s %10s %10s\n", "layer", "outCh", "inCh", "k", "weights", "int8 err", "fp16 err");
+        for(size_t i = 0; i<scan.layers_.size(); i++)
+        {
+            const QUANT_LAYER_t & layer = scan.layers_[i];
+            printf("%5zu %6d %6d %4d %10d %10.2e %10.2e\n", i, layer.outCh_, layer.inCh_, layer.kSize_,
+                   layer_weight_num(layer), layer_error(model, layer, NN_WEIGHT_INT8),
+                   layer_error(model, layer, NN_WEIGHT_FP16));
+        }
+        tts_free_data(model);
+        return 0;
+    }
+
+    std::vector<int32_t> types(scan.layers_.size(), NN_WEIGHT_FP32);
+    int32_t converted = 0;
+    for(size_t i = 0; i<scan.layers_.size(); i++)
+    {
+        if((keep.count(i) == 0) && (layer_weight_num(scan.layers_[i]) >= minWeights))
+        {
+            types[i] = type;
+            converted++;
+        }
+    }
+
+    std::vector<float> out = convert_model(model, size, scan, types);
+    FILE * fp = fopen(argv[2], "wb");
+    if((NULL == fp) || (fwrite(out.data(), sizeof(float), out.size(), fp) != out.size()))
+    {
+        fprintf(stderr, "tts_quantize: cannot write %s\n", argv[2]);
+        if(NULL != fp)
+        {
+            fclose(fp);
+        }
+        tts_free_data(model);
+        return 1;
+    }
+    fclose(fp);
+    printf("%d of %zu layers converted to %s, %d -> %zu bytes\n", converted, scan.layers_.size(),
+           type == NN_WEIGHT_FP16 ? "fp16" : (type == NN_WEIGHT_FP32 ? "fp32" : "int8"), size,
+           out.size()*sizeof(float));
+
+    int ret = 0;
+    if(!checkText.empty())
+    {
+        double snr = synth_snr(model, size, out.data(), out.size()*sizeof(float), checkText);
+        printf("SNR vs fp32: %.2f dB\n", snr);
+        if(snr < minSnr)
+        {
+            fprintf(stderr, "tts_quantize: SNR %.2f dB is below --min-snr %.2f dB\n", snr, minSnr);
+            ret = 1;
+        }
+    }
+
+    tts_free_data(model);
+    return ret;
+}
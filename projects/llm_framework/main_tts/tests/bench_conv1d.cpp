@@ -0,0 +1,148 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * Micro-benchmark of the conv layers on the shapes of a 22 kHz hifigan/MB-iSTFT model, against the algorithm
+ * they replaced: padded input copy, zero-inflated dilated kernel and one im2col GEMM per call, and a per-row
+ * scatter for the transposed conv. Prints the time of both and the max relative error, fails above 1e-5.
+ *   make bench
+ */
+#include "nn_conv1d.h"
+#include "nn_conv1d_transposed.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+using Eigen::MatrixXf;
+
+static double time_us(const std::function<void()> &fn)
+{
+    double best = 1e30;
+    for (int rep = 0; rep < 5; rep++) {
+        auto begin = std::chrono::steady_clock::now();
+        fn();
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+        if (us < best) best = us;
+    }
+    return best;
+}
+
+static float rel_error(const MatrixXf &a, const MatrixXf &ref)
+{
+    if ((a.rows() != ref.rows()) || (a.cols() != ref.cols())) return 1e30f;
+    return (a - ref).cwiseAbs().maxCoeff() / (ref.cwiseAbs().maxCoeff() + 1e-30f);
+}
+
+// w is (k*inCh) x outCh tap-major, sep layers have inCh 1 and one weight column per channel
+static MatrixXf im2col_conv(const MatrixXf &x, const MatrixXf &w, const MatrixXf &b, int k, int padding,
+                            int dilation, bool sep)
+{
+    int inCh = x.cols();
+    MatrixXf padded = MatrixXf::Zero(x.rows() + 2 * padding, inCh);
+    padded.middleRows(padding, x.rows()) = x;
+    int span       = (k - 1) * dilation + 1;
+    int tapRows    = sep ? 1 : inCh;
+    MatrixXf dw    = MatrixXf::Zero(span * tapRows, w.cols());
+    for (int i = 0; i < k; i++) dw.middleRows(i * dilation * tapRows, tapRows) = w.middleRows(i * tapRows, tapRows);
+    int outLen = padded.rows() - span + 1;
+    MatrixXf out(outLen, w.cols());
+    if (sep) {
+        for (int i = 0; i < outLen; i++) {
+            MatrixXf block = padded.middleRows(i, span).transpose();
+            for (int j = 0; j < w.cols(); j++) out(i, j) = block.row(j) * dw.col(j);
+        }
+    } else {
+        MatrixXf cols(outLen, span * inCh);
+        for (int i = 0; i < outLen; i++)
+            cols.row(i) = padded.middleRows(i, span).reshaped<Eigen::RowMajor>().transpose();
+        out = cols * dw;
+    }
+    return out.rowwise() + b.row(0);
+}
+
+// w is inCh x (k*outCh), column o*k+j is tap j of output channel o
+static MatrixXf scatter_convt(const MatrixXf &x, const MatrixXf &w, const MatrixXf &b, int k, int padding,
+                              int stride)
+{
+    int outCh    = b.cols();
+    int fullLen  = (x.rows() - 1) * stride + k;
+    MatrixXf out = MatrixXf::Zero(fullLen, outCh);
+    for (int i = 0; i < x.rows(); i++) {
+        MatrixXf y = (x.row(i) * w).reshaped(k, outCh);
+        out.middleRows(i * stride, k) += y;
+    }
+    MatrixXf cropped = out.middleRows(padding, fullLen - 2 * padding);
+    return cropped.rowwise() + b.row(0);
+}
+
+static int failures = 0;
+
+static void report(const char *name, double ref_us, double us, float err)
+{
+    printf("  %-28s %9.0fus -> %7.0fus  err %.1e\n", name, ref_us, us, err);
+    if (err > 1e-5f) failures++;
+}
+
+static void bench_conv(const char *name, int len, int inCh, int outCh, int k, int dilation)
+{
+    int padding = (k * dilation - dilation) / 2;
+    MatrixXf w  = MatrixXf::Random(k * inCh, outCh) * 0.1f;
+    MatrixXf b  = MatrixXf::Random(1, outCh);
+    MatrixXf x  = MatrixXf::Random(len, inCh);
+    nn_conv1d conv(inCh, outCh, k, padding, dilation, 1, w, b);
+    MatrixXf y, ref;
+    double us     = time_us([&] { y = conv.forward(x); });
+    double ref_us = time_us([&] { ref = im2col_conv(x, w, b, k, padding, dilation, false); });
+    report(name, ref_us, us, rel_error(y, ref));
+}
+
+static void bench_sep(const char *name, int len, int ch, int k, int dilation)
+{
+    int padding = (k * dilation - dilation) / 2;
+    std::vector<float> blob = {(float)ch, 1, (float)k, 0, 1, 1};
+    MatrixXf w = MatrixXf::Random(k, ch) * 0.1f;
+    MatrixXf b = MatrixXf::Random(1, ch);
+    blob.insert(blob.end(), w.data(), w.data() + w.size());
+    blob.insert(blob.end(), b.data(), b.data() + b.size());
+    int32_t offset = 0;
+    nn_conv1d conv(blob.data(), offset, padding, dilation, 1);
+    MatrixXf x = MatrixXf::Random(len, ch);
+    MatrixXf y, ref;
+    double us     = time_us([&] { y = conv.forward(x); });
+    double ref_us = time_us([&] { ref = im2col_conv(x, w, b, k, padding, dilation, true); });
+    report(name, ref_us, us, rel_error(y, ref));
+}
+
+static void bench_convt(const char *name, int len, int inCh, int outCh, int k, int stride)
+{
+    int padding = (k - stride) / 2;
+    MatrixXf w  = MatrixXf::Random(inCh, k * outCh) * 0.1f;
+    MatrixXf b  = MatrixXf::Random(1, outCh);
+    MatrixXf x  = MatrixXf::Random(len, inCh);
+    nn_conv1d_transposed convt(inCh, outCh, k, padding, 1, 1, stride, w, b);
+    MatrixXf y, ref;
+    double us     = time_us([&] { y = convt.forward(x); });
+    double ref_us = time_us([&] { ref = scatter_convt(x, w, b, k, padding, stride); });
+    report(name, ref_us, us, rel_error(y, ref));
+}
+
+int main()
+{
+    srand(1);
+    printf("bench_conv1d: previous algorithm -> current, best of 5\n");
+    bench_conv("conv_pre 200x192->256 k7", 200, 192, 256, 7, 1);
+    bench_conv("resblock 400x128->128 k3 d3", 400, 128, 128, 3, 3);
+    bench_conv("resblock 1600x64->64 k7 d5", 1600, 64, 64, 7, 5);
+    bench_conv("WN in_layer 200x192->384 k5", 200, 192, 384, 5, 2);
+    bench_sep("DDSConv sep 200x192 k3 d9", 200, 192, 3, 9);
+    bench_conv("conv_post 6400x32->18 k7", 6400, 32, 18, 7, 1);
+    bench_convt("upsample x8 1600x128->64", 1600, 128, 64, 16, 8);
+    if (failures) {
+        fprintf(stderr, "%d layer(s) differ from the reference\n", failures);
+        return 1;
+    }
+    return 0;
+}
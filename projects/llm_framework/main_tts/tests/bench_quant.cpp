@@ -0,0 +1,89 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * Real-time factor of a hifigan generator (22 kHz shapes, 256 channels, x256 upsampling) with its conv weights
+ * stored as fp32, fp16 and int8. Converted weights stay in the stored format and are dequantized tile by tile
+ * inside the conv GEMMs, so the blob size is the weight memory of the loaded model. Prints the RTF, the weight
+ * memory and the SNR against the fp32 output, fails when a converted model drops below 25 dB.
+ *   make bench
+ */
+#include "Generator_hifigan.h"
+#include "tts_workspace.h"
+#include "tts_test_model.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+
+static const int sample_rate = 22050;
+static const int frames      = 64;
+
+static double time_us(const std::function<void()> &fn)
+{
+    double best = 1e30;
+    for (int rep = 0; rep < 5; rep++) {
+        auto begin = std::chrono::steady_clock::now();
+        fn();
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+        if (us < best) best = us;
+    }
+    return best;
+}
+
+static double snr(const MatrixXf &ref, const MatrixXf &test)
+{
+    if (ref.size() != test.size()) return -INFINITY;
+    double noise = (ref - test).squaredNorm();
+    return (noise > 0) ? 10 * std::log10(ref.squaredNorm() / noise) : INFINITY;
+}
+
+int main()
+{
+    const int types[3]        = {NN_WEIGHT_FP32, NN_WEIGHT_FP16, NN_WEIGHT_INT8};
+    const char *type_names[3] = {"fp32", "fp16", "int8"};
+    int failures              = 0;
+
+    srand(1);
+    MatrixXf x = MatrixXf::Random(frames, 192);
+    MatrixXf g;
+    MatrixXf ref;
+    double fp32_us = 0;
+
+    printf("bench_quant: hifigan generator, %d frames, one thread, RTF (best of 5) per storage type\n", frames);
+    for (int t = 0; t < 3; t++) {
+        tts_test_model model;
+        model.set_weight_type(types[t]);
+        model.hifigan(192, {8, 8, 2, 2}, {16, 16, 4, 4}, 256);
+        int32_t offset = 0;
+        Generator_hifiGan generator(model.data(), offset, 0);
+
+        tts_workspace workspace;
+        tts_set_workspace(&workspace);
+        MatrixXf y;
+        double us = time_us([&] {
+            workspace.reset();
+            y = generator.forward(x, g);
+        });
+        if (t == 0) fp32_us = us;
+        double audio_us = 1e6 * y.size() / sample_rate;
+        printf("  %s  %6.2f MB  RTF %.3f  (%.2fx fp32)", type_names[t], model.size() / 1048576.0, us / audio_us,
+               fp32_us / us);
+        if (t == 0) {
+            ref = y;
+            printf("\n");
+        } else {
+            double db = snr(ref, y);
+            printf("  SNR %.1f dB\n", db);
+            if (db < 25.0) failures++;
+        }
+        tts_set_workspace(NULL);
+    }
+    if (failures) {
+        fprintf(stderr, "%d run(s) below 25 dB\n", failures);
+        return 1;
+    }
+    return 0;
+}
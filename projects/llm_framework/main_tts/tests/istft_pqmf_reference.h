@@ -0,0 +1,76 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+/*
+ * The vocoder tail as it was computed before the batched iSTFT and the polyphase PQMF: one complex inverse
+ * FFT per frame of the mirrored spectrum with a sequential overlap-add, and zero-insertion upsampling
+ * followed by the 63-tap synthesis filter, written out as plain loops.
+ */
+#include <Eigen/Dense>
+#include <unsupported/Eigen/FFT>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+extern float hann_w[];
+extern float hann_w_pow[];
+
+// mag and phase are frames x (filterLen/2 + 1), returns 1 x (frames-1)*hopLen
+static Eigen::MatrixXf reference_istft(const Eigen::MatrixXf &mag, const Eigen::MatrixXf &phase, int filterLen,
+                                       int hopLen)
+{
+    int frames  = mag.rows();
+    int bins    = mag.cols();
+    int fullLen = (frames - 1) * hopLen + filterLen;
+    std::vector<float> ret(fullLen, 0.0f), wsum(fullLen, 0.0f);
+    Eigen::FFT<float> fft;
+    std::vector<std::complex<float> > freq(filterLen);
+    std::vector<float> time;
+    for (int f = 0; f < frames; f++) {
+        for (int i = 0; i < bins; i++) freq[i] = std::polar(mag(f, i), phase(f, i));
+        for (int i = bins, s = 1; i < filterLen; i++, s++) freq[i] = std::conj(freq[i - 2 * s]);
+        fft.inv(time, freq);
+        for (int n = 0; n < filterLen; n++) {
+            ret[f * hopLen + n] += time[n] * hann_w[n];
+            wsum[f * hopLen + n] += hann_w_pow[n];
+        }
+    }
+    for (int i = 0; i < fullLen; i++) {
+        if (wsum[i] > 1e-14f) ret[i] /= wsum[i];
+    }
+    Eigen::MatrixXf out(1, (frames - 1) * hopLen);
+    for (int i = 0; i < out.cols(); i++) out(0, i) = ret[filterLen / 2 + i];
+    return out;
+}
+
+// x is steps x subBands, returns (steps*subBands) x 1
+static Eigen::MatrixXf reference_pqmf(const Eigen::MatrixXf &x, const float *proto, int protoLen)
+{
+    int bands = x.cols();
+    int taps  = protoLen - 1;
+    int half  = taps / 2;
+    Eigen::MatrixXf h(bands, protoLen);
+    for (int k = 0; k < bands; k++) {
+        for (int n = 0; n < protoLen; n++) {
+            // the centre is (taps-1)/2 as in the original filter design, not taps/2
+            double arg = (2 * k + 1) * (M_PI / (2 * bands)) * (n - (taps - 1) / 2.0) - ((k & 1) ? -1 : 1) * M_PI / 4;
+            h(k, n)    = (float)(2.0 * proto[n] * std::cos(arg));
+        }
+    }
+
+    int outLen = x.rows() * bands;
+    Eigen::MatrixXf up = Eigen::MatrixXf::Zero(outLen + 2 * half, bands);
+    for (int t = 0; t < x.rows(); t++) up.row(half + t * bands) = x.row(t) * (float)bands;
+    Eigen::MatrixXf y = Eigen::MatrixXf::Zero(outLen, 1);
+    for (int t = 0; t < outLen; t++) {
+        double acc = 0;
+        for (int n = 0; n < protoLen; n++) {
+            for (int k = 0; k < bands; k++) acc += (double)up(t + n, k) * h(k, n);
+        }
+        y(t, 0) = (float)acc;
+    }
+    return y;
+}
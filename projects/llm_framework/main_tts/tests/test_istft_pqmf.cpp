@@ -0,0 +1,72 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "iStft.h"
+#include "pqmf.h"
+#include "tts_thread_pool.h"
+#include "istft_pqmf_reference.h"
+#include <cstdio>
+
+extern float h_filter[];
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+static float rel_error(const Eigen::MatrixXf &a, const Eigen::MatrixXf &ref)
+{
+    if ((a.rows() != ref.rows()) || (a.cols() != ref.cols())) return 1e30f;
+    if (ref.size() == 0) return 0.0f;
+    return (a - ref).cwiseAbs().maxCoeff() / (ref.cwiseAbs().maxCoeff() + 1e-30f);
+}
+
+// the 16-point, hop 4 transform of the iSTFT generators, frame counts around the edge and chunk sizes
+static void test_istft()
+{
+    iStft istft(16, 4, 16);
+    for (int threads : {1, 3}) {
+        tts_thread_pool pool(threads);
+        tts_set_thread_pool(&pool);
+        for (int frames : {1, 2, 3, 5, 17, 64, 65, 1000}) {
+            Eigen::MatrixXf mag   = Eigen::MatrixXf::Random(frames, 9).cwiseAbs() * 2.0f;
+            Eigen::MatrixXf phase = Eigen::MatrixXf::Random(frames, 9) * (float)M_PI;
+            Eigen::MatrixXf ref   = reference_istft(mag, phase, 16, 4);
+            float err             = rel_error(istft.forward(mag, phase), ref);
+            if (err > 1e-5f) fprintf(stderr, "istft threads %d frames %d: error %.1e\n", threads, frames, err);
+            CHECK(err <= 1e-5f);
+        }
+        tts_set_thread_pool(NULL);
+    }
+}
+
+static void test_pqmf()
+{
+    pqmf filter(4);
+    for (int steps : {1, 2, 7, 16, 300, 2000}) {
+        Eigen::MatrixXf x   = Eigen::MatrixXf::Random(steps, 4);
+        Eigen::MatrixXf ref = reference_pqmf(x, h_filter, 63);
+        float err           = rel_error(filter.forward(x), ref);
+        if (err > 1e-5f) fprintf(stderr, "pqmf steps %d: error %.1e\n", steps, err);
+        CHECK(err <= 1e-5f);
+    }
+}
+
+int main()
+{
+    srand(1);
+    test_istft();
+    test_pqmf();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_istft_pqmf: ok\n");
+    return 0;
+}
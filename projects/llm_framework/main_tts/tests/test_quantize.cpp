@@ -0,0 +1,147 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * The offline converter end to end: tts_quantize rewrites a test blob as int8 and fp16, its --check run
+ * passes the --min-snr gate, and the converted blob loads and synthesizes as many samples as the fp32 one.
+ * Repacked to tap-major fp32 only, the blob maps read-only and synthesizes exactly the fp32 output.
+ */
+#include "SynthesizerTrn.h"
+#include "tts_test_model.h"
+#include "utils.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+static const char *test_line = "你好，世界。今天天气很好，我们一起去公园散步吧。";
+
+// exit status of the converter, -1 when it did not exit normally
+static int run_quantize(const std::string &args)
+{
+    std::string cmd = "./tts_quantize " + args + " > /dev/null";
+    int status      = system(cmd.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static long file_size(const std::string &path)
+{
+    struct stat st;
+    return (stat(path.c_str(), &st) == 0) ? (long)st.st_size : -1;
+}
+
+static double snr(const std::vector<int16_t> &ref, const std::vector<int16_t> &test)
+{
+    double sig = 0, noise = 0;
+    for (size_t i = 0; i < ref.size(); i++) {
+        double d = (double)ref[i] - test[i];
+        sig += (double)ref[i] * ref[i];
+        noise += d * d;
+    }
+    return (noise > 0) ? 10 * std::log10(sig / noise) : INFINITY;
+}
+
+/*
+ * min_snr is the gate handed to the tool, set well below what the test blob reaches (about 38 dB for int8,
+ * 60 dB for fp16) so it only trips when the converted path is wrong rather than merely lossy.
+ */
+static void test_convert(const std::string &dir, const char *type, double min_snr)
+{
+    std::string in  = dir + "/model.bin";
+    std::string out = dir + "/model." + type + ".bin";
+    std::string common = in + " " + out + " --type " + type + " --min-weights 0 --check \"" + test_line + "\"";
+
+    char gate[32];
+    snprintf(gate, sizeof(gate), " --min-snr %.1f", min_snr);
+    CHECK(run_quantize(common + gate) == 0);
+    CHECK((file_size(out) > 0) && (file_size(out) < file_size(in)));
+    // the gate fails the run when the SNR is below it
+    CHECK(run_quantize(common + " --min-snr 1000") == 1);
+    // converted blobs are not converted again
+    CHECK(run_quantize(out + " " + dir + "/again.bin --min-weights 0") == 1);
+
+    float *ref_data  = NULL;
+    float *test_data = NULL;
+    int32_t ref_size  = ttsLoadModel(&in[0], &ref_data);
+    int32_t test_size = ttsLoadModel(&out[0], &test_data);
+    CHECK((ref_size > 0) && (test_size > 0));
+    if ((ref_size > 0) && (test_size > 0)) {
+        std::vector<int16_t> ref, pcm;
+        SynthesizerTrn ref_model(ref_data, ref_size);
+        SynthesizerTrn test_model(test_data, test_size);
+        CHECK(ref_model.infer(test_line, 0, 1.0f, ref) > 0);
+        CHECK(test_model.infer(test_line, 0, 1.0f, pcm) == (int32_t)ref.size());
+        if (pcm.size() == ref.size()) CHECK(snr(ref, pcm) >= min_snr);
+    }
+    tts_free_data(ref_data);
+    tts_free_data(test_data);
+    unlink(out.c_str());
+    unlink((dir + "/again.bin").c_str());
+}
+
+static void test_repack(const std::string &dir)
+{
+    std::string in  = dir + "/model.bin";
+    std::string out = dir + "/model.fp32.bin";
+    CHECK(run_quantize(in + " " + out + " --type fp32 --min-weights 0") == 0);
+    CHECK(file_size(out) == file_size(in));
+    CHECK(run_quantize(out + " " + dir + "/again.bin --type fp32") == 1);
+
+    float *ref_data  = NULL;
+    float *test_data = NULL;
+    int32_t ref_size  = ttsLoadModel(&in[0], &ref_data);
+    int32_t test_size = ttsMapModel(&out[0], &test_data);
+    CHECK((ref_size > 0) && (test_size == ref_size));
+    if ((ref_size > 0) && (test_size == ref_size)) {
+        std::vector<int16_t> ref, pcm;
+        SynthesizerTrn ref_model(ref_data, ref_size);
+        SynthesizerTrn test_model(test_data, test_size);
+        CHECK(ref_model.infer(test_line, 0, 1.0f, ref) > 0);
+        CHECK(test_model.infer(test_line, 0, 1.0f, pcm) == (int32_t)ref.size());
+        CHECK(pcm == ref);
+    }
+    tts_free_data(ref_data);
+    if (test_size > 0) ttsUnmapModel(test_data, test_size);
+    unlink(out.c_str());
+    unlink((dir + "/again.bin").c_str());
+}
+
+int main()
+{
+    char dir[] = "/tmp/test_quantize_XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    tts_test_model model;
+    model.synthesizer(4.0f);
+    CHECK(model.save(std::string(dir) + "/model.bin"));
+
+    test_convert(dir, "int8", 25.0);
+    test_convert(dir, "fp16", 50.0);
+    test_repack(dir);
+
+    unlink((std::string(dir) + "/model.bin").c_str());
+    rmdir(dir);
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_quantize: ok\n");
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "SynthesizerTrn.h"
+#include "tts_test_model.h"
+#include "utils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+static const char *test_line = "你好，世界。今天天气很好，我们一起去公园散步吧。";
+
+struct stream_result {
+    std::vector<int16_t> pcm;
+    std::vector<int32_t> blocks;
+    int last_flags = 0;
+    bool last_on_final = false;
+    int stop_after = 0;
+};
+
+static int32_t collect(const int16_t *pcm, int32_t sampleNum, bool isLast, void *userData)
+{
+    stream_result *result = (stream_result *)userData;
+    result->pcm.insert(result->pcm.end(), pcm, pcm + sampleNum);
+    result->blocks.push_back(sampleNum);
+    result->last_flags += isLast ? 1 : 0;
+    result->last_on_final = isLast;
+    return (result->stop_after > 0) && ((int)result->blocks.size() >= result->stop_after);
+}
+
+static int max_diff(const std::vector<int16_t> &a, const std::vector<int16_t> &b)
+{
+    if (a.size() != b.size()) return 1 << 16;
+    int diff = 0;
+    for (size_t i = 0; i < a.size(); i++) diff = std::max(diff, std::abs((int)a[i] - (int)b[i]));
+    return diff;
+}
+
+// the stitched stream equals the batch result up to float rounding of the decoder
+static void test_stream_matches_batch(SynthesizerTrn &model)
+{
+    std::vector<int16_t> batch;
+    int32_t len = model.infer(test_line, 0, 1.0f, batch);
+    CHECK(len > 0 && len == (int32_t)batch.size());
+    CHECK(len % tts_test_model::hop_ == 0);
+    int frames = len / tts_test_model::hop_;
+    CHECK(frames > 4 * 32);
+
+    model.setStreamParams(32, 16);
+    stream_result stream;
+    CHECK(model.inferStream(test_line, 0, 1.0f, collect, &stream) == len);
+    CHECK((int)stream.blocks.size() == (frames + 31) / 32);
+    for (size_t i = 0; i + 1 < stream.blocks.size(); i++) CHECK(stream.blocks[i] == 32 * tts_test_model::hop_);
+    CHECK(stream.last_flags == 1 && stream.last_on_final);
+    int diff = max_diff(stream.pcm, batch);
+    if (diff > 2) fprintf(stderr, "stream vs batch: max difference %d\n", diff);
+    CHECK(diff <= 2);
+
+    // chunks decoded without context differ at the seams, so the comparison above does see them
+    model.setStreamParams(32, 0);
+    stream_result no_context;
+    CHECK(model.inferStream(test_line, 0, 1.0f, collect, &no_context) == len);
+    CHECK(max_diff(no_context.pcm, batch) > 2);
+
+    // a non-zero return from the callback ends the stream
+    model.setStreamParams(32, 16);
+    stream_result stopped;
+    stopped.stop_after = 2;
+    CHECK(model.inferStream(test_line, 0, 1.0f, collect, &stopped) == 2 * 32 * tts_test_model::hop_);
+    CHECK(stopped.blocks.size() == 2 && stopped.last_flags == 0);
+}
+
+// a stream shorter than one chunk is a single final block
+static void test_short_stream(SynthesizerTrn &model)
+{
+    std::vector<int16_t> batch;
+    int32_t len = model.infer("好。", 0, 1.0f, batch);
+    CHECK(len > 0);
+    model.setStreamParams(1024, 16);
+    stream_result stream;
+    CHECK(model.inferStream("好。", 0, 1.0f, collect, &stream) == len);
+    CHECK(stream.blocks.size() == 1 && stream.last_flags == 1);
+    CHECK(max_diff(stream.pcm, batch) == 0);
+}
+
+// sessions on one model running in parallel threads give exactly the single-session result
+static void test_concurrent_sessions(SynthesizerTrn &model)
+{
+    const char *lines[2] = {test_line, "我们明天早上八点在学校门口见面。"};
+    std::vector<int16_t> ref[2];
+    for (int i = 0; i < 2; i++) CHECK(model.infer(lines[i], 0, 1.0f, ref[i]) > 0);
+
+    for (int threads : {1, 2}) {
+        int bad[2] = {0, 0};
+        auto run = [&](int i) {
+            SynthesizerTrnSession session(&model);
+            session.setThreadNum(threads);
+            std::vector<int16_t> pcm;
+            for (int rep = 0; rep < 4; rep++) {
+                // alternate the lines so both threads go through the shared front-end cache at once
+                int line = (i + rep) & 1;
+                int32_t len = session.infer(lines[line], 0, 1.0f, pcm);
+                if ((len != (int32_t)ref[line].size()) ||
+                    memcmp(pcm.data(), ref[line].data(), ref[line].size() * sizeof(int16_t)))
+                    bad[i]++;
+            }
+        };
+        std::thread worker(run, 1);
+        run(0);
+        worker.join();
+        CHECK(bad[0] == 0 && bad[1] == 0);
+    }
+}
+
+// a model mapped read-only from its file synthesizes exactly like the one built from memory
+static void test_mapped_model(tts_test_model &blob, SynthesizerTrn &model)
+{
+    char path[] = "/tmp/test_synth_XXXXXX";
+    int fd      = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    close(fd);
+    CHECK(blob.save(path));
+
+    float *data = NULL;
+    int size    = ttsMapModel(path, &data);
+    CHECK(size == blob.size());
+    if (size == blob.size()) {
+        std::vector<int16_t> ref, pcm;
+        CHECK(model.infer(test_line, 0, 1.0f, ref) > 0);
+        SynthesizerTrn mapped(data, size);
+        CHECK(mapped.infer(test_line, 0, 1.0f, pcm) == (int32_t)ref.size());
+        CHECK(pcm == ref);
+    }
+    if (size > 0) ttsUnmapModel(data, size);
+    unlink(path);
+}
+
+int main()
+{
+    tts_test_model blob;
+    blob.synthesizer(4.0f);
+    SynthesizerTrn model(blob.data(), blob.size());
+    test_stream_matches_batch(model);
+    test_short_stream(model);
+    test_concurrent_sessions(model);
+    test_mapped_model(blob, model);
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_synth: ok\n");
+    return 0;
+}
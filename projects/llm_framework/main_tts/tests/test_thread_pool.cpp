@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "tts_thread_pool.h"
+#include "nn_conv1d.h"
+#include "nn_conv1d_transposed.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+static bool same_bits(const MatrixXf &a, const MatrixXf &b)
+{
+    return (a.rows() == b.rows()) && (a.cols() == b.cols()) && !memcmp(a.data(), b.data(), a.size() * sizeof(float));
+}
+
+// every index is visited exactly once, chunk bounds follow the grain whatever the thread count
+static void test_coverage()
+{
+    for (int threads : {1, 2, 3, 8}) {
+        tts_thread_pool pool(threads);
+        tts_set_thread_pool(&pool);
+        for (int total : {0, 1, 63, 64, 65, 1000}) {
+            std::vector<std::atomic<int>> hits(total);
+            std::atomic<int> bad_chunk(0);
+            tts_parallel_for(total, 64, [&](int32_t begin, int32_t end) {
+                if ((begin % 64) || ((end - begin != 64) && (end != total))) bad_chunk++;
+                for (int32_t i = begin; i < end; i++) hits[i]++;
+            });
+            CHECK(bad_chunk == 0);
+            for (auto &h : hits) CHECK(h == 1);
+        }
+        tts_set_thread_pool(NULL);
+    }
+}
+
+// a parallel region started from inside another one runs inline instead of waiting for busy workers
+static void test_nested()
+{
+    tts_thread_pool pool(4);
+    tts_set_thread_pool(&pool);
+    std::atomic<int> sum(0);
+    tts_parallel_for(8, 1, [&](int32_t, int32_t) {
+        tts_set_thread_pool(&pool);
+        tts_parallel_for(100, 10, [&](int32_t begin, int32_t end) { sum += end - begin; });
+    });
+    CHECK(sum == 800);
+    tts_set_thread_pool(NULL);
+}
+
+// kernel output does not depend on the number of threads
+static void test_conv_bitwise()
+{
+    srand(1);
+    MatrixXf w  = MatrixXf::Random(5 * 48, 40);
+    MatrixXf b  = MatrixXf::Random(1, 40);
+    MatrixXf wt = MatrixXf::Random(48, 16 * 24);
+    MatrixXf bt = MatrixXf::Random(1, 24);
+    nn_conv1d conv(48, 40, 5, 6, 3, 1, w, b);
+    nn_conv1d_transposed convt(48, 24, 16, 4, 1, 1, 8, wt, bt);
+    MatrixXf x = MatrixXf::Random(333, 48);
+
+    MatrixXf ref  = conv.forward(x);
+    MatrixXf reft = convt.forward(x);
+    CHECK(ref.rows() == 333 && reft.rows() == 332 * 8 - 8 + 16);
+    for (int threads : {2, 3, 4, 8}) {
+        tts_thread_pool pool(threads);
+        tts_set_thread_pool(&pool);
+        CHECK(same_bits(conv.forward(x), ref));
+        CHECK(same_bits(convt.forward(x), reft));
+        tts_set_thread_pool(NULL);
+    }
+}
+
+int main()
+{
+    test_coverage();
+    test_nested();
+    test_conv_bitwise();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_thread_pool: ok\n");
+    return 0;
+}
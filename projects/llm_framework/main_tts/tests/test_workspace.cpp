@@ -0,0 +1,162 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * Heap allocations of the vocoder once the workspaces are warm. Linked with --wrap=malloc and
+ * --wrap=posix_memalign, so every allocation made by runner code (Eigen temporaries, workspace blocks) on any
+ * thread goes through the counters below, as do operator new calls. The same counters show that loading a
+ * generator reads its weights from the blob rather than copying them.
+ */
+#include "Generator_hifigan.h"
+#include "tts_thread_pool.h"
+#include "tts_workspace.h"
+#include "tts_test_model.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <unistd.h>
+
+static std::atomic<bool> counting(false);
+static std::atomic<long> heap_allocs(0);
+static std::atomic<long> heap_bytes(0);
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" int __real_posix_memalign(void **ptr, size_t align, size_t size);
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+    if (counting) {
+        heap_allocs++;
+        heap_bytes += size;
+    }
+    return __real_malloc(size);
+}
+
+extern "C" int __wrap_posix_memalign(void **ptr, size_t align, size_t size)
+{
+    if (counting) {
+        heap_allocs++;
+        heap_bytes += size;
+    }
+    return __real_posix_memalign(ptr, align, size);
+}
+
+void *operator new(size_t size)
+{
+    if (counting) heap_allocs++;
+    void *ptr = malloc(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+// chunks running on pool workers draw their scratch from the worker's own workspace
+static void test_worker_scratch()
+{
+    tts_thread_pool pool(4);
+    tts_workspace workspace;
+    tts_set_workspace(&workspace);
+    tts_set_thread_pool(&pool);
+    workspace.reserve(256 * 32);
+    std::atomic<int> bad(0);
+    auto region = [&](int rows, bool slow) {
+        tts_parallel_for(64, 1, [&](int32_t begin, int32_t) {
+            tts_workspace_mat buf(rows, 32);
+            buf.mat().setConstant((float)begin);
+            if (buf.mat().sum() != (float)begin * rows * 32) bad++;
+            // long chunks while warming up, so that every worker takes some
+            if (slow) usleep(1000);
+        });
+    };
+    for (int i = 0; i < 3; i++) region(256, true);
+    heap_allocs = 0;
+    counting    = true;
+    region(256, false);
+    region(128, false);
+    counting = false;
+    CHECK(heap_allocs == 0);
+    CHECK(bad == 0);
+    tts_set_thread_pool(NULL);
+    tts_set_workspace(NULL);
+}
+
+/*
+ * Loading the generator reads the conv weights from the blob in place, fp16/int8 ones included: the heap it
+ * takes is a small fraction of the blob (a copy of the weights would be about all of it). A whole forward only
+ * allocates its returned matrix after the first run, the dequantized weight tiles come from the workspaces.
+ */
+static void test_generator(int weight_type)
+{
+    tts_test_model model;
+    model.set_weight_type(weight_type);
+    model.hifigan(64, {8, 8}, {16, 16}, 256);
+    int32_t offset = 0;
+    heap_bytes = 0;
+    counting   = true;
+    Generator_hifiGan generator(model.data(), offset, 0);
+    counting = false;
+    CHECK(offset * (int)sizeof(float) == model.size());
+    if (heap_bytes > model.size() / 16) fprintf(stderr, "load: %ld heap bytes\n", heap_bytes.load());
+    CHECK(heap_bytes <= model.size() / 16);
+
+    MatrixXf x = MatrixXf::Random(80, 64);
+    MatrixXf g;
+    MatrixXf ref = generator.forward(x, g);
+
+    tts_workspace workspace;
+    for (int threads : {1, 3}) {
+        tts_thread_pool pool(threads);
+        tts_set_thread_pool(&pool);
+        tts_set_workspace(&workspace);
+        for (int run = 0; run < 3; run++) {
+            workspace.reset();
+            heap_allocs = 0;
+            counting    = (run > 0);
+            MatrixXf y  = generator.forward(x, g);
+            counting    = false;
+            CHECK(y.size() == ref.size() && !memcmp(y.data(), ref.data(), y.size() * sizeof(float)));
+            if (run > 0) {
+                if (heap_allocs > 1) fprintf(stderr, "threads %d run %d: %ld heap allocations\n", threads, run,
+                                             heap_allocs.load());
+                CHECK(heap_allocs <= 1);
+            }
+        }
+        tts_set_workspace(NULL);
+        tts_set_thread_pool(NULL);
+    }
+}
+
+int main()
+{
+    test_worker_scratch();
+    test_generator(NN_WEIGHT_FP32);
+    test_generator(NN_WEIGHT_INT8);
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_workspace: ok\n");
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+/*
+ * Builds main_tts model blobs with random weights in the layout the runner modules read, see their
+ * constructors.
+ */
+#include "nn_quant.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+class tts_test_model {
+public:
+    static const int hidden_ = 32;
+    static const int latent_ = 16;
+    // samples per latent frame of the generator built by synthesizer()
+    static const int hop_ = 16;
+
+    explicit tts_test_model(unsigned seed = 1) : rng_(seed)
+    {
+    }
+
+    /*
+     * Complete SynthesizerTrn blob: Chinese front end without dictionary sections (built-in pinyin table only),
+     * one-layer attention text encoder, hifigan generator, residual coupling flow and fixed duration predictor.
+     * frames_per_phone sets the duration predictor bias, the latent length is about phones * frames_per_phone.
+     */
+    void synthesizer(float frames_per_phone)
+    {
+        put(0);  // isMS
+        put(0);  // LANG_TYPE_CHS
+        put(1);  // DUR_PRED_TYPE_NOSTOC
+        put(0);  // DEC_TYPE_HIFIGAN
+        text_encoder();
+        hifigan(latent_, {4, 4}, {8, 8}, 64);
+        flow(2, 2);
+        duration_predictor(std::log(frames_per_phone));
+    }
+
+    float *data()
+    {
+        return data_.data();
+    }
+
+    int size() const
+    {
+        return (int)(data_.size() * sizeof(float));
+    }
+
+    /*
+     * Storage type (NN_WEIGHT_FP32/FP16/INT8) of the conv weights written from now on. Converted weights are
+     * stored tap-major like tts_quantize writes them; the random values drawn are the same for every type.
+     */
+    void set_weight_type(int type)
+    {
+        weight_type_ = type;
+    }
+
+    bool save(const std::string &path) const
+    {
+        FILE *fp = fopen(path.c_str(), "wb");
+        if (!fp) return false;
+        bool ok = fwrite(data_.data(), sizeof(float), data_.size(), fp) == data_.size();
+        return (fclose(fp) == 0) && ok;
+    }
+
+    // hifigan generator for in_ch channel latents, upsampling by the product of rates
+    void hifigan(int in_ch, const std::vector<int> &rates, const std::vector<int> &kernels, int channels)
+    {
+        const int res_kernels[2]   = {3, 5};
+        const int res_dilations[3] = {1, 3, 5};
+        put(rates.size());
+        for (int r : rates) put(r);
+        put(channels);
+        put(kernels.size());
+        for (int k : kernels) put(k);
+        put(2);
+        for (int k : res_kernels) put(k);
+        put(2);
+        for (int i = 0; i < 2; i++) {
+            for (int d : res_dilations) put(d);
+        }
+
+        conv(in_ch, channels, 7, 3);
+        int ch = channels;
+        for (size_t i = 0; i < rates.size(); i++) {
+            // transposed: [outCh, inCh, k, padding, dilation, hasBias, stride] inCh x (k*outCh) weights, bias
+            put(ch / 2);
+            put(ch);
+            put(kernels[i]);
+            put((kernels[i] - rates[i]) / 2);
+            put(1);
+            put(flags());
+            put(rates[i]);
+            weights(ch / 2, kernels[i], ch, std::sqrt(3.0f * rates[i] / (ch * kernels[i])));
+            for (int j = 0; j < ch / 2; j++) put(0.0f);
+            ch /= 2;
+        }
+        ch = channels;
+        for (size_t i = 0; i < rates.size(); i++) {
+            ch /= 2;
+            for (int k : res_kernels) {
+                put(3);
+                for (int d : res_dilations) conv(ch, ch, k, (k * d - d) / 2, d, 0.3f);
+                for (int j = 0; j < 3; j++) conv(ch, ch, k, (k - 1) / 2, 1, 0.3f);
+            }
+        }
+        conv(ch, 1, 7, 3, 1, 0.5f);
+    }
+
+private:
+    std::vector<float> data_;
+    std::mt19937 rng_;
+    int weight_type_ = NN_WEIGHT_FP32;
+
+    void put(float v)
+    {
+        data_.push_back(v);
+    }
+
+    void random(int count, float scale)
+    {
+        std::uniform_real_distribution<float> dist(-scale, scale);
+        for (int i = 0; i < count; i++) data_.push_back(dist(rng_));
+    }
+
+    // hasBias set, with the storage type of the weights
+    float flags() const
+    {
+        if (weight_type_ == NN_WEIGHT_FP32) return 1;
+        return nn_weights_encode_flags(1, weight_type_, NN_WEIGHT_ORDER_TAP);
+    }
+
+    // random [out][k][in] weights in the current storage type
+    void weights(int out, int k, int in, float scale)
+    {
+        if (weight_type_ == NN_WEIGHT_FP32) {
+            random(out * k * in, scale);
+            return;
+        }
+        std::vector<float> src;
+        src.swap(data_);
+        random(out * k * in, scale);
+        src.swap(data_);
+        size_t pos = data_.size();
+        data_.resize(pos + nn_weights_size(weight_type_, out * k * in, out));
+        nn_weights_pack(src.data(), weight_type_, NN_WEIGHT_ORDER_TAP, out, k, in, data_.data() + pos);
+    }
+
+    // [outCh, inCh, k, padding, dilation, hasBias] (k*inCh) x outCh weights, outCh bias
+    void conv(int in, int out, int k, int padding = 0, int dilation = 1, float gain = 1.0f, float bias = 0.0f)
+    {
+        put(out);
+        put(in);
+        put(k);
+        put(padding);
+        put(dilation);
+        put(flags());
+        weights(out, k, in, gain * std::sqrt(3.0f / (in * k)));
+        for (int i = 0; i < out; i++) put(bias);
+    }
+
+    void layer_norm(int size)
+    {
+        put(size);
+        for (int i = 0; i < size; i++) put(1.0f);
+        for (int i = 0; i < size; i++) put(0.0f);
+    }
+
+    void text_encoder()
+    {
+        const int vocab = 256;
+        put(hidden_);
+        put(vocab);
+        put(hidden_);
+        random(vocab * hidden_, 0.5f);
+        put(1);  // attention layers
+        put(hidden_);
+        put(hidden_);
+        put(2);  // heads
+        put(0);  // no relative position window
+        for (int i = 0; i < 4; i++) conv(hidden_, hidden_, 1);
+        layer_norm(hidden_);
+        put(3);  // ffn kernel
+        conv(hidden_, 2 * hidden_, 3);
+        conv(2 * hidden_, hidden_, 3);
+        layer_norm(hidden_);
+        conv(hidden_, 2 * latent_, 1);
+    }
+
+    void flow(int flows, int layers)
+    {
+        const int wn_hidden = 16;
+        put(flows);
+        put(layers);
+        for (int f = 0; f < flows; f++) {
+            conv(latent_ / 2, wn_hidden, 1);
+            put(layers);
+            put(5);  // WN kernel
+            for (int i = 0; i < layers; i++) conv(wn_hidden, 2 * wn_hidden, 5);
+            for (int i = 0; i < layers; i++) conv(wn_hidden, (i < layers - 1) ? 2 * wn_hidden : wn_hidden, 1);
+            conv(wn_hidden, latent_ / 2, 1, 0, 1, 0.1f);
+        }
+    }
+
+    void duration_predictor(float log_frames)
+    {
+        const int filters = 32;
+        conv(hidden_, filters, 3, 1);
+        layer_norm(filters);
+        conv(filters, filters, 3, 1);
+        layer_norm(filters);
+        conv(filters, 1, 1, 0, 1, 0.01f, log_frames);
+    }
+};
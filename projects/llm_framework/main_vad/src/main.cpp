@@ -14,9 +14,8 @@
 #include <thread_safe_list.h>
 #include "../../../../SDK/components/utilities/include/sample_log.h"
 
-#define BUFFER_IMPLEMENTATION
 #include <stdint.h>
-#include "libs/buffer.h"
+#include "audio_frontend.hpp"
 
 #include <iostream>
 
@@ -61,7 +60,7 @@ public:
     task_callback_t out_callback_;
     int awake_delay_       = 50;
     int delay_audio_frame_ = 3;
-    buffer_t *pcmdata;
+    audio_frontend pcm_frontend_{1.0f / INT16_MAX};
     std::string wake_wav_file_;
 
     std::function<void(void)> pause;
@@ -152,27 +151,10 @@ public:
 
     void sys_pcm_on_data(const std::string &raw)
     {
-        static int count = 0;
-        if (count < delay_audio_frame_) {
-            buffer_write_char(pcmdata, raw.c_str(), raw.length());
-            count++;
-            return;
-        }
-        buffer_write_char(pcmdata, raw.c_str(), raw.length());
-        buffer_position_set(pcmdata, 0);
-
-        std::vector<float> floatSamples;
-        {
-            int16_t audio_val;
-            while (buffer_read_i16(pcmdata, &audio_val, 1)) {
-                float normalizedSample = static_cast<float>(audio_val) / INT16_MAX;
-                floatSamples.push_back(normalizedSample);
-            }
-        }
-        buffer_resize(pcmdata, 0);
-        count = 0;
-
-        vad_->AcceptWaveform(floatSamples.data(), floatSamples.size());
+        pcm_frontend_.set_delay_frames(delay_audio_frame_);
+        if (!pcm_frontend_.push(raw)) return;
+        vad_->AcceptWaveform(pcm_frontend_.data(), pcm_frontend_.size());
+        pcm_frontend_.consume(pcm_frontend_.size());
 
         if (vad_->IsSpeechDetected() && !printed) {
             printed = true;
@@ -216,7 +198,6 @@ public:
     {
         ensleep_     = false;
         awake_flage_ = false;
-        pcmdata      = buffer_create();
     }
 
     void start()
@@ -230,7 +211,6 @@ public:
     ~llm_task()
     {
         stop();
-        buffer_destroy(pcmdata);
     }
 };
 #undef CONFIG_AUTO_SET
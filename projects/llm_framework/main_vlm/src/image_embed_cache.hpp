@@ -0,0 +1,192 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <stdint.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Output of the vision encoder for one request, everything needed to build the prompt without running it again.
+ * deepstack and grid_thw are only filled for the Qwen models.
+ */
+struct image_embed_t {
+    std::vector<std::vector<unsigned short>> embeds;
+    std::vector<std::vector<float>> deepstack;
+    std::vector<std::vector<int>> grid_thw;
+
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (const auto &e : embeds) total += e.size() * sizeof(unsigned short);
+        for (const auto &d : deepstack) total += d.size() * sizeof(float);
+        for (const auto &g : grid_thw) total += g.size() * sizeof(int);
+        return total;
+    }
+};
+
+typedef std::shared_ptr<const image_embed_t> image_embed_ptr;
+
+/**
+ * Identity of the images of one request: the source bytes themselves, each prefixed with its length, and a
+ * 64-bit FNV-1a of them for the index. Two sources sharing the hash are still told apart by the bytes.
+ */
+struct image_embed_key {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    std::string bytes;
+
+    void append(const void *data, size_t size)
+    {
+        append_raw(&size, sizeof(size));
+        append_raw(data, size);
+    }
+
+    template <typename T>
+    void append_value(const T &value)
+    {
+        append_raw(&value, sizeof(value));
+    }
+
+private:
+    void append_raw(const void *data, size_t size)
+    {
+        const uint8_t *p = (const uint8_t *)data;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ p[i]) * 0x100000001b3ULL;
+        }
+        bytes.append((const char *)data, size);
+    }
+};
+
+/**
+ * LRU cache of image embeddings keyed by the compressed image bytes, bounded by a memory budget.
+ * A hit skips the decode, the resize and the vision encoder, so follow-up questions about the same picture only
+ * pay for the text prefill. The key is exact: re-encoded or freshly captured frames of the same scene miss.
+ * Each entry keeps its source bytes, which count against the budget, and a hit compares them in full.
+ */
+class image_embed_cache {
+public:
+    explicit image_embed_cache(size_t budget = 0) : budget_(budget), bytes_(0), hits_(0), misses_(0)
+    {
+    }
+
+    static image_embed_key key(const void *data, size_t size)
+    {
+        image_embed_key k;
+        k.append(data, size);
+        return k;
+    }
+
+    // budget in bytes, 0 disables the cache and drops what it holds
+    void set_budget(size_t budget)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        budget_ = budget;
+        evict_locked();
+    }
+
+    bool enabled()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        return budget_ > 0;
+    }
+
+    image_embed_ptr get(const image_embed_key &key)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        auto iter = index_.find(key.hash);
+        if ((iter == index_.end()) || (iter->second->key.bytes != key.bytes)) {
+            misses_++;
+            return nullptr;
+        }
+        lru_.splice(lru_.begin(), lru_, iter->second);
+        hits_++;
+        return iter->second->value;
+    }
+
+    // an entry larger than the whole budget is not kept, one with the hash of another replaces it
+    void put(image_embed_key &&key, image_embed_t &&value)
+    {
+        entry_t entry;
+        entry.value = std::make_shared<const image_embed_t>(std::move(value));
+        entry.key   = std::move(key);
+        entry.size  = entry.value->bytes() + entry.key.bytes.size();
+        std::lock_guard<std::mutex> guard(mtx_);
+        if (entry.size > budget_) return;
+        auto iter = index_.find(entry.key.hash);
+        if (iter != index_.end()) {
+            bytes_ -= iter->second->size;
+            lru_.erase(iter->second);
+            index_.erase(iter);
+        }
+        bytes_ += entry.size;
+        lru_.push_front(std::move(entry));
+        index_[lru_.front().key.hash] = lru_.begin();
+        evict_locked();
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        lru_.clear();
+        index_.clear();
+        bytes_ = 0;
+    }
+
+    size_t entries()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        return lru_.size();
+    }
+
+    size_t bytes()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        return bytes_;
+    }
+
+    uint64_t hits()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        return hits_;
+    }
+
+    uint64_t misses()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        return misses_;
+    }
+
+private:
+    void evict_locked()
+    {
+        while (!lru_.empty() && (bytes_ > budget_)) {
+            bytes_ -= lru_.back().size;
+            index_.erase(lru_.back().key.hash);
+            lru_.pop_back();
+        }
+    }
+
+    struct entry_t {
+        image_embed_key key;
+        image_embed_ptr value;
+        size_t size;
+    };
+    typedef std::list<entry_t> lru_list_t;
+
+    std::mutex mtx_;
+    size_t budget_;
+    size_t bytes_;
+    uint64_t hits_;
+    uint64_t misses_;
+    lru_list_t lru_;
+    std::unordered_map<uint64_t, lru_list_t::iterator> index_;
+};
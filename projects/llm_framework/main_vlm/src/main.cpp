@@ -16,6 +16,7 @@
 #include <stdexcept>
 #include "../../../../SDK/components/utilities/include/sample_log.h"
 #include "thread_safe_list.h"
+#include "image_embed_cache.hpp"
 
 using namespace StackFlows;
 
@@ -82,6 +83,7 @@ public:
     std::string kvcache_path;
     int precompute_len = 0;
     std::vector<int> _token_ids;
+    image_embed_cache image_cache_;
     static int ax_init_flage_;
     task_callback_t out_callback_;
     bool enoutput_;
@@ -229,6 +231,14 @@ public:
             QWEN_CONFIG_AUTO_SET(file_body["mode_param"], image_token_id);
             QWEN_CONFIG_AUTO_SET(file_body["mode_param"], video_token_id);
             QWEN_CONFIG_AUTO_SET(file_body["mode_param"], vision_start_token_id);
+            {
+                int image_cache_mb = 32;
+                if (config_body.contains("image_cache_mb"))
+                    image_cache_mb = config_body["image_cache_mb"];
+                else if (file_body["mode_param"].contains("image_cache_mb"))
+                    image_cache_mb = file_body["mode_param"]["image_cache_mb"];
+                image_cache_.set_budget((size_t)std::max(image_cache_mb, 0) << 20);
+            }
             {
                 auto has_http = [](const std::string &s) { return s.find("http") != std::string::npos; };
 
@@ -434,10 +444,16 @@ public:
                     std::string out = lLaMa_->Run(prompt_data_);
                     if (out_callback_) out_callback_(out, true);
                 } else {
-                    cv::Mat src = cv::imdecode(image_data_, cv::IMREAD_COLOR);
-                    if (src.empty()) return;
+                    image_embed_key key = image_embed_cache::key(image_data_.data(), image_data_.size());
+                    if (auto hit = image_cache_.get(key)) {
+                        img_embed = hit->embeds[0];
+                    } else {
+                        cv::Mat src = cv::imdecode(image_data_, cv::IMREAD_COLOR);
+                        if (src.empty()) return;
+                        if ((lLaMa_->Encode(src, img_embed) == 0) && image_cache_.enabled())
+                            image_cache_.put(std::move(key), {{img_embed}});
+                    }
                     image_data_.clear();
-                    lLaMa_->Encode(src, img_embed);
                     lLaMa_->Encode(img_embed, prompt_data_, prompt_complete(msg));
                     std::string out = lLaMa_->Run(prompt_data_);
                     if (out_callback_) out_callback_(out, true);
@@ -467,24 +483,30 @@ public:
                     lLaMa_ctx_->GetKVCache(k_caches, v_caches, precompute_len);
                     if (out_callback_) out_callback_(last_reply, true);
                 } else {
+                    std::vector<std::vector<unsigned short>> all_embeds;
                     for (const auto &img_buf : images_data) {
+                        image_embed_key key = image_embed_cache::key(img_buf.data(), img_buf.size());
+                        if (auto hit = image_cache_.get(key)) {
+                            all_embeds.push_back(hit->embeds[0]);
+                            continue;
+                        }
                         cv::Mat src = cv::imdecode(img_buf, cv::IMREAD_COLOR);
                         if (src.empty()) {
                             std::cerr << "Decode failed!" << std::endl;
                             continue;
                         }
-                        mats.push_back(src);
+                        std::vector<unsigned short> embed;
+                        if (auto ret = lLaMa_ctx_->Encode(src, embed); ret != 0) {
+                            ALOGE("lLaMaCtx.Encode failed");
+                            if (out_callback_) out_callback_("Encode failed", true);
+                            return;
+                        }
+                        if (image_cache_.enabled()) image_cache_.put(std::move(key), {{embed}});
+                        all_embeds.push_back(std::move(embed));
                     }
-                    if (mats.empty()) return;
+                    if (all_embeds.empty()) return;
                     images_data.clear();
                     lLaMa_ctx_->ClearImgsEmbed();
-                    std::vector<std::vector<unsigned short>> all_embeds;
-                    if (auto ret = lLaMa_ctx_->Encode(mats, all_embeds); ret != 0) {
-                        ALOGE("lLaMaCtx.Encode failed");
-                        if (out_callback_) out_callback_("Encode failed", true);
-                        return;
-                    }
-                    mats.clear();
                     if (auto ret =
                             lLaMa_ctx_->Encode(all_embeds, prompt_data_, prompt_complete(msg), tokens_ids, tokens_diff);
                         ret != 0) {
@@ -512,19 +534,43 @@ public:
                     last_reply = qwen_->Run(prompt_data_, position_ids, deepstack_features, visual_pos_mask);
                     if (out_callback_) out_callback_(last_reply, true);
                 } else {
+                    // the images of one request are encoded together, so they are cached as a set
+                    image_embed_key key;
+                    key.append_value(mode_config_.b_video);
                     for (const auto &img_buf : images_data) {
-                        cv::Mat src = cv::imdecode(img_buf, cv::IMREAD_COLOR);
-                        if (src.empty()) {
-                            std::cerr << "Decode failed!" << std::endl;
-                            continue;
-                        }
-                        mats.push_back(src);
+                        key.append(img_buf.data(), img_buf.size());
                     }
-                    images_data.clear();
-                    if (mats.empty()) return;
+                    auto &grid_thw = mode_config_.b_video ? qwen_mode_config_.video_grid_thw
+                                                          : qwen_mode_config_.image_grid_thw;
                     std::vector<std::vector<unsigned short>> all_embeds;
-                    qwen_->EncodeImage(mats, mode_config_.b_video, qwen_mode_config_, all_embeds, deepstack_features);
-                    mats.clear();
+                    if (auto hit = image_cache_.get(key)) {
+                        images_data.clear();
+                        all_embeds         = hit->embeds;
+                        deepstack_features = hit->deepstack;
+                        grid_thw.insert(grid_thw.end(), hit->grid_thw.begin(), hit->grid_thw.end());
+                    } else {
+                        for (const auto &img_buf : images_data) {
+                            cv::Mat src = cv::imdecode(img_buf, cv::IMREAD_COLOR);
+                            if (src.empty()) {
+                                std::cerr << "Decode failed!" << std::endl;
+                                continue;
+                            }
+                            mats.push_back(src);
+                        }
+                        images_data.clear();
+                        if (mats.empty()) return;
+                        size_t grid_begin = mode_config_.b_video ? 0 : grid_thw.size();
+                        qwen_->EncodeImage(mats, mode_config_.b_video, qwen_mode_config_, all_embeds,
+                                           deepstack_features);
+                        mats.clear();
+                        if (image_cache_.enabled()) {
+                            image_embed_t entry;
+                            entry.embeds    = all_embeds;
+                            entry.deepstack = deepstack_features;
+                            entry.grid_thw.assign(grid_thw.begin() + grid_begin, grid_thw.end());
+                            image_cache_.put(std::move(key), std::move(entry));
+                        }
+                    }
                     qwen_->Encode(all_embeds, mode_config_.b_video, prompt_data_, position_ids, visual_pos_mask,
                                   qwen_mode_config_, prompt_complete(msg));
                     last_reply = qwen_->Run(prompt_data_, position_ids, deepstack_features, visual_pos_mask);
@@ -979,6 +1025,10 @@ public:
             req_body["response_format"] = llm_task_obj->response_format_;
             req_body["enoutput"]        = llm_task_obj->enoutput_;
             req_body["inputs"]          = llm_task_obj->inputs_;
+            req_body["image_cache"]     = {{"entries", llm_task_obj->image_cache_.entries()},
+                                           {"bytes", llm_task_obj->image_cache_.bytes()},
+                                           {"hits", llm_task_obj->image_cache_.hits()},
+                                           {"misses", llm_task_obj->image_cache_.misses()}};
             send("vlm.taskinfo", req_body, LLM_NO_ERROR, work_id);
         }
     }
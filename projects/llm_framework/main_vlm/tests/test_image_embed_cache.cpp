@@ -0,0 +1,124 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * The image embedding cache: exact hits, sources that share a hash kept apart, image sets keyed in order and
+ * with their mode, and the LRU eviction against the byte budget, which includes the stored source bytes.
+ */
+#include "image_embed_cache.hpp"
+#include <cstdio>
+#include <string>
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+// an embedding of tokens values, all equal to tag
+static image_embed_t embed(unsigned short tag, size_t tokens = 64)
+{
+    image_embed_t value;
+    value.embeds.push_back(std::vector<unsigned short>(tokens, tag));
+    return value;
+}
+
+static unsigned short tag_of(const image_embed_ptr &hit)
+{
+    return hit ? hit->embeds[0][0] : 0;
+}
+
+static void test_hit_and_miss()
+{
+    image_embed_cache cache(1 << 20);
+    const std::string jpeg_a = "jpeg a", jpeg_b = "jpeg b";
+    CHECK(!cache.get(image_embed_cache::key(jpeg_a.data(), jpeg_a.size())));
+    cache.put(image_embed_cache::key(jpeg_a.data(), jpeg_a.size()), embed(1));
+    CHECK(tag_of(cache.get(image_embed_cache::key(jpeg_a.data(), jpeg_a.size()))) == 1);
+    CHECK(!cache.get(image_embed_cache::key(jpeg_b.data(), jpeg_b.size())));
+    // a prefix of the source is another source
+    CHECK(!cache.get(image_embed_cache::key(jpeg_a.data(), jpeg_a.size() - 1)));
+    CHECK((cache.hits() == 1) && (cache.misses() == 3));
+    CHECK(cache.entries() == 1);
+    CHECK(cache.bytes() == 64 * sizeof(unsigned short) + sizeof(size_t) + jpeg_a.size());
+}
+
+// two sources with the same 64-bit hash: neither is served the other's embedding
+static void test_hash_collision()
+{
+    image_embed_cache cache(1 << 20);
+    image_embed_key a = image_embed_cache::key("picture one", 11);
+    image_embed_key b = image_embed_cache::key("picture two", 11);
+    b.hash            = a.hash;
+
+    cache.put(image_embed_key(a), embed(1));
+    CHECK(!cache.get(b));
+    CHECK(tag_of(cache.get(a)) == 1);
+    // the newer one takes the slot
+    cache.put(image_embed_key(b), embed(2));
+    CHECK(tag_of(cache.get(b)) == 2);
+    CHECK(!cache.get(a));
+    CHECK(cache.entries() == 1);
+}
+
+// a set of images is its images in order plus the mode, not the concatenation of their bytes
+static void test_image_sets()
+{
+    image_embed_cache cache(1 << 20);
+    auto set_key = [](bool video, const std::vector<std::string> &images) {
+        image_embed_key key;
+        key.append_value(video);
+        for (const auto &img : images) key.append(img.data(), img.size());
+        return key;
+    };
+    cache.put(set_key(false, {"ab", "c"}), embed(1));
+    CHECK(tag_of(cache.get(set_key(false, {"ab", "c"}))) == 1);
+    CHECK(!cache.get(set_key(false, {"a", "bc"})));
+    CHECK(!cache.get(set_key(false, {"c", "ab"})));
+    CHECK(!cache.get(set_key(true, {"ab", "c"})));
+}
+
+static void test_budget()
+{
+    const std::string src[3] = {"one", "two", "six"};
+    const size_t entry_bytes = 64 * sizeof(unsigned short) + sizeof(size_t) + 3;
+    image_embed_cache cache(2 * entry_bytes);
+    for (int i = 0; i < 2; i++) cache.put(image_embed_cache::key(src[i].data(), 3), embed(i + 1));
+    CHECK(cache.bytes() == 2 * entry_bytes);
+    // touching "one" makes "two" the least recently used
+    CHECK(tag_of(cache.get(image_embed_cache::key(src[0].data(), 3))) == 1);
+    cache.put(image_embed_cache::key(src[2].data(), 3), embed(3));
+    CHECK(cache.entries() == 2);
+    CHECK(!cache.get(image_embed_cache::key(src[1].data(), 3)));
+    CHECK(tag_of(cache.get(image_embed_cache::key(src[0].data(), 3))) == 1);
+    CHECK(tag_of(cache.get(image_embed_cache::key(src[2].data(), 3))) == 3);
+
+    // the source bytes count: an embedding that fits alone no longer does with a large source
+    const std::string big(2 * entry_bytes, 'x');
+    cache.put(image_embed_cache::key(big.data(), big.size()), embed(4, 32));
+    CHECK(!cache.get(image_embed_cache::key(big.data(), big.size())));
+
+    cache.set_budget(0);
+    CHECK((cache.entries() == 0) && (cache.bytes() == 0) && !cache.enabled());
+    cache.put(image_embed_cache::key(src[0].data(), 3), embed(1));
+    CHECK(cache.entries() == 0);
+}
+
+int main()
+{
+    test_hit_and_miss();
+    test_hash_collision();
+    test_image_sets();
+    test_budget();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_image_embed_cache: ok\n");
+    return 0;
+}
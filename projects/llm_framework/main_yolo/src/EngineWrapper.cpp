@@ -11,6 +11,7 @@
 #define UNUSE_STRUCT_OBJECT
 #include "EngineWrapper.hpp"
 #include "utils/io.hpp"
+#include "yolo_postprocess.hpp"
 #include <cstdlib>
 
 #include <global_config.h>
@@ -428,49 +429,47 @@ void post_process(AX_ENGINE_IO_INFO_T* io_info, AX_ENGINE_IO_T* io_data, const c
                   int& cls_num, int& point_num, float& prob_threshold, float& nms_threshold,
                   std::vector<detection::Object>& objects, std::string& model_type)
 {
-    // std::vector<detection::Object> objects;
-    std::vector<detection::Object> proposals;
-    if (model_type == "detect") {
+    if ((model_type == "detect") || (model_type == "segment") || (model_type == "pose")) {
+        yolo_post::Config config;
+        config.input_w        = input_w;
+        config.input_h        = input_h;
+        config.cls_num        = cls_num;
+        config.prob_threshold = prob_threshold;
+        config.nms_threshold  = nms_threshold;
+
+        std::vector<yolo_post::Detection> dets;
         for (int i = 0; i < 3; ++i) {
-            auto feat_ptr  = (float*)io_data->pOutputs[i].pVirAddr;
-            int32_t stride = (1 << i) * 8;
-            detection::generate_proposals_yolov8_native(stride, feat_ptr, prob_threshold, proposals, input_w, input_h,
-                                                        cls_num);
+            auto feat_ptr = (float*)io_data->pOutputs[i].pVirAddr;
+            yolo_post::decode_level(feat_ptr, (1 << i) * 8, i, config, dets);
         }
-        detection::get_out_bbox(proposals, objects, nms_threshold, input_h, input_w, mat.rows, mat.cols);
-        // detection::draw_objects(mat, objects, CLASS_NAMES, "yolo11_out");
-    } else if (model_type == "segment") {
-        float* output_ptr[3]     = {(float*)io_data->pOutputs[0].pVirAddr, (float*)io_data->pOutputs[1].pVirAddr,
-                                    (float*)io_data->pOutputs[2].pVirAddr};
-        float* output_seg_ptr[3] = {(float*)io_data->pOutputs[3].pVirAddr, (float*)io_data->pOutputs[4].pVirAddr,
-                                    (float*)io_data->pOutputs[5].pVirAddr};
-        for (int i = 0; i < 3; ++i) {
-            auto feat_ptr     = output_ptr[i];
-            auto feat_seg_ptr = output_seg_ptr[i];
-            int32_t stride    = (1 << i) * 8;
-            detection::generate_proposals_yolov8_seg_native(stride, feat_ptr, feat_seg_ptr, prob_threshold, proposals,
-                                                            input_w, input_h, cls_num);
-        }
-        auto mask_proto_ptr = (float*)io_data->pOutputs[6].pVirAddr;
-        detection::get_out_bbox_mask(proposals, objects, mask_proto_ptr, 32, 4, nms_threshold, input_h, input_w,
-                                     mat.rows, mat.cols);
-        // detection::draw_objects_mask(mat, objects, CLASS_NAMES, COCO_COLORS, "yolo11_seg_out");
-    } else if (model_type == "pose") {
-        float* output_ptr[3]     = {(float*)io_data->pOutputs[0].pVirAddr, (float*)io_data->pOutputs[1].pVirAddr,
-                                    (float*)io_data->pOutputs[2].pVirAddr};
-        float* output_kps_ptr[3] = {(float*)io_data->pOutputs[3].pVirAddr, (float*)io_data->pOutputs[4].pVirAddr,
-                                    (float*)io_data->pOutputs[5].pVirAddr};
-
-        for (int i = 0; i < 3; ++i) {
-            auto feat_ptr     = output_ptr[i];
-            auto feat_kps_ptr = output_kps_ptr[i];
-            int32_t stride    = (1 << i) * 8;
-            detection::generate_proposals_yolov8_pose_native(stride, feat_ptr, feat_kps_ptr, prob_threshold, proposals,
-                                                             input_h, input_w, point_num, cls_num);
+        yolo_post::nms(dets, config);
+
+        // keypoints and masks are decoded for the surviving boxes only
+        yolo_post::Letterbox lb = yolo_post::letterbox(input_w, input_h, mat.cols, mat.rows);
+        std::vector<uint8_t> mask;
+        objects.clear();
+        objects.resize(dets.size());
+        for (size_t i = 0; i < dets.size(); i++) {
+            const auto& det           = dets[i];
+            detection::Object& object = objects[i];
+            object.label              = det.label;
+            object.prob               = det.prob;
+            yolo_post::map_box(det, lb, object.rect.x, object.rect.y, object.rect.width, object.rect.height);
+            if (model_type == "segment") {
+                auto feat_seg_ptr = (float*)io_data->pOutputs[3 + det.level].pVirAddr;
+                yolo_post::mask_coefs(feat_seg_ptr, det, 32, object.mask_feat);
+                cv::Rect box = cv::Rect(object.rect) & cv::Rect(0, 0, mat.cols, mat.rows);
+                yolo_post::decode_mask((float*)io_data->pOutputs[6].pVirAddr, 32, 4, config,
+                                       object.mask_feat.data(), lb, box.x, box.y, box.width, box.height, mask);
+                object.mask = cv::Mat(box.height, box.width, CV_8UC1, mask.data()).clone();
+            } else if (model_type == "pose") {
+                auto feat_kps_ptr = (float*)io_data->pOutputs[3 + det.level].pVirAddr;
+                yolo_post::decode_keypoints(feat_kps_ptr, (1 << det.level) * 8, det, config, point_num, lb,
+                                            object.kps_feat);
+            }
         }
-        detection::get_out_bbox_kps(proposals, objects, nms_threshold, input_h, input_w, mat.rows, mat.cols);
-        // detection::draw_keypoints(mat, objects, KPS_COLORS, LIMB_COLORS, SKELETON, "yolo11_pose_out");
     } else if (model_type == "obb") {
+        std::vector<detection::Object> proposals;
         std::vector<int> strides = {8, 16, 32};
         std::vector<detection::GridAndStride> grid_strides;
         detection::generate_grids_and_stride(input_w, input_h, strides, grid_strides);
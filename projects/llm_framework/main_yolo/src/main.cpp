@@ -5,10 +5,13 @@
  */
 #include "StackFlow.h"
 #include "EngineWrapper.hpp"
+#include "yolo_result_codec.hpp"
 #include "base/common.hpp"
+#include "image_preprocess.hpp"
 #include <ax_sys_api.h>
 #include <sys/stat.h>
 #include <fstream>
+#include <mutex>
 #include <semaphore.h>
 #include "../../../../SDK/components/utilities/include/sample_log.h"
 #include "thread_safe_list.h"
@@ -44,11 +47,13 @@ typedef struct {
 } yolo_config;
 
 typedef struct {
-    cv::Mat inference_src;
-    bool inference_bgr2rgb;
+    // letterboxed RGB model input, null stops the inference thread
+    std::shared_ptr<std::vector<uint8_t>> inference_input;
 } inference_async_par;
 
 typedef std::function<void(const nlohmann::json &data, bool finish)> task_callback_t;
+// one packed yolo_result frame per inference
+typedef std::function<void(const std::string &data)> task_raw_callback_t;
 
 #define CONFIG_AUTO_SET(obj, key)             \
     if (config_body.contains(#key))           \
@@ -69,9 +74,13 @@ public:
     bool enstream_;
     static int ax_init_flage_;
     task_callback_t out_callback_;
+    task_raw_callback_t out_raw_callback_;
+    uint32_t frame_index_ = 0;
     std::atomic_bool camera_flage_;
     std::unique_ptr<std::thread> inference_run_;
     thread_safe::list<inference_async_par> async_list_;
+    std::mutex input_pool_mtx_;
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> input_pool_;
 
     bool parse_config(const nlohmann::json &config_body)
     {
@@ -161,11 +170,54 @@ public:
         out_callback_ = out_callback;
     }
 
+    void set_raw_output(task_raw_callback_t out_raw_callback)
+    {
+        out_raw_callback_ = out_raw_callback;
+    }
+
+    bool enbinary() const
+    {
+        return response_format_.compare(0, 11, "yolo.boxbin") == 0;
+    }
+
+    void send_binary(const std::vector<detection::Object> &objects)
+    {
+        yolo_result::Frame frame;
+        frame.frame_index = frame_index_++;
+        frame.img_w       = mode_config_.img_w;
+        frame.img_h       = mode_config_.img_h;
+        if (mode_config_.model_type == "segment") {
+            frame.flags |= yolo_result::YOLO_RESULT_MASK;
+            frame.mask_dim = objects.empty() ? 32 : objects[0].mask_feat.size();
+        }
+        if (mode_config_.model_type == "pose") {
+            frame.flags |= yolo_result::YOLO_RESULT_KPS;
+            frame.point_num = mode_config_.point_num;
+        }
+        if (mode_config_.model_type == "obb") frame.flags |= yolo_result::YOLO_RESULT_ANGLE;
+        frame.objects.resize(objects.size());
+        for (size_t i = 0; i < objects.size(); i++) {
+            yolo_result::Object &out = frame.objects[i];
+            out.label                = objects[i].label;
+            out.prob                 = objects[i].prob;
+            out.x                    = objects[i].rect.x;
+            out.y                    = objects[i].rect.y;
+            out.w                    = objects[i].rect.width;
+            out.h                    = objects[i].rect.height;
+            out.angle                = objects[i].angle;
+            if (frame.flags & yolo_result::YOLO_RESULT_KPS) out.kps = objects[i].kps_feat;
+            if (frame.flags & yolo_result::YOLO_RESULT_MASK) out.mask = objects[i].mask_feat;
+        }
+        std::string data;
+        yolo_result::encode(frame, data);
+        out_raw_callback_(data);
+    }
+
     bool inference_decode(const std::string &msg)
     {
         cv::Mat src = cv::imdecode(std::vector<uint8_t>(msg.begin(), msg.end()), cv::IMREAD_COLOR);
         if (src.empty()) return true;
-        return inference_async(src) ? false : true;
+        return inference_async(src.data, src.cols, src.rows, src.step, StackFlows::IMAGE_FORMAT_BGR) ? false : true;
     }
 
     bool inference_raw_yuv(const std::string &msg)
@@ -173,10 +225,10 @@ public:
         if (msg.size() != mode_config_.img_w * mode_config_.img_h * 2) {
             throw std::string("img size error");
         }
-        cv::Mat camera_data(mode_config_.img_h, mode_config_.img_w, CV_8UC2, (void *)msg.data());
-        cv::Mat rgb;
-        cv::cvtColor(camera_data, rgb, cv::COLOR_YUV2RGB_YUYV);
-        return inference_async(rgb, true) ? false : true;
+        return inference_async((const uint8_t *)msg.data(), mode_config_.img_w, mode_config_.img_h, 0,
+                               StackFlows::IMAGE_FORMAT_YUYV)
+                   ? false
+                   : true;
     }
 
     bool inference_raw_rgb(const std::string &msg)
@@ -184,8 +236,10 @@ public:
         if (msg.size() != mode_config_.img_w * mode_config_.img_h * 3) {
             throw std::string("img size error");
         }
-        cv::Mat camera_data(mode_config_.img_h, mode_config_.img_w, CV_8UC3, (void *)msg.data());
-        return inference_async(camera_data, false) ? false : true;
+        return inference_async((const uint8_t *)msg.data(), mode_config_.img_w, mode_config_.img_h, 0,
+                               StackFlows::IMAGE_FORMAT_RGB)
+                   ? false
+                   : true;
     }
 
     bool inference_raw_bgr(const std::string &msg)
@@ -193,8 +247,10 @@ public:
         if (msg.size() != mode_config_.img_w * mode_config_.img_h * 3) {
             throw std::string("img size error");
         }
-        cv::Mat camera_data(mode_config_.img_h, mode_config_.img_w, CV_8UC3, (void *)msg.data());
-        return inference_async(camera_data) ? false : true;
+        return inference_async((const uint8_t *)msg.data(), mode_config_.img_w, mode_config_.img_h, 0,
+                               StackFlows::IMAGE_FORMAT_BGR)
+                   ? false
+                   : true;
     }
 
     void run()
@@ -203,18 +259,29 @@ public:
         for (;;) {
             {
                 par = async_list_.get();
-                if (par.inference_src.empty()) break;
-                inference(par.inference_src, par.inference_bgr2rgb);
+                if (!par.inference_input) break;
+                inference(*par.inference_input);
+                std::lock_guard<std::mutex> guard(input_pool_mtx_);
+                input_pool_.push_back(par.inference_input);
             }
         }
     }
 
-    int inference_async(cv::Mat &src, bool bgr2rgb = true)
+    // converts straight into a pooled model input buffer, the source is not kept
+    int inference_async(const uint8_t *src, int src_w, int src_h, int src_stride, StackFlows::image_format_t format)
     {
         if (async_list_.size() < 3) {
             inference_async_par par;
-            par.inference_src     = src.clone();
-            par.inference_bgr2rgb = bgr2rgb;
+            {
+                std::lock_guard<std::mutex> guard(input_pool_mtx_);
+                if (!input_pool_.empty()) {
+                    par.inference_input = input_pool_.back();
+                    input_pool_.pop_back();
+                }
+            }
+            if (!par.inference_input) par.inference_input = std::make_shared<std::vector<uint8_t>>();
+            StackFlows::image_letterbox(src, src_w, src_h, src_stride, format, *par.inference_input,
+                                        mode_config_.img_w, mode_config_.img_h);
             async_list_.put(par);
         } else {
             SLOGE("inference list is full\n");
@@ -222,12 +289,10 @@ public:
         return async_list_.size();
     }
 
-    bool inference(cv::Mat &src, bool bgr2rgb = true)
+    bool inference(std::vector<uint8_t> &image)
     {
         try {
             int ret = -1;
-            std::vector<uint8_t> image(mode_config_.img_w * mode_config_.img_h * 3, 0);
-            common::get_input_data_letterbox(src, image, mode_config_.img_h, mode_config_.img_w, bgr2rgb);
             cv::Mat img_mat(mode_config_.img_h, mode_config_.img_w, CV_8UC3, image.data());
             yolo_->SetInput((void *)image.data(), 0);
             if (0 != yolo_->Run()) {
@@ -238,6 +303,10 @@ public:
             yolo_->Post_Process(img_mat, mode_config_.img_w, mode_config_.img_h, mode_config_.cls_num,
                                 mode_config_.point_num, mode_config_.pron_threshold, mode_config_.nms_threshold,
                                 objects, mode_config_.model_type);
+            if (enbinary() && out_raw_callback_) {
+                send_binary(objects);
+                return false;
+            }
             nlohmann::json yolo_output = nlohmann::json::array();
             if (response_format_.compare(0, 10, "yolo.boxV2") == 0) {
                 nlohmann::json out_obj;
@@ -381,6 +450,36 @@ public:
         }
     }
 
+    void task_output_raw(const std::weak_ptr<llm_task> llm_task_obj_weak,
+                         const std::weak_ptr<llm_channel_obj> llm_channel_weak, const std::string &data)
+    {
+        auto llm_task_obj = llm_task_obj_weak.lock();
+        auto llm_channel  = llm_channel_weak.lock();
+        if (!(llm_task_obj && llm_channel)) {
+            return;
+        }
+        // StackFlow output, packed as is
+        llm_channel->send_raw_to_pub(data);
+        // user output
+        if (llm_task_obj->enoutput_) {
+            std::string base64_data;
+            StackFlows::encode_base64(data, base64_data);
+            std::string out_json_str;
+            out_json_str.reserve(llm_channel->request_id_.size() + llm_channel->work_id_.size() + base64_data.size() +
+                                 128);
+            out_json_str += R"({"request_id":")";
+            out_json_str += llm_channel->request_id_;
+            out_json_str += R"(","work_id":")";
+            out_json_str += llm_channel->work_id_;
+            out_json_str += R"(","object":")";
+            out_json_str += llm_task_obj->response_format_;
+            out_json_str += R"(","error":{"code":0, "message":""},"data":")";
+            out_json_str += base64_data;
+            out_json_str += "\"}\n";
+            llm_channel->send_raw_to_usr(out_json_str);
+        }
+    }
+
     void task_user_data(const std::weak_ptr<llm_task> llm_task_obj_weak,
                         const std::weak_ptr<llm_channel_obj> llm_channel_weak, const std::string &object,
                         const std::string &data)
@@ -485,6 +584,8 @@ public:
 
             llm_task_obj->set_output(std::bind(&llm_yolo::task_output, this, llm_task_obj, llm_channel,
                                                std::placeholders::_1, std::placeholders::_2));
+            llm_task_obj->set_raw_output(
+                std::bind(&llm_yolo::task_output_raw, this, llm_task_obj, llm_channel, std::placeholders::_1));
 
             for (const auto input : llm_task_obj->inputs_) {
                 if (input.find("yolo") != std::string::npos) {
@@ -0,0 +1,348 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "yolo_postprocess.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace yolo_post {
+
+static inline float sigmoid(float x)
+{
+    return 1.0f / (1.0f + expf(-x));
+}
+
+static inline float clampf(float v, float lo, float hi)
+{
+    return std::max(std::min(v, hi), lo);
+}
+
+static inline float max_value(const float* v, int n)
+{
+    float m = -FLT_MAX;
+    int i   = 0;
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__aarch64__)
+    if (n >= 4) {
+        float32x4_t acc = vld1q_f32(v);
+        for (i = 4; i + 4 <= n; i += 4) {
+            acc = vmaxq_f32(acc, vld1q_f32(v + i));
+        }
+        m = vmaxvq_f32(acc);
+    }
+#else
+    // independent lanes so the compiler can keep them in vector registers
+    if (n >= 4) {
+        float m0 = v[0], m1 = v[1], m2 = v[2], m3 = v[3];
+        for (i = 4; i + 4 <= n; i += 4) {
+            m0 = v[i] > m0 ? v[i] : m0;
+            m1 = v[i + 1] > m1 ? v[i + 1] : m1;
+            m2 = v[i + 2] > m2 ? v[i + 2] : m2;
+            m3 = v[i + 3] > m3 ? v[i + 3] : m3;
+        }
+        m = std::max(std::max(m0, m1), std::max(m2, m3));
+    }
+#endif
+    for (; i < n; i++) {
+        m = v[i] > m ? v[i] : m;
+    }
+    return m;
+}
+
+/*
+ * Cephes-style exp: 2^n * p(r) with r = x - n*ln2 and a degree-6 polynomial, relative error below 2e-7.
+ * Inputs are clamped to [-88, 88]; the DFL softmax only feeds it x <= 0, where the clamp is harmless.
+ */
+#define EXP_HI (88.f)
+#define EXP_LO (-88.f)
+#define EXP_LOG2E (1.44269504088896341f)
+#define EXP_C1 (0.693359375f)
+#define EXP_C2 (-2.12194440e-4f)
+#define EXP_P0 (1.9875691500e-4f)
+#define EXP_P1 (1.3981999507e-3f)
+#define EXP_P2 (8.3334519073e-3f)
+#define EXP_P3 (4.1665795894e-2f)
+#define EXP_P4 (1.6666665459e-1f)
+#define EXP_P5 (5.0000001201e-1f)
+
+static inline float fast_exp(float x)
+{
+    x        = clampf(x, EXP_LO, EXP_HI);
+    float fx = floorf(x * EXP_LOG2E + 0.5f);
+    float r  = x - fx * EXP_C1 - fx * EXP_C2;
+    float y  = EXP_P0;
+    y        = y * r + EXP_P1;
+    y        = y * r + EXP_P2;
+    y        = y * r + EXP_P3;
+    y        = y * r + EXP_P4;
+    y        = y * r + EXP_P5;
+    y        = y * r * r + r + 1.f;
+    // 2^fx built in the exponent field, fx >= -127 after the clamp so the field never goes negative
+    uint32_t bits = (uint32_t)((int32_t)fx + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return y * scale;
+}
+
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__aarch64__)
+// fast_exp() on four lanes
+static inline float32x4_t fast_exp_f32x4(float32x4_t x)
+{
+    x              = vminq_f32(vmaxq_f32(x, vdupq_n_f32(EXP_LO)), vdupq_n_f32(EXP_HI));
+    float32x4_t fx = vrndmq_f32(vmlaq_n_f32(vdupq_n_f32(0.5f), x, EXP_LOG2E));
+    float32x4_t r  = vmlsq_n_f32(vmlsq_n_f32(x, fx, EXP_C1), fx, EXP_C2);
+    float32x4_t y  = vdupq_n_f32(EXP_P0);
+    y              = vmlaq_f32(vdupq_n_f32(EXP_P1), y, r);
+    y              = vmlaq_f32(vdupq_n_f32(EXP_P2), y, r);
+    y              = vmlaq_f32(vdupq_n_f32(EXP_P3), y, r);
+    y              = vmlaq_f32(vdupq_n_f32(EXP_P4), y, r);
+    y              = vmlaq_f32(vdupq_n_f32(EXP_P5), y, r);
+    y              = vmlaq_f32(vaddq_f32(r, vdupq_n_f32(1.f)), y, vmulq_f32(r, r));
+    int32x4_t n    = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(fx), vdupq_n_s32(127)), 23);
+    return vmulq_f32(y, vreinterpretq_f32_s32(n));
+}
+#endif
+
+// expectation of the softmax over the DFL bins of one box side
+static inline float dfl_distance(const float* bins, int reg_max)
+{
+    float m   = max_value(bins, reg_max);
+    float sum = 0.f;
+    float acc = 0.f;
+    int i     = 0;
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__aarch64__)
+    if (reg_max >= 4) {
+        const float first_idx[4] = {0.f, 1.f, 2.f, 3.f};
+        float32x4_t vm           = vdupq_n_f32(m);
+        float32x4_t vidx         = vld1q_f32(first_idx);
+        float32x4_t vsum         = vdupq_n_f32(0.f);
+        float32x4_t vacc         = vdupq_n_f32(0.f);
+        for (; i + 4 <= reg_max; i += 4) {
+            float32x4_t e = fast_exp_f32x4(vsubq_f32(vld1q_f32(bins + i), vm));
+            vsum          = vaddq_f32(vsum, e);
+            vacc          = vmlaq_f32(vacc, e, vidx);
+            vidx          = vaddq_f32(vidx, vdupq_n_f32(4.f));
+        }
+        sum = vaddvq_f32(vsum);
+        acc = vaddvq_f32(vacc);
+    }
+#else
+    // independent lanes so the compiler can keep them in vector registers
+    if (reg_max >= 4) {
+        float s[4] = {0.f, 0.f, 0.f, 0.f};
+        float a[4] = {0.f, 0.f, 0.f, 0.f};
+        for (; i + 4 <= reg_max; i += 4) {
+            for (int l = 0; l < 4; l++) {
+                float e = fast_exp(bins[i + l] - m);
+                s[l] += e;
+                a[l] += e * (i + l);
+            }
+        }
+        sum = (s[0] + s[1]) + (s[2] + s[3]);
+        acc = (a[0] + a[1]) + (a[2] + a[3]);
+    }
+#endif
+    for (; i < reg_max; i++) {
+        float e = fast_exp(bins[i] - m);
+        sum += e;
+        acc += e * i;
+    }
+    return acc / sum;
+}
+
+void decode_level(const float* feat, int stride, int level, const Config& config, std::vector<Detection>& out)
+{
+    int feat_w   = config.input_w / stride;
+    int feat_h   = config.input_h / stride;
+    int box_len  = 4 * config.reg_max;
+    int cell_len = box_len + config.cls_num;
+
+    // sigmoid(x) > p exactly when x > log(p / (1 - p))
+    float p         = clampf(config.prob_threshold, 1e-6f, 1.f - 1e-6f);
+    float logit_thr = logf(p / (1.f - p));
+
+    for (int cell = 0; cell < feat_w * feat_h; cell++) {
+        const float* ptr = feat + (size_t)cell * cell_len;
+        const float* cls = ptr + box_len;
+        float best       = max_value(cls, config.cls_num);
+        if (best <= logit_thr) {
+            continue;
+        }
+        float prob = sigmoid(best);
+        if (prob <= config.prob_threshold) {
+            continue;
+        }
+        int label = std::find(cls, cls + config.cls_num, best) - cls;
+
+        float cx = (cell % feat_w + 0.5f) * stride;
+        float cy = (cell / feat_w + 0.5f) * stride;
+        Detection det;
+        det.x0    = clampf(cx - dfl_distance(ptr, config.reg_max) * stride, 0.f, config.input_w - 1.f);
+        det.y0    = clampf(cy - dfl_distance(ptr + config.reg_max, config.reg_max) * stride, 0.f, config.input_h - 1.f);
+        det.x1    = clampf(cx + dfl_distance(ptr + 2 * config.reg_max, config.reg_max) * stride, 0.f,
+                           config.input_w - 1.f);
+        det.y1    = clampf(cy + dfl_distance(ptr + 3 * config.reg_max, config.reg_max) * stride, 0.f,
+                           config.input_h - 1.f);
+        det.prob  = prob;
+        det.label = label;
+        det.level = level;
+        det.cell  = cell;
+        out.push_back(det);
+    }
+}
+
+void nms(std::vector<Detection>& dets, const Config& config)
+{
+    auto by_prob = [](const Detection& a, const Detection& b) { return a.prob > b.prob; };
+    if ((config.top_k > 0) && ((int)dets.size() > config.top_k)) {
+        std::nth_element(dets.begin(), dets.begin() + config.top_k, dets.end(), by_prob);
+        dets.resize(config.top_k);
+    }
+    std::sort(dets.begin(), dets.end(), by_prob);
+
+    // every candidate is compared only with the boxes already kept, at most max_det of them
+    std::vector<Detection> kept;
+    std::vector<float> kept_area;
+    for (const auto& det : dets) {
+        float area = (det.x1 - det.x0) * (det.y1 - det.y0);
+        bool keep  = true;
+        for (size_t j = 0; j < kept.size(); j++) {
+            const Detection& other = kept[j];
+            if (config.class_aware && (other.label != det.label)) {
+                continue;
+            }
+            float iw = std::min(det.x1, other.x1) - std::max(det.x0, other.x0);
+            float ih = std::min(det.y1, other.y1) - std::max(det.y0, other.y0);
+            if ((iw <= 0.f) || (ih <= 0.f)) {
+                continue;
+            }
+            float inter = iw * ih;
+            if (inter / (area + kept_area[j] - inter) > config.nms_threshold) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) {
+            kept.push_back(det);
+            kept_area.push_back(area);
+            if ((config.max_det > 0) && ((int)kept.size() >= config.max_det)) {
+                break;
+            }
+        }
+    }
+    dets.swap(kept);
+}
+
+Letterbox letterbox(int input_w, int input_h, int src_w, int src_h)
+{
+    float scale   = std::min((float)input_h / src_h, (float)input_w / src_w);
+    int resize_w  = (int)(scale * src_w);
+    int resize_h  = (int)(scale * src_h);
+    Letterbox lb;
+    lb.scale_x = (float)src_w / resize_w;
+    lb.scale_y = (float)src_h / resize_h;
+    lb.pad_x   = (float)((input_w - resize_w) / 2);
+    lb.pad_y   = (float)((input_h - resize_h) / 2);
+    lb.src_w   = src_w;
+    lb.src_h   = src_h;
+    return lb;
+}
+
+void map_box(const Detection& det, const Letterbox& lb, float& x, float& y, float& w, float& h)
+{
+    float x0 = clampf((det.x0 - lb.pad_x) * lb.scale_x, 0.f, lb.src_w - 1.f);
+    float y0 = clampf((det.y0 - lb.pad_y) * lb.scale_y, 0.f, lb.src_h - 1.f);
+    float x1 = clampf((det.x1 - lb.pad_x) * lb.scale_x, 0.f, lb.src_w - 1.f);
+    float y1 = clampf((det.y1 - lb.pad_y) * lb.scale_y, 0.f, lb.src_h - 1.f);
+    x        = x0;
+    y        = y0;
+    w        = x1 - x0;
+    h        = y1 - y0;
+}
+
+void decode_keypoints(const float* feat_kps, int stride, const Detection& det, const Config& config, int point_num,
+                      const Letterbox& lb, std::vector<float>& kps)
+{
+    int feat_w       = config.input_w / stride;
+    float gx         = (float)(det.cell % feat_w);
+    float gy         = (float)(det.cell / feat_w);
+    const float* ptr = feat_kps + (size_t)det.cell * point_num * 3;
+    kps.resize(point_num * 3);
+    for (int k = 0; k < point_num; k++) {
+        float x        = (ptr[k * 3] * 2.f + gx) * stride;
+        float y        = (ptr[k * 3 + 1] * 2.f + gy) * stride;
+        kps[k * 3]     = clampf((x - lb.pad_x) * lb.scale_x, 0.f, lb.src_w - 1.f);
+        kps[k * 3 + 1] = clampf((y - lb.pad_y) * lb.scale_y, 0.f, lb.src_h - 1.f);
+        kps[k * 3 + 2] = sigmoid(ptr[k * 3 + 2]);
+    }
+}
+
+void mask_coefs(const float* feat_seg, const Detection& det, int mask_dim, std::vector<float>& coefs)
+{
+    const float* ptr = feat_seg + (size_t)det.cell * mask_dim;
+    coefs.assign(ptr, ptr + mask_dim);
+}
+
+void decode_mask(const float* proto, int mask_dim, int mask_stride, const Config& config, const float* coefs,
+                 const Letterbox& lb, int box_x, int box_y, int box_w, int box_h, std::vector<uint8_t>& mask)
+{
+    mask.assign((size_t)std::max(box_w, 0) * std::max(box_h, 0), 0);
+    if ((box_w <= 0) || (box_h <= 0)) {
+        return;
+    }
+    int proto_w = config.input_w / mask_stride;
+    int proto_h = config.input_h / mask_stride;
+
+    // source pixel centre -> prototype grid coordinate
+    auto grid_x = [&](int u) { return ((box_x + u + 0.5f) / lb.scale_x + lb.pad_x) / mask_stride - 0.5f; };
+    auto grid_y = [&](int v) { return ((box_y + v + 0.5f) / lb.scale_y + lb.pad_y) / mask_stride - 0.5f; };
+
+    int gx0 = std::max((int)floorf(grid_x(0)), 0);
+    int gx1 = std::min((int)floorf(grid_x(box_w - 1)) + 1, proto_w - 1);
+    int gy0 = std::max((int)floorf(grid_y(0)), 0);
+    int gy1 = std::min((int)floorf(grid_y(box_h - 1)) + 1, proto_h - 1);
+    if ((gx0 > gx1) || (gy0 > gy1)) {
+        return;
+    }
+
+    // mask logits of the prototype cells under the box, the prototype is NHWC
+    int crop_w = gx1 - gx0 + 1;
+    int crop_h = gy1 - gy0 + 1;
+    std::vector<float> logits((size_t)crop_w * crop_h);
+    for (int gy = gy0; gy <= gy1; gy++) {
+        for (int gx = gx0; gx <= gx1; gx++) {
+            const float* p = proto + ((size_t)gy * proto_w + gx) * mask_dim;
+            float sum      = 0.f;
+            for (int c = 0; c < mask_dim; c++) {
+                sum += coefs[c] * p[c];
+            }
+            logits[(gy - gy0) * crop_w + (gx - gx0)] = sum;
+        }
+    }
+
+    // bilinear upsampling of the logits, sigmoid > 0.5 is logit > 0
+    for (int v = 0; v < box_h; v++) {
+        float fy = clampf(grid_y(v), (float)gy0, (float)gy1) - gy0;
+        int y0   = std::min((int)fy, crop_h - 1);
+        int y1   = std::min(y0 + 1, crop_h - 1);
+        float wy = fy - y0;
+        for (int u = 0; u < box_w; u++) {
+            float fx = clampf(grid_x(u), (float)gx0, (float)gx1) - gx0;
+            int x0   = std::min((int)fx, crop_w - 1);
+            int x1   = std::min(x0 + 1, crop_w - 1);
+            float wx = fx - x0;
+            float top = logits[y0 * crop_w + x0] * (1.f - wx) + logits[y0 * crop_w + x1] * wx;
+            float bot = logits[y1 * crop_w + x0] * (1.f - wx) + logits[y1 * crop_w + x1] * wx;
+            mask[(size_t)v * box_w + u] = (top * (1.f - wy) + bot * wy) > 0.f ? 255 : 0;
+        }
+    }
+}
+
+}  // namespace yolo_post
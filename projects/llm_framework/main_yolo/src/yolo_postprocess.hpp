@@ -0,0 +1,88 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * YOLOv8/11 head post-processing on raw output tensors. No NPU or OpenCV dependency, so recorded tensors
+ * can be replayed on the host.
+ *
+ * Every stride level is an NHWC tensor of (4 * reg_max + cls_num) floats per cell: the DFL box bins, then
+ * the class logits. Segment models add mask_dim coefficients per cell in a second tensor, pose models add
+ * point_num * 3 keypoint values (x, y, visibility logit). The mask prototype is NHWC as well,
+ * mask_dim floats per prototype cell.
+ */
+namespace yolo_post {
+
+struct Config {
+    int input_w          = 640;
+    int input_h          = 640;
+    int cls_num          = 80;
+    int reg_max          = 16;
+    float prob_threshold = 0.45f;
+    float nms_threshold  = 0.45f;
+    // candidates kept for NMS, highest scores first
+    int top_k = 1000;
+    // detections returned
+    int max_det = 300;
+    // suppress only boxes of the same class
+    bool class_aware = true;
+};
+
+// one candidate, in letterbox (network input) coordinates
+struct Detection {
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+    float prob;
+    int label;
+    // where the candidate came from, for the lazy keypoint / mask lookups
+    int level;
+    int cell;
+};
+
+// mapping from letterbox coordinates back to the source image
+struct Letterbox {
+    float scale_x;
+    float scale_y;
+    float pad_x;
+    float pad_y;
+    int src_w;
+    int src_h;
+};
+
+/*
+ * Appends the candidates of one stride level. Cells are culled on the raw class logit against
+ * logit(prob_threshold) before any sigmoid or DFL work is done.
+ */
+void decode_level(const float* feat, int stride, int level, const Config& config, std::vector<Detection>& out);
+
+// sorts by score, caps to top_k, runs greedy NMS and keeps at most max_det boxes
+void nms(std::vector<Detection>& dets, const Config& config);
+
+Letterbox letterbox(int input_w, int input_h, int src_w, int src_h);
+
+// the box in source image coordinates, clamped to the image
+void map_box(const Detection& det, const Letterbox& lb, float& x, float& y, float& w, float& h);
+
+// x, y, visibility triplets of one detection in source image coordinates
+void decode_keypoints(const float* feat_kps, int stride, const Detection& det, const Config& config, int point_num,
+                      const Letterbox& lb, std::vector<float>& kps);
+
+// raw mask coefficients of one detection
+void mask_coefs(const float* feat_seg, const Detection& det, int mask_dim, std::vector<float>& coefs);
+
+/*
+ * Binary mask (0 / 255) of one detection, box_w x box_h row-major for the box at (box_x, box_y) in the source
+ * image. Only the prototype cells under the box are evaluated.
+ */
+void decode_mask(const float* proto, int mask_dim, int mask_stride, const Config& config, const float* coefs,
+                 const Letterbox& lb, int box_x, int box_y, int box_w, int box_h, std::vector<uint8_t>& mask);
+
+}  // namespace yolo_post
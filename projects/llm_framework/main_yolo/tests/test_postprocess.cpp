@@ -0,0 +1,281 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * The YOLO head post-processing on synthetic tensors: DFL boxes against a softmax written with expf, logit
+ * culling, NMS, and the letterbox, keypoint and mask mappings back to the source image.
+ */
+#include "yolo_postprocess.hpp"
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+using namespace yolo_post;
+
+// the expectation decode_level() replaced its exp with
+static float reference_dfl(const float* bins, int reg_max)
+{
+    float m = bins[0];
+    for (int i = 1; i < reg_max; i++) m = std::max(m, bins[i]);
+    double sum = 0, acc = 0;
+    for (int i = 0; i < reg_max; i++) {
+        double e = exp((double)bins[i] - m);
+        sum += e;
+        acc += e * i;
+    }
+    return (float)(acc / sum);
+}
+
+static float clamp_ref(float v, float hi)
+{
+    return std::max(std::min(v, hi), 0.f);
+}
+
+// every cell carries a detection of class cell % cls_num, the boxes must match the reference decode
+static void test_dfl(int reg_max, float bin_range)
+{
+    Config config;
+    config.input_w = 64;
+    config.input_h = 96;
+    config.cls_num = 3;
+    config.reg_max = reg_max;
+    const int stride = 8;
+    int feat_w       = config.input_w / stride;
+    int cells        = feat_w * (config.input_h / stride);
+    int cell_len     = 4 * reg_max + config.cls_num;
+
+    std::mt19937 rng(reg_max);
+    std::uniform_real_distribution<float> bins(-bin_range, bin_range);
+    std::vector<float> feat((size_t)cells * cell_len);
+    for (int cell = 0; cell < cells; cell++) {
+        float* ptr = feat.data() + (size_t)cell * cell_len;
+        for (int i = 0; i < 4 * reg_max; i++) ptr[i] = bins(rng);
+        for (int c = 0; c < config.cls_num; c++) ptr[4 * reg_max + c] = (c == cell % config.cls_num) ? 3.f : -3.f;
+    }
+
+    std::vector<Detection> dets;
+    decode_level(feat.data(), stride, 2, config, dets);
+    CHECK((int)dets.size() == cells);
+
+    float max_err = 0.f;
+    for (const auto& det : dets) {
+        const float* ptr = feat.data() + (size_t)det.cell * cell_len;
+        float cx         = (det.cell % feat_w + 0.5f) * stride;
+        float cy         = (det.cell / feat_w + 0.5f) * stride;
+        float x0         = clamp_ref(cx - reference_dfl(ptr, reg_max) * stride, config.input_w - 1.f);
+        float y0         = clamp_ref(cy - reference_dfl(ptr + reg_max, reg_max) * stride, config.input_h - 1.f);
+        float x1         = clamp_ref(cx + reference_dfl(ptr + 2 * reg_max, reg_max) * stride, config.input_w - 1.f);
+        float y1         = clamp_ref(cy + reference_dfl(ptr + 3 * reg_max, reg_max) * stride, config.input_h - 1.f);
+        max_err          = std::max(max_err, std::fabs(det.x0 - x0));
+        max_err          = std::max(max_err, std::fabs(det.y0 - y0));
+        max_err          = std::max(max_err, std::fabs(det.x1 - x1));
+        max_err          = std::max(max_err, std::fabs(det.y1 - y1));
+        CHECK(det.label == det.cell % config.cls_num);
+        CHECK(det.level == 2);
+        CHECK(std::fabs(det.prob - 1.f / (1.f + expf(-3.f))) < 1e-6f);
+    }
+    // pixels, the distances themselves are within a few ulp of reg_max
+    CHECK(max_err < 1e-3f);
+}
+
+// a bin far above the others puts the whole distance on it, also at the ends of the exp range
+static void test_dfl_peaked()
+{
+    Config config;
+    config.input_w = 256;
+    config.input_h = 256;
+    config.cls_num = 1;
+    const int stride = 32;
+    int cell_len     = 4 * config.reg_max + config.cls_num;
+    std::vector<float> feat((size_t)64 * cell_len, -200.f);
+    // cell 9 is (1, 1), centre (48, 48)
+    float* ptr = feat.data() + 9 * cell_len;
+    const int peak[4] = {0, 1, 15, 1};
+    for (int s = 0; s < 4; s++) ptr[s * config.reg_max + peak[s]] = 200.f;
+    ptr[4 * config.reg_max] = 5.f;
+
+    std::vector<Detection> dets;
+    decode_level(feat.data(), stride, 0, config, dets);
+    CHECK(dets.size() == 1);
+    if (dets.size() == 1) {
+        CHECK(dets[0].cell == 9);
+        CHECK(std::fabs(dets[0].x0 - 48.f) < 1e-3f);
+        CHECK(std::fabs(dets[0].y0 - 16.f) < 1e-3f);
+        CHECK(std::fabs(dets[0].x1 - 255.f) < 1e-3f);
+        CHECK(std::fabs(dets[0].y1 - 80.f) < 1e-3f);
+    }
+}
+
+// cells are kept exactly when the sigmoid of the best logit is above the threshold
+static void test_culling()
+{
+    Config config;
+    config.input_w        = 32;
+    config.input_h        = 32;
+    config.cls_num        = 5;
+    config.prob_threshold = 0.6f;
+    const int stride      = 16;
+    int cell_len          = 4 * config.reg_max + config.cls_num;
+    float thr             = logf(0.6f / 0.4f);
+    std::vector<float> feat((size_t)4 * cell_len, 0.f);
+    const float best[4] = {thr - 1e-3f, thr + 1e-3f, -20.f, 20.f};
+    for (int cell = 0; cell < 4; cell++) {
+        float* cls = feat.data() + (size_t)cell * cell_len + 4 * config.reg_max;
+        for (int c = 0; c < config.cls_num; c++) cls[c] = -30.f;
+        cls[(cell + 2) % config.cls_num] = best[cell];
+    }
+
+    std::vector<Detection> dets;
+    decode_level(feat.data(), stride, 0, config, dets);
+    CHECK(dets.size() == 2);
+    if (dets.size() == 2) {
+        CHECK((dets[0].cell == 1) && (dets[0].label == 3));
+        CHECK((dets[1].cell == 3) && (dets[1].label == 0));
+        CHECK(dets[0].prob > 0.6f);
+    }
+}
+
+static Detection box(float x0, float y0, float x1, float y1, float prob, int label)
+{
+    Detection det;
+    det.x0    = x0;
+    det.y0    = y0;
+    det.x1    = x1;
+    det.y1    = y1;
+    det.prob  = prob;
+    det.label = label;
+    det.level = 0;
+    det.cell  = 0;
+    return det;
+}
+
+static void test_nms()
+{
+    Config config;
+    config.nms_threshold = 0.5f;
+
+    // b overlaps a with IoU 0.81 and goes, c is another class, d does not overlap
+    std::vector<Detection> dets = {box(0, 0, 10, 10, 0.7f, 0), box(1, 1, 10, 10, 0.9f, 0), box(0, 0, 10, 10, 0.8f, 1),
+                                   box(20, 20, 30, 30, 0.6f, 0)};
+    std::vector<Detection> aware = dets;
+    nms(aware, config);
+    CHECK(aware.size() == 3);
+    if (aware.size() == 3) {
+        CHECK((aware[0].prob == 0.9f) && (aware[1].prob == 0.8f) && (aware[2].prob == 0.6f));
+    }
+
+    config.class_aware = false;
+    std::vector<Detection> agnostic = dets;
+    nms(agnostic, config);
+    CHECK(agnostic.size() == 2);
+
+    // top_k caps the candidates, max_det the result
+    config.class_aware = true;
+    config.top_k       = 2;
+    std::vector<Detection> capped = dets;
+    nms(capped, config);
+    CHECK(capped.size() == 2);
+    config.top_k   = 1000;
+    config.max_det = 1;
+    capped         = dets;
+    nms(capped, config);
+    CHECK((capped.size() == 1) && (capped[0].prob == 0.9f));
+}
+
+// 1280x720 into 640x640: scale 0.5, 140 rows of padding above
+static void test_letterbox()
+{
+    Letterbox lb = letterbox(640, 640, 1280, 720);
+    CHECK((lb.scale_x == 2.f) && (lb.scale_y == 2.f));
+    CHECK((lb.pad_x == 0.f) && (lb.pad_y == 140.f));
+
+    float x, y, w, h;
+    map_box(box(100, 150, 300, 250, 1.f, 0), lb, x, y, w, h);
+    CHECK((x == 200.f) && (y == 20.f) && (w == 400.f) && (h == 200.f));
+    // parts in the padding are clamped to the image
+    map_box(box(600, 100, 700, 600, 1.f, 0), lb, x, y, w, h);
+    CHECK((x == 1200.f) && (y == 0.f) && (x + w == 1279.f) && (y + h == 719.f));
+}
+
+static void test_keypoints()
+{
+    Config config;
+    Letterbox lb = letterbox(640, 640, 640, 640);
+    const int stride = 8, point_num = 2;
+    std::vector<float> feat((size_t)80 * 80 * point_num * 3, 0.f);
+    Detection det = box(0, 0, 1, 1, 1.f, 0);
+    det.cell      = 3 * 80 + 5;
+    float* ptr    = feat.data() + (size_t)det.cell * point_num * 3;
+    const float raw[6] = {0.5f, -0.25f, 0.f, 100.f, 0.f, 20.f};
+    std::copy(raw, raw + 6, ptr);
+
+    std::vector<float> kps;
+    decode_keypoints(feat.data(), stride, det, config, point_num, lb, kps);
+    CHECK(kps.size() == 6);
+    if (kps.size() == 6) {
+        CHECK((kps[0] == 48.f) && (kps[1] == 20.f) && (kps[2] == 0.5f));
+        CHECK((kps[3] == 639.f) && (kps[4] == 24.f) && (kps[5] > 0.999f));
+    }
+}
+
+// prototype logits +1 left of prototype column 8 and -1 right of it, the mask edge falls between
+static void test_mask()
+{
+    Config config;
+    config.input_w = 64;
+    config.input_h = 64;
+    Letterbox lb   = letterbox(64, 64, 64, 64);
+    const int mask_dim = 2, mask_stride = 4, proto_w = 16;
+    std::vector<float> proto((size_t)proto_w * proto_w * mask_dim);
+    for (int gy = 0; gy < proto_w; gy++) {
+        for (int gx = 0; gx < proto_w; gx++) {
+            float* p = proto.data() + ((size_t)gy * proto_w + gx) * mask_dim;
+            p[0]     = (gx < 8) ? 1.f : -1.f;
+            p[1]     = 5.f;
+        }
+    }
+    const float coefs[2] = {1.f, 0.f};
+
+    std::vector<uint8_t> mask;
+    decode_mask(proto.data(), mask_dim, mask_stride, config, coefs, lb, 20, 10, 24, 8, mask);
+    CHECK(mask.size() == 24 * 8);
+    if (mask.size() == 24 * 8) {
+        // source x 30 sits at grid 7.125 (logit 0.75), x 32 at 7.625 (-0.25)
+        for (int v = 0; v < 8; v++) {
+            for (int u = 0; u < 24; u++) CHECK(mask[(size_t)v * 24 + u] == ((20 + u <= 31) ? 255 : 0));
+        }
+    }
+    decode_mask(proto.data(), mask_dim, mask_stride, config, coefs, lb, 20, 10, 0, 8, mask);
+    CHECK(mask.empty());
+}
+
+int main()
+{
+    test_dfl(16, 8.f);
+    test_dfl(16, 60.f);
+    test_dfl(7, 8.f);
+    test_dfl(1, 8.f);
+    test_dfl_peaked();
+    test_culling();
+    test_nms();
+    test_letterbox();
+    test_keypoints();
+    test_mask();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_postprocess: ok\n");
+    return 0;
+}
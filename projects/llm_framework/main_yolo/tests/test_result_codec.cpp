@@ -0,0 +1,237 @@
+/*
+ * SPDX-FileCopyrightText: 2024 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/*
+ * The "yolo.boxbin" codec: frames encoded and decoded back keep every field within its quantization step,
+ * the byte layout matches the documented one, and foreign, newer or truncated buffers are rejected.
+ */
+#include "yolo_result_codec.hpp"
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+static int failures = 0;
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                       \
+        }                                                                     \
+    } while (0)
+
+using namespace yolo_result;
+
+static Frame random_frame(std::mt19937& rng, uint16_t flags, int objects)
+{
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    Frame frame;
+    frame.flags       = flags;
+    frame.frame_index = rng();
+    frame.img_w       = 1920;
+    frame.img_h       = 1080;
+    frame.point_num   = (flags & YOLO_RESULT_KPS) ? 17 : 0;
+    frame.mask_dim    = (flags & YOLO_RESULT_MASK) ? 32 : 0;
+    for (int i = 0; i < objects; i++) {
+        Object obj;
+        obj.label = rng() % 80;
+        obj.prob  = unit(rng);
+        obj.x     = unit(rng) * 1900.f;
+        obj.y     = unit(rng) * 1000.f;
+        obj.w     = unit(rng) * 300.f;
+        obj.h     = unit(rng) * 300.f;
+        obj.angle = (unit(rng) - 0.5f) * 6.f;
+        for (int k = 0; k < frame.point_num; k++) {
+            obj.kps.push_back(unit(rng) * 1919.f);
+            obj.kps.push_back(unit(rng) * 1079.f);
+            obj.kps.push_back(unit(rng));
+        }
+        for (int c = 0; c < frame.mask_dim; c++) obj.mask.push_back((unit(rng) - 0.5f) * 8.f);
+        frame.objects.push_back(obj);
+    }
+    return frame;
+}
+
+static void check_same(const Frame& in, const Frame& out)
+{
+    CHECK(out.flags == in.flags);
+    CHECK(out.frame_index == in.frame_index);
+    CHECK((out.img_w == in.img_w) && (out.img_h == in.img_h));
+    CHECK((out.point_num == in.point_num) && (out.mask_dim == in.mask_dim));
+    CHECK(out.objects.size() == in.objects.size());
+    if (out.objects.size() != in.objects.size()) return;
+
+    for (size_t i = 0; i < in.objects.size(); i++) {
+        const Object& a = in.objects[i];
+        const Object& b = out.objects[i];
+        CHECK(b.label == a.label);
+        CHECK(std::fabs(b.prob - a.prob) <= 0.5f / 65535.f + 1e-7f);
+        // boxes and angles are stored as f32
+        CHECK((b.x == a.x) && (b.y == a.y) && (b.w == a.w) && (b.h == a.h));
+        CHECK(b.angle == ((in.flags & YOLO_RESULT_ANGLE) ? a.angle : 0.f));
+
+        CHECK(b.kps.size() == ((in.flags & YOLO_RESULT_KPS) ? a.kps.size() : 0));
+        for (size_t k = 0; k < b.kps.size(); k += 3) {
+            CHECK(std::fabs(b.kps[k] - a.kps[k]) <= 0.125f);
+            CHECK(std::fabs(b.kps[k + 1] - a.kps[k + 1]) <= 0.125f);
+            CHECK(std::fabs(b.kps[k + 2] - a.kps[k + 2]) <= 0.5f / 255.f + 1e-6f);
+        }
+
+        CHECK(b.mask.size() == ((in.flags & YOLO_RESULT_MASK) ? a.mask.size() : 0));
+        if (!b.mask.empty()) {
+            float max_abs = 0.f;
+            for (float v : a.mask) max_abs = std::max(max_abs, std::fabs(v));
+            for (size_t c = 0; c < b.mask.size(); c++) {
+                CHECK(std::fabs(b.mask[c] - a.mask[c]) <= 0.5f * max_abs / 127.f + 1e-5f);
+            }
+        }
+    }
+}
+
+static void test_round_trip()
+{
+    std::mt19937 rng(1);
+    const uint16_t flag_sets[] = {0, YOLO_RESULT_ANGLE, YOLO_RESULT_KPS, YOLO_RESULT_MASK,
+                                  YOLO_RESULT_MASK | YOLO_RESULT_KPS | YOLO_RESULT_ANGLE};
+    for (uint16_t flags : flag_sets) {
+        for (int objects : {0, 1, 25}) {
+            Frame in = random_frame(rng, flags, objects);
+            std::string buf;
+            encode(in, buf);
+            CHECK(buf.size() == 24 + objects * object_size(in));
+
+            Frame out;
+            CHECK(decode((const uint8_t*)buf.data(), buf.size(), out));
+            check_same(in, out);
+        }
+    }
+}
+
+// encode() appends, a reused decode target is overwritten rather than merged
+static void test_append_and_reuse()
+{
+    std::mt19937 rng(2);
+    Frame first  = random_frame(rng, YOLO_RESULT_KPS | YOLO_RESULT_MASK, 3);
+    Frame second = random_frame(rng, 0, 1);
+    std::string buf;
+    encode(first, buf);
+    size_t first_size = buf.size();
+    encode(second, buf);
+
+    Frame out;
+    CHECK(decode((const uint8_t*)buf.data(), first_size, out));
+    check_same(first, out);
+    CHECK(decode((const uint8_t*)buf.data() + first_size, buf.size() - first_size, out));
+    check_same(second, out);
+}
+
+// the documented layout, byte for byte
+static void test_layout()
+{
+    Frame frame;
+    frame.flags       = YOLO_RESULT_KPS | YOLO_RESULT_MASK;
+    frame.frame_index = 0x01020304;
+    frame.img_w       = 640;
+    frame.img_h       = 480;
+    frame.point_num   = 1;
+    frame.mask_dim    = 2;
+    Object obj;
+    obj.label = 7;
+    obj.prob  = 1.f;
+    obj.x     = 1.f;
+    obj.y     = 2.f;
+    obj.w     = 3.f;
+    obj.h     = 4.f;
+    obj.angle = 0.f;
+    obj.kps   = {10.25f, 20.5f, 1.f};
+    obj.mask  = {-2.f, 1.f};
+    frame.objects.push_back(obj);
+
+    std::string buf;
+    encode(frame, buf);
+    const uint8_t* p = (const uint8_t*)buf.data();
+    CHECK(buf.size() == 24 + 20 + 5 + 4 + 2);
+    CHECK(memcmp(p, "YOLB", 4) == 0);
+    CHECK((p[4] == 1) && (p[5] == 0));
+    CHECK((p[6] == 3) && (p[7] == 0));
+    CHECK((p[8] == 4) && (p[9] == 3) && (p[10] == 2) && (p[11] == 1));
+    CHECK((p[12] == 0x80) && (p[13] == 0x02) && (p[14] == 0xE0) && (p[15] == 0x01));
+    CHECK((p[16] == 1) && (p[17] == 0) && (p[18] == 1) && (p[19] == 2));
+    CHECK((p[24] == 7) && (p[25] == 0) && (p[26] == 0xFF) && (p[27] == 0xFF));
+    float x;
+    memcpy(&x, p + 28, 4);
+    CHECK(x == 1.f);
+    // keypoint 41, 82 in quarter pixels, visibility 255
+    CHECK((p[44] == 41) && (p[45] == 0) && (p[46] == 82) && (p[47] == 0) && (p[48] == 255));
+    float scale;
+    memcpy(&scale, p + 49, 4);
+    CHECK(scale == 2.f / 127.f);
+    CHECK(((int8_t)p[53] == -127) && ((int8_t)p[54] == 64));
+}
+
+// out of range values saturate, missing keypoints and masks are zero
+static void test_saturation()
+{
+    Frame frame;
+    frame.flags     = YOLO_RESULT_KPS | YOLO_RESULT_MASK;
+    frame.point_num = 2;
+    frame.mask_dim  = 3;
+    Object obj;
+    obj.label = 1;
+    obj.prob  = 1.5f;
+    obj.x = obj.y = obj.w = obj.h = 0.f;
+    obj.angle = 0.f;
+    obj.kps   = {-5.f, 20000.f, 2.f};
+    frame.objects.push_back(obj);
+
+    std::string buf;
+    encode(frame, buf);
+    Frame out;
+    CHECK(decode((const uint8_t*)buf.data(), buf.size(), out));
+    CHECK(out.objects.size() == 1);
+    if (out.objects.size() == 1) {
+        const Object& o = out.objects[0];
+        CHECK(o.prob == 1.f);
+        CHECK((o.kps.size() == 6) && (o.kps[0] == 0.f) && (o.kps[1] == 65535.f / 4.f) && (o.kps[2] == 1.f));
+        CHECK((o.kps.size() == 6) && (o.kps[3] == 0.f) && (o.kps[4] == 0.f) && (o.kps[5] == 0.f));
+        CHECK((o.mask.size() == 3) && (o.mask[0] == 0.f) && (o.mask[1] == 0.f) && (o.mask[2] == 0.f));
+    }
+}
+
+static void test_rejects()
+{
+    std::mt19937 rng(3);
+    Frame in = random_frame(rng, YOLO_RESULT_KPS | YOLO_RESULT_MASK | YOLO_RESULT_ANGLE, 4);
+    std::string buf;
+    encode(in, buf);
+
+    Frame out;
+    for (size_t len = 0; len < buf.size(); len++) CHECK(!decode((const uint8_t*)buf.data(), len, out));
+
+    std::string bad = buf;
+    bad[0]          = 'X';
+    CHECK(!decode((const uint8_t*)bad.data(), bad.size(), out));
+    bad    = buf;
+    bad[4] = 2;
+    CHECK(!decode((const uint8_t*)bad.data(), bad.size(), out));
+    // an object count the buffer cannot hold
+    bad     = buf;
+    bad[16] = (char)0xFF;
+    CHECK(!decode((const uint8_t*)bad.data(), bad.size(), out));
+}
+
+int main()
+{
+    test_round_trip();
+    test_append_and_reuse();
+    test_layout();
+    test_saturation();
+    test_rejects();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_result_codec: ok\n");
+    return 0;
+}
@@ -259,13 +259,6 @@ def create_bin_deb(package_name, version, src_folder, revision = 'm5stack1', dep
     os.makedirs(os.path.join(deb_folder, 'opt/m5stack/bin'), exist_ok = True)
     os.makedirs(os.path.join(deb_folder, 'DEBIAN'), exist_ok = True)
     # shutil.copytree(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'deb_overlay'), deb_folder)
-    if package_name == 'llm-openai-api':
-        m5module_dir = os.path.join(src_folder, 'ModuleLLM-OpenAI-Plugin')
-        if os.path.exists(m5module_dir):
-            shutil.copytree(m5module_dir, os.path.join(deb_folder, 'opt/m5stack/bin/ModuleLLM-OpenAI-Plugin'))
-        openai_api_dir = os.path.join(src_folder, 'openai-api')
-        if os.path.exists(openai_api_dir):
-            shutil.copytree(openai_api_dir, os.path.join(deb_folder, 'opt/m5stack/lib/openai-api'))
     if package_name == 'llm-kws':
         sherpa_dir = os.path.join(src_folder, 'sherpa-onnx')
         if os.path.exists(sherpa_dir):
@@ -387,7 +380,7 @@ if __name__ == "__main__":
         'llm-depth-anything':[create_bin_deb,'llm-depth-anything', '1.7', src_folder, revision],
         'llm-vad':[create_bin_deb,'llm-vad', '1.8', src_folder, revision],
         'llm-whisper':[create_bin_deb,'llm-whisper', '1.8', src_folder, revision],
-        'llm-openai-api':[create_bin_deb,'llm-openai-api', '1.10', src_folder, revision],
+        'llm-openai-api':[create_bin_deb,'llm-openai-api', '1.11', src_folder, revision],
         'llm-cosy-voice':[create_bin_deb,'llm-cosy-voice', '1.10', src_folder, revision],
         # keyword spotting Audio file
         'llm-model-audio-en-us':[create_data_deb,'llm-model-audio-en-us', '0.3', src_folder, revision],